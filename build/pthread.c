@@ -0,0 +1,21 @@
+
+#include <pthread.h>
+#include <semaphore.h>
+
+static void * start(void * arg) {
+
+  return arg;
+}
+
+int main(int argc, char ** argv) {
+
+  pthread_t thread;
+  sem_t sem;
+
+  sem_init(&sem, 0, 0);
+  pthread_create(&thread, NULL, start, NULL);
+  pthread_join(thread, NULL);
+  sem_destroy(&sem);
+
+  return 0;
+}
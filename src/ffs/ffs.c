@@ -32,6 +32,15 @@ struct ffs_s {
   var_t lambda;
   int seed;
   char * lambda_name;
+  /* Packed state exchange */
+  void * state_buf;
+  size_t state_nbytes;
+  /* Trial run by the simulation */
+  double trial_lambda_min;
+  double trial_lambda_max;
+  int trial_nstepmax;
+  int trial_nsteplambda;
+  int trial_nstep;
 };
 
 static int ffs_free_command_line(ffs_t * ffs);
@@ -134,6 +143,7 @@ int ffs_lambda_name(ffs_t * obj, char * name, int len) {
 
   dbg_return_if(obj == NULL, -1);
   dbg_return_if(name == NULL, -1);
+  dbg_return_if(obj->lambda_name == NULL, -1);
 
   dbg_err_if( u_strlcpy(name, obj->lambda_name, len) );
 
@@ -479,6 +489,145 @@ int ffs_time(ffs_t * obj, double * t) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  ffs_state_size_set
+ *
+ *****************************************************************************/
+
+int ffs_state_size_set(ffs_t * obj, size_t nbytes) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  obj->state_nbytes = nbytes;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_state_size
+ *
+ *****************************************************************************/
+
+int ffs_state_size(ffs_t * obj, size_t * nbytes) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(nbytes == NULL, -1);
+
+  *nbytes = obj->state_nbytes;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_state_buffer_set
+ *
+ *****************************************************************************/
+
+int ffs_state_buffer_set(ffs_t * obj, void * buf, size_t nbytes) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  obj->state_buf = buf;
+  obj->state_nbytes = nbytes;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_state_buffer
+ *
+ *****************************************************************************/
+
+int ffs_state_buffer(ffs_t * obj, void ** buf, size_t * nbytes) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(buf == NULL, -1);
+  dbg_return_if(nbytes == NULL, -1);
+  dbg_return_if(obj->state_buf == NULL, -1);
+
+  *buf = obj->state_buf;
+  *nbytes = obj->state_nbytes;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_trial_bounds_set
+ *
+ *****************************************************************************/
+
+int ffs_trial_bounds_set(ffs_t * obj, double lambda_min, double lambda_max,
+			 int nstepmax, int nsteplambda) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  obj->trial_lambda_min = lambda_min;
+  obj->trial_lambda_max = lambda_max;
+  obj->trial_nstepmax = nstepmax;
+  obj->trial_nsteplambda = nsteplambda;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_trial_bounds
+ *
+ *****************************************************************************/
+
+int ffs_trial_bounds(ffs_t * obj, double * lambda_min, double * lambda_max,
+		     int * nstepmax, int * nsteplambda) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(lambda_min == NULL, -1);
+  dbg_return_if(lambda_max == NULL, -1);
+  dbg_return_if(nstepmax == NULL, -1);
+  dbg_return_if(nsteplambda == NULL, -1);
+
+  *lambda_min = obj->trial_lambda_min;
+  *lambda_max = obj->trial_lambda_max;
+  *nstepmax = obj->trial_nstepmax;
+  *nsteplambda = obj->trial_nsteplambda;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_trial_nstep_set
+ *
+ *****************************************************************************/
+
+int ffs_trial_nstep_set(ffs_t * obj, int nstep) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  obj->trial_nstep = nstep;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_trial_nstep
+ *
+ *****************************************************************************/
+
+int ffs_trial_nstep(ffs_t * obj, int * nstep) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(nstep == NULL, -1);
+
+  *nstep = obj->trial_nstep;
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  ffs_free_command_line
@@ -7,6 +7,7 @@
 #ifndef FFS_H
 #define FFS_H
 
+#include <stddef.h>
 #include <mpi.h>
 
 /**
@@ -177,6 +178,74 @@ int ffs_info_int(ffs_t * obj, ffs_info_enum_t type, int n, int * data);
 
 int ffs_type_set(ffs_t * obj, ffs_info_enum_t type, int n, ffs_var_enum_t t);
 
+/**
+ *  \brief Report the size of the packed simulation state
+ *
+ *  \param  obj        the ffs_t structure
+ *  \param  nbytes     the number of bytes required to pack the state
+ *
+ *  \retval 0          a success
+ *  \retval -1         a NULL pointer was received
+ *
+ *  A simulation supporting in-memory states should call this in
+ *  response to SIM_STATE_PACK_SIZE. The size reported should be that
+ *  for the current rank in the simulation communicator.
+ */
+
+int ffs_state_size_set(ffs_t * obj, size_t nbytes);
+
+/**
+ *  \brief Obtain the buffer for a packed simulation state
+ *
+ *  \param  obj        the ffs_t structure
+ *  \param  buf        a pointer to the buffer to be returned
+ *  \param  nbytes     a pointer to the size of the buffer (bytes)
+ *
+ *  \retval 0          a success
+ *  \retval -1         a NULL pointer was received, or no buffer is present
+ *
+ *  The buffer is owned by FFS. In response to SIM_STATE_PACK, the
+ *  simulation should copy its state into the buffer (which will be
+ *  at least the size reported for SIM_STATE_PACK_SIZE). In response to
+ *  SIM_STATE_UNPACK, the simulation should restore its state from the
+ *  buffer. The simulation must not retain a reference to the buffer
+ *  beyond the state action.
+ */
+
+int ffs_state_buffer(ffs_t * obj, void ** buf, size_t * nbytes);
+
+/**
+ *  \brief Obtain the bounds of a trial run by the simulation
+ *
+ *  \param  obj         the ffs_t structure
+ *  \param  lambda_min  the trial stops if lambda falls below this value
+ *  \param  lambda_max  the trial stops if lambda reaches this value
+ *  \param  nstepmax    the trial stops after at least this many steps
+ *  \param  nsteplambda the number of steps between examinations of lambda
+ *
+ *  \retval 0           a success
+ *  \retval -1          a NULL pointer was received
+ *
+ *  For use in response to SIM_EXECUTE_TRIAL.
+ */
+
+int ffs_trial_bounds(ffs_t * obj, double * lambda_min, double * lambda_max,
+		     int * nstepmax, int * nsteplambda);
+
+/**
+ *  \brief Report the number of steps taken in a trial
+ *
+ *  \param  obj         the ffs_t structure
+ *  \param  nstep       the number of steps taken
+ *
+ *  \retval 0           a success
+ *  \retval -1          a NULL pointer was received
+ *
+ *  For use in response to SIM_EXECUTE_TRIAL.
+ */
+
+int ffs_trial_nstep_set(ffs_t * obj, int nstep);
+
 /**
  *  \}
  */
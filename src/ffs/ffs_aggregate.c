@@ -0,0 +1,514 @@
+/*****************************************************************************
+ *
+ *  ffs_aggregate.c
+ *
+ *  Packed states from many ranks in one file, via MPI-IO.
+ *
+ *  The file holds only the packed states, end to end, in rank order.
+ *  The table for each file (handle, offset, and size of each state)
+ *  is held by every rank, sorted by handle.
+ *
+ *  The write is one collective call per state: ranks with fewer
+ *  states than others take part with nothing to write, so that the
+ *  MPI-IO layer may combine the requests into large contiguous
+ *  writes by a few aggregator ranks.
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "u/libu.h"
+#include "ffs_aggregate.h"
+
+typedef struct ffs_aggregate_entry_s ffs_aggregate_entry_t;
+typedef struct ffs_aggregate_file_s ffs_aggregate_file_t;
+
+struct ffs_aggregate_entry_s {
+  ffs_handle_t handle;           /* State */
+  MPI_Offset offset;             /* Offset of state in file */
+  long long nbytes;              /* Size of packed state */
+};
+
+struct ffs_aggregate_file_s {
+  char * filename;               /* File name */
+  MPI_File fh;                   /* Open for reading (or MPI_FILE_NULL) */
+  int n;                         /* Number of states */
+  ffs_aggregate_entry_t * entry; /* Table sorted by handle */
+  ffs_aggregate_file_t * next;   /* Next file */
+};
+
+struct ffs_aggregate_s {
+  ffs_aggregate_file_t * file;   /* Files (most recent first) */
+};
+
+static int ffs_aggregate_gather(MPI_Comm comm, int n, long long * local,
+				ffs_aggregate_file_t * file);
+static ffs_aggregate_entry_t * ffs_aggregate_find(ffs_aggregate_t * obj,
+						  ffs_handle_t handle,
+						  ffs_aggregate_file_t ** pf);
+static ffs_aggregate_file_t ** ffs_aggregate_file(ffs_aggregate_t * obj,
+						  const char * filename);
+static void ffs_aggregate_file_free(ffs_aggregate_file_t * file);
+static int ffs_aggregate_cmp(const void * a, const void * b);
+static int ffs_aggregate_key_cmp(const void * key, const void * a);
+
+/*****************************************************************************
+ *
+ *  ffs_aggregate_create
+ *
+ *****************************************************************************/
+
+int ffs_aggregate_create(ffs_aggregate_t ** pobj) {
+
+  ffs_aggregate_t * obj = NULL;
+
+  dbg_return_if(pobj == NULL, -1);
+
+  obj = u_calloc(1, sizeof(ffs_aggregate_t));
+  dbg_err_sif(obj == NULL);
+
+  *pobj = obj;
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_aggregate_free
+ *
+ *****************************************************************************/
+
+void ffs_aggregate_free(ffs_aggregate_t * obj) {
+
+  ffs_aggregate_file_t * file = NULL;
+
+  dbg_return_if(obj == NULL, );
+
+  while ((file = obj->file)) {
+    obj->file = file->next;
+    ffs_aggregate_file_free(file);
+  }
+
+  u_free(obj);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_aggregate_write
+ *
+ *  Local failures (e.g., a state too large) are agreed by all ranks
+ *  before the file is touched, so that no rank is left waiting in a
+ *  collective call.
+ *
+ *****************************************************************************/
+
+int ffs_aggregate_write(ffs_aggregate_t * obj, const char * filename, int n,
+			ffs_handle_t * handle, void ** buf, size_t * nbytes,
+			MPI_Comm comm) {
+  int i, rank;
+  int nmax;
+  int ifail = 0, ifail_any = 0;
+  long long nlocal = 0, offset = 0;
+  long long * local = NULL;
+  MPI_File fh = MPI_FILE_NULL;
+  MPI_Status status;
+  ffs_aggregate_file_t ** pfile = NULL;
+  ffs_aggregate_file_t * file = NULL;
+  ffs_aggregate_file_t * old = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(filename == NULL, -1);
+  dbg_return_if(n < 0, -1);
+  dbg_return_if(n > 0 && (handle == NULL || buf == NULL || nbytes == NULL),
+		-1);
+
+  MPI_Comm_rank(comm, &rank);
+
+  for (i = 0; i < n; i++) {
+    if (nbytes[i] > INT_MAX) ifail = 1;
+    nlocal += nbytes[i];
+  }
+
+  local = u_calloc(3*n + 1, sizeof(long long));
+  file = u_calloc(1, sizeof(ffs_aggregate_file_t));
+  if (file) {
+    file->fh = MPI_FILE_NULL;
+    file->filename = u_strdup(filename);
+  }
+  if (local == NULL) ifail = 1;
+  if (file == NULL || file->filename == NULL) ifail = 1;
+
+  MPI_Allreduce(&ifail, &ifail_any, 1, MPI_INT, MPI_LOR, comm);
+  dbg_err_ifm(ifail_any, "Cannot write %s", filename);
+
+  /* This rank's states start after all those of lower rank */
+
+  MPI_Exscan(&nlocal, &offset, 1, MPI_LONG_LONG, MPI_SUM, comm);
+  if (rank == 0) offset = 0;
+
+  for (i = 0; i < n; i++) {
+    local[3*i] = handle[i];
+    local[3*i + 1] = offset;
+    local[3*i + 2] = nbytes[i];
+    offset += nbytes[i];
+  }
+
+  ifail = (MPI_File_open(comm, filename, MPI_MODE_WRONLY | MPI_MODE_CREATE,
+			 MPI_INFO_NULL, &fh) != MPI_SUCCESS);
+  MPI_Allreduce(&ifail, &ifail_any, 1, MPI_INT, MPI_LOR, comm);
+  if (ifail_any && fh != MPI_FILE_NULL) MPI_File_close(&fh);
+  dbg_err_ifm(ifail_any, "MPI_File_open(%s) failed", filename);
+
+  MPI_Allreduce(&n, &nmax, 1, MPI_INT, MPI_MAX, comm);
+
+  ifail = (MPI_File_set_size(fh, 0) != MPI_SUCCESS);
+
+  for (i = 0; i < nmax; i++) {
+    if (i < n) {
+      ifail += (MPI_File_write_at_all(fh, local[3*i + 1], buf[i],
+				      (int) nbytes[i], MPI_BYTE, &status)
+		!= MPI_SUCCESS);
+    }
+    else {
+      ifail += (MPI_File_write_at_all(fh, offset, NULL, 0, MPI_BYTE, &status)
+		!= MPI_SUCCESS);
+    }
+  }
+
+  ifail += (MPI_File_close(&fh) != MPI_SUCCESS);
+
+  MPI_Allreduce(&ifail, &ifail_any, 1, MPI_INT, MPI_LOR, comm);
+  dbg_err_ifm(ifail_any, "Failed to write %s", filename);
+
+  /* Every rank holds the whole table */
+
+  dbg_err_if(ffs_aggregate_gather(comm, n, local, file));
+
+  /* A file of the same name known from before is superseded */
+
+  pfile = ffs_aggregate_file(obj, filename);
+  if ((old = *pfile)) {
+    *pfile = old->next;
+    ffs_aggregate_file_free(old);
+  }
+
+  file->next = obj->file;
+  obj->file = file;
+
+  u_free(local);
+
+  return 0;
+
+ err:
+
+  if (file) ffs_aggregate_file_free(file);
+  if (local) u_free(local);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_aggregate_present
+ *
+ *****************************************************************************/
+
+int ffs_aggregate_present(ffs_aggregate_t * obj, ffs_handle_t handle,
+			  int * present) {
+
+  ffs_aggregate_file_t * file = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(present == NULL, -1);
+
+  *present = (ffs_aggregate_find(obj, handle, &file) != NULL);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_aggregate_get
+ *
+ *  The file is opened (by this rank alone) at the first read, and
+ *  held open until it is removed.
+ *
+ *****************************************************************************/
+
+int ffs_aggregate_get(ffs_aggregate_t * obj, ffs_handle_t handle,
+		      void ** pbuf, size_t * nbytes) {
+
+  void * buf = NULL;
+  MPI_Status status;
+  ffs_aggregate_file_t * file = NULL;
+  ffs_aggregate_entry_t * entry = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(pbuf == NULL, -1);
+  dbg_return_if(nbytes == NULL, -1);
+
+  *pbuf = NULL;
+  *nbytes = 0;
+
+  entry = ffs_aggregate_find(obj, handle, &file);
+  if (entry == NULL) return 0;
+
+  if (file->fh == MPI_FILE_NULL) {
+    dbg_err_ifm(MPI_File_open(MPI_COMM_SELF, file->filename, MPI_MODE_RDONLY,
+			      MPI_INFO_NULL, &file->fh) != MPI_SUCCESS,
+		"MPI_File_open(%s) failed", file->filename);
+  }
+
+  buf = u_malloc(entry->nbytes > 0 ? entry->nbytes : 1);
+  dbg_err_sif(buf == NULL);
+
+  dbg_err_ifm(MPI_File_read_at(file->fh, entry->offset, buf,
+			       (int) entry->nbytes, MPI_BYTE, &status)
+	      != MPI_SUCCESS, "Failed to read %lld from %s", handle,
+	      file->filename);
+
+  *pbuf = buf;
+  *nbytes = entry->nbytes;
+
+  return 0;
+
+ err:
+
+  if (buf) u_free(buf);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_aggregate_remove
+ *
+ *  Every rank must have closed the file before it is deleted.
+ *
+ *****************************************************************************/
+
+int ffs_aggregate_remove(ffs_aggregate_t * obj, const char * filename,
+			 MPI_Comm comm) {
+  int rank;
+  int ifail = 0;
+  ffs_aggregate_file_t ** pfile = NULL;
+  ffs_aggregate_file_t * file = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(filename == NULL, -1);
+
+  pfile = ffs_aggregate_file(obj, filename);
+  if (*pfile == NULL) return 0;
+
+  file = *pfile;
+  *pfile = file->next;
+  ffs_aggregate_file_free(file);
+
+  MPI_Barrier(comm);
+  MPI_Comm_rank(comm, &rank);
+
+  if (rank == 0) {
+    ifail = (MPI_File_delete(filename, MPI_INFO_NULL) != MPI_SUCCESS);
+  }
+
+  dbg_return_ifm(ifail, -1, "MPI_File_delete(%s) failed", filename);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_aggregate_nfile
+ *
+ *****************************************************************************/
+
+int ffs_aggregate_nfile(ffs_aggregate_t * obj, int * nfile) {
+
+  ffs_aggregate_file_t * file = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(nfile == NULL, -1);
+
+  *nfile = 0;
+  for (file = obj->file; file; file = file->next) *nfile += 1;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_aggregate_gather
+ *
+ *  Gather the (handle, offset, size) triples from all ranks, and form
+ *  the sorted table for the file.
+ *
+ *****************************************************************************/
+
+static int ffs_aggregate_gather(MPI_Comm comm, int n, long long * local,
+				ffs_aggregate_file_t * file) {
+  int i, nrank;
+  int ntotal = 0;
+  int ifail = 0, ifail_any = 0;
+  int * counts = NULL;
+  int * ntable = NULL;
+  int * dtable = NULL;
+  long long * table = NULL;
+
+  dbg_return_if(local == NULL, -1);
+  dbg_return_if(file == NULL, -1);
+
+  MPI_Comm_size(comm, &nrank);
+
+  counts = u_calloc(nrank, sizeof(int));
+  ntable = u_calloc(nrank, sizeof(int));
+  dtable = u_calloc(nrank, sizeof(int));
+  if (counts == NULL || ntable == NULL || dtable == NULL) ifail = 1;
+
+  MPI_Allreduce(&ifail, &ifail_any, 1, MPI_INT, MPI_LOR, comm);
+  dbg_err_if(ifail_any);
+
+  MPI_Allgather(&n, 1, MPI_INT, counts, 1, MPI_INT, comm);
+
+  for (i = 0; i < nrank; i++) {
+    ntable[i] = 3*counts[i];
+    dtable[i] = 3*ntotal;
+    ntotal += counts[i];
+  }
+
+  table = u_calloc(3*ntotal + 1, sizeof(long long));
+  file->entry = u_calloc(ntotal + 1, sizeof(ffs_aggregate_entry_t));
+  ifail = (table == NULL || file->entry == NULL);
+
+  MPI_Allreduce(&ifail, &ifail_any, 1, MPI_INT, MPI_LOR, comm);
+  dbg_err_if(ifail_any);
+
+  MPI_Allgatherv(local, 3*n, MPI_LONG_LONG, table, ntable, dtable,
+		 MPI_LONG_LONG, comm);
+
+  for (i = 0; i < ntotal; i++) {
+    file->entry[i].handle = table[3*i];
+    file->entry[i].offset = table[3*i + 1];
+    file->entry[i].nbytes = table[3*i + 2];
+  }
+  file->n = ntotal;
+
+  qsort(file->entry, ntotal, sizeof(ffs_aggregate_entry_t),
+	ffs_aggregate_cmp);
+
+  u_free(table);
+  u_free(dtable);
+  u_free(ntable);
+  u_free(counts);
+
+  return 0;
+
+ err:
+
+  if (table) u_free(table);
+  if (dtable) u_free(dtable);
+  if (ntable) u_free(ntable);
+  if (counts) u_free(counts);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_aggregate_find
+ *
+ *  The most recent file holding the state, and its table entry.
+ *
+ *****************************************************************************/
+
+static ffs_aggregate_entry_t * ffs_aggregate_find(ffs_aggregate_t * obj,
+						  ffs_handle_t handle,
+						  ffs_aggregate_file_t ** pf) {
+  ffs_aggregate_file_t * file = NULL;
+  ffs_aggregate_entry_t * entry = NULL;
+
+  for (file = obj->file; file; file = file->next) {
+    entry = bsearch(&handle, file->entry, file->n,
+		    sizeof(ffs_aggregate_entry_t), ffs_aggregate_key_cmp);
+    if (entry) break;
+  }
+
+  *pf = file;
+
+  return entry;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_aggregate_file
+ *
+ *  The link to the file of the given name (*link is NULL if none).
+ *
+ *****************************************************************************/
+
+static ffs_aggregate_file_t ** ffs_aggregate_file(ffs_aggregate_t * obj,
+						  const char * filename) {
+  ffs_aggregate_file_t ** pfile = NULL;
+
+  for (pfile = &obj->file; *pfile; pfile = &(*pfile)->next) {
+    if (strcmp((*pfile)->filename, filename) == 0) break;
+  }
+
+  return pfile;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_aggregate_file_free
+ *
+ *****************************************************************************/
+
+static void ffs_aggregate_file_free(ffs_aggregate_file_t * file) {
+
+  if (file->fh != MPI_FILE_NULL) MPI_File_close(&file->fh);
+  if (file->entry) u_free(file->entry);
+  if (file->filename) u_free(file->filename);
+  u_free(file);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_aggregate_cmp
+ *
+ *****************************************************************************/
+
+static int ffs_aggregate_cmp(const void * a, const void * b) {
+
+  const ffs_aggregate_entry_t * ea = a;
+  const ffs_aggregate_entry_t * eb = b;
+
+  return (ea->handle > eb->handle) - (ea->handle < eb->handle);
+}
+
+/*****************************************************************************
+ *
+ *  ffs_aggregate_key_cmp
+ *
+ *****************************************************************************/
+
+static int ffs_aggregate_key_cmp(const void * key, const void * a) {
+
+  const ffs_handle_t * handle = key;
+  const ffs_aggregate_entry_t * entry = a;
+
+  return (*handle > entry->handle) - (*handle < entry->handle);
+}
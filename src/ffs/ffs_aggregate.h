@@ -0,0 +1,147 @@
+/*****************************************************************************
+ *
+ *  ffs_aggregate.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef FFS_AGGREGATE_H
+#define FFS_AGGREGATE_H
+
+#include <stddef.h>
+#include <mpi.h>
+
+#include "ffs_util.h"
+
+/**
+ *  \defgroup ffs_aggregate FFS state aggregate files
+ *  \ingroup ffs_library
+ *  \{
+ *
+ *    A group of packed states (e.g., those at one interface) held by
+ *    different proxies is written to a single file by one collective
+ *    MPI-IO operation, rather than one file per state. Each rank's
+ *    states are placed at an offset found by an exclusive scan of
+ *    the number of bytes held by the ranks before it.
+ *
+ *    The offset table, with the handle of each state, is then gathered
+ *    by all ranks, so that any state in the file may be read without
+ *    reference to the file system beyond the file itself. The file is
+ *    held open for reading until it is removed.
+ */
+
+/**
+ *  \brief Opaque aggregate type
+ */
+
+typedef struct ffs_aggregate_s ffs_aggregate_t;
+
+/**
+ *  \brief Create a new (empty) set of aggregate files
+ *
+ *  \param  pobj     a pointer to the new object to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ */
+
+int ffs_aggregate_create(ffs_aggregate_t ** pobj);
+
+/**
+ *  \brief Release the object (files are closed but not removed)
+ *
+ *  \param  obj      the object
+ */
+
+void ffs_aggregate_free(ffs_aggregate_t * obj);
+
+/**
+ *  \brief Write packed states to a new aggregate file (collective)
+ *
+ *  \param  obj      the object
+ *  \param  filename the file name, which must be the same on all ranks
+ *  \param  n        the number of states held by this rank
+ *  \param  handle   the handles identifying the states
+ *  \param  buf      the packed states
+ *  \param  nbytes   the size of each packed state
+ *  \param  comm     the ranks taking part
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure (on all ranks)
+ *
+ *  Any existing file of the same name is replaced. Each state must
+ *  be no more than INT_MAX bytes.
+ */
+
+int ffs_aggregate_write(ffs_aggregate_t * obj, const char * filename, int n,
+			ffs_handle_t * handle, void ** buf, size_t * nbytes,
+			MPI_Comm comm);
+
+/**
+ *  \brief Is a state held in an aggregate file?
+ *
+ *  \param  obj      the object
+ *  \param  handle   the handle identifying the state
+ *  \param  present  a pointer to the flag to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
+ */
+
+int ffs_aggregate_present(ffs_aggregate_t * obj, ffs_handle_t handle,
+			  int * present);
+
+/**
+ *  \brief Read a packed state into a new buffer
+ *
+ *  \param  obj      the object
+ *  \param  handle   the handle identifying the state
+ *  \param  buf      pointer to the new buffer (to be released by the caller)
+ *  \param  nbytes   pointer to the size of the buffer
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  If the state is in no aggregate file, the buffer returned is NULL.
+ */
+
+int ffs_aggregate_get(ffs_aggregate_t * obj, ffs_handle_t handle,
+		      void ** buf, size_t * nbytes);
+
+/**
+ *  \brief Remove an aggregate file (collective)
+ *
+ *  \param  obj      the object
+ *  \param  filename the file name given to ffs_aggregate_write()
+ *  \param  comm     the ranks which wrote the file
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  There is no action (and no communication) if the file is not
+ *  known, which must then be so on all ranks.
+ */
+
+int ffs_aggregate_remove(ffs_aggregate_t * obj, const char * filename,
+			 MPI_Comm comm);
+
+/**
+ *  \brief Return the number of aggregate files held
+ *
+ *  \param  obj      the object
+ *  \param  nfile    a pointer to the number to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
+ */
+
+int ffs_aggregate_nfile(ffs_aggregate_t * obj, int * nfile);
+
+/**
+ * \}
+ */
+
+#endif
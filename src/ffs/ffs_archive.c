@@ -0,0 +1,830 @@
+/*****************************************************************************
+ *
+ *  ffs_archive.c
+ *
+ *  Append-only segment files of packed states.
+ *
+ *  Each record is a header, holding the handle of the state, and the
+ *  packed state. The index is a hash table keyed by handle (as
+ *  ffs_store.c) giving the segment and offset of the record.
+ *
+ *  Segments written by other archives are scanned only when a state
+ *  cannot be found in the index. As segments are append-only, each
+ *  scan starts where the last one stopped. A segment which has been
+ *  removed and recreated by its owner is detected, either because it
+ *  is shorter than expected, or because a record does not match, and
+ *  is scanned again from the start.
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+
+#include "u/libu.h"
+#include "ffs_archive.h"
+
+#define FFS_ARCHIVE_NBUCKET_INIT 64
+#define FFS_ARCHIVE_MAGIC 0x42534646u   /* "FFSB" */
+
+typedef struct ffs_archive_header_s ffs_archive_header_t;
+typedef struct ffs_archive_seg_s ffs_archive_seg_t;
+typedef struct ffs_archive_node_s ffs_archive_node_t;
+
+struct ffs_archive_header_s {
+  unsigned int magic;            /* FFS_ARCHIVE_MAGIC */
+  ffs_handle_t handle;           /* State */
+  size_t nbytes;                 /* Size of packed state */
+};
+
+struct ffs_archive_seg_s {
+  char * filename;               /* Segment file name */
+  int local;                     /* Written by this archive */
+  long size;                     /* Bytes appended (local) or scanned */
+  int nnode;                     /* Index entries in this segment */
+  ffs_archive_seg_t * next;      /* Next segment */
+};
+
+struct ffs_archive_node_s {
+  ffs_handle_t handle;           /* Key */
+  unsigned int hash;             /* Hash of handle */
+  ffs_archive_seg_t * seg;       /* Segment holding record */
+  long offset;                   /* Offset of record in segment */
+  ffs_archive_node_t * next;     /* Next in chain */
+};
+
+struct ffs_archive_s {
+  int inst;                      /* Instance id */
+  int id;                        /* Proxy id */
+  int rank;                      /* Rank in proxy communicator */
+  int nbucket;                   /* Number of buckets */
+  int nnode;                     /* Number of index entries */
+  ffs_archive_node_t ** bucket;  /* Index */
+  ffs_archive_seg_t * seg;       /* Segments (local and other) */
+};
+
+static ffs_archive_node_t * ffs_archive_find(ffs_archive_t * obj,
+					     ffs_handle_t handle);
+static int ffs_archive_index(ffs_archive_t * obj, ffs_handle_t handle,
+			     ffs_archive_seg_t * seg, long offset,
+			     ffs_writer_t * writer);
+static int ffs_archive_unindex(ffs_archive_t * obj, ffs_handle_t handle,
+			       ffs_writer_t * writer);
+static int ffs_archive_purge(ffs_archive_t * obj, ffs_archive_seg_t * seg);
+static int ffs_archive_grow(ffs_archive_t * obj);
+static int ffs_archive_segment(ffs_archive_t * obj, const char * filename,
+			       int local, ffs_writer_t * writer,
+			       ffs_archive_seg_t ** pseg);
+static int ffs_archive_segment_drop(ffs_archive_t * obj,
+				    ffs_archive_seg_t * seg,
+				    ffs_writer_t * writer);
+static int ffs_archive_segment_name(ffs_archive_t * obj, ffs_handle_t handle,
+				    char * filename);
+static int ffs_archive_scan(ffs_archive_t * obj, ffs_handle_t handle);
+static int ffs_archive_scan_segment(ffs_archive_t * obj,
+				    ffs_archive_seg_t * seg);
+static int ffs_archive_read(ffs_archive_node_t * node, void ** buf,
+			    size_t * nbytes);
+static unsigned int ffs_archive_hash(ffs_handle_t handle);
+
+/*****************************************************************************
+ *
+ *  ffs_archive_create
+ *
+ *****************************************************************************/
+
+int ffs_archive_create(int inst, int id, int rank, ffs_archive_t ** pobj) {
+
+  ffs_archive_t * obj = NULL;
+
+  dbg_return_if(inst < 0, -1);
+  dbg_return_if(id < 0, -1);
+  dbg_return_if(rank < 0, -1);
+  dbg_return_if(pobj == NULL, -1);
+
+  obj = u_calloc(1, sizeof(ffs_archive_t));
+  dbg_err_sif(obj == NULL);
+
+  obj->inst = inst;
+  obj->id = id;
+  obj->rank = rank;
+  obj->nbucket = FFS_ARCHIVE_NBUCKET_INIT;
+  obj->bucket = u_calloc(obj->nbucket, sizeof(ffs_archive_node_t *));
+  dbg_err_sif(obj->bucket == NULL);
+
+  *pobj = obj;
+
+  return 0;
+
+ err:
+
+  if (obj) ffs_archive_free(obj);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_free
+ *
+ *****************************************************************************/
+
+void ffs_archive_free(ffs_archive_t * obj) {
+
+  int n;
+  ffs_archive_node_t * node = NULL;
+  ffs_archive_seg_t * seg = NULL;
+
+  dbg_return_if(obj == NULL, );
+
+  if (obj->bucket) {
+    for (n = 0; n < obj->nbucket; n++) {
+      while ((node = obj->bucket[n])) {
+	obj->bucket[n] = node->next;
+	u_free(node);
+      }
+    }
+    u_free(obj->bucket);
+  }
+
+  while ((seg = obj->seg)) {
+    obj->seg = seg->next;
+    u_free(seg->filename);
+    u_free(seg);
+  }
+
+  u_free(obj);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_put
+ *
+ *****************************************************************************/
+
+int ffs_archive_put(ffs_archive_t * obj, ffs_handle_t handle,
+		    const void * buf, size_t nbytes, ffs_writer_t * writer) {
+  int ifail;
+  size_t nrec;
+  long offset;
+  char * rec = NULL;
+  char filename[FILENAME_MAX];
+  ffs_archive_header_t header;
+  ffs_archive_seg_t * seg = NULL;
+  FILE * fp = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(buf == NULL, -1);
+
+  dbg_err_if(ffs_archive_segment_name(obj, handle, filename));
+  dbg_err_if(ffs_archive_segment(obj, filename, 1, writer, &seg));
+
+  memset(&header, 0, sizeof(header));
+  header.magic = FFS_ARCHIVE_MAGIC;
+  header.handle = handle;
+  header.nbytes = nbytes;
+
+  nrec = sizeof(header) + nbytes;
+  rec = u_malloc(nrec);
+  dbg_err_sif(rec == NULL);
+
+  memcpy(rec, &header, sizeof(header));
+  memcpy(rec + sizeof(header), buf, nbytes);
+
+  if (writer) {
+    /* The writer takes the record, whatever the outcome */
+    ifail = ffs_writer_append(writer, seg->filename, rec, nrec);
+    rec = NULL;
+    dbg_err_if(ifail);
+  }
+  else {
+    fp = fopen(seg->filename, "ab");
+    dbg_err_ifm(fp == NULL, "fopen(%s) failed", seg->filename);
+    dbg_err_sif(fwrite(rec, 1, nrec, fp) != nrec);
+    dbg_err_sif(fclose(fp));
+    fp = NULL;
+    u_free(rec);
+    rec = NULL;
+  }
+
+  offset = seg->size;
+  seg->size += nrec;
+
+  dbg_err_if(ffs_archive_index(obj, handle, seg, offset, writer));
+
+  return 0;
+
+ err:
+
+  if (fp) fclose(fp);
+  if (rec) u_free(rec);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_get
+ *
+ *  If the record found does not match, the segment has been replaced
+ *  since it was scanned, so it is scanned again (once).
+ *
+ *****************************************************************************/
+
+int ffs_archive_get(ffs_archive_t * obj, ffs_handle_t handle, void ** buf,
+		    size_t * nbytes) {
+
+  ffs_archive_node_t * node = NULL;
+  ffs_archive_seg_t * seg = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(buf == NULL, -1);
+  dbg_return_if(nbytes == NULL, -1);
+
+  if ((node = ffs_archive_find(obj, handle)) == NULL) {
+    dbg_err_if(ffs_archive_scan(obj, handle));
+    node = ffs_archive_find(obj, handle);
+  }
+
+  dbg_err_ifm(node == NULL, "State %lld not found in archive", handle);
+
+  if (ffs_archive_read(node, buf, nbytes) == 0) return 0;
+
+  seg = node->seg;
+  dbg_err_ifm(seg->local, "Failed to read %lld from %s", handle,
+	      seg->filename);
+
+  dbg_err_if(ffs_archive_purge(obj, seg));
+  dbg_err_if(ffs_archive_scan_segment(obj, seg));
+
+  node = ffs_archive_find(obj, handle);
+  dbg_err_ifm(node == NULL, "State %lld not found in archive", handle);
+  dbg_err_ifm(ffs_archive_read(node, buf, nbytes),
+	      "Failed to read %lld from %s", handle, node->seg->filename);
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_remove
+ *
+ *****************************************************************************/
+
+int ffs_archive_remove(ffs_archive_t * obj, ffs_handle_t handle,
+		       ffs_writer_t * writer) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  if (ffs_archive_find(obj, handle) == NULL) return 0;
+
+  return ffs_archive_unindex(obj, handle, writer);
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_forget
+ *
+ *****************************************************************************/
+
+int ffs_archive_forget(ffs_archive_t * obj, ffs_handle_t handle) {
+
+  ffs_archive_node_t * node = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  node = ffs_archive_find(obj, handle);
+  if (node == NULL || node->seg->local) return 0;
+
+  return ffs_archive_unindex(obj, handle, NULL);
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_nsegment
+ *
+ *****************************************************************************/
+
+int ffs_archive_nsegment(ffs_archive_t * obj, int * nseg) {
+
+  ffs_archive_seg_t * seg = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(nseg == NULL, -1);
+
+  *nseg = 0;
+  for (seg = obj->seg; seg; seg = seg->next) {
+    if (seg->local) *nseg += 1;
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_find
+ *
+ *****************************************************************************/
+
+static ffs_archive_node_t * ffs_archive_find(ffs_archive_t * obj,
+					     ffs_handle_t handle) {
+  unsigned int hash;
+  ffs_archive_node_t * node = NULL;
+
+  dbg_return_if(obj == NULL, NULL);
+
+  hash = ffs_archive_hash(handle);
+
+  for (node = obj->bucket[hash % obj->nbucket]; node; node = node->next) {
+    if (node->handle == handle) break;
+  }
+
+  return node;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_index
+ *
+ *  Add or update the index entry for handle. A local segment left
+ *  with no entries is removed.
+ *
+ *****************************************************************************/
+
+static int ffs_archive_index(ffs_archive_t * obj, ffs_handle_t handle,
+			     ffs_archive_seg_t * seg, long offset,
+			     ffs_writer_t * writer) {
+  unsigned int hash;
+  ffs_archive_seg_t * old = NULL;
+  ffs_archive_node_t * node = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(seg == NULL, -1);
+
+  node = ffs_archive_find(obj, handle);
+
+  if (node) {
+    old = node->seg;
+    node->seg = seg;
+    node->offset = offset;
+    seg->nnode += 1;
+    old->nnode -= 1;
+    if (old->local && old->nnode == 0) {
+      dbg_err_if(ffs_archive_segment_drop(obj, old, writer));
+    }
+    return 0;
+  }
+
+  if (obj->nnode >= 2*obj->nbucket) dbg_err_if(ffs_archive_grow(obj));
+
+  node = u_calloc(1, sizeof(ffs_archive_node_t));
+  dbg_err_sif(node == NULL);
+
+  hash = ffs_archive_hash(handle);
+  node->handle = handle;
+  node->hash = hash;
+  node->seg = seg;
+  node->offset = offset;
+  node->next = obj->bucket[hash % obj->nbucket];
+  obj->bucket[hash % obj->nbucket] = node;
+  obj->nnode += 1;
+  seg->nnode += 1;
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_unindex
+ *
+ *  Remove the index entry for handle. Segments written by other
+ *  archives are retained, so that scanning can continue from where
+ *  it left off.
+ *
+ *****************************************************************************/
+
+static int ffs_archive_unindex(ffs_archive_t * obj, ffs_handle_t handle,
+			       ffs_writer_t * writer) {
+  unsigned int hash;
+  ffs_archive_seg_t * seg = NULL;
+  ffs_archive_node_t ** pnode = NULL;
+  ffs_archive_node_t * node = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  hash = ffs_archive_hash(handle);
+
+  for (pnode = &obj->bucket[hash % obj->nbucket]; *pnode;
+       pnode = &(*pnode)->next) {
+    node = *pnode;
+    if (node->handle != handle) continue;
+
+    *pnode = node->next;
+    seg = node->seg;
+    u_free(node);
+    obj->nnode -= 1;
+
+    seg->nnode -= 1;
+    if (seg->local && seg->nnode == 0) {
+      dbg_return_if(ffs_archive_segment_drop(obj, seg, writer), -1);
+    }
+
+    return 0;
+  }
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_purge
+ *
+ *  Remove all index entries for a segment written by another archive,
+ *  and rewind it.
+ *
+ *****************************************************************************/
+
+static int ffs_archive_purge(ffs_archive_t * obj, ffs_archive_seg_t * seg) {
+
+  int n;
+  ffs_archive_node_t ** pnode = NULL;
+  ffs_archive_node_t * node = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(seg == NULL, -1);
+  dbg_return_if(seg->local, -1);
+
+  for (n = 0; n < obj->nbucket; n++) {
+    pnode = &obj->bucket[n];
+    while ((node = *pnode)) {
+      if (node->seg == seg) {
+	*pnode = node->next;
+	u_free(node);
+	obj->nnode -= 1;
+      }
+      else {
+	pnode = &node->next;
+      }
+    }
+  }
+
+  seg->nnode = 0;
+  seg->size = 0;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_grow
+ *
+ *  Double the number of buckets and rehash.
+ *
+ *****************************************************************************/
+
+static int ffs_archive_grow(ffs_archive_t * obj) {
+
+  int n, nbucket;
+  ffs_archive_node_t ** bucket = NULL;
+  ffs_archive_node_t * node = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  nbucket = 2*obj->nbucket;
+  bucket = u_calloc(nbucket, sizeof(ffs_archive_node_t *));
+  dbg_err_sif(bucket == NULL);
+
+  for (n = 0; n < obj->nbucket; n++) {
+    while ((node = obj->bucket[n])) {
+      obj->bucket[n] = node->next;
+      node->next = bucket[node->hash % nbucket];
+      bucket[node->hash % nbucket] = node;
+    }
+  }
+
+  u_free(obj->bucket);
+  obj->bucket = bucket;
+  obj->nbucket = nbucket;
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_segment
+ *
+ *  Find, or start, the segment with the given file name. Any file
+ *  left over from an earlier segment of the same name is removed
+ *  before this archive starts to append to it.
+ *
+ *****************************************************************************/
+
+static int ffs_archive_segment(ffs_archive_t * obj, const char * filename,
+			       int local, ffs_writer_t * writer,
+			       ffs_archive_seg_t ** pseg) {
+
+  ffs_archive_seg_t * seg = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(filename == NULL, -1);
+  dbg_return_if(pseg == NULL, -1);
+
+  for (seg = obj->seg; seg; seg = seg->next) {
+    if (strcmp(seg->filename, filename) == 0) break;
+  }
+
+  if (seg == NULL) {
+    seg = u_calloc(1, sizeof(ffs_archive_seg_t));
+    dbg_err_sif(seg == NULL);
+    seg->filename = u_strdup(filename);
+    dbg_err_sif(seg->filename == NULL);
+    seg->local = local;
+    seg->next = obj->seg;
+    obj->seg = seg;
+
+    if (local) {
+      if (writer) {
+	dbg_err_if(ffs_writer_remove(writer, filename));
+      }
+      else {
+	remove(filename);
+      }
+    }
+  }
+
+  *pseg = seg;
+
+  return 0;
+
+ err:
+
+  if (seg && seg != obj->seg) {
+    if (seg->filename) u_free(seg->filename);
+    u_free(seg);
+  }
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_segment_drop
+ *
+ *  Remove a local segment file, and forget the segment.
+ *
+ *****************************************************************************/
+
+static int ffs_archive_segment_drop(ffs_archive_t * obj,
+				    ffs_archive_seg_t * seg,
+				    ffs_writer_t * writer) {
+  int ifail = 0;
+  ffs_archive_seg_t ** pseg = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(seg == NULL, -1);
+
+  if (writer) {
+    ifail = ffs_writer_remove(writer, seg->filename);
+  }
+  else {
+    remove(seg->filename);
+  }
+
+  for (pseg = &obj->seg; *pseg; pseg = &(*pseg)->next) {
+    if (*pseg == seg) {
+      *pseg = seg->next;
+      break;
+    }
+  }
+
+  u_free(seg->filename);
+  u_free(seg);
+
+  return ifail;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_segment_name
+ *
+ *  The prefix is that of the state stubs of the group (see
+ *  util_handle_stub()).
+ *
+ *****************************************************************************/
+
+static int ffs_archive_segment_name(ffs_archive_t * obj, ffs_handle_t handle,
+				    char * filename) {
+  int id_group;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(filename == NULL, -1);
+  dbg_return_if(util_handle_ids(handle, &id_group, NULL), -1);
+
+  dbg_return_if(snprintf(filename, FILENAME_MAX, "inst%4.4d-grp%4.4d"
+			 ".proxy%4.4d.rank%4.4d.archive", obj->inst, id_group,
+			 obj->id, obj->rank) >= FILENAME_MAX, -1);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_scan
+ *
+ *  Look for segments written by other archives for the same group
+ *  (and the same rank) as handle, and scan them for new records.
+ *
+ *****************************************************************************/
+
+static int ffs_archive_scan(ffs_archive_t * obj, ffs_handle_t handle) {
+
+  size_t nhead, ntail, len;
+  char filename[FILENAME_MAX];
+  char tail[FILENAME_MAX];
+  const char * dot;
+  DIR * dir = NULL;
+  struct dirent * entry = NULL;
+  ffs_archive_seg_t * seg = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  /* Segment names are head + "NNNN" (proxy id) + tail, where the
+   * head runs to the end of ".proxy" */
+
+  dbg_err_if(ffs_archive_segment_name(obj, handle, filename));
+
+  dot = strstr(filename, ".proxy");
+  dbg_err_if(dot == NULL);
+  nhead = (dot - filename) + strlen(".proxy");
+  snprintf(tail, FILENAME_MAX, ".rank%4.4d.archive", obj->rank);
+  ntail = strlen(tail);
+
+  dir = opendir(".");
+  dbg_err_sif(dir == NULL);
+
+  while ((entry = readdir(dir))) {
+    len = strlen(entry->d_name);
+    if (len <= nhead + ntail) continue;
+    if (strncmp(entry->d_name, filename, nhead) != 0) continue;
+    if (strcmp(entry->d_name + len - ntail, tail) != 0) continue;
+    if (strcmp(entry->d_name, filename) == 0) continue;
+
+    dbg_err_if(ffs_archive_segment(obj, entry->d_name, 0, NULL, &seg));
+    if (seg->local) continue;
+    dbg_err_if(ffs_archive_scan_segment(obj, seg));
+  }
+
+  closedir(dir);
+
+  return 0;
+
+ err:
+
+  if (dir) closedir(dir);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_scan_segment
+ *
+ *  Index the records in a segment written by another archive, from
+ *  the end of the last scan. An incomplete record at the end is left
+ *  for a later scan. Records of states also written by this archive
+ *  are ignored.
+ *
+ *****************************************************************************/
+
+static int ffs_archive_scan_segment(ffs_archive_t * obj,
+				    ffs_archive_seg_t * seg) {
+  long len;
+  long offset;
+  ffs_archive_header_t header;
+  ffs_archive_node_t * node = NULL;
+  FILE * fp = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(seg == NULL, -1);
+  dbg_return_if(seg->local, -1);
+
+  /* The file may have been removed since the directory was read */
+
+  fp = fopen(seg->filename, "rb");
+  if (fp == NULL) return 0;
+
+  dbg_err_sif(fseek(fp, 0, SEEK_END));
+  dbg_err_sif((len = ftell(fp)) < 0);
+  if (len < seg->size) dbg_err_if(ffs_archive_purge(obj, seg));
+
+  offset = seg->size;
+  dbg_err_sif(fseek(fp, offset, SEEK_SET));
+
+  while (fread(&header, sizeof(header), 1, fp) == 1) {
+    if (header.magic != FFS_ARCHIVE_MAGIC) break;
+    if (util_handle_ids(header.handle, NULL, NULL)) break;
+    if (header.nbytes > (size_t) (len - ftell(fp))) break;
+
+    node = ffs_archive_find(obj, header.handle);
+    if (node == NULL || node->seg->local == 0) {
+      dbg_err_if(ffs_archive_index(obj, header.handle, seg, offset, NULL));
+    }
+
+    offset += sizeof(header) + header.nbytes;
+    seg->size = offset;
+    dbg_err_sif(fseek(fp, offset, SEEK_SET));
+  }
+
+  fclose(fp);
+
+  return 0;
+
+ err:
+
+  if (fp) fclose(fp);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_read
+ *
+ *  Read the record for node into a new buffer, which is returned
+ *  only if the record is intact.
+ *
+ *****************************************************************************/
+
+static int ffs_archive_read(ffs_archive_node_t * node, void ** pbuf,
+			    size_t * nbytes) {
+  void * buf = NULL;
+  ffs_archive_header_t header;
+  FILE * fp = NULL;
+
+  dbg_return_if(node == NULL, -1);
+  dbg_return_if(pbuf == NULL, -1);
+  dbg_return_if(nbytes == NULL, -1);
+
+  fp = fopen(node->seg->filename, "rb");
+  nop_err_if(fp == NULL);
+  nop_err_if(fseek(fp, node->offset, SEEK_SET));
+  nop_err_if(fread(&header, sizeof(header), 1, fp) != 1);
+  nop_err_if(header.magic != FFS_ARCHIVE_MAGIC);
+  nop_err_if(header.handle != node->handle);
+
+  buf = u_malloc(header.nbytes > 0 ? header.nbytes : 1);
+  dbg_err_sif(buf == NULL);
+  nop_err_if(fread(buf, 1, header.nbytes, fp) != header.nbytes);
+  fclose(fp);
+
+  *pbuf = buf;
+  *nbytes = header.nbytes;
+
+  return 0;
+
+ err:
+
+  if (fp) fclose(fp);
+  if (buf) u_free(buf);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_archive_hash
+ *
+ *  As ffs_store_hash().
+ *
+ *****************************************************************************/
+
+static unsigned int ffs_archive_hash(ffs_handle_t handle) {
+
+  unsigned long long h = (unsigned long long) handle;
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+
+  return (unsigned int) h;
+}
@@ -0,0 +1,151 @@
+/*****************************************************************************
+ *
+ *  ffs_archive.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef FFS_ARCHIVE_H
+#define FFS_ARCHIVE_H
+
+#include <stddef.h>
+
+#include "ffs_util.h"
+#include "ffs_writer.h"
+
+/**
+ *  \defgroup ffs_archive FFS state archive
+ *  \ingroup ffs_library
+ *  \{
+ *
+ *    Packed simulation states are appended to a small number of
+ *    segment files, rather than one file per state. All the states
+ *    in the same group (e.g., the same interface; see util_handle())
+ *    written by one proxy rank go to the same segment file
+ *    "instNNNN-grpNNNN.proxyNNNN.rankNNNN.archive".
+ *
+ *    Each record in a segment carries its own handle, so that an archive
+ *    may locate states written by other proxies (at the same rank in
+ *    the proxy communicator) by scanning their segments. An in-memory
+ *    index records the position of each state.
+ *
+ *    Segments are append-only. A segment file is removed as a whole
+ *    when the last state written to it by this archive is removed.
+ */
+
+/**
+ *  \brief Opaque archive type
+ */
+
+typedef struct ffs_archive_s ffs_archive_t;
+
+/**
+ *  \brief Create a new archive
+ *
+ *  \param  inst     the instance id
+ *  \param  id       the proxy id
+ *  \param  rank     the rank in the proxy communicator
+ *  \param  pobj     a pointer to the new object to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ */
+
+int ffs_archive_create(int inst, int id, int rank, ffs_archive_t ** pobj);
+
+/**
+ *  \brief Release an archive (files are not removed)
+ *
+ *  \param  obj      the archive
+ */
+
+void ffs_archive_free(ffs_archive_t * obj);
+
+/**
+ *  \brief Append a packed state to the appropriate segment
+ *
+ *  \param  obj      the archive
+ *  \param  handle   the handle identifying the state
+ *  \param  buf      the packed state (which is copied)
+ *  \param  nbytes   the size of the packed state
+ *  \param  writer   if not NULL, the append is made via the writer
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  Any earlier record of the same state is superseded.
+ */
+
+int ffs_archive_put(ffs_archive_t * obj, ffs_handle_t handle,
+		    const void * buf, size_t nbytes, ffs_writer_t * writer);
+
+/**
+ *  \brief Read a packed state into a new buffer
+ *
+ *  \param  obj      the archive
+ *  \param  handle   the handle identifying the state
+ *  \param  buf      pointer to the new buffer (to be released by the caller)
+ *  \param  nbytes   pointer to the size of the buffer
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure, including the state not being found
+ *
+ *  States written by other archives are available once their writes
+ *  have completed.
+ */
+
+int ffs_archive_get(ffs_archive_t * obj, ffs_handle_t handle, void ** buf,
+		    size_t * nbytes);
+
+/**
+ *  \brief Remove a state written by this archive
+ *
+ *  \param  obj      the archive
+ *  \param  handle   the handle identifying the state
+ *  \param  writer   if not NULL, any file removal is made via the writer
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  If no other state written by this archive remains in the segment,
+ *  the segment file is removed. A state written by another archive
+ *  is only removed from the index.
+ */
+
+int ffs_archive_remove(ffs_archive_t * obj, ffs_handle_t handle,
+		       ffs_writer_t * writer);
+
+/**
+ *  \brief Remove a state written by another archive from the index
+ *
+ *  \param  obj      the archive
+ *  \param  handle   the handle identifying the state
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
+ *
+ *  There is no action if the state was written by this archive.
+ */
+
+int ffs_archive_forget(ffs_archive_t * obj, ffs_handle_t handle);
+
+/**
+ *  \brief Return the number of segment files written by this archive
+ *
+ *  \param  obj      the archive
+ *  \param  nseg     a pointer to the number to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
+ */
+
+int ffs_archive_nsegment(ffs_archive_t * obj, int * nseg);
+
+/**
+ * \}
+ */
+
+#endif
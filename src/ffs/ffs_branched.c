@@ -10,10 +10,19 @@
 
 #include "ffs_private.h"
 #include "ffs_state.h"
+#include "ffs_checkpoint.h"
+#include "ffs_frontier.h"
 #include "ffs_branched.h"
 
-static int ffs_branched_recursive(ffs_trial_arg_t * trial, int interface,
-				  int id, double wt, ranlcg_t * ran);
+static int ffs_branched_tree(ffs_trial_arg_t * trial, ffs_frontier_t * frontier,
+			     ranlcg_t * ran);
+static int ffs_branched_enter(ffs_trial_arg_t * trial,
+			      ffs_frontier_t * frontier, int interface, int id,
+			      double wt, int * pushed);
+static int ffs_branched_next(ffs_trial_arg_t * trial, ffs_frame_t * frame,
+			     ranlcg_t * ran);
+static int ffs_branched_leave(ffs_trial_arg_t * trial,
+			      ffs_frontier_t * frontier);
 
 /*****************************************************************************
  *
@@ -25,15 +34,17 @@ int ffs_branched_run(ffs_trial_arg_t * trial) {
 
   int pid;
   int ntrial;
+  int nlambda;
   int n, nstart;
+  int nfirst = 0;
   int status;
   int itraj;
   long int lseed;
-  double wt;
-  const char * stub = NULL;
+  ffs_handle_t handle;
   ffs_t * ffs = NULL;
   ranlcg_t * ran = NULL;
   ffs_state_t * sinit = NULL;
+  ffs_frontier_t * frontier = NULL;
 
   dbg_return_if(trial == NULL, -1);
 
@@ -46,9 +57,9 @@ int ffs_branched_run(ffs_trial_arg_t * trial) {
 
   /* Save initial reference state with id = 0 */
 
-  stub = util_filename_stub(trial->inst_id, pid, 0);
-  dbg_err_if( proxy_state(trial->proxy, SIM_STATE_INIT, stub) );
-  dbg_err_if( proxy_state(trial->proxy, SIM_STATE_WRITE, stub) );
+  dbg_err_if( util_handle(pid, 0, &handle) );
+  dbg_err_if( proxy_state(trial->proxy, SIM_STATE_INIT, handle) );
+  dbg_err_if( proxy_state(trial->proxy, SIM_STATE_WRITE, handle) );
   dbg_err_if( ffs_state_create(trial->inst_id, pid, &sinit) );
   dbg_err_if( ffs_state_id_set(sinit, 0) );
 
@@ -57,6 +68,9 @@ int ffs_branched_run(ffs_trial_arg_t * trial) {
   lseed = trial->inst_seed;
   ranlcg_create(lseed, &ran);
 
+  dbg_err_if( ffs_param_nlambda(trial->param, &nlambda) );
+  dbg_err_if( ffs_frontier_create(nlambda, &frontier) );
+
   /* Distribute the trials evenly among the simulation instances */
   /* We have a local trial index n, and a global seed (1 + n + nstart) */
 
@@ -67,38 +81,70 @@ int ffs_branched_run(ffs_trial_arg_t * trial) {
   ntrial = ntrial / trial->nproxy;
   nstart = pid*ntrial;
 
+  /* Completed trees are not repeated */
+
+  if (trial->resume) {
+    dbg_err_if( ffs_trial_tree_resume(trial, FFS_CHECKPOINT_BRANCHED, ntrial,
+				      &nfirst) );
+  }
+
+  /* Initial states may be taken from, or kept for, the cache */
+
+  dbg_err_if( ffs_trial_tree_cache_start(trial, ntrial) );
+
   mpilog(trial->log, "\n");
   mpilog(trial->log, "Starting %d trials each on %d proxies\n", ntrial,
 	 trial->nproxy);
 
-  for (n = 0; n < ntrial; n++) {
+  for (n = nfirst; n < ntrial; n++) {
 
     itraj = 1 + n + nstart;                  /* trajectory number (global) */
     lseed = trial->inst_seed + n + nstart;   /* trajectory seed */
     ranlcg_state_set(ran, lseed);
 
-    ffs_trial_init(trial, sinit, ran, n, itraj, &status);
+    dbg_err_if( ffs_trial_tree_init(trial, sinit, ran, n, itraj, &status) );
+
+    /* If we reached the first interface, start the trials! */
 
-    if (status != FFS_TRIAL_SUCCEEDED) continue;
+    if (status == FFS_TRIAL_SUCCEEDED) {
+      dbg_err_if( ffs_branched_tree(trial, frontier, ran) );
+    }
+
+    if (trial->checkpoint) {
+      dbg_err_if( ffs_trial_tree_checkpoint(trial, FFS_CHECKPOINT_BRANCHED,
+					    n + 1, ntrial) );
+    }
+
+    if (trial->checkpoint && ffs_checkpoint_stop()) {
+      mpilog(trial->log, "Stopping after checkpoint (as requested)\n");
+      goto err;
+    }
+  }
 
-    /* We reached the first interface; start the trials! */
+  dbg_err_if( ffs_trial_tree_cache_finish(trial, nfirst == 0) );
 
-    wt = 1.0;
-    ffs_branched_recursive(trial, 1, 1, wt, ran);
+  if (trial->checkpoint || trial->resume) {
+    dbg_err_if( ffs_trial_tree_finish(trial) );
   }
 
-  /* Remove the reference state, and finish */
+  /* Remove the reference state, and any outstanding states, and finish */
 
-  stub = util_filename_stub(trial->inst_id, pid, 0);
-  proxy_state(trial->proxy, SIM_STATE_DELETE, stub);
+  ffs_trial_reaper_report(trial);
+
+  dbg_err_if( util_handle(pid, 0, &handle) );
+  proxy_state(trial->proxy, SIM_STATE_DELETE, handle);
+  proxy_state_reap(trial->proxy, -1);
   proxy_execute(trial->proxy, SIM_EXECUTE_FINISH);
 
+  ffs_frontier_free(frontier);
   ranlcg_free(ran);
 
   return 0;
 
  err:
 
+  ffs_trial_tree_cache_finish(trial, 0);
+  if (frontier) ffs_frontier_free(frontier);
   if (ran) ranlcg_free(ran);
   if (sinit) ffs_state_free(sinit);
 
@@ -107,74 +153,214 @@ int ffs_branched_run(ffs_trial_arg_t * trial) {
 
 /*****************************************************************************
  *
- *  ffs_branched_recursive
+ *  ffs_branched_tree
+ *
+ *  Grow the tree of trials from the current state at the first
+ *  interface, depth first. Each state on the frontier makes its
+ *  trials in turn; a success moves down to the child, and the parent
+ *  takes up its next trial when the child is finished.
  *
  *****************************************************************************/
 
-static int ffs_branched_recursive(ffs_trial_arg_t * trial, int interface,
-				  int id, double wt, ranlcg_t * ran) {
-
-  int nlambda;
-  int ntrial, itrial;
+static int ffs_branched_tree(ffs_trial_arg_t * trial, ffs_frontier_t * frontier,
+			     ranlcg_t * ran) {
   int status;
-  int pid;
-  int seed;
+  int pushed;
   double lambda_min;
   double lambda_max;
   double wtnow;
-  ffs_state_t * s_keep = NULL;
+  ffs_frame_t * frame = NULL;
+
+  dbg_return_if(trial == NULL, -1);
+  dbg_return_if(frontier == NULL, -1);
+
+  dbg_err_if( ffs_branched_enter(trial, frontier, 1, 1, 1.0, &pushed) );
+
+  while (ffs_frontier_top(frontier, &frame) == 0) {
+
+    if (frame->itrial == frame->ntrial) {
+      dbg_err_if( ffs_branched_leave(trial, frontier) );
+      if (ffs_frontier_top(frontier, &frame) == 0) {
+	dbg_err_if( ffs_branched_next(trial, frame, ran) );
+      }
+      continue;
+    }
+
+    ffs_param_lambda(trial->param, frame->interface - 1, &lambda_min);
+    ffs_param_lambda(trial->param, frame->interface + 1, &lambda_max);
+
+    /* fire off the branches with total weight 1.0*incoming weight */
+    wtnow = frame->wt / ((double) frame->ntrial);
+
+    ffs_trial_run_to_lambda(trial, lambda_min, lambda_max, &status);
+
+    if (status == FFS_TRIAL_WENT_BACKWARDS || status == FFS_TRIAL_TIMED_OUT) {
+      ffs_trial_prune(trial, frame->interface, ran, &wtnow, &status);
+    }
+
+    if (status == FFS_TRIAL_SUCCEEDED) {
+      frame->idnext += 1;
+      dbg_err_if( ffs_branched_enter(trial, frontier, frame->interface + 1,
+				     frame->idnext, wtnow, &pushed) );
+      if (pushed) continue;
+    }
+
+    dbg_err_if( ffs_branched_next(trial, frame, ran) );
+  }
+
+  return 0;
+
+ err:
+
+  /* Abandon the remainder of the tree */
+
+  while (ffs_frontier_pop(frontier) == 0);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_branched_enter
+ *
+ *  A state has been reached at the interface. Record it, and unless
+ *  it is at the final interface, push it on to the frontier.
+ *
+ *****************************************************************************/
+
+static int ffs_branched_enter(ffs_trial_arg_t * trial,
+			      ffs_frontier_t * frontier, int interface, int id,
+			      double wt, int * pushed) {
+  int nlambda;
+  int ntrial;
+  int pid;
+  int init_independent;
+  int restore_last;
+  ffs_handle_t handle;
+  ffs_frame_t * frame = NULL;
+
+  dbg_return_if(trial == NULL, -1);
+  dbg_return_if(frontier == NULL, -1);
+  dbg_return_if(pushed == NULL, -1);
+
+  *pushed = 0;
 
   ffs_param_nlambda(trial->param, &nlambda);
   ffs_param_weight_accum(trial->param, interface, wt);
   ffs_result_weight_accum(trial->result, interface, wt);
   ffs_result_trial_success_add(trial->result, interface);
 
-  /* If we have reached the final state then end the recursion */
+  /* If we have reached the final state then this branch ends */
 
   if (interface == nlambda) return 0;
 
-  ffs_param_lambda(trial->param, interface - 1, &lambda_min);
-  ffs_param_lambda(trial->param, interface + 1, &lambda_max);
   ffs_param_ntrial(trial->param, interface, &ntrial);
 
-  /* Save this current state, as it needs to be restored. */
+  /* After the last trial, the state need only be restored at the
+   * first interface if the next initial trajectory continues from
+   * it (see ffs_trial_init()). Otherwise, whoever runs next reads
+   * its own state first. */
+
+  ffs_init_independent(trial->init, &init_independent);
+  restore_last = (interface == 1 && init_independent == 0);
 
   dbg_err_if(proxy_id(trial->proxy, &pid));
-  dbg_err_if(ffs_state_create(trial->inst_id, pid, &s_keep));
-  dbg_err_if(ffs_state_id_set(s_keep, id));
-  proxy_state(trial->proxy, SIM_STATE_WRITE, ffs_state_stub(s_keep));
+  dbg_err_if(util_handle(pid, id, &handle));
+  dbg_err_if(ffs_frontier_push(frontier, interface, id, wt, &frame));
+  frame->ntrial = ntrial;
+  frame->keep = (ntrial > 1 || restore_last);
 
-  for (itrial = 0; itrial < ntrial; itrial++) {
+  /* Save this current state, if it is to be restored. */
 
-    /* fire off the branches with total weight 1.0*incoming weight */
-    wtnow = wt / ((double) ntrial);
+  if (frame->keep) {
+    proxy_state(trial->proxy, SIM_STATE_WRITE, handle);
+  }
 
-    ffs_trial_run_to_lambda(trial, lambda_min, lambda_max, &status);
+  *pushed = 1;
 
-    if (status == FFS_TRIAL_WENT_BACKWARDS || status == FFS_TRIAL_TIMED_OUT) {
-      ffs_trial_prune(trial, interface, ran, &wtnow, &status);
-    }
+  return 0;
 
-    if (status == FFS_TRIAL_SUCCEEDED) {
-      ffs_branched_recursive(trial, interface + 1, ++id, wtnow, ran);
-    }
+ err:
+
+  mpilog(trial->log, "Failed at interface %d\n", interface);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_branched_next
+ *
+ *  Reset for the next trial from this state with a new seed, or end
+ *  of trials. The seed is always drawn, so the sequence does not
+ *  depend on whether the state is restored.
+ *
+ *****************************************************************************/
+
+static int ffs_branched_next(ffs_trial_arg_t * trial, ffs_frame_t * frame,
+			     ranlcg_t * ran) {
+  int pid;
+  int seed;
+  int init_independent;
+  int restore_last;
+  ffs_handle_t handle;
+
+  dbg_return_if(trial == NULL, -1);
+  dbg_return_if(frame == NULL, -1);
 
-    /* Reset and next trial with new seed, or end of trials */
+  ffs_init_independent(trial->init, &init_independent);
+  restore_last = (frame->interface == 1 && init_independent == 0);
 
-    proxy_state(trial->proxy, SIM_STATE_READ, ffs_state_stub(s_keep));
-    ranlcg_reep_int32(ran, &seed);
+  dbg_err_if(proxy_id(trial->proxy, &pid));
+
+  ranlcg_reep_int32(ran, &seed);
+
+  if (frame->itrial < frame->ntrial - 1 || restore_last) {
+    dbg_err_if(util_handle(pid, frame->id, &handle));
+    proxy_state(trial->proxy, SIM_STATE_READ, handle);
     proxy_cache_info_int(trial->proxy, FFS_INFO_RNG_SEED_PUT, 1, &seed);
     proxy_info(trial->proxy, FFS_INFO_RNG_SEED_FETCH);
   }
 
-  proxy_state(trial->proxy, SIM_STATE_DELETE, ffs_state_stub(s_keep));
-  ffs_state_free(s_keep);
+  frame->itrial += 1;
 
   return 0;
 
  err:
 
-  mpilog(trial->log, "Failed at interface %d\n", interface);
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_branched_leave
+ *
+ *  All trials from the top state are done, so it is released.
+ *
+ *****************************************************************************/
+
+static int ffs_branched_leave(ffs_trial_arg_t * trial,
+			      ffs_frontier_t * frontier) {
+  int pid;
+  ffs_handle_t handle;
+  ffs_frame_t * frame = NULL;
+
+  dbg_return_if(trial == NULL, -1);
+  dbg_return_if(frontier == NULL, -1);
+
+  dbg_err_if(proxy_id(trial->proxy, &pid));
+  dbg_err_if(ffs_frontier_top(frontier, &frame));
+
+  if (frame->keep) {
+    dbg_err_if(util_handle(pid, frame->id, &handle));
+    proxy_state_retire(trial->proxy, handle);
+  }
+
+  dbg_err_if(ffs_frontier_pop(frontier));
+
+  return 0;
+
+ err:
 
   return -1;
 }
@@ -0,0 +1,384 @@
+/*****************************************************************************
+ *
+ *  ffs_cache.c
+ *
+ *  Cache of states and flux results at the first interface.
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "u/libu.h"
+#include "ffs_cache.h"
+
+#define FFS_CACHE_MAGIC   "FFSI"
+#define FFS_CACHE_VERSION 2
+
+typedef struct ffs_cache_header_s ffs_cache_header_t;
+
+struct ffs_cache_header_s {
+  char magic[4];             /* FFS_CACHE_MAGIC (no '\0') */
+  int version;               /* FFS_CACHE_VERSION */
+  int kind;                  /* ffs_cache_enum */
+  unsigned int hash;         /* Hash of the key */
+  int nkey;                  /* Length of the key which follows */
+};
+
+static unsigned int ffs_cache_hash(const char * key);
+static int ffs_cache_open(const char * filename, int kind, const char * key,
+			  FILE ** fp);
+static int ffs_cache_create(const char * filename, int kind, const char * key,
+			    FILE ** fp);
+static int ffs_cache_close(const char * filename, FILE * fp, int ifail);
+
+/*****************************************************************************
+ *
+ *  ffs_cache_filename
+ *
+ *****************************************************************************/
+
+int ffs_cache_filename(const char * key, int rank, char * filename) {
+
+  dbg_return_if(key == NULL, -1);
+  dbg_return_if(rank < 0, -1);
+  dbg_return_if(filename == NULL, -1);
+
+  snprintf(filename, FILENAME_MAX, "cache%8.8x.rank%4.4d",
+	   ffs_cache_hash(key), rank);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_cache_prefix
+ *
+ *****************************************************************************/
+
+int ffs_cache_prefix(const char * key, char * prefix) {
+
+  dbg_return_if(key == NULL, -1);
+  dbg_return_if(prefix == NULL, -1);
+
+  snprintf(prefix, FILENAME_MAX, "cache%8.8x", ffs_cache_hash(key));
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_cache_valid
+ *
+ *****************************************************************************/
+
+int ffs_cache_valid(const char * filename, int kind, const char * key,
+		    MPI_Comm comm, int * valid) {
+  int found, nfound;
+  int nrank;
+  FILE * fp = NULL;
+
+  dbg_return_if(filename == NULL, -1);
+  dbg_return_if(key == NULL, -1);
+  dbg_return_if(valid == NULL, -1);
+
+  found = (ffs_cache_open(filename, kind, key, &fp) == 0);
+  if (fp) fclose(fp);
+
+  MPI_Comm_size(comm, &nrank);
+  MPI_Allreduce(&found, &nfound, 1, MPI_INT, MPI_SUM, comm);
+
+  *valid = (nfound == nrank);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_cache_direct_write
+ *
+ *****************************************************************************/
+
+int ffs_cache_direct_write(const char * filename, const char * key,
+			   ffs_ensemble_t * states, int nsuccess,
+			   ffs_result_aflux_t * flux) {
+  int ifail = 0;
+  FILE * fp = NULL;
+
+  dbg_return_if(states == NULL, -1);
+  dbg_return_if(flux == NULL, -1);
+
+  dbg_err_if(ffs_cache_create(filename, FFS_CACHE_DIRECT, key, &fp));
+
+  ifail += (fwrite(&nsuccess, sizeof(int), 1, fp) != 1);
+  ifail += (ffs_ensemble_fwrite(states, fp) != 0);
+  ifail += (ffs_result_aflux_fwrite(flux, fp) != 0);
+
+  return ffs_cache_close(filename, fp, ifail);
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_cache_direct_read
+ *
+ *****************************************************************************/
+
+int ffs_cache_direct_read(const char * filename, const char * key,
+			  ffs_ensemble_t ** states, int * nsuccess,
+			  ffs_result_aflux_t * flux) {
+  FILE * fp = NULL;
+  ffs_ensemble_t * ensemble = NULL;
+
+  dbg_return_if(states == NULL, -1);
+  dbg_return_if(nsuccess == NULL, -1);
+  dbg_return_if(flux == NULL, -1);
+
+  dbg_err_ifm(ffs_cache_open(filename, FFS_CACHE_DIRECT, key, &fp),
+	      "%s is not a cache for this run", filename);
+
+  dbg_err_if(fread(nsuccess, sizeof(int), 1, fp) != 1);
+  dbg_err_if(ffs_ensemble_fread(&ensemble, fp));
+  dbg_err_if(ffs_result_aflux_fread(flux, fp));
+
+  fclose(fp);
+  *states = ensemble;
+
+  return 0;
+
+ err:
+
+  if (fp) fclose(fp);
+  if (ensemble) ffs_ensemble_free(ensemble);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_cache_tree_write
+ *
+ *****************************************************************************/
+
+int ffs_cache_tree_write(const char * filename, const char * key, int ntraj,
+			 const int * status, const long int * ranstate,
+			 ffs_result_aflux_t * flux) {
+  int ifail = 0;
+  size_t n;
+  FILE * fp = NULL;
+
+  dbg_return_if(ntraj < 0, -1);
+  dbg_return_if(status == NULL, -1);
+  dbg_return_if(ranstate == NULL, -1);
+  dbg_return_if(flux == NULL, -1);
+
+  dbg_err_if(ffs_cache_create(filename, FFS_CACHE_TREE, key, &fp));
+
+  n = ntraj;
+  ifail += (fwrite(&ntraj, sizeof(int), 1, fp) != 1);
+  ifail += (fwrite(status, sizeof(int), n, fp) != n);
+  ifail += (fwrite(ranstate, sizeof(long int), n, fp) != n);
+  ifail += (ffs_result_aflux_fwrite(flux, fp) != 0);
+
+  return ffs_cache_close(filename, fp, ifail);
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_cache_tree_read
+ *
+ *****************************************************************************/
+
+int ffs_cache_tree_read(const char * filename, const char * key, int ntraj,
+			int * status, long int * ranstate,
+			ffs_result_aflux_t * flux) {
+  int nread;
+  size_t n;
+  size_t nerr = 0;
+  FILE * fp = NULL;
+
+  dbg_return_if(status == NULL, -1);
+  dbg_return_if(ranstate == NULL, -1);
+  dbg_return_if(flux == NULL, -1);
+
+  dbg_err_ifm(ffs_cache_open(filename, FFS_CACHE_TREE, key, &fp),
+	      "%s is not a cache for this run", filename);
+
+  dbg_err_if(fread(&nread, sizeof(int), 1, fp) != 1);
+  dbg_err_ifm(nread != ntraj, "%s: %d trajectories (expected %d)",
+	      filename, nread, ntraj);
+
+  n = ntraj;
+  nerr += (fread(status, sizeof(int), n, fp) != n);
+  nerr += (fread(ranstate, sizeof(long int), n, fp) != n);
+  dbg_err_if(nerr);
+  dbg_err_if(ffs_result_aflux_fread(flux, fp));
+
+  fclose(fp);
+
+  return 0;
+
+ err:
+
+  if (fp) fclose(fp);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_cache_hash
+ *
+ *  FNV-1a (32 bit).
+ *
+ *****************************************************************************/
+
+static unsigned int ffs_cache_hash(const char * key) {
+
+  unsigned int hash = 2166136261u;
+
+  while (*key) {
+    hash ^= (unsigned char) *key++;
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_cache_open
+ *
+ *  Open the file for reading, and check the header and key. On
+ *  return the stream is positioned after the key; if there is no
+ *  match, it is NULL. This is silent, as a miss is not an error.
+ *
+ *****************************************************************************/
+
+static int ffs_cache_open(const char * filename, int kind, const char * key,
+			  FILE ** fp) {
+  int match = 0;
+  size_t nkey;
+  char * buf = NULL;
+  ffs_cache_header_t header;
+
+  dbg_return_if(filename == NULL, -1);
+  dbg_return_if(key == NULL, -1);
+  dbg_return_if(fp == NULL, -1);
+
+  nkey = strlen(key);
+
+  *fp = fopen(filename, "rb");
+  if (*fp == NULL) return -1;
+
+  if (fread(&header, sizeof(header), 1, *fp) == 1 &&
+      memcmp(header.magic, FFS_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+      header.version == FFS_CACHE_VERSION &&
+      header.kind == kind &&
+      header.hash == ffs_cache_hash(key) &&
+      header.nkey == (int) nkey) {
+
+    buf = u_calloc(nkey + 1, sizeof(char));
+    if (buf && fread(buf, sizeof(char), nkey, *fp) == nkey) {
+      match = (memcmp(buf, key, nkey) == 0);
+    }
+    if (buf) u_free(buf);
+  }
+
+  if (match) return 0;
+
+  fclose(*fp);
+  *fp = NULL;
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_cache_create
+ *
+ *  Open a temporary file for writing, and write the header and key;
+ *  ffs_cache_close() puts it in place.
+ *
+ *****************************************************************************/
+
+static int ffs_cache_create(const char * filename, int kind, const char * key,
+			    FILE ** fp) {
+  size_t nkey;
+  char tmp[FILENAME_MAX];
+  ffs_cache_header_t header;
+
+  dbg_return_if(filename == NULL, -1);
+  dbg_return_if(key == NULL, -1);
+  dbg_return_if(fp == NULL, -1);
+
+  dbg_return_if(snprintf(tmp, FILENAME_MAX, "%s.tmp", filename)
+		>= FILENAME_MAX, -1);
+
+  nkey = strlen(key);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, FFS_CACHE_MAGIC, sizeof(header.magic));
+  header.version = FFS_CACHE_VERSION;
+  header.kind = kind;
+  header.hash = ffs_cache_hash(key);
+  header.nkey = nkey;
+
+  *fp = fopen(tmp, "wb");
+  dbg_err_ifm(*fp == NULL, "fopen(%s) failed", tmp);
+
+  dbg_err_sif(fwrite(&header, sizeof(header), 1, *fp) != 1);
+  dbg_err_sif(fwrite(key, sizeof(char), nkey, *fp) != nkey);
+
+  return 0;
+
+ err:
+
+  if (*fp) fclose(*fp);
+  *fp = NULL;
+  remove(tmp);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_cache_close
+ *
+ *  The temporary file replaces any existing file only if there has
+ *  been no failure in writing it.
+ *
+ *****************************************************************************/
+
+static int ffs_cache_close(const char * filename, FILE * fp, int ifail) {
+
+  char tmp[FILENAME_MAX];
+
+  dbg_return_if(filename == NULL, -1);
+  dbg_return_if(fp == NULL, -1);
+
+  snprintf(tmp, FILENAME_MAX, "%s.tmp", filename);
+
+  ifail += (fclose(fp) != 0);
+  dbg_err_ifm(ifail, "Failed to write %s", tmp);
+  dbg_err_sif(rename(tmp, filename));
+
+  return 0;
+
+ err:
+
+  remove(tmp);
+
+  return -1;
+}
@@ -0,0 +1,175 @@
+/*****************************************************************************
+ *
+ *  ffs_cache.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef FFS_CACHE_H
+#define FFS_CACHE_H
+
+#include <mpi.h>
+
+#include "../util/ffs_ensemble.h"
+#include "ffs_result_aflux.h"
+
+/**
+ *  \defgroup ffs_cache FFS first interface cache
+ *  \ingroup ffs_library
+ *  \{
+ *
+ *    The states generated at the first interface, and the flux
+ *    results which go with them, depend only on the simulation,
+ *    the initial parameters, lambda_A (and lambda_B, as trajectories
+ *    reaching B are returned to A), the seed, and the number of
+ *    proxies. They may be kept so that a later run which differs only
+ *    in the interfaces beyond the first need not generate them again.
+ *
+ *    The caller forms a key, a string describing everything the
+ *    states depend on. The files are named for a hash of the key, and
+ *    the key itself is kept in each file, so that a file for another
+ *    key is never mistaken for a match.
+ *
+ *    Each rank in the instance has its own index file, as the flux
+ *    results are held per rank until the reduction at the end. For
+ *    direct FFS the index holds the ensemble at the first interface;
+ *    for the branched and Rosenbluth methods, which grow one tree per
+ *    initial trajectory, it holds the outcome of each trajectory and
+ *    the state of the trajectory RNG on reaching the interface.
+ *
+ *    The states themselves are written by the caller, via the proxy,
+ *    in group FFS_HANDLE_GROUP_CACHE with the initial trajectory
+ *    number as id; the proxy names them by the prefix given by
+ *    ffs_cache_prefix() (see proxy_state_cache_set()). Nothing removes
+ *    them; a cache is discarded by deleting its files.
+ */
+
+/**
+ *  \brief Kinds of cache
+ */
+
+enum ffs_cache_enum {FFS_CACHE_DIRECT = 1,
+		     FFS_CACHE_TREE};
+
+/**
+ *  \brief Form the index file name for an instance rank
+ *
+ *  \param  key       the key
+ *  \param  rank      the rank in the instance communicator
+ *  \param  filename  a buffer of at least FILENAME_MAX
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure
+ */
+
+int ffs_cache_filename(const char * key, int rank, char * filename);
+
+/**
+ *  \brief Form the prefix under which cached states are named
+ *
+ *  \param  key       the key
+ *  \param  prefix    a buffer of at least FILENAME_MAX
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure
+ */
+
+int ffs_cache_prefix(const char * key, char * prefix);
+
+/**
+ *  \brief Is there a usable cache? (collective)
+ *
+ *  \param  filename  this rank's index file name
+ *  \param  kind      the kind of cache required
+ *  \param  key       the key, which must match
+ *  \param  comm      the ranks which must agree
+ *  \param  valid     a pointer to the result (1 if all ranks have a match)
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure
+ *
+ *  A missing or mismatched file is not an error: the cache is just
+ *  not valid.
+ */
+
+int ffs_cache_valid(const char * filename, int kind, const char * key,
+		    MPI_Comm comm, int * valid);
+
+/**
+ *  \brief Write the index for direct FFS
+ *
+ *  \param  filename  the file name
+ *  \param  key       the key
+ *  \param  states    the (global) ensemble at the first interface
+ *  \param  nsuccess  the number of (local) successful trials
+ *  \param  flux      the (local) flux result
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure (any previous index is untouched)
+ */
+
+int ffs_cache_direct_write(const char * filename, const char * key,
+			   ffs_ensemble_t * states, int nsuccess,
+			   ffs_result_aflux_t * flux);
+
+/**
+ *  \brief Read an index written by ffs_cache_direct_write()
+ *
+ *  \param  filename  the file name
+ *  \param  key       the key, which must match
+ *  \param  states    a pointer to the new ensemble to be returned
+ *  \param  nsuccess  a pointer to the number of successful trials
+ *  \param  flux      the flux result to be overwritten
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure
+ */
+
+int ffs_cache_direct_read(const char * filename, const char * key,
+			  ffs_ensemble_t ** states, int * nsuccess,
+			  ffs_result_aflux_t * flux);
+
+/**
+ *  \brief Write the index for the branched or Rosenbluth methods
+ *
+ *  \param  filename  the file name
+ *  \param  key       the key
+ *  \param  ntraj     the number of (local) initial trajectories
+ *  \param  status    the status of each trajectory (ffs_trial_enum_t)
+ *  \param  ranstate  the trajectory RNG state for each trajectory
+ *  \param  flux      the (local) flux result
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure (any previous index is untouched)
+ */
+
+int ffs_cache_tree_write(const char * filename, const char * key, int ntraj,
+			 const int * status, const long int * ranstate,
+			 ffs_result_aflux_t * flux);
+
+/**
+ *  \brief Read an index written by ffs_cache_tree_write()
+ *
+ *  \param  filename  the file name
+ *  \param  key       the key, which must match
+ *  \param  ntraj     the number of trajectories, which must match
+ *  \param  status    an array of ntraj to receive the status
+ *  \param  ranstate  an array of ntraj to receive the RNG states
+ *  \param  flux      the flux result to be overwritten
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure
+ */
+
+int ffs_cache_tree_read(const char * filename, const char * key, int ntraj,
+			int * status, long int * ranstate,
+			ffs_result_aflux_t * flux);
+
+/**
+ * \}
+ */
+
+#endif
@@ -0,0 +1,363 @@
+/*****************************************************************************
+ *
+ *  ffs_checkpoint.c
+ *
+ *  Instance checkpoints.
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "u/libu.h"
+#include "ffs_checkpoint.h"
+
+#define FFS_CHECKPOINT_MAGIC   "FFSC"
+#define FFS_CHECKPOINT_VERSION 3
+
+typedef struct ffs_checkpoint_header_s ffs_checkpoint_header_t;
+
+struct ffs_checkpoint_header_s {
+  char magic[4];             /* FFS_CHECKPOINT_MAGIC (no '\0') */
+  int version;               /* FFS_CHECKPOINT_VERSION */
+  int kind;                  /* ffs_checkpoint_enum */
+  int seed;                  /* Instance seed */
+  int nproxy;                /* Number of proxies */
+  int position;              /* Interface (direct) or trajectories (trees) */
+  long long int ncum_trial;  /* Cumulative trials (direct only) */
+};
+
+/* Test only: see ffs_checkpoint_stop_set() */
+
+static int ffs_checkpoint_nstop = 0;    /* Stop after this many (0 never) */
+static int ffs_checkpoint_nwrite = 0;   /* Checkpoints written since set */
+
+static int ffs_checkpoint_save(const char * filename,
+			       ffs_checkpoint_header_t * header,
+			       ffs_ensemble_t * states, ffs_result_t * result,
+			       ffs_result_aflux_t * flux);
+static int ffs_checkpoint_load(const char * filename,
+			       ffs_checkpoint_header_t * header,
+			       ffs_ensemble_t ** states, ffs_result_t * result,
+			       ffs_result_aflux_t * flux);
+
+/*****************************************************************************
+ *
+ *  ffs_checkpoint_filename
+ *
+ *****************************************************************************/
+
+int ffs_checkpoint_filename(int inst_id, int rank, char * filename) {
+
+  dbg_return_if(inst_id < 0, -1);
+  dbg_return_if(rank < 0, -1);
+  dbg_return_if(filename == NULL, -1);
+
+  snprintf(filename, FILENAME_MAX, "inst%4.4d-checkpoint.rank%4.4d",
+	   inst_id, rank);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_checkpoint_handle
+ *
+ *****************************************************************************/
+
+int ffs_checkpoint_handle(int pid, int n, ffs_handle_t * handle) {
+
+  dbg_return_if(pid < 0, -1);
+  dbg_return_if(n < 0, -1);
+  dbg_return_if(handle == NULL, -1);
+
+  return util_handle(FFS_HANDLE_GROUP_CHECKPOINT, 2*pid + n % 2, handle);
+}
+
+/*****************************************************************************
+ *
+ *  ffs_checkpoint_present
+ *
+ *****************************************************************************/
+
+int ffs_checkpoint_present(const char * filename, MPI_Comm comm,
+			   int * present) {
+  int found, nfound;
+  int nrank;
+  FILE * fp = NULL;
+
+  dbg_return_if(filename == NULL, -1);
+  dbg_return_if(present == NULL, -1);
+
+  fp = fopen(filename, "rb");
+  found = (fp != NULL);
+  if (fp) fclose(fp);
+
+  MPI_Comm_size(comm, &nrank);
+  MPI_Allreduce(&found, &nfound, 1, MPI_INT, MPI_SUM, comm);
+
+  dbg_err_ifm(nfound != 0 && nfound != nrank,
+	      "Checkpoint present for %d of %d ranks", nfound, nrank);
+
+  *present = (nfound > 0);
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_checkpoint_write
+ *
+ *****************************************************************************/
+
+int ffs_checkpoint_write(const char * filename, int seed, int nproxy,
+			 int interface, long long int ncum_trial,
+			 ffs_ensemble_t * states, ffs_result_t * result,
+			 ffs_result_aflux_t * flux) {
+
+  ffs_checkpoint_header_t header;
+
+  dbg_return_if(states == NULL, -1);
+
+  memset(&header, 0, sizeof(header));
+  header.kind = FFS_CHECKPOINT_DIRECT;
+  header.seed = seed;
+  header.nproxy = nproxy;
+  header.position = interface;
+  header.ncum_trial = ncum_trial;
+
+  return ffs_checkpoint_save(filename, &header, states, result, flux);
+}
+
+/*****************************************************************************
+ *
+ *  ffs_checkpoint_read
+ *
+ *****************************************************************************/
+
+int ffs_checkpoint_read(const char * filename, int seed, int nproxy,
+			int * interface, long long int * ncum_trial,
+			ffs_ensemble_t ** states, ffs_result_t * result,
+			ffs_result_aflux_t * flux) {
+
+  ffs_checkpoint_header_t header;
+
+  dbg_return_if(interface == NULL, -1);
+  dbg_return_if(ncum_trial == NULL, -1);
+  dbg_return_if(states == NULL, -1);
+
+  memset(&header, 0, sizeof(header));
+  header.kind = FFS_CHECKPOINT_DIRECT;
+  header.seed = seed;
+  header.nproxy = nproxy;
+
+  dbg_err_if(ffs_checkpoint_load(filename, &header, states, result, flux));
+
+  *interface = header.position;
+  *ncum_trial = header.ncum_trial;
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_checkpoint_tree_write
+ *
+ *****************************************************************************/
+
+int ffs_checkpoint_tree_write(const char * filename, int kind, int seed,
+			      int nproxy, int ntraj, ffs_result_t * result,
+			      ffs_result_aflux_t * flux) {
+
+  ffs_checkpoint_header_t header;
+
+  dbg_return_if(kind == FFS_CHECKPOINT_DIRECT, -1);
+
+  memset(&header, 0, sizeof(header));
+  header.kind = kind;
+  header.seed = seed;
+  header.nproxy = nproxy;
+  header.position = ntraj;
+
+  return ffs_checkpoint_save(filename, &header, NULL, result, flux);
+}
+
+/*****************************************************************************
+ *
+ *  ffs_checkpoint_tree_read
+ *
+ *****************************************************************************/
+
+int ffs_checkpoint_tree_read(const char * filename, int kind, int seed,
+			     int nproxy, int * ntraj, ffs_result_t * result,
+			     ffs_result_aflux_t * flux) {
+
+  ffs_checkpoint_header_t header;
+
+  dbg_return_if(kind == FFS_CHECKPOINT_DIRECT, -1);
+  dbg_return_if(ntraj == NULL, -1);
+
+  memset(&header, 0, sizeof(header));
+  header.kind = kind;
+  header.seed = seed;
+  header.nproxy = nproxy;
+
+  dbg_err_if(ffs_checkpoint_load(filename, &header, NULL, result, flux));
+
+  *ntraj = header.position;
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_checkpoint_stop_set
+ *
+ *****************************************************************************/
+
+int ffs_checkpoint_stop_set(int nstop) {
+
+  dbg_return_if(nstop < 0, -1);
+
+  ffs_checkpoint_nstop = nstop;
+  ffs_checkpoint_nwrite = 0;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_checkpoint_stop
+ *
+ *****************************************************************************/
+
+int ffs_checkpoint_stop(void) {
+
+  if (ffs_checkpoint_nstop == 0) return 0;
+
+  return (ffs_checkpoint_nwrite >= ffs_checkpoint_nstop);
+}
+
+/*****************************************************************************
+ *
+ *  ffs_checkpoint_save
+ *
+ *  The header supplies kind, seed, nproxy and the position. The
+ *  ensemble is present only for direct FFS.
+ *
+ *****************************************************************************/
+
+static int ffs_checkpoint_save(const char * filename,
+			       ffs_checkpoint_header_t * header,
+			       ffs_ensemble_t * states, ffs_result_t * result,
+			       ffs_result_aflux_t * flux) {
+  char tmp[FILENAME_MAX];
+  FILE * fp = NULL;
+
+  dbg_return_if(filename == NULL, -1);
+  dbg_return_if(header == NULL, -1);
+  dbg_return_if(result == NULL, -1);
+  dbg_return_if(flux == NULL, -1);
+
+  dbg_return_if(snprintf(tmp, FILENAME_MAX, "%s.tmp", filename)
+		>= FILENAME_MAX, -1);
+
+  memcpy(header->magic, FFS_CHECKPOINT_MAGIC, sizeof(header->magic));
+  header->version = FFS_CHECKPOINT_VERSION;
+
+  fp = fopen(tmp, "wb");
+  dbg_err_ifm(fp == NULL, "fopen(%s) failed", tmp);
+
+  dbg_err_sif(fwrite(header, sizeof(ffs_checkpoint_header_t), 1, fp) != 1);
+  if (states) dbg_err_if(ffs_ensemble_fwrite(states, fp));
+  dbg_err_if(ffs_result_fwrite(result, fp));
+  dbg_err_if(ffs_result_aflux_fwrite(flux, fp));
+
+  dbg_err_sif(fclose(fp));
+  fp = NULL;
+
+  dbg_err_sif(rename(tmp, filename));
+  ffs_checkpoint_nwrite += 1;
+
+  return 0;
+
+ err:
+
+  if (fp) fclose(fp);
+  remove(tmp);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_checkpoint_load
+ *
+ *  The header supplies the expected kind, seed, and nproxy, and
+ *  returns the position. The ensemble is read only if requested.
+ *
+ *****************************************************************************/
+
+static int ffs_checkpoint_load(const char * filename,
+			       ffs_checkpoint_header_t * header,
+			       ffs_ensemble_t ** states, ffs_result_t * result,
+			       ffs_result_aflux_t * flux) {
+  FILE * fp = NULL;
+  ffs_ensemble_t * ensemble = NULL;
+  ffs_checkpoint_header_t file;
+
+  dbg_return_if(filename == NULL, -1);
+  dbg_return_if(header == NULL, -1);
+  dbg_return_if(result == NULL, -1);
+  dbg_return_if(flux == NULL, -1);
+
+  fp = fopen(filename, "rb");
+  dbg_err_ifm(fp == NULL, "fopen(%s) failed", filename);
+
+  dbg_err_if(fread(&file, sizeof(file), 1, fp) != 1);
+  dbg_err_ifm(memcmp(file.magic, FFS_CHECKPOINT_MAGIC, sizeof(file.magic)),
+	      "%s is not a checkpoint", filename);
+  dbg_err_ifm(file.version != FFS_CHECKPOINT_VERSION,
+	      "%s: version %d (expected %d)", filename, file.version,
+	      FFS_CHECKPOINT_VERSION);
+  dbg_err_ifm(file.kind != header->kind,
+	      "%s: kind %d (expected %d)", filename, file.kind, header->kind);
+  dbg_err_ifm(file.seed != header->seed || file.nproxy != header->nproxy,
+	      "%s: seed %d, %d proxies (expected %d, %d)", filename,
+	      file.seed, file.nproxy, header->seed, header->nproxy);
+
+  if (states) dbg_err_if(ffs_ensemble_fread(&ensemble, fp));
+  dbg_err_if(ffs_result_fread(result, fp));
+  dbg_err_if(ffs_result_aflux_fread(flux, fp));
+
+  fclose(fp);
+
+  header->position = file.position;
+  header->ncum_trial = file.ncum_trial;
+  if (states) *states = ensemble;
+
+  return 0;
+
+ err:
+
+  if (fp) fclose(fp);
+  if (ensemble) ffs_ensemble_free(ensemble);
+
+  return -1;
+}
@@ -0,0 +1,209 @@
+/*****************************************************************************
+ *
+ *  ffs_checkpoint.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef FFS_CHECKPOINT_H
+#define FFS_CHECKPOINT_H
+
+#include <mpi.h>
+
+#include "../util/ffs_ensemble.h"
+#include "../util/ffs_util.h"
+#include "ffs_result.h"
+#include "ffs_result_aflux.h"
+
+/**
+ *  \defgroup ffs_checkpoint FFS instance checkpoint
+ *  \ingroup ffs_library
+ *  \{
+ *
+ *    A checkpoint allows an instance to resume after a failure. Each
+ *    rank in the instance has its own file, as the results are held
+ *    per rank until the reduction at the end. The file is binary: a
+ *    header (magic, version, the kind of checkpoint, the instance
+ *    seed and number of proxies), the position reached, the ensemble
+ *    of states, and the local results.
+ *
+ *    A new checkpoint is written to a temporary file which then
+ *    replaces the old one, so that a failure part way through the
+ *    write leaves the previous checkpoint intact.
+ *
+ *    The states themselves are not part of the checkpoint; the caller
+ *    must ensure that they are in the shared directory.
+ *
+ *    For direct FFS the position is the interface reached, and the
+ *    ensemble at that interface is included. For the branched and
+ *    Rosenbluth methods, each tree is grown by one proxy from one
+ *    initial trajectory, so the position is the number of initial
+ *    trajectories completed by the proxy.
+ */
+
+/**
+ *  \brief Kinds of checkpoint
+ */
+
+enum ffs_checkpoint_enum {FFS_CHECKPOINT_DIRECT = 1,
+			  FFS_CHECKPOINT_BRANCHED,
+			  FFS_CHECKPOINT_ROSENBLUTH};
+
+/**
+ *  \brief Form the checkpoint file name for an instance rank
+ *
+ *  \param  inst_id   the instance id
+ *  \param  rank      the rank in the instance communicator
+ *  \param  filename  a buffer of at least FILENAME_MAX
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure
+ */
+
+int ffs_checkpoint_filename(int inst_id, int rank, char * filename);
+
+/**
+ *  \brief Form the handle for a simulation state kept with a checkpoint
+ *
+ *  \param  pid       the proxy id
+ *  \param  n         the checkpoint position
+ *  \param  handle    a pointer to the handle
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure
+ *
+ *  The handle is in group FFS_HANDLE_GROUP_CHECKPOINT. Successive
+ *  positions alternate between two handles, so the state belonging
+ *  to the previous checkpoint survives until the new checkpoint is
+ *  complete.
+ */
+
+int ffs_checkpoint_handle(int pid, int n, ffs_handle_t * handle);
+
+/**
+ *  \brief Are checkpoint files present? (collective)
+ *
+ *  \param  filename  this rank's checkpoint file name
+ *  \param  comm      the ranks which must agree
+ *  \param  present   a pointer to the result (1 for all, 0 for none)
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure, including files for only some ranks
+ */
+
+int ffs_checkpoint_present(const char * filename, MPI_Comm comm,
+			   int * present);
+
+/**
+ *  \brief Write a checkpoint for direct FFS
+ *
+ *  \param  filename    the file name
+ *  \param  seed        the instance seed
+ *  \param  nproxy      the number of proxies in the instance
+ *  \param  interface   the interface at which the ensemble sits
+ *  \param  ncum_trial  the cumulative number of trials so far
+ *  \param  states      the ensemble
+ *  \param  result      the (local) result
+ *  \param  flux        the (local) flux result
+ *
+ *  \retval 0           a success
+ *  \retval -1          a failure (any previous checkpoint is untouched)
+ */
+
+int ffs_checkpoint_write(const char * filename, int seed, int nproxy,
+			 int interface, long long int ncum_trial,
+			 ffs_ensemble_t * states, ffs_result_t * result,
+			 ffs_result_aflux_t * flux);
+
+/**
+ *  \brief Read a checkpoint written by ffs_checkpoint_write()
+ *
+ *  \param  filename    the file name
+ *  \param  seed        the instance seed, which must match
+ *  \param  nproxy      the number of proxies, which must match
+ *  \param  interface   a pointer to the interface to be returned
+ *  \param  ncum_trial  a pointer to the number of trials to be returned
+ *  \param  states      a pointer to the new ensemble to be returned
+ *  \param  result      the result to be overwritten
+ *  \param  flux        the flux result to be overwritten
+ *
+ *  \retval 0           a success
+ *  \retval -1          a failure, including a checkpoint of another run
+ */
+
+int ffs_checkpoint_read(const char * filename, int seed, int nproxy,
+			int * interface, long long int * ncum_trial,
+			ffs_ensemble_t ** states, ffs_result_t * result,
+			ffs_result_aflux_t * flux);
+
+/**
+ *  \brief Write a checkpoint between the trees of branched/Rosenbluth
+ *
+ *  \param  filename    the file name
+ *  \param  kind        FFS_CHECKPOINT_BRANCHED or FFS_CHECKPOINT_ROSENBLUTH
+ *  \param  seed        the instance seed
+ *  \param  nproxy      the number of proxies in the instance
+ *  \param  ntraj       the number of (local) initial trajectories completed
+ *  \param  result      the (local) result
+ *  \param  flux        the (local) flux result
+ *
+ *  \retval 0           a success
+ *  \retval -1          a failure (any previous checkpoint is untouched)
+ */
+
+int ffs_checkpoint_tree_write(const char * filename, int kind, int seed,
+			      int nproxy, int ntraj, ffs_result_t * result,
+			      ffs_result_aflux_t * flux);
+
+/**
+ *  \brief Read a checkpoint written by ffs_checkpoint_tree_write()
+ *
+ *  \param  filename    the file name
+ *  \param  kind        the kind, which must match
+ *  \param  seed        the instance seed, which must match
+ *  \param  nproxy      the number of proxies, which must match
+ *  \param  ntraj       a pointer to the number of trajectories completed
+ *  \param  result      the result to be overwritten
+ *  \param  flux        the flux result to be overwritten
+ *
+ *  \retval 0           a success
+ *  \retval -1          a failure, including a checkpoint of another run
+ */
+
+int ffs_checkpoint_tree_read(const char * filename, int kind, int seed,
+			     int nproxy, int * ntraj, ffs_result_t * result,
+			     ffs_result_aflux_t * flux);
+
+/**
+ *  \brief Stop the run after a number of checkpoints (for testing)
+ *
+ *  \param  nstop       the number of checkpoints (0 to run to the end)
+ *
+ *  \retval 0           a success
+ *  \retval -1          a failure (nstop negative)
+ *
+ *  Once this process has written nstop checkpoints, the methods
+ *  fail as if the run had been killed just after the last one,
+ *  leaving the checkpoint and its states in place to be resumed.
+ *  The count starts again at each call.
+ */
+
+int ffs_checkpoint_stop_set(int nstop);
+
+/**
+ *  \brief Has the number of checkpoints set for a stop been reached?
+ *
+ *  \retval 1           the run should stop
+ *  \retval 0           the run continues
+ */
+
+int ffs_checkpoint_stop(void);
+
+/**
+ * \}
+ */
+
+#endif
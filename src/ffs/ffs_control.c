@@ -248,6 +248,7 @@ int ffs_control_execute(ffs_control_t * obj, const char * configfilename) {
  err:
 
   if (obj->res) ffs_result_summary_free(obj->res);
+  obj->res = NULL;
   if (obj->instance) ffs_inst_free(obj->instance);
   obj->instance = NULL;
   if (ran) ranlcg_free(ran);
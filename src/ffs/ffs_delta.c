@@ -0,0 +1,142 @@
+/*****************************************************************************
+ *
+ *  ffs_delta.c
+ *
+ *  Delta encoding of packed simulation states.
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#include <limits.h>
+#include <string.h>
+
+#include "u/libu.h"
+#include "ffs_delta.h"
+
+typedef struct ffs_delta_run_s ffs_delta_run_t;
+
+struct ffs_delta_run_s {
+  unsigned int offset;      /* Offset of run in state */
+  unsigned int length;      /* Number of bytes in run */
+};
+
+/* A run ends at the first stretch of this many bytes which agree */
+
+#define FFS_DELTA_GAP sizeof(ffs_delta_run_t)
+
+/*****************************************************************************
+ *
+ *  ffs_delta_encode
+ *
+ *  Each run is at least one byte, and is followed by at least
+ *  FFS_DELTA_GAP bytes of agreement (or the end), so the delta can
+ *  be no more than about twice the size of the state. The buffer is
+ *  trimmed to the actual size at the end.
+ *
+ *****************************************************************************/
+
+int ffs_delta_encode(const void * base, const void * buf, size_t nbytes,
+		     void ** delta, size_t * ndelta) {
+
+  size_t n, nsame;
+  size_t nmax, nout = 0;
+  const unsigned char * b0 = base;
+  const unsigned char * b1 = buf;
+  unsigned char * out = NULL;
+  void * tmp = NULL;
+  ffs_delta_run_t run;
+
+  dbg_return_if(base == NULL, -1);
+  dbg_return_if(buf == NULL, -1);
+  dbg_return_if(delta == NULL, -1);
+  dbg_return_if(ndelta == NULL, -1);
+  dbg_return_if(nbytes > UINT_MAX, -1);
+
+  nmax = 2*nbytes + 2*sizeof(ffs_delta_run_t);
+  out = u_malloc(nmax);
+  dbg_err_sif(out == NULL);
+
+  n = 0;
+
+  while (n < nbytes) {
+
+    if (b0[n] == b1[n]) {
+      n += 1;
+      continue;
+    }
+
+    /* Start of a run: extend until FFS_DELTA_GAP bytes agree */
+
+    run.offset = n;
+    nsame = 0;
+
+    for ( ; n < nbytes && nsame < FFS_DELTA_GAP; n++) {
+      nsame = (b0[n] == b1[n]) ? nsame + 1 : 0;
+    }
+
+    run.length = n - nsame - run.offset;
+
+    memcpy(out + nout, &run, sizeof(ffs_delta_run_t));
+    nout += sizeof(ffs_delta_run_t);
+    memcpy(out + nout, b1 + run.offset, run.length);
+    nout += run.length;
+  }
+
+  /* An identical state has an empty delta */
+
+  tmp = u_realloc(out, nout > 0 ? nout : 1);
+  dbg_err_sif(tmp == NULL);
+
+  *delta = tmp;
+  *ndelta = nout;
+
+  return 0;
+
+ err:
+
+  if (out) u_free(out);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_delta_decode
+ *
+ *****************************************************************************/
+
+int ffs_delta_decode(const void * base, size_t nbytes, const void * delta,
+		     size_t ndelta, void * buf) {
+
+  size_t n = 0;
+  const unsigned char * in = delta;
+  unsigned char * out = buf;
+  ffs_delta_run_t run;
+
+  dbg_return_if(base == NULL, -1);
+  dbg_return_if(buf == NULL, -1);
+  dbg_return_if(delta == NULL && ndelta > 0, -1);
+
+  memcpy(out, base, nbytes);
+
+  while (n < ndelta) {
+    dbg_err_if(ndelta - n < sizeof(ffs_delta_run_t));
+    memcpy(&run, in + n, sizeof(ffs_delta_run_t));
+    n += sizeof(ffs_delta_run_t);
+
+    dbg_err_if(run.length > ndelta - n);
+    dbg_err_if(run.offset > nbytes || run.length > nbytes - run.offset);
+
+    memcpy(out + run.offset, in + n, run.length);
+    n += run.length;
+  }
+
+  return 0;
+
+ err:
+
+  return -1;
+}
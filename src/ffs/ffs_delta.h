@@ -0,0 +1,68 @@
+/*****************************************************************************
+ *
+ *  ffs_delta.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef FFS_DELTA_H
+#define FFS_DELTA_H
+
+#include <stddef.h>
+
+/**
+ *  \defgroup ffs_delta FFS state delta encoding
+ *  \ingroup ffs_library
+ *  \{
+ *
+ *    A packed state may be recorded as the difference from another
+ *    packed state of the same size (its base). The delta is a
+ *    sequence of runs, each an offset and a length followed by the
+ *    bytes which replace those of the base. Short stretches of
+ *    agreement between two differences are absorbed into one run,
+ *    as a new run header would cost more than it saves.
+ */
+
+/**
+ *  \brief Encode a packed state as a delta against a base
+ *
+ *  \param  base     the base state
+ *  \param  buf      the state to be encoded
+ *  \param  nbytes   the size of both base and buf
+ *  \param  delta    a pointer to the new delta (to be released by the caller)
+ *  \param  ndelta   a pointer to the size of the delta
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  The delta may be larger than the original; it is for the caller
+ *  to decide whether it is worth keeping.
+ */
+
+int ffs_delta_encode(const void * base, const void * buf, size_t nbytes,
+		     void ** delta, size_t * ndelta);
+
+/**
+ *  \brief Decode a delta against its base
+ *
+ *  \param  base     the base state
+ *  \param  nbytes   the size of the base (and the decoded state)
+ *  \param  delta    the delta
+ *  \param  ndelta   the size of the delta
+ *  \param  buf      a buffer of at least nbytes for the decoded state
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure, including a delta inconsistent with nbytes
+ */
+
+int ffs_delta_decode(const void * base, size_t nbytes, const void * delta,
+		     size_t ndelta, void * buf);
+
+/**
+ * \}
+ */
+
+#endif
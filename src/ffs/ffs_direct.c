@@ -4,17 +4,22 @@
  *
  *****************************************************************************/
 
+#include <stdio.h>
+
 #include "util/ffs_ensemble.h"
+#include "ffs_cache.h"
+#include "ffs_checkpoint.h"
 #include "ffs_direct.h"
 
 static int ffs_direct_init(ffs_state_t * sref, ffs_trial_arg_t * trial,
 			   ffs_ensemble_t * states);
 static int ffs_direct_exec(ffs_state_t * sref, ffs_trial_arg_t * trial);
-static int ffs_direct_advance(ffs_ensemble_t ** old, ffs_trial_arg_t * trial);
+static int ffs_direct_advance(ffs_ensemble_t ** old, ffs_trial_arg_t * trial,
+			      int nfirst, long long int ncum_trial);
 
 static int ffs_direct_trials(ffs_trial_arg_t * trial, int interface,
 			     ffs_ensemble_t * old, ffs_ensemble_t * new,
-			     int * ncum_trial);
+			     long long int * ncum_trial);
 
 static int ffs_direct_delete(ffs_ensemble_t * old, ffs_trial_arg_t * trial,
 			     int interface);
@@ -22,6 +27,26 @@ static int ffs_direct_delete(ffs_ensemble_t * old, ffs_trial_arg_t * trial,
 static int ffs_direct_close_up(ffs_ensemble_t * old, ffs_ensemble_t * new,
 			       ffs_trial_arg_t * trial, int interface);
 
+static int ffs_direct_handover(ffs_trial_arg_t * trial, int interface,
+			       ffs_ensemble_t * old, long long int ncum_trial);
+
+static int ffs_direct_aggregate(ffs_trial_arg_t * trial, int interface,
+				ffs_ensemble_t * old);
+
+static int ffs_direct_checkpoint(ffs_trial_arg_t * trial, int interface,
+				 long long int ncum_trial,
+				 ffs_ensemble_t * states);
+
+static int ffs_direct_resume(ffs_trial_arg_t * trial, int * interface,
+			     long long int * ncum_trial,
+			     ffs_ensemble_t ** states);
+
+static int ffs_direct_cache_load(ffs_trial_arg_t * trial,
+				 ffs_ensemble_t ** states);
+
+static int ffs_direct_cache_save(ffs_trial_arg_t * trial,
+				 ffs_ensemble_t * states);
+
 /*****************************************************************************
  *
  *  ffs_direct_run
@@ -32,7 +57,7 @@ int ffs_direct_run(ffs_trial_arg_t * trial) {
 
   int pid;
   int mpi_errnol = 0;
-  const char * stub = NULL;
+  ffs_handle_t handle;
   ffs_state_t * sref = NULL;
 
   MPI_Comm comm;
@@ -58,10 +83,9 @@ int ffs_direct_run(ffs_trial_arg_t * trial) {
 
   mpi_sync_if_any(mpi_errnol, comm);
 
-  stub = ffs_state_stub(sref);
-  dbg_err_if(stub == NULL);
+  dbg_err_if( ffs_state_handle(sref, &handle) );
 
-  mpi_errnol = proxy_state(trial->proxy, SIM_STATE_INIT, stub);
+  mpi_errnol = proxy_state(trial->proxy, SIM_STATE_INIT, handle);
 
   if (mpi_errnol) {
     mpilog_all(trial->log, "SIM_STATE_INIT (proxy %d) failed\n", pid);
@@ -69,7 +93,7 @@ int ffs_direct_run(ffs_trial_arg_t * trial) {
 
   mpi_sync_if_any(mpi_errnol, comm);
 
-  mpi_errnol = proxy_state(trial->proxy, SIM_STATE_WRITE, stub);
+  mpi_errnol = proxy_state(trial->proxy, SIM_STATE_WRITE, handle);
 
   if (mpi_errnol) {
     mpilog_all(trial->log, "SIM_STATE_WRITE (proxy %d) failed\n", pid);
@@ -85,7 +109,8 @@ int ffs_direct_run(ffs_trial_arg_t * trial) {
    * even if it doesn't, let's have a normal exit so we get to
    * to the results... */
 
-  proxy_state(trial->proxy, SIM_STATE_DELETE, stub);
+  proxy_state(trial->proxy, SIM_STATE_DELETE, handle);
+  proxy_state_reap(trial->proxy, -1);
   proxy_execute(trial->proxy, SIM_EXECUTE_FINISH);
 
   ffs_state_free(sref);
@@ -108,7 +133,10 @@ int ffs_direct_run(ffs_trial_arg_t * trial) {
  *
  *  ffs_direct_delete
  *
- *  Delete the files associated with an interface (first proxy only).
+ *  Retire the states associated with an interface. Each state is
+ *  retired by the proxy which generated it, and the files are then
+ *  deleted in the course of later trials. Any aggregate file for
+ *  the interface is removed at once.
  *
  *****************************************************************************/
 
@@ -117,7 +145,8 @@ static int ffs_direct_delete(ffs_ensemble_t * old, ffs_trial_arg_t * trial,
   int n;
   int pid;
   int mpi_errnol = 0;
-  const char * stub = NULL;
+  ffs_handle_t handle;
+  char prefix[FILENAME_MAX];
 
   MPI_Comm comm;
 
@@ -127,18 +156,37 @@ static int ffs_direct_delete(ffs_ensemble_t * old, ffs_trial_arg_t * trial,
   proxy_id(trial->proxy, &pid);
   proxy_comm(trial->proxy, &comm);
 
-  if (pid == 0) {
-    for (n = 0; n < old->nsuccess; n++) {
-      stub = util_filename_stub(trial->inst_id, interface, old->traj[n]);
-      mpi_errnol = proxy_state(trial->proxy, SIM_STATE_DELETE, stub);
-      dbg_ifm(mpi_errnol, "Failed to remove file %s", stub);
+  for (n = 0; n < old->nsuccess; n++) {
+    dbg_err_if( util_handle(interface, old->traj[n], &handle) );
+    if (old->owner[n] == pid) {
+      mpi_errnol = proxy_state_retire(trial->proxy, handle);
+      dbg_ifm(mpi_errnol, "Failed to retire state %lld", handle);
+    }
+    else {
+      proxy_state_discard(trial->proxy, handle);
     }
   }
 
+  if (trial->nproxy > 1) {
+    snprintf(prefix, FILENAME_MAX, "inst%4.4d-grp%4.4d", trial->inst_id,
+	     interface);
+    mpi_errnol = proxy_state_aggregate_remove(trial->proxy, prefix,
+					      trial->xcomm);
+    dbg_ifm(mpi_errnol, "Failed to remove aggregate %s", prefix);
+  }
+
   /* An error may have occured removing a file, but we should try to
    * continue */
 
   return 0;
+
+ err:
+
+  /* The state ids are the same on all ranks, so all fail together */
+
+  mpilog(trial->log, "Bad state id at interface %d\n", interface);
+
+  return -1;
 }
 
 /*****************************************************************************
@@ -150,6 +198,15 @@ static int ffs_direct_delete(ffs_ensemble_t * old, ffs_trial_arg_t * trial,
  *  the number of successes is greater than the number of states
  *  required, we delete the excess.
  *
+ *  The proxy holding each state is recorded, so that states need
+ *  only be made available to other proxies if they are actually
+ *  required by another proxy (see ffs_direct_handover()).
+ *
+ *  If nskeep is set for the interface, the ensemble is then cut to
+ *  at most nskeep states by weighted subsampling, with the weights
+ *  corrected (see ffs_ensemble_subsample()). All ranks make the same
+ *  choice from a generator seeded for the interface.
+ *
  *****************************************************************************/
 
 static int ffs_direct_close_up(ffs_ensemble_t * old, ffs_ensemble_t * new,
@@ -160,16 +217,23 @@ static int ffs_direct_close_up(ffs_ensemble_t * old, ffs_ensemble_t * new,
   int * displs = NULL;
   int nsuccess;
   int nexcess;
+  int nskeep, ndrop;
   int pid;
   int n, ntmp;
 
-  const char * stub = NULL;
+  ffs_handle_t handle;
+  ranlcg_t * ran = NULL;
 
   dbg_return_if(old == NULL, -1);
   dbg_return_if(new == NULL, -1);
 
   dbg_err_if( proxy_id(trial->proxy, &pid) );
 
+  /* Any background writes of these states must be complete before
+   * they are made known to the other proxies */
+
+  dbg_err_if( proxy_state_flush(trial->proxy) );
+
   /* Form the global list of successful trials from the (local) old ensemble */
 
   list_nsuccess = u_calloc(trial->nproxy, sizeof(int));
@@ -186,40 +250,66 @@ static int ffs_direct_close_up(ffs_ensemble_t * old, ffs_ensemble_t * new,
   displs = u_calloc(trial->nproxy, sizeof(int));
   dbg_err_if(displs == NULL);
   dbg_err_if( ffs_ensemble_create(nsuccess, &list) );
+  list->nsuccess = nsuccess;
 
   displs[0] = 0;
   for (n = 1; n < trial->nproxy; n++) {
     displs[n] = displs[n-1] + list_nsuccess[n-1];
   }
 
-  MPI_Allgatherv(old->traj, old->nsuccess, MPI_INT,
-		 list->traj, list_nsuccess, displs, MPI_INT, trial->xcomm);
+  MPI_Allgatherv(old->traj, old->nsuccess, MPI_LONG_LONG,
+		 list->traj, list_nsuccess, displs, MPI_LONG_LONG, trial->xcomm);
 
   MPI_Allgatherv(old->wt, old->nsuccess, MPI_DOUBLE,
 		 list->wt, list_nsuccess, displs, MPI_DOUBLE, trial->xcomm);
 
-  /* Delete excess. Only one proxy is required to delete the files, but
-   * all instance ranks delete their record of the state. */
+  for (n = 0; n < trial->nproxy; n++) {
+    for (ntmp = displs[n]; ntmp < displs[n] + list_nsuccess[n]; ntmp++) {
+      list->owner[ntmp] = n;
+    }
+  }
+
+  /* Delete excess. Only the owning proxy is required to delete the
+   * files, but all instance ranks delete their record of the state. */
 
   nexcess = nsuccess - new->nmax;
 
   for (n = 0; n < nexcess; n += 1) {
     ntmp = n*(nsuccess/nexcess);
-    if (pid == 0) {
-      stub = util_filename_stub(trial->inst_id, interface, list->traj[ntmp]);
-      proxy_state(trial->proxy, SIM_STATE_DELETE, stub);
+    if (pid == list->owner[ntmp]) {
+      dbg_err_if( util_handle(interface, list->traj[ntmp], &handle) );
+      proxy_state_retire(trial->proxy, handle);
     }
     /* These are skipped in the next loop */
     list->traj[ntmp] = -1;
   }
 
-  new->nsuccess = 0;
-  for (n = 0; n < nsuccess; n++) {
-    if (list->traj[n] != -1) {
-      new->traj[new->nsuccess] = list->traj[n];
-      new->wt[new->nsuccess] = list->traj[n];
-      new->nsuccess += 1;
+  dbg_err_if( ffs_ensemble_compact(list, new) );
+
+  /* Initial states are of equal weight */
+
+  if (interface == 1) {
+    for (n = 0; n < new->nsuccess; n++) {
+      new->wt[n] = 1.0;
+    }
+  }
+
+  dbg_err_if( ffs_param_nskeep(trial->param, interface, &nskeep) );
+
+  if (nskeep > 0 && new->nsuccess > nskeep) {
+    dbg_err_if( ranlcg_create(trial->inst_seed + interface, &ran) );
+    dbg_err_if( ffs_ensemble_subsample(new, nskeep, ran, &ndrop) );
+
+    for (n = new->nsuccess; n < new->nsuccess + ndrop; n++) {
+      if (pid != new->owner[n]) continue;
+      dbg_err_if( util_handle(interface, new->traj[n], &handle) );
+      proxy_state_retire(trial->proxy, handle);
     }
+
+    mpilog(trial->log, "Kept %d of %d states at interface %d (nskeep %d)\n",
+	   new->nsuccess, new->nsuccess + ndrop, interface, nskeep);
+    ranlcg_free(ran);
+    ran = NULL;
   }
 
   u_free(displs);
@@ -232,6 +322,7 @@ static int ffs_direct_close_up(ffs_ensemble_t * old, ffs_ensemble_t * new,
 
   mpilog(trial->log, "Problem in closing up states (maybe deadlock!)\n");
 
+  if (ran) ranlcg_free(ran);
   if (displs) u_free(displs);
   if (list_nsuccess) u_free(list_nsuccess);
   if (list) ffs_ensemble_free(list);
@@ -247,29 +338,61 @@ static int ffs_direct_close_up(ffs_ensemble_t * old, ffs_ensemble_t * new,
 
 static int ffs_direct_exec(ffs_state_t * sref, ffs_trial_arg_t * trial) {
 
-  int n, nstate;
+  int nstate;
+  int rank;
+  int nfirst = 1;
+  long long int ncum_trial = 0;
+  char filename[FILENAME_MAX];
   ffs_ensemble_t * states = NULL;
 
   dbg_return_if(sref == NULL, -1);
   dbg_return_if(trial == NULL, -1);
 
-  /* Set up the initial (global) ensemble, and then run. */
+  /* Pick up from a checkpoint, if requested and present */
 
-  dbg_err_if( ffs_param_nstate(trial->param, 1, &nstate));
-  dbg_err_if( ffs_ensemble_create(nstate, &states) );
+  if (trial->resume) {
+    dbg_err_if( ffs_direct_resume(trial, &nfirst, &ncum_trial, &states) );
+  }
 
-  mpilog(trial->log, "Generating %d initial direct states\n", nstate);
-  dbg_err_if( ffs_direct_init(sref, trial, states) );
+  /* Otherwise, set up the initial (global) ensemble, from the cache
+   * if possible, and then run. */
 
-  for (n = 0; n < states->nsuccess; n++) {
-    states->wt[n] = 1.0;
+  if (states == NULL && trial->cache_key) {
+    dbg_err_if( ffs_direct_cache_load(trial, &states) );
+    if (states && trial->checkpoint) {
+      dbg_err_if( ffs_direct_checkpoint(trial, 1, ncum_trial, states) );
+    }
+  }
+
+  if (states == NULL) {
+    dbg_err_if( ffs_param_nstate(trial->param, 1, &nstate));
+    dbg_err_if( ffs_ensemble_create(nstate, &states) );
+
+    mpilog(trial->log, "Generating %d initial direct states\n", nstate);
+    dbg_err_if( ffs_direct_init(sref, trial, states) );
+
+    if (trial->cache_key) {
+      dbg_err_if( ffs_direct_cache_save(trial, states) );
+    }
+
+    if (trial->checkpoint) {
+      dbg_err_if( ffs_direct_checkpoint(trial, 1, ncum_trial, states) );
+    }
   }
 
   mpilog(trial->log, "Advancing states\n");
 
-  dbg_err_if( ffs_direct_advance(&states, trial) );
+  dbg_err_if( ffs_direct_advance(&states, trial, nfirst, ncum_trial) );
   ffs_ensemble_free(states);
 
+  /* The run is complete, so any checkpoint is no longer wanted */
+
+  if (trial->checkpoint || trial->resume) {
+    MPI_Comm_rank(trial->inst_comm, &rank);
+    dbg_err_if( ffs_checkpoint_filename(trial->inst_id, rank, filename) );
+    remove(filename);
+  }
+
   return 0;
 
  err:
@@ -296,7 +419,7 @@ static int ffs_direct_init(ffs_state_t * sref, ffs_trial_arg_t * trial,
   int itraj;
   int status;
   long int lseed;
-  const char * stub = NULL;
+  ffs_handle_t handle;
 
   ranlcg_t * ran = NULL;
   ffs_ensemble_t * list_local = NULL;
@@ -333,14 +456,14 @@ static int ffs_direct_init(ffs_state_t * sref, ffs_trial_arg_t * trial,
     /* Record state (interface = 1) */
 
     list_local->traj[list_local->nsuccess] = itraj;
-    stub = util_filename_stub(trial->inst_id, interface, itraj);
-    proxy_state(trial->proxy, SIM_STATE_WRITE, stub);
+    dbg_err_if( util_handle(interface, itraj, &handle) );
+    proxy_state(trial->proxy, SIM_STATE_WRITE, handle);
 
     ffs_result_trial_success_add(trial->result, 1);
     list_local->nsuccess += 1;
   }
 
-  ffs_direct_close_up(list_local, states, trial, interface);
+  dbg_err_if( ffs_direct_close_up(list_local, states, trial, interface) );
   ffs_result_nkeep_set(trial->result, 1, states->nsuccess);
 
   ranlcg_free(ran);
@@ -363,18 +486,22 @@ static int ffs_direct_init(ffs_state_t * sref, ffs_trial_arg_t * trial,
  *
  *****************************************************************************/
 
-static int ffs_direct_advance(ffs_ensemble_t ** old, ffs_trial_arg_t * trial) {
+static int ffs_direct_advance(ffs_ensemble_t ** old, ffs_trial_arg_t * trial,
+			      int nfirst, long long int ncum_trial) {
 
   int n, nlambda, nstate;
-  int ncum_trial = 0;          /* Cummulative number of trials (global) */
   ffs_ensemble_t * new = NULL;
 
   dbg_return_if(old == NULL, -1);
   dbg_return_if(trial == NULL, -1);
+  dbg_return_if(nfirst < 1, -1);
 
   dbg_err_if( ffs_param_nlambda(trial->param, &nlambda) );
 
-  for (n = 1; n < nlambda; n++) {
+  /* ncum_trial is the cumulative number of trials (global) made
+   * before interface nfirst */
+
+  for (n = nfirst; n < nlambda; n++) {
 
     /* If there are no states, leave the loop, otherwise continue */
 
@@ -392,13 +519,26 @@ static int ffs_direct_advance(ffs_ensemble_t ** old, ffs_trial_arg_t * trial) {
 
     dbg_err_if( ffs_direct_trials(trial, n, *old, new, &ncum_trial) );
 
+    /* The old states are only removed once the new checkpoint is
+     * complete on all ranks */
+
+    if (trial->checkpoint) {
+      dbg_err_if( ffs_direct_checkpoint(trial, n+1, ncum_trial, new) );
+    }
+
     /* Remove old states and the old ensemble structure; update the
      * ensemble pointers for the next step, or at the end we exit
      * with the final ensemble being "old" to be returned. */
 
-    ffs_direct_delete(*old, trial, n);
+    dbg_err_if( ffs_direct_delete(*old, trial, n) );
+    ffs_trial_reaper_report(trial);
     ffs_ensemble_free(*old);
     *old = new; new = NULL;
+
+    if (trial->checkpoint && ffs_checkpoint_stop()) {
+      mpilog(trial->log, "Stopping after checkpoint (as requested)\n");
+      goto err;
+    }
   }
 
   return 0;
@@ -416,19 +556,22 @@ static int ffs_direct_advance(ffs_ensemble_t ** old, ffs_trial_arg_t * trial) {
 
 static int ffs_direct_trials(ffs_trial_arg_t * trial, int interface,
 			     ffs_ensemble_t * old, ffs_ensemble_t * new,
-			     int * ncum_trial) {
+			     long long int * ncum_trial) {
 
   int n, ntrial, ntrial_local;
-  int itraj, irun;
+  int irun, inext;
+  long long int itraj;
   int pid, nstart;
+  int mpiio = 0;
   int status;
   int seed;
   long int lseed;
   double wt;
   double lambda_min, lambda_max;
 
-  const char * stub = NULL;
+  ffs_handle_t handle;
   ranlcg_t * ran = NULL;
+  ranlcg_t * ran_next = NULL;
   ffs_ensemble_t * list_local = NULL;
 
   dbg_return_if(trial == NULL, -1);
@@ -448,8 +591,19 @@ static int ffs_direct_trials(ffs_trial_arg_t * trial, int interface,
   nstart = pid*ntrial_local;
   dbg_err_if( ffs_ensemble_create(ntrial_local, &list_local) );
 
+  if (trial->nproxy > 1) {
+    dbg_err_if( proxy_state_mpiio(trial->proxy, &mpiio) );
+    if (mpiio) {
+      dbg_err_if( ffs_direct_aggregate(trial, interface, old) );
+    }
+    else {
+      dbg_err_if( ffs_direct_handover(trial, interface, old, *ncum_trial) );
+    }
+  }
+
   lseed = trial->inst_seed;
   ranlcg_create(lseed, &ran);
+  ranlcg_create(lseed, &ran_next);
 
   for (n = 0; n < ntrial_local; n++) {
 
@@ -461,8 +615,21 @@ static int ffs_direct_trials(ffs_trial_arg_t * trial, int interface,
 
     dbg_err_if(ffs_ensemble_samplewt(old, ran, &irun));
     dbg_err_if(irun >= old->nsuccess);
-    stub = util_filename_stub(trial->inst_id, interface, old->traj[irun]);
-    dbg_err_if( proxy_state(trial->proxy, SIM_STATE_READ, stub) );
+    dbg_err_if( util_handle(interface, old->traj[irun], &handle) );
+    dbg_err_if( proxy_state(trial->proxy, SIM_STATE_READ, handle) );
+
+    /* The parent for the next trial depends only on its trajectory
+     * seed, so it can be chosen now (with a separate generator, to
+     * leave this trial's sequence alone) and read while this trial
+     * runs. */
+
+    if (n + 1 < ntrial_local) {
+      ranlcg_state_set(ran_next, lseed + 1);
+      dbg_err_if(ffs_ensemble_samplewt(old, ran_next, &inext));
+      dbg_err_if(inext >= old->nsuccess);
+      dbg_err_if( util_handle(interface, old->traj[inext], &handle) );
+      dbg_err_if( proxy_state_prefetch(trial->proxy, handle) );
+    }
 
     /* Inject a seed into the simulation */
 
@@ -486,8 +653,8 @@ static int ffs_direct_trials(ffs_trial_arg_t * trial, int interface,
 
     list_local->traj[list_local->nsuccess] = itraj;
     list_local->wt[list_local->nsuccess] = wt;
-    stub = util_filename_stub(trial->inst_id, interface + 1, itraj);
-    dbg_err_if(proxy_state(trial->proxy, SIM_STATE_WRITE, stub));
+    dbg_err_if(util_handle(interface + 1, itraj, &handle));
+    dbg_err_if(proxy_state(trial->proxy, SIM_STATE_WRITE, handle));
 
     ffs_result_trial_success_add(trial->result, interface + 1);
     ffs_result_weight_accum(trial->result, interface + 1, wt);
@@ -497,6 +664,7 @@ static int ffs_direct_trials(ffs_trial_arg_t * trial, int interface,
   dbg_err_if( ffs_direct_close_up(list_local, new, trial, interface + 1) );
   ffs_result_nkeep_set(trial->result, interface + 1, new->nsuccess);
 
+  ranlcg_free(ran_next);
   ranlcg_free(ran);
   ffs_ensemble_free(list_local);
 
@@ -509,6 +677,445 @@ static int ffs_direct_trials(ffs_trial_arg_t * trial, int interface,
   return -1;
 }
 
+/*****************************************************************************
+ *
+ *  ffs_direct_handover
+ *
+ *  States are held locally by the proxy which generated them, e.g.,
+ *  in memory or in node-local scratch, and so are invisible to other
+ *  proxies. The choice of parent state for every trial is determined
+ *  by the trajectory seed alone, so each proxy can repeat the choice
+ *  for all trials (not just its own) and work out which states must
+ *  move between which proxies.
+ *
+ *  If the proxy supports it, states are sent directly to the proxies
+ *  which need them in the cross communicator (rank is proxy id), and
+ *  the file system is not involved. Otherwise, the owner publishes
+ *  the state, and the barrier ensures the shared copies exist before
+ *  any reads.
+ *
+ *****************************************************************************/
+
+static int ffs_direct_handover(ffs_trial_arg_t * trial, int interface,
+			       ffs_ensemble_t * old, long long int ncum_trial) {
+
+  int n, ntrial, ntrial_local;
+  int irun;
+  long long int itraj;
+  int pid, owner, reader;
+  int mpi = 0;
+  int nreq = 0;
+  long int lseed;
+
+  ffs_handle_t handle;
+  char * moved = NULL;
+  MPI_Request * req = NULL;
+  MPI_Status * status = NULL;
+  ranlcg_t * ran = NULL;
+
+  dbg_return_if(trial == NULL, -1);
+  dbg_return_if(old == NULL, -1);
+
+  dbg_err_if( proxy_id(trial->proxy, &pid) );
+  dbg_err_if( proxy_state_mpi(trial->proxy, &mpi) );
+  dbg_err_if( ffs_param_ntrial(trial->param, interface, &ntrial) );
+
+  ntrial_local = ntrial / trial->nproxy;
+
+  /* Each state need move to a given proxy only once */
+
+  moved = u_calloc(old->nsuccess*trial->nproxy + 1, sizeof(char));
+  dbg_err_sif(moved == NULL);
+
+  if (mpi) {
+    req = u_calloc(ntrial + 1, sizeof(MPI_Request));
+    status = u_calloc(ntrial + 1, sizeof(MPI_Status));
+    dbg_err_sif(req == NULL);
+    dbg_err_sif(status == NULL);
+  }
+
+  lseed = trial->inst_seed;
+  ranlcg_create(lseed, &ran);
+
+  for (n = 0; n < ntrial; n++) {
+
+    /* Must be the same sequence as ffs_direct_trials() */
+
+    reader = n / ntrial_local;
+    itraj = 1 + n + ncum_trial;
+    lseed = trial->inst_seed + itraj - 1;
+    ranlcg_state_set(ran, lseed);
+
+    dbg_err_if(ffs_ensemble_samplewt(old, ran, &irun));
+    dbg_err_if(irun >= old->nsuccess);
+
+    owner = old->owner[irun];
+    if (owner == reader) continue;
+    if (moved[irun*trial->nproxy + reader]) continue;
+    moved[irun*trial->nproxy + reader] = 1;
+
+    if (owner != pid && (mpi == 0 || reader != pid)) continue;
+
+    /* Sends are non-blocking, so the receives may be posted in the
+     * same order without deadlock. */
+
+    dbg_err_if( util_handle(interface, old->traj[irun], &handle) );
+
+    if (mpi == 0) {
+      dbg_err_if( proxy_state_publish(trial->proxy, handle) );
+    }
+    else if (owner == pid) {
+      dbg_err_if( proxy_state_isend(trial->proxy, handle, reader, trial->xcomm,
+				    req + nreq) );
+      nreq += 1;
+    }
+    else {
+      dbg_err_if( proxy_state_recv(trial->proxy, handle, owner,
+				   trial->xcomm) );
+    }
+  }
+
+  if (mpi) {
+    MPI_Waitall(nreq, req, status);
+    u_free(status);
+    u_free(req);
+  }
+  else {
+    MPI_Barrier(trial->xcomm);
+  }
+
+  ranlcg_free(ran);
+  u_free(moved);
+
+  return 0;
+
+ err:
+
+  if (status) u_free(status);
+  if (req) u_free(req);
+  if (moved) u_free(moved);
+  if (ran) ranlcg_free(ran);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_direct_aggregate
+ *
+ *  An alternative to ffs_direct_handover(): every state at the
+ *  interface is written, by one collective operation, to a single
+ *  MPI-IO file (per proxy rank), from which any proxy may read any
+ *  state. This is one file per interface, whatever the number of
+ *  states or proxies.
+ *
+ *****************************************************************************/
+
+static int ffs_direct_aggregate(ffs_trial_arg_t * trial, int interface,
+				ffs_ensemble_t * old) {
+  int n;
+  int pid;
+  int nstate = 0;
+  ffs_handle_t * handle = NULL;
+  char prefix[FILENAME_MAX];
+
+  dbg_return_if(trial == NULL, -1);
+  dbg_return_if(old == NULL, -1);
+
+  dbg_err_if( proxy_id(trial->proxy, &pid) );
+
+  handle = u_calloc(old->nsuccess + 1, sizeof(ffs_handle_t));
+  dbg_err_sif(handle == NULL);
+
+  for (n = 0; n < old->nsuccess; n++) {
+    if (old->owner[n] != pid) continue;
+    dbg_err_if( util_handle(interface, old->traj[n], handle + nstate) );
+    nstate += 1;
+  }
+
+  snprintf(prefix, FILENAME_MAX, "inst%4.4d-grp%4.4d", trial->inst_id,
+	   interface);
+  dbg_err_if( proxy_state_aggregate(trial->proxy, prefix, nstate, handle,
+				    trial->xcomm) );
+
+  u_free(handle);
+
+  return 0;
+
+ err:
+
+  mpilog(trial->log, "Failed to aggregate states at interface %d\n",
+	 interface);
+
+  if (handle) u_free(handle);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_direct_checkpoint
+ *
+ *  Each rank records the ensemble at the given interface, and its
+ *  results so far. The states of the ensemble must survive the run,
+ *  so any held only in memory, or in scratch, are published first.
+ *
+ *****************************************************************************/
+
+static int ffs_direct_checkpoint(ffs_trial_arg_t * trial, int interface,
+				 long long int ncum_trial,
+				 ffs_ensemble_t * states) {
+  int n;
+  int pid, rank;
+  int ifail = 0;
+  char filename[FILENAME_MAX];
+  ffs_handle_t handle;
+
+  dbg_return_if(trial == NULL, -1);
+  dbg_return_if(states == NULL, -1);
+
+  dbg_err_if( proxy_id(trial->proxy, &pid) );
+  MPI_Comm_rank(trial->inst_comm, &rank);
+
+  for (n = 0; n < states->nsuccess; n++) {
+    if (states->owner[n] != pid) continue;
+    ifail += util_handle(interface, states->traj[n], &handle);
+    if (ifail == 0) ifail += proxy_state_publish(trial->proxy, handle);
+  }
+
+  ifail += proxy_state_flush(trial->proxy);
+  ifail += ffs_checkpoint_filename(trial->inst_id, rank, filename);
+
+  if (ifail == 0) {
+    ifail = ffs_checkpoint_write(filename, trial->inst_seed, trial->nproxy,
+				 interface, ncum_trial, states, trial->result,
+				 trial->flux);
+  }
+
+  mpi_err_if_any(ifail, trial->inst_comm);
+
+  mpilog(trial->log, "Checkpoint written at interface %2d\n", interface);
+
+  return 0;
+
+ err:
+
+  mpilog(trial->log, "Failed to write checkpoint at interface %d\n",
+	 interface);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_direct_resume
+ *
+ *  If every rank has a checkpoint, return the ensemble and position
+ *  recorded, and restore the results. If no rank has a checkpoint,
+ *  the ensemble returned is NULL and the run starts afresh. Anything
+ *  in between is an error.
+ *
+ *****************************************************************************/
+
+static int ffs_direct_resume(ffs_trial_arg_t * trial, int * interface,
+			     long long int * ncum_trial,
+			     ffs_ensemble_t ** states) {
+  int n;
+  int pid, rank;
+  int present;
+  int ifail = 0;
+  int nread = 0, nmin, nmax;
+  char filename[FILENAME_MAX];
+  ffs_handle_t handle;
+  ffs_ensemble_t * ensemble = NULL;
+
+  dbg_return_if(trial == NULL, -1);
+  dbg_return_if(interface == NULL, -1);
+  dbg_return_if(ncum_trial == NULL, -1);
+  dbg_return_if(states == NULL, -1);
+
+  *states = NULL;
+
+  dbg_err_if( proxy_id(trial->proxy, &pid) );
+  MPI_Comm_rank(trial->inst_comm, &rank);
+  dbg_err_if( ffs_checkpoint_filename(trial->inst_id, rank, filename) );
+  dbg_err_if( ffs_checkpoint_present(filename, trial->inst_comm, &present) );
+
+  if (present == 0) {
+    mpilog(trial->log, "No checkpoint to resume from; starting afresh\n");
+    return 0;
+  }
+
+  ifail = ffs_checkpoint_read(filename, trial->inst_seed, trial->nproxy,
+			      &nread, ncum_trial, &ensemble, trial->result,
+			      trial->flux);
+  mpi_err_if_any(ifail, trial->inst_comm);
+
+  /* A failure between the ranks' writes may leave them out of step */
+
+  MPI_Allreduce(&nread, &nmin, 1, MPI_INT, MPI_MIN, trial->inst_comm);
+  MPI_Allreduce(&nread, &nmax, 1, MPI_INT, MPI_MAX, trial->inst_comm);
+  mpilog_err_if(nmin != nmax, trial->log,
+		"Checkpoints disagree (interfaces %d to %d)\n", nmin, nmax);
+
+  for (n = 0; n < ensemble->nsuccess; n++) {
+    if (ensemble->owner[n] != pid) continue;
+    ifail += util_handle(nread, ensemble->traj[n], &handle);
+    if (ifail == 0) ifail += proxy_state_adopt(trial->proxy, handle);
+  }
+  mpi_err_if_any(ifail, trial->inst_comm);
+
+  mpilog(trial->log, "Resuming from checkpoint at interface %d\n", nread);
+
+  *interface = nread;
+  *states = ensemble;
+
+  return 0;
+
+ err:
+
+  mpilog(trial->log, "Failed to resume from checkpoint\n");
+  if (ensemble) ffs_ensemble_free(ensemble);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_direct_cache_load
+ *
+ *  If there is a match in the cache, each proxy copies the states it
+ *  owns from the cache, and the results at the first interface are
+ *  restored. Otherwise the ensemble returned is NULL.
+ *
+ *****************************************************************************/
+
+static int ffs_direct_cache_load(ffs_trial_arg_t * trial,
+				 ffs_ensemble_t ** states) {
+  int n;
+  int pid, rank;
+  int valid;
+  int nsuccess = 0;
+  int ifail = 0;
+  char filename[FILENAME_MAX];
+  ffs_handle_t handle;
+  ffs_handle_t cached;
+  ffs_ensemble_t * ensemble = NULL;
+
+  dbg_return_if(trial == NULL, -1);
+  dbg_return_if(trial->cache_key == NULL, -1);
+  dbg_return_if(states == NULL, -1);
+
+  *states = NULL;
+
+  dbg_err_if( proxy_id(trial->proxy, &pid) );
+  MPI_Comm_rank(trial->inst_comm, &rank);
+  dbg_err_if( ffs_cache_filename(trial->cache_key, rank, filename) );
+  dbg_err_if( ffs_cache_valid(filename, FFS_CACHE_DIRECT, trial->cache_key,
+			      trial->inst_comm, &valid) );
+
+  if (valid == 0) {
+    mpilog(trial->log, "No initial state cache (%s)\n", filename);
+    return 0;
+  }
+
+  ifail = ffs_cache_direct_read(filename, trial->cache_key, &ensemble,
+				&nsuccess, trial->flux);
+  mpi_err_if_any(ifail, trial->inst_comm);
+
+  for (n = 0; n < ensemble->nsuccess; n++) {
+    if (ensemble->owner[n] != pid) continue;
+    ifail += util_handle(FFS_HANDLE_GROUP_CACHE, ensemble->traj[n], &cached);
+    ifail += util_handle(1, ensemble->traj[n], &handle);
+    if (ifail) break;
+    ifail += proxy_state(trial->proxy, SIM_STATE_READ, cached);
+    ifail += proxy_state(trial->proxy, SIM_STATE_WRITE, handle);
+  }
+  mpi_err_if_any(ifail, trial->inst_comm);
+
+  for (n = 0; n < nsuccess; n++) {
+    ffs_result_trial_success_add(trial->result, 1);
+  }
+  ffs_result_nkeep_set(trial->result, 1, ensemble->nsuccess);
+
+  mpilog(trial->log, "Taken %d initial direct states from cache (%s)\n",
+	 ensemble->nsuccess, filename);
+
+  *states = ensemble;
+
+  return 0;
+
+ err:
+
+  mpilog(trial->log, "Failed to read initial state cache\n");
+  if (ensemble) ffs_ensemble_free(ensemble);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_direct_cache_save
+ *
+ *  Each proxy copies the states it owns to the cache, and gives up
+ *  the copies, which must outlive the run. Each rank then records
+ *  the ensemble and its results at the first interface.
+ *
+ *****************************************************************************/
+
+static int ffs_direct_cache_save(ffs_trial_arg_t * trial,
+				 ffs_ensemble_t * states) {
+  int n;
+  int pid, rank;
+  int nsuccess = 0;
+  int ifail = 0;
+  char filename[FILENAME_MAX];
+  ffs_handle_t handle;
+  ffs_handle_t cached;
+
+  dbg_return_if(trial == NULL, -1);
+  dbg_return_if(trial->cache_key == NULL, -1);
+  dbg_return_if(states == NULL, -1);
+
+  dbg_err_if( proxy_id(trial->proxy, &pid) );
+  MPI_Comm_rank(trial->inst_comm, &rank);
+
+  for (n = 0; n < states->nsuccess; n++) {
+    if (states->owner[n] != pid) continue;
+    ifail += util_handle(1, states->traj[n], &handle);
+    ifail += util_handle(FFS_HANDLE_GROUP_CACHE, states->traj[n], &cached);
+    if (ifail) break;
+    ifail += proxy_state(trial->proxy, SIM_STATE_READ, handle);
+    ifail += proxy_state(trial->proxy, SIM_STATE_WRITE, cached);
+    ifail += proxy_state_publish(trial->proxy, cached);
+  }
+
+  for (n = 0; n < states->nsuccess; n++) {
+    if (states->owner[n] != pid) continue;
+    ifail += util_handle(FFS_HANDLE_GROUP_CACHE, states->traj[n], &cached);
+    ifail += proxy_state_release(trial->proxy, cached);
+  }
+
+  ifail += ffs_result_trial_success(trial->result, 1, &nsuccess);
+  ifail += ffs_cache_filename(trial->cache_key, rank, filename);
+
+  if (ifail == 0) {
+    ifail = ffs_cache_direct_write(filename, trial->cache_key, states,
+				   nsuccess, trial->flux);
+  }
+
+  mpi_err_if_any(ifail, trial->inst_comm);
+
+  mpilog(trial->log, "Initial states kept in cache (%s)\n", filename);
+
+  return 0;
+
+ err:
+
+  mpilog(trial->log, "Failed to write initial state cache\n");
+
+  return -1;
+}
 
 /*****************************************************************************
  *
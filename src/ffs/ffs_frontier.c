@@ -0,0 +1,148 @@
+/*****************************************************************************
+ *
+ *  ffs_frontier.c
+ *
+ *  The frontier is a fixed array of frames used as a stack.
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *
+ *****************************************************************************/
+
+#include <string.h>
+
+#include "u/libu.h"
+#include "ffs_frontier.h"
+
+struct ffs_frontier_s {
+  int nmax;                /* Capacity */
+  int depth;               /* Number of frames held */
+  ffs_frame_t * frame;     /* Frames, bottom first */
+};
+
+/*****************************************************************************
+ *
+ *  ffs_frontier_create
+ *
+ *****************************************************************************/
+
+int ffs_frontier_create(int nmax, ffs_frontier_t ** pobj) {
+
+  ffs_frontier_t * obj = NULL;
+
+  dbg_return_if(nmax < 1, -1);
+  dbg_return_if(pobj == NULL, -1);
+
+  obj = u_calloc(1, sizeof(ffs_frontier_t));
+  dbg_err_sif(obj == NULL);
+
+  obj->nmax = nmax;
+  obj->frame = u_calloc(nmax, sizeof(ffs_frame_t));
+  dbg_err_sif(obj->frame == NULL);
+
+  *pobj = obj;
+
+  return 0;
+
+ err:
+
+  if (obj) ffs_frontier_free(obj);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_frontier_free
+ *
+ *****************************************************************************/
+
+void ffs_frontier_free(ffs_frontier_t * obj) {
+
+  dbg_return_if(obj == NULL, );
+
+  if (obj->frame) u_free(obj->frame);
+  u_free(obj);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_frontier_push
+ *
+ *****************************************************************************/
+
+int ffs_frontier_push(ffs_frontier_t * obj, int interface, int id, double wt,
+		      ffs_frame_t ** pframe) {
+
+  ffs_frame_t * frame = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(pframe == NULL, -1);
+  dbg_return_if(obj->depth >= obj->nmax, -1);
+
+  frame = obj->frame + obj->depth;
+  memset(frame, 0, sizeof(ffs_frame_t));
+
+  frame->interface = interface;
+  frame->id = id;
+  frame->idnext = id;
+  frame->wt = wt;
+
+  obj->depth += 1;
+  *pframe = frame;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_frontier_top
+ *
+ *****************************************************************************/
+
+int ffs_frontier_top(ffs_frontier_t * obj, ffs_frame_t ** pframe) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(pframe == NULL, -1);
+
+  if (obj->depth == 0) return -1;
+
+  *pframe = obj->frame + obj->depth - 1;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_frontier_pop
+ *
+ *****************************************************************************/
+
+int ffs_frontier_pop(ffs_frontier_t * obj) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  if (obj->depth == 0) return -1;
+
+  obj->depth -= 1;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_frontier_depth
+ *
+ *****************************************************************************/
+
+int ffs_frontier_depth(ffs_frontier_t * obj, int * depth) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(depth == NULL, -1);
+
+  *depth = obj->depth;
+
+  return 0;
+}
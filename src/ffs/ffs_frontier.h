@@ -0,0 +1,139 @@
+/*****************************************************************************
+ *
+ *  ffs_frontier.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef FFS_FRONTIER_H
+#define FFS_FRONTIER_H
+
+/**
+ *  \defgroup ffs_frontier FFS tree frontier
+ *  \ingroup ffs_library
+ *  \{
+ *
+ *    The branched and Rosenbluth methods grow a tree of trials
+ *    depth first from each state at the first interface. The frontier
+ *    is the stack of states from which further trials are still to be
+ *    made (or which are still to be released), the deepest on top.
+ *    It is held explicitly, rather than on the C stack, so that the
+ *    position in a tree is visible to the caller.
+ *
+ *    There is at most one frame per interface, so the depth is fixed
+ *    at creation. The frontier is local to one rank.
+ *
+ *    The frontier is held in memory only, and is never written to a
+ *    checkpoint. A frame holds no generator state and no handle for
+ *    its snapshot (the stub is formed from the id), so a tree cannot
+ *    be taken up part way. Runs are checkpointed only between trees,
+ *    when the frontier is empty (see ffs_trial_tree_checkpoint()),
+ *    and a resumed run repeats any tree which was not complete.
+ */
+
+/**
+ *  \brief Opaque frontier type
+ */
+
+typedef struct ffs_frontier_s ffs_frontier_t;
+
+/**
+ *  \brief One state on the frontier
+ *
+ *  Position in the tree only: neither the generator state nor the
+ *  snapshot is held here.
+ */
+
+typedef struct ffs_frame_s ffs_frame_t;
+
+struct ffs_frame_s {
+  int interface;        /**< Interface at which the state sits */
+  int id;               /**< State id (stub) of the state */
+  int idnext;           /**< Last id given to a child state */
+  double wt;            /**< Weight carried by the state */
+  int itrial;           /**< Next trial to be made */
+  int ntrial;           /**< Number of trials to be made */
+  int keep;             /**< State has been saved for restoration */
+};
+
+/**
+ *  \brief Create a new (empty) frontier
+ *
+ *  \param  nmax     the maximum depth (the number of interfaces)
+ *  \param  pobj     a pointer to the new object to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ */
+
+int ffs_frontier_create(int nmax, ffs_frontier_t ** pobj);
+
+/**
+ *  \brief Release a frontier
+ *
+ *  \param  obj      the frontier
+ */
+
+void ffs_frontier_free(ffs_frontier_t * obj);
+
+/**
+ *  \brief Push a new frame, which becomes the top
+ *
+ *  \param  obj       the frontier
+ *  \param  interface the interface
+ *  \param  id        the state id
+ *  \param  wt        the weight
+ *  \param  pframe    a pointer to the new frame to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure (the frontier is full)
+ *
+ *  The remaining fields of the frame are zero.
+ */
+
+int ffs_frontier_push(ffs_frontier_t * obj, int interface, int id, double wt,
+		      ffs_frame_t ** pframe);
+
+/**
+ *  \brief Return the top frame
+ *
+ *  \param  obj      the frontier
+ *  \param  pframe   a pointer to the frame to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       the frontier is empty
+ */
+
+int ffs_frontier_top(ffs_frontier_t * obj, ffs_frame_t ** pframe);
+
+/**
+ *  \brief Remove the top frame
+ *
+ *  \param  obj      the frontier
+ *
+ *  \retval 0        a success
+ *  \retval -1       the frontier is empty
+ */
+
+int ffs_frontier_pop(ffs_frontier_t * obj);
+
+/**
+ *  \brief Return the current depth
+ *
+ *  \param  obj      the frontier
+ *  \param  depth    a pointer to the number of frames to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
+ */
+
+int ffs_frontier_depth(ffs_frontier_t * obj, int * depth);
+
+/**
+ * \}
+ */
+
+#endif
@@ -18,6 +18,7 @@
 #include "../util/ffs_util.h"
 #include "../util/mpilog.h"
 
+#include "ffs_cache.h"
 #include "ffs_init.h"
 #include "ffs_private.h"
 #include "ffs_result.h"
@@ -33,6 +34,10 @@ struct ffs_inst_type {
   int inst_id;          /* Unique id */
   int method;           /* ffs_method_enum */
   int seed;             /* RNG seed */
+  int checkpoint;       /* Checkpoint at each interface */
+  int resume;           /* Resume from checkpoint if present */
+  int init_cache;       /* Cache states at the first interface */
+  u_string_t * cache_key; /* Key identifying the cache (or NULL) */
   MPI_Comm parent;      /* Parent communicator */
   MPI_Comm comm;        /* FFS instance communicator */
   MPI_Comm x_comm;      /* instance x communicator between proxies */
@@ -51,6 +56,15 @@ struct ffs_inst_type {
   int nproxy;              /* Number of simulations for this instance */
   int proxy_id;            /* id */
   int ntask_per_proxy;     /* Number of MPI tasks per proxy (actual) */
+  int state_memory;        /* Allow states to be held in memory */
+  int state_mpi;           /* Move states between proxies by message */
+  int state_mpiio;         /* Move states between proxies by MPI-IO file */
+  int state_write_behind;  /* Length of background write queue */
+  int state_archive;       /* Shared states in segment files */
+  int state_delta;         /* Maximum depth of in-memory delta chains */
+  int state_memory_max;    /* Limit (kB) on in-memory states per proxy rank */
+  int state_prefetch;      /* Read states from file ahead of need */
+  u_string_t * state_scratch; /* Node-local directory for states (or NULL) */
 
   /* Initialisation parameters, result objects. */
   ffs_init_t * init;
@@ -59,15 +73,19 @@ struct ffs_inst_type {
   ffs_result_summary_t * summary;
   int nstepmax_trial;
   int nsteplambda_trial;
+  int reservoir_trial;
 };
 
 static int ffs_inst_read_init(ffs_inst_t * obj, u_config_t * config);
 static int ffs_inst_read_trial(ffs_inst_t * obj, u_config_t * config);
+static int ffs_inst_read_state(ffs_inst_t * obj, u_config_t * config);
 static int ffs_inst_run(ffs_inst_t * obj);
 static int ffs_inst_compute_proxy_size(ffs_inst_t * obj);
 static int ffs_inst_start_xcomm(ffs_inst_t * obj);
 static int ffs_inst_aflux_result(ffs_result_aflux_t * flux, mpilog_t * log);
 static int ffs_inst_run_brute_force(ffs_inst_t * obj);
+static int ffs_inst_cache_report(ffs_inst_t * obj);
+static int ffs_inst_init_cache_key(ffs_inst_t * obj);
 
 /*****************************************************************************
  *
@@ -93,6 +111,7 @@ int ffs_inst_create(int id, MPI_Comm parent, ffs_inst_t ** pobj) {
   obj->inst_id = id;
   obj->parent = parent;
   obj->x_comm = MPI_COMM_NULL;
+  obj->state_memory = FFS_DEFAULT_STATE_MEMORY;
 
   MPI_Comm_rank(obj->parent, &rank);
   MPI_Comm_split(obj->parent, obj->inst_id, rank, &obj->comm);
@@ -137,6 +156,8 @@ void ffs_inst_free(ffs_inst_t * obj) {
   if (obj->sim_name) u_string_free(obj->sim_name);
   if (obj->sim_argv) u_string_free(obj->sim_argv);
   if (obj->sim_lambda) u_string_free(obj->sim_lambda);
+  if (obj->state_scratch) u_string_free(obj->state_scratch);
+  if (obj->cache_key) u_string_free(obj->cache_key);
 
   if (obj->x_comm != MPI_COMM_NULL) MPI_Comm_free(&obj->x_comm);
   MPI_Comm_free(&obj->comm);
@@ -380,6 +401,37 @@ int ffs_inst_init_from_config(ffs_inst_t * obj, u_config_t * input) {
 
   dbg_err_if( ffs_inst_read_init(obj, config) );
   dbg_err_if( ffs_inst_read_trial(obj, config) );
+  dbg_err_if( ffs_inst_read_state(obj, config) );
+
+  /* Checkpoint and resume */
+
+  dbg_err_if( u_config_get_subkey_value_b(config, FFS_CONFIG_INST_CHECKPOINT,
+	      FFS_DEFAULT_INST_CHECKPOINT, &obj->checkpoint));
+  dbg_err_if( u_config_get_subkey_value_b(config, FFS_CONFIG_INST_RESUME,
+	      FFS_DEFAULT_INST_RESUME, &obj->resume));
+
+  if (obj->checkpoint || obj->resume) {
+    mpilog_err_if(obj->method == FFS_METHOD_TEST ||
+		  obj->method == FFS_METHOD_BRUTE_FORCE, obj->log,
+		  "%s/%s are not available for %s\n",
+		  FFS_CONFIG_INST_CHECKPOINT, FFS_CONFIG_INST_RESUME, method);
+    mpilog_err_if(obj->state_archive, obj->log, "%s/%s require %s no\n",
+		  FFS_CONFIG_INST_CHECKPOINT, FFS_CONFIG_INST_RESUME,
+		  FFS_CONFIG_STATE_ARCHIVE);
+  }
+
+  /* Cache of states at the first interface */
+
+  dbg_err_if( u_config_get_subkey_value_b(config, FFS_CONFIG_INIT_CACHE,
+	      FFS_DEFAULT_INIT_CACHE, &obj->init_cache));
+
+  if (obj->init_cache) {
+    mpilog_err_if(obj->method == FFS_METHOD_TEST ||
+		  obj->method == FFS_METHOD_BRUTE_FORCE, obj->log,
+		  "%s is not available for %s\n", FFS_CONFIG_INIT_CACHE, method);
+    mpilog_err_if(obj->state_archive, obj->log, "%s requires %s no\n",
+		  FFS_CONFIG_INIT_CACHE, FFS_CONFIG_STATE_ARCHIVE);
+  }
 
   /* Interface section */
 
@@ -496,6 +548,9 @@ static int ffs_inst_read_trial(ffs_inst_t * obj, u_config_t * config) {
   dbg_err_if( u_config_get_subkey_value_i(config, FFS_CONFIG_TRIAL_NSTEPLAMBDA,
 	      FFS_DEFAULT_TRIAL_NSTEPLAMBDA, &obj->nsteplambda_trial));
 
+  dbg_err_if( u_config_get_subkey_value_b(config, FFS_CONFIG_TRIAL_RESERVOIR,
+	      FFS_DEFAULT_TRIAL_RESERVOIR, &obj->reservoir_trial));
+
   return 0;
 
  err:
@@ -505,6 +560,87 @@ static int ffs_inst_read_trial(ffs_inst_t * obj, u_config_t * config) {
   return -1;
 }
 
+/*****************************************************************************
+ *
+ *  ffs_inst_read_state
+ *
+ *  Where simulation states are to be kept. Scratch is optional.
+ *
+ *****************************************************************************/
+
+static int ffs_inst_read_state(ffs_inst_t * obj, u_config_t * config) {
+
+  const char * scratch;
+  const char * transport;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(config == NULL, -1);
+
+  dbg_err_if( u_config_get_subkey_value_b(config, FFS_CONFIG_STATE_MEMORY,
+	      FFS_DEFAULT_STATE_MEMORY, &obj->state_memory));
+
+  dbg_err_if( u_config_get_subkey_value_i(config,
+	      FFS_CONFIG_STATE_MEMORY_MAX, FFS_DEFAULT_STATE_MEMORY_MAX,
+	      &obj->state_memory_max));
+  mpilog_err_if(obj->state_memory_max < 0, obj->log, "%s must be >= 0\n",
+		FFS_CONFIG_STATE_MEMORY_MAX);
+
+  dbg_err_if( u_config_get_subkey_value_i(config,
+	      FFS_CONFIG_STATE_WRITE_BEHIND, FFS_DEFAULT_STATE_WRITE_BEHIND,
+	      &obj->state_write_behind));
+  mpilog_err_if(obj->state_write_behind < 0, obj->log, "%s must be >= 0\n",
+		FFS_CONFIG_STATE_WRITE_BEHIND);
+
+  dbg_err_if( u_config_get_subkey_value_b(config, FFS_CONFIG_STATE_ARCHIVE,
+	      FFS_DEFAULT_STATE_ARCHIVE, &obj->state_archive));
+
+  dbg_err_if( u_config_get_subkey_value_b(config, FFS_CONFIG_STATE_PREFETCH,
+	      FFS_DEFAULT_STATE_PREFETCH, &obj->state_prefetch));
+
+  dbg_err_if( u_config_get_subkey_value_i(config, FFS_CONFIG_STATE_DELTA,
+	      FFS_DEFAULT_STATE_DELTA, &obj->state_delta));
+  mpilog_err_if(obj->state_delta < 0, obj->log, "%s must be >= 0\n",
+		FFS_CONFIG_STATE_DELTA);
+
+  transport = u_config_get_subkey_value(config, FFS_CONFIG_STATE_TRANSPORT);
+
+  obj->state_mpi = 0;
+  obj->state_mpiio = 0;
+
+  if (transport == NULL) {
+    /* Default is file */
+  }
+  else if (strcmp(transport, FFS_CONFIG_STATE_TRANSPORT_FILE) == 0) {
+    /* As default */
+  }
+  else if (strcmp(transport, FFS_CONFIG_STATE_TRANSPORT_MPI) == 0) {
+    obj->state_mpi = 1;
+  }
+  else if (strcmp(transport, FFS_CONFIG_STATE_TRANSPORT_MPIIO) == 0) {
+    obj->state_mpiio = 1;
+  }
+  else {
+    mpilog(obj->log, "%s (%s) not recognised\n", FFS_CONFIG_STATE_TRANSPORT,
+	   transport);
+    dbg_err("%s (%s) not recognised", FFS_CONFIG_STATE_TRANSPORT, transport);
+  }
+
+  scratch = u_config_get_subkey_value(config, FFS_CONFIG_STATE_SCRATCH);
+
+  if (scratch) {
+    dbg_err_if( u_string_create(scratch, strlen(scratch),
+				&obj->state_scratch) );
+  }
+
+  return 0;
+
+ err:
+
+  mpilog(obj->log, "Failed to parse state parameters\n");
+
+  return -1;
+}
+
 /*****************************************************************************
  *
  *  ffs_inst_method_name
@@ -550,10 +686,29 @@ int ffs_inst_config_log(ffs_inst_t * obj, mpilog_t * log) {
   mpilog(log, "{\n");
   mpilog(log, fmts, FFS_CONFIG_INST_METHOD, ffs_inst_method_name(obj));
   mpilog(log, fmti, FFS_CONFIG_INST_SEED, obj->seed);
+  mpilog(log, fmts, FFS_CONFIG_INST_CHECKPOINT, obj->checkpoint ? "yes" : "no");
+  mpilog(log, fmts, FFS_CONFIG_INST_RESUME, obj->resume ? "yes" : "no");
+  mpilog(log, fmts, FFS_CONFIG_INIT_CACHE, obj->init_cache ? "yes" : "no");
+  mpilog(log, fmts, FFS_CONFIG_TRIAL_RESERVOIR,
+	 obj->reservoir_trial ? "yes" : "no");
   mpilog(log, fmti, FFS_CONFIG_SIM_MPI_TASKS, obj->mpi_request);
   mpilog(log, fmts, FFS_CONFIG_SIM_NAME, u_string_c(obj->sim_name));
   mpilog(log, fmts, FFS_CONFIG_SIM_ARGV, u_string_c(obj->sim_argv));
   mpilog(log, fmts, FFS_CONFIG_SIM_LAMBDA, u_string_c(obj->sim_lambda));
+  mpilog(log, fmts, FFS_CONFIG_STATE_MEMORY, obj->state_memory ? "yes" : "no");
+  mpilog(log, fmti, FFS_CONFIG_STATE_MEMORY_MAX, obj->state_memory_max);
+  mpilog(log, fmts, FFS_CONFIG_STATE_TRANSPORT,
+	 obj->state_mpi ? FFS_CONFIG_STATE_TRANSPORT_MPI :
+	 (obj->state_mpiio ? FFS_CONFIG_STATE_TRANSPORT_MPIIO :
+	  FFS_CONFIG_STATE_TRANSPORT_FILE));
+  mpilog(log, fmti, FFS_CONFIG_STATE_WRITE_BEHIND, obj->state_write_behind);
+  mpilog(log, fmts, FFS_CONFIG_STATE_ARCHIVE, obj->state_archive ? "yes" : "no");
+  mpilog(log, fmti, FFS_CONFIG_STATE_DELTA, obj->state_delta);
+  mpilog(log, fmts, FFS_CONFIG_STATE_PREFETCH,
+	 obj->state_prefetch ? "yes" : "no");
+  if (obj->state_scratch) {
+    mpilog(log, fmts, FFS_CONFIG_STATE_SCRATCH, u_string_c(obj->state_scratch));
+  }
   mpilog(log, "}\n");
 
   return 0;
@@ -583,6 +738,7 @@ static int ffs_inst_run(ffs_inst_t * obj) {
 
   int ntrial;
   int nlambda;
+  char prefix[FILENAME_MAX];
   ffs_trial_arg_t list;
   ffs_trial_arg_t * trial = &list;
 
@@ -619,6 +775,18 @@ static int ffs_inst_run(ffs_inst_t * obj) {
   trial->inst_comm = obj->comm;
   trial->nstepmax = obj->nstepmax_trial;
   trial->nsteplambda = obj->nsteplambda_trial;
+  trial->reservoir = obj->reservoir_trial;
+  trial->checkpoint = obj->checkpoint;
+  trial->resume = obj->resume;
+  trial->cache_key = NULL;
+  trial->cache = NULL;
+
+  if (obj->init_cache) {
+    dbg_err_if( ffs_inst_init_cache_key(obj) );
+    dbg_err_if( ffs_cache_prefix(u_string_c(obj->cache_key), prefix) );
+    dbg_err_if( proxy_state_cache_set(obj->proxy, prefix) );
+    trial->cache_key = u_string_c(obj->cache_key);
+  }
 
   ffs_init_ntrials(obj->init, &ntrial);
   dbg_err_if( ffs_result_create(nlambda, &obj->result) );
@@ -663,6 +831,7 @@ static int ffs_inst_run(ffs_inst_t * obj) {
     dbg_err("Internal error: no method");
   }
 
+  ffs_inst_cache_report(obj);
   ffs_inst_stop_proxy(obj);
   ffs_result_free(obj->result);
   obj->result = NULL;
@@ -678,6 +847,34 @@ static int ffs_inst_run(ffs_inst_t * obj) {
   return -1;
 }
 
+/*****************************************************************************
+ *
+ *  ffs_inst_cache_report
+ *
+ *  Use of in-memory states summed over proxies (root ranks only).
+ *
+ *****************************************************************************/
+
+static int ffs_inst_cache_report(ffs_inst_t * obj) {
+
+  int nlocal[4] = {0, 0, 0, 0};
+  int ntotal[4] = {0, 0, 0, 0};
+
+  dbg_return_if(obj == NULL, -1);
+
+  proxy_state_cache_stats(obj->proxy, nlocal, nlocal + 1, nlocal + 2);
+  proxy_state_nclean(obj->proxy, nlocal + 3);
+  MPI_Reduce(nlocal, ntotal, 4, MPI_INT, MPI_SUM, 0, obj->x_comm);
+
+  mpilog(obj->log, "\n");
+  mpilog(obj->log, "State reads from memory: %d\n", ntotal[0]);
+  mpilog(obj->log, "State reads from file:   %d\n", ntotal[1]);
+  mpilog(obj->log, "States spilled to file:  %d\n", ntotal[2]);
+  mpilog(obj->log, "State reads elided:      %d\n", ntotal[3]);
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  ffs_inst_compute_proxy_size
@@ -738,6 +935,23 @@ int ffs_inst_start_proxy(ffs_inst_t * obj) {
 
   dbg_err_if( proxy_create(obj->proxy_id, obj->comm, &obj->proxy) );
   dbg_err_if( proxy_delegate_create(obj->proxy, u_string_c(obj->sim_name)) );
+  dbg_err_if( proxy_state_inst_set(obj->proxy, obj->inst_id) );
+  dbg_err_if( proxy_state_memory_set(obj->proxy, obj->state_memory) );
+  dbg_err_if( proxy_state_mpi_set(obj->proxy, obj->state_mpi) );
+  dbg_err_if( proxy_state_mpiio_set(obj->proxy, obj->state_mpiio) );
+  dbg_err_if( proxy_state_write_behind_set(obj->proxy,
+					   obj->state_write_behind) );
+  dbg_err_if( proxy_state_archive_set(obj->proxy, obj->state_archive) );
+  dbg_err_if( proxy_state_delta_set(obj->proxy, obj->state_delta) );
+  dbg_err_if( proxy_state_memory_max_set(obj->proxy,
+					 1024*((size_t) obj->state_memory_max)) );
+  dbg_err_if( proxy_state_prefetch_set(obj->proxy, obj->state_prefetch) );
+
+  if (obj->state_scratch) {
+    mpilog(obj->log, "State scratch directory: %s\n",
+	   u_string_c(obj->state_scratch));
+    dbg_err_if( proxy_scratch_set(obj->proxy, u_string_c(obj->state_scratch)) );
+  }
 
   dbg_err_if( proxy_ffs(obj->proxy, &ffs) );
   dbg_err_if( ffs_command_line_set(ffs, u_string_c(obj->sim_argv)) );
@@ -770,6 +984,7 @@ int ffs_inst_stop_proxy(ffs_inst_t * obj) {
   mpilog(obj->log, "\n");
   mpilog(obj->log, "Closing down the simulation proxy\n");
 
+  proxy_scratch_remove(obj->proxy);
   proxy_delegate_free(obj->proxy);
   proxy_free(obj->proxy);
 
@@ -861,6 +1076,62 @@ static int ffs_inst_start_xcomm(ffs_inst_t * obj) {
   return -1;
 }
 
+/*****************************************************************************
+ *
+ *  ffs_inst_init_cache_key
+ *
+ *  Everything on which the states at the first interface depend.
+ *  The direct method keeps a single ensemble, while the branched and
+ *  Rosenbluth methods keep one state per tree, which they can share.
+ *  Doubles are written in full so that any change is seen.
+ *
+ *****************************************************************************/
+
+static int ffs_inst_init_cache_key(ffs_inst_t * obj) {
+
+  int independent, nstepmax, nskip, nsteplambda, ntrials;
+  double prob_accept, teq;
+  double lambda_a, lambda_b;
+  const char * kind;
+
+  dbg_return_if(obj == NULL, -1);
+
+  kind = (obj->method == FFS_METHOD_DIRECT) ? "direct" : "tree";
+
+  ffs_init_independent(obj->init, &independent);
+  ffs_init_nstepmax(obj->init, &nstepmax);
+  ffs_init_nskip(obj->init, &nskip);
+  ffs_init_nsteplambda(obj->init, &nsteplambda);
+  ffs_init_ntrials(obj->init, &ntrials);
+  ffs_init_prob_accept(obj->init, &prob_accept);
+  ffs_init_teq(obj->init, &teq);
+  dbg_err_if( ffs_param_lambda_a(obj->param, &lambda_a) );
+  dbg_err_if( ffs_param_lambda_b(obj->param, &lambda_b) );
+
+  if (obj->cache_key == NULL) {
+    dbg_err_if( u_string_create("", 0, &obj->cache_key) );
+  }
+
+  dbg_err_if( u_string_sprintf(obj->cache_key, "%s %s [%s] %s %d %d %d",
+			       kind, u_string_c(obj->sim_name),
+			       u_string_c(obj->sim_argv),
+			       u_string_c(obj->sim_lambda),
+			       obj->ntask_per_proxy, obj->nproxy, obj->seed) );
+  dbg_err_if( u_string_aprintf(obj->cache_key, " %.17g %.17g",
+			       lambda_a, lambda_b) );
+  dbg_err_if( u_string_aprintf(obj->cache_key, " %d %d %d %d %d %.17g %.17g",
+			       independent, nstepmax, nskip, nsteplambda,
+			       ntrials, prob_accept, teq) );
+
+  return 0;
+
+ err:
+
+  mpilog(obj->log, "Failed to form the initial state cache key\n");
+
+  return -1;
+}
+
 /*****************************************************************************
  *
  *  ffs_inst_proxy
@@ -949,6 +1220,11 @@ static int ffs_inst_run_brute_force(ffs_inst_t * obj) {
   trial->inst_comm = obj->comm;
   trial->nstepmax = obj->nstepmax_trial;
   trial->nsteplambda = obj->nsteplambda_trial;
+  trial->reservoir = obj->reservoir_trial;
+  trial->checkpoint = obj->checkpoint;
+  trial->resume = obj->resume;
+  trial->cache_key = NULL;
+  trial->cache = NULL;
 
   dbg_err_if( ffs_brute_force_run(trial) );
 
@@ -73,13 +73,19 @@
  *    init_nskip       int         # Crossing skip rate (steps)
  *    init_prob_accept double      # Crossing acceptance rate
  *    init_teq         double      # Equilibration time (simulation units)
+ *    init_cache       flag        # Reuse states at the first interface
  *
  *    trial_nstepmax    int        # Maximum length of trial (steps)
  *    trial_tmax        double     # Maximum time of trial (simulation units)
  *    trial_nsteplambda int        # Steps between lambda evaluations
+ *    trial_reservoir   flag       # Rosenbluth: keep one candidate state
  *
  *    seed0             int        # RNG seed for this instance
  *
+ *    checkpoint        flag       # Checkpoint at each interface (direct)
+ *                                 # or each initial trajectory (others)
+ *    resume            flag       # Resume from any checkpoint
+ *
  *  }
  *  \endcode
  *
@@ -94,11 +100,28 @@
  *
  *  \def FFS_CONFIG_INST_SEED
  *  Key string for the instance RNG seed
+ *
+ *  \def FFS_CONFIG_INST_CHECKPOINT
+ *  Key to write a checkpoint as each interface is reached (direct), or
+ *  as each initial trajectory is completed (branched, Rosenbluth)
+ *
+ *  \def FFS_CONFIG_INST_RESUME
+ *  Key to resume from the last checkpoint, if there is one
+ *
+ *  \def FFS_DEFAULT_INST_CHECKPOINT
+ *  Default value
+ *
+ *  \def FFS_DEFAULT_INST_RESUME
+ *  Default value
  */
 
 #define FFS_CONFIG_INST               "ffs_inst"
 #define FFS_CONFIG_INST_METHOD        "method"
 #define FFS_CONFIG_INST_SEED          "seed"
+#define FFS_CONFIG_INST_CHECKPOINT    "checkpoint"
+#define FFS_CONFIG_INST_RESUME        "resume"
+#define FFS_DEFAULT_INST_CHECKPOINT   0
+#define FFS_DEFAULT_INST_RESUME       0
 
 /**
  *  \def FFS_CONFIG_TRIAL_NSTEPMAX
@@ -115,14 +138,22 @@
  *
  *  \def FFS_DEFAULT_TRIAL_NSTEPLAMBDA
  *  Default value
+ *
+ *  \def FFS_CONFIG_TRIAL_RESERVOIR
+ *  Key to choose the Rosenbluth successor by reservoir sampling
+ *
+ *  \def FFS_DEFAULT_TRIAL_RESERVOIR
+ *  Default is off (all successful states are kept until the choice)
  */
 
 #define FFS_CONFIG_TRIAL_NSTEPMAX     "trial_nstepmax"
 #define FFS_CONFIG_TRIAL_TMAX         "trial_tmax"
 #define FFS_CONFIG_TRIAL_NSTEPLAMBDA  "trial_nsteplambda"
+#define FFS_CONFIG_TRIAL_RESERVOIR    "trial_reservoir"
 
 #define FFS_DEFAULT_TRIAL_NSTEPMAX    1
 #define FFS_DEFAULT_TRIAL_NSTEPLAMBDA 1
+#define FFS_DEFAULT_TRIAL_RESERVOIR   0
 
 /**
  *  \def FFS_CONFIG_SIM_MPI_TASKS
@@ -147,6 +178,78 @@
 #define FFS_CONFIG_SIM_LAMBDA         "sim_lambda"
 #define FFS_DEFAULT_SIM_MPI_TASKS     1
 
+/**
+ *  \def FFS_CONFIG_STATE_SCRATCH
+ *  Key for node-local scratch directory for simulation states
+ *
+ *  \def FFS_CONFIG_STATE_MEMORY
+ *  Key to allow simulation states to be held in memory
+ *
+ *  \def FFS_CONFIG_STATE_MEMORY_MAX
+ *  Key for limit (kB per proxy rank) on states in memory (0 for none)
+ *
+ *  \def FFS_CONFIG_STATE_TRANSPORT
+ *  Key for how states move between proxies (file, mpi or mpiio)
+ *
+ *  \def FFS_CONFIG_STATE_WRITE_BEHIND
+ *  Key for length of background state write queue (0 for none)
+ *
+ *  \def FFS_CONFIG_STATE_ARCHIVE
+ *  Key to append shared states to per-interface segment files
+ *
+ *  \def FFS_CONFIG_STATE_DELTA
+ *  Key for maximum length of chains of in-memory deltas (0 for none)
+ *
+ *  \def FFS_CONFIG_STATE_PREFETCH
+ *  Key to read the next parent state from file while a trial runs
+ *
+ *  \def FFS_DEFAULT_STATE_MEMORY
+ *  Default value
+ *
+ *  \def FFS_DEFAULT_STATE_MEMORY_MAX
+ *  Default value
+ *
+ *  \def FFS_DEFAULT_STATE_WRITE_BEHIND
+ *  Default value
+ *
+ *  \def FFS_DEFAULT_STATE_ARCHIVE
+ *  Default value
+ *
+ *  \def FFS_DEFAULT_STATE_DELTA
+ *  Default value
+ *
+ *  \def FFS_DEFAULT_STATE_PREFETCH
+ *  Default value
+ *
+ *  \def FFS_CONFIG_STATE_TRANSPORT_FILE
+ *  Value for states via the shared file system (the default)
+ *
+ *  \def FFS_CONFIG_STATE_TRANSPORT_MPI
+ *  Value for states via MPI messages (if held in memory)
+ *
+ *  \def FFS_CONFIG_STATE_TRANSPORT_MPIIO
+ *  Value for states via one MPI-IO file per interface (if held in memory)
+ */
+
+#define FFS_CONFIG_STATE_SCRATCH      "state_scratch"
+#define FFS_CONFIG_STATE_MEMORY       "state_memory"
+#define FFS_CONFIG_STATE_MEMORY_MAX   "state_memory_max"
+#define FFS_CONFIG_STATE_TRANSPORT    "state_transport"
+#define FFS_CONFIG_STATE_WRITE_BEHIND "state_write_behind"
+#define FFS_CONFIG_STATE_ARCHIVE      "state_archive"
+#define FFS_CONFIG_STATE_DELTA        "state_delta"
+#define FFS_CONFIG_STATE_PREFETCH     "state_prefetch"
+#define FFS_DEFAULT_STATE_MEMORY      1
+#define FFS_DEFAULT_STATE_MEMORY_MAX  0
+#define FFS_DEFAULT_STATE_WRITE_BEHIND 0
+#define FFS_DEFAULT_STATE_ARCHIVE     0
+#define FFS_DEFAULT_STATE_DELTA       0
+#define FFS_DEFAULT_STATE_PREFETCH    0
+
+#define FFS_CONFIG_STATE_TRANSPORT_FILE "file"
+#define FFS_CONFIG_STATE_TRANSPORT_MPI  "mpi"
+#define FFS_CONFIG_STATE_TRANSPORT_MPIIO "mpiio"
+
 /**
  * \def FFS_CONFIG_INIT_INDEPENDENT
  * Key for initialisation method (serial/parallel)
@@ -166,6 +269,11 @@
  * \def FFS_CONFIG_INIT_NTRIALS
  * Key for initial trials
  *
+ * \def FFS_CONFIG_INIT_CACHE
+ * Key to take the states at the first interface, and the flux, from
+ * an earlier run with the same simulation and initial parameters, or
+ * to keep them for a later one
+ *
  * \def FFS_DEFAULT_INIT_INDEPENDENT
  * Use parallel initialisation of states at lambda_A
  *
@@ -183,6 +291,9 @@
  *
  * \def FFS_DEFAULT_INIT_NTRIALS
  * The number of trials used to generate states at the first interface
+ *
+ * \def FFS_DEFAULT_INIT_CACHE
+ * Default value
  */ 
 
 #define FFS_CONFIG_INIT_INDEPENDENT   "init_independent"
@@ -191,12 +302,14 @@
 #define FFS_CONFIG_INIT_PROB_ACCEPT   "init_prob_accept"
 #define FFS_CONFIG_INIT_TEQ           "init_teq"
 #define FFS_CONFIG_INIT_NTRIALS       "init_ntrials"
+#define FFS_CONFIG_INIT_CACHE         "init_cache"
 #define FFS_DEFAULT_INIT_INDEPENDENT  1
 #define FFS_DEFAULT_INIT_NSTEPMAX     0
 #define FFS_DEFAULT_INIT_NSKIP        1
 #define FFS_DEFAULT_INIT_PROB_ACCEPT  1.0
 #define FFS_DEFAULT_INIT_TEQ          0.0
 #define FFS_DEFAULT_INIT_NTRIALS      1
+#define FFS_DEFAULT_INIT_CACHE        0
 
 /**
  *  \def FFS_CONFIG_METHOD_TEST
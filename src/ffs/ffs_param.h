@@ -121,7 +121,9 @@ typedef struct ffs_param_type ffs_param_t;
  *  \def FFS_NSTATE_DEFAULT
  *  Default value for number of states per interface (if not set by user).
  *  \def FFS_NSKEEP_DEFAULT
- *  Default value for number of states to keep per interface.
+ *  Default value for number of states to keep per interface (0 is no
+ *  limit). Direct FFS caps the ensemble at each interface at nskeep
+ *  states by weighted subsampling.
  *  \def FFS_PPRUNE_DEFAULT
  *  Default value for pruning probability (if not set by user).
  */
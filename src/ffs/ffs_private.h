@@ -117,6 +117,61 @@ int ffs_lambda(ffs_t * obj, double * lambda);
 
 int ffs_time(ffs_t * obj, double * t);
 
+/**
+ *  \brief Return the packed state size reported by the simulation
+ *
+ *  \param obj        the ffs_t object
+ *  \param nbytes     a pointer to the size to be returned
+ *
+ *  \retval 0         a success
+ *  \retval -1        a NULL pointer was received
+ */
+
+int ffs_state_size(ffs_t * obj, size_t * nbytes);
+
+/**
+ *  \brief Lend a buffer to the simulation for pack or unpack
+ *
+ *  \param obj        the ffs_t object
+ *  \param buf        the buffer (or NULL to withdraw the buffer)
+ *  \param nbytes     the size of the buffer in bytes
+ *
+ *  \retval 0         a success
+ *  \retval -1        a NULL pointer was received
+ *
+ *  The caller retains ownership of the buffer.
+ */
+
+int ffs_state_buffer_set(ffs_t * obj, void * buf, size_t nbytes);
+
+/**
+ *  \brief Set the bounds of a trial to be run by the simulation
+ *
+ *  \param obj         the ffs_t object
+ *  \param lambda_min  the lower bound on lambda
+ *  \param lambda_max  the upper bound on lambda
+ *  \param nstepmax    the maximum number of steps
+ *  \param nsteplambda the number of steps between examinations of lambda
+ *
+ *  \retval 0          a success
+ *  \retval -1         a NULL pointer was received
+ */
+
+int ffs_trial_bounds_set(ffs_t * obj, double lambda_min, double lambda_max,
+			 int nstepmax, int nsteplambda);
+
+/**
+ *  \brief Return the number of steps reported by the simulation
+ *
+ *  \param obj         the ffs_t object
+ *  \param nstep       a pointer to the number to be returned
+ *
+ *  \retval 0          a success
+ *  \retval -1         a NULL pointer was received
+ */
+
+int ffs_trial_nstep(ffs_t * obj, int * nstep);
+
 /**
  *  \}
  */
@@ -0,0 +1,167 @@
+/*****************************************************************************
+ *
+ *  ffs_reaper.c
+ *
+ *  The list is a circular buffer of handles which is doubled in size
+ *  when full.
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2012 The University of Edinburgh
+ *
+ *****************************************************************************/
+
+#include "u/libu.h"
+#include "ffs_reaper.h"
+
+#define FFS_REAPER_NMAX_INIT 64
+
+struct ffs_reaper_s {
+  int nmax;                /* Capacity */
+  int nstate;              /* Number of handles held */
+  int head;                /* Position of first handle */
+  ffs_handle_t * handle;   /* Circular buffer */
+};
+
+static int ffs_reaper_grow(ffs_reaper_t * obj);
+
+/*****************************************************************************
+ *
+ *  ffs_reaper_create
+ *
+ *****************************************************************************/
+
+int ffs_reaper_create(ffs_reaper_t ** pobj) {
+
+  ffs_reaper_t * obj = NULL;
+
+  dbg_return_if(pobj == NULL, -1);
+
+  obj = u_calloc(1, sizeof(ffs_reaper_t));
+  dbg_err_sif(obj == NULL);
+
+  obj->nmax = FFS_REAPER_NMAX_INIT;
+  obj->handle = u_calloc(obj->nmax, sizeof(ffs_handle_t));
+  dbg_err_sif(obj->handle == NULL);
+
+  *pobj = obj;
+
+  return 0;
+
+ err:
+
+  if (obj) ffs_reaper_free(obj);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_reaper_free
+ *
+ *****************************************************************************/
+
+void ffs_reaper_free(ffs_reaper_t * obj) {
+
+  dbg_return_if(obj == NULL, );
+
+  if (obj->handle) u_free(obj->handle);
+
+  u_free(obj);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_reaper_add
+ *
+ *****************************************************************************/
+
+int ffs_reaper_add(ffs_reaper_t * obj, ffs_handle_t handle) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(util_handle_ids(handle, NULL, NULL), -1);
+
+  if (obj->nstate == obj->nmax) dbg_err_if(ffs_reaper_grow(obj));
+
+  obj->handle[(obj->head + obj->nstate) % obj->nmax] = handle;
+  obj->nstate += 1;
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_reaper_next
+ *
+ *****************************************************************************/
+
+int ffs_reaper_next(ffs_reaper_t * obj, ffs_handle_t * handle) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(handle == NULL, -1);
+
+  if (obj->nstate == 0) return -1;
+
+  *handle = obj->handle[obj->head];
+
+  obj->head = (obj->head + 1) % obj->nmax;
+  obj->nstate -= 1;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_reaper_nstate
+ *
+ *****************************************************************************/
+
+int ffs_reaper_nstate(ffs_reaper_t * obj, int * nstate) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(nstate == NULL, -1);
+
+  *nstate = obj->nstate;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_reaper_grow
+ *
+ *  Double the capacity, unwrapping the list to start at zero.
+ *
+ *****************************************************************************/
+
+static int ffs_reaper_grow(ffs_reaper_t * obj) {
+
+  int n, nmax;
+  ffs_handle_t * handle = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  nmax = 2*obj->nmax;
+  handle = u_calloc(nmax, sizeof(ffs_handle_t));
+  dbg_err_sif(handle == NULL);
+
+  for (n = 0; n < obj->nstate; n++) {
+    handle[n] = obj->handle[(obj->head + n) % obj->nmax];
+  }
+
+  u_free(obj->handle);
+  obj->handle = handle;
+  obj->nmax = nmax;
+  obj->head = 0;
+
+  return 0;
+
+ err:
+
+  return -1;
+}
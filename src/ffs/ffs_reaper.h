@@ -0,0 +1,94 @@
+/*****************************************************************************
+ *
+ *  ffs_reaper.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2012 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef FFS_REAPER_H
+#define FFS_REAPER_H
+
+#include "ffs_util.h"
+
+/**
+ *  \defgroup ffs_reaper FFS state reaper
+ *  \ingroup ffs_library
+ *  \{
+ *
+ *    A first-in first-out list of the handles of states which are
+ *    no longer required, but which have not yet been deleted. This
+ *    allows deletion to be deferred and spread out, rather than
+ *    being done all at once at the end of an interface.
+ *
+ *    The reaper is local to one rank; no communication is involved.
+ */
+
+/**
+ *  \brief Opaque reaper type
+ */
+
+typedef struct ffs_reaper_s ffs_reaper_t;
+
+/**
+ *  \brief Create a new (empty) reaper
+ *
+ *  \param  pobj     a pointer to the new object to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ */
+
+int ffs_reaper_create(ffs_reaper_t ** pobj);
+
+/**
+ *  \brief Release a reaper (outstanding states are forgotten)
+ *
+ *  \param  obj      the reaper
+ */
+
+void ffs_reaper_free(ffs_reaper_t * obj);
+
+/**
+ *  \brief Add a state at the end of the list
+ *
+ *  \param  obj      the reaper
+ *  \param  handle   the handle identifying the state
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ */
+
+int ffs_reaper_add(ffs_reaper_t * obj, ffs_handle_t handle);
+
+/**
+ *  \brief Remove the state at the head of the list
+ *
+ *  \param  obj      the reaper
+ *  \param  handle   a pointer to the handle to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       the list is empty
+ */
+
+int ffs_reaper_next(ffs_reaper_t * obj, ffs_handle_t * handle);
+
+/**
+ *  \brief Return the number of states in the list
+ *
+ *  \param  obj      the reaper
+ *  \param  nstate   a pointer to the number to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
+ */
+
+int ffs_reaper_nstate(ffs_reaper_t * obj, int * nstate);
+
+/**
+ * \}
+ */
+
+#endif
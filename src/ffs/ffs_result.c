@@ -544,3 +544,76 @@ int ffs_result_nback_add(ffs_result_t * obj, int n) {
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  ffs_result_fwrite
+ *
+ *  The local (unreduced) counts, in binary, preceded by nlambda.
+ *
+ *****************************************************************************/
+
+int ffs_result_fwrite(ffs_result_t * obj, FILE * fp) {
+
+  size_t n;
+  size_t nerr = 0;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(fp == NULL, -1);
+
+  n = obj->nlambda + 1;
+
+  nerr += (fwrite(&obj->nlambda, sizeof(int), 1, fp) != 1);
+  nerr += (fwrite(obj->wt, sizeof(double), n, fp) != n);
+  nerr += (fwrite(obj->probs, sizeof(double), n, fp) != n);
+  nerr += (fwrite(obj->swt, sizeof(double), n, fp) != n);
+  nerr += (fwrite(obj->nsuccess, sizeof(int), n, fp) != n);
+  nerr += (fwrite(obj->nprune, sizeof(int), n, fp) != n);
+  nerr += (fwrite(obj->nkeep, sizeof(int), n, fp) != n);
+  nerr += (fwrite(obj->nto, sizeof(int), n, fp) != n);
+  nerr += (fwrite(obj->nstart, sizeof(int), n, fp) != n);
+  nerr += (fwrite(obj->ndrop, sizeof(int), n, fp) != n);
+  nerr += (fwrite(obj->nback, sizeof(int), n, fp) != n);
+
+  return (nerr == 0) ? 0 : -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_result_fread
+ *
+ *****************************************************************************/
+
+int ffs_result_fread(ffs_result_t * obj, FILE * fp) {
+
+  int nlambda;
+  size_t n;
+  size_t nerr = 0;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(fp == NULL, -1);
+
+  dbg_err_if(fread(&nlambda, sizeof(int), 1, fp) != 1);
+  dbg_err_ifm(nlambda != obj->nlambda, "nlambda %d (expected %d)", nlambda,
+	      obj->nlambda);
+
+  n = obj->nlambda + 1;
+
+  nerr += (fread(obj->wt, sizeof(double), n, fp) != n);
+  nerr += (fread(obj->probs, sizeof(double), n, fp) != n);
+  nerr += (fread(obj->swt, sizeof(double), n, fp) != n);
+  nerr += (fread(obj->nsuccess, sizeof(int), n, fp) != n);
+  nerr += (fread(obj->nprune, sizeof(int), n, fp) != n);
+  nerr += (fread(obj->nkeep, sizeof(int), n, fp) != n);
+  nerr += (fread(obj->nto, sizeof(int), n, fp) != n);
+  nerr += (fread(obj->nstart, sizeof(int), n, fp) != n);
+  nerr += (fread(obj->ndrop, sizeof(int), n, fp) != n);
+  nerr += (fread(obj->nback, sizeof(int), n, fp) != n);
+  dbg_err_if(nerr);
+
+  return 0;
+
+ err:
+
+  return -1;
+}
@@ -7,6 +7,7 @@
 #ifndef FFS_RESULT_H
 #define FFS_RESULT_H
 
+#include <stdio.h>
 #include <mpi.h>
 #include "ffs_util.h"
 
@@ -324,6 +325,32 @@ int ffs_result_nback(ffs_result_t * obj, int n, int * nback);
 
 int ffs_result_nback_add(ffs_result_t * obj, int n);
 
+/**
+ *  \brief Write the (local) result to a binary file
+ *
+ *  \param  obj        the ffs_result_t structure
+ *  \param  fp         the stream, open for writing
+ *
+ *  \retval 0          a success
+ *  \retval -1         a failure
+ */
+
+int ffs_result_fwrite(ffs_result_t * obj, FILE * fp);
+
+/**
+ *  \brief Read a result written by ffs_result_fwrite()
+ *
+ *  \param  obj        the ffs_result_t structure, of the same nlambda
+ *  \param  fp         the stream, open for reading
+ *
+ *  \retval 0          a success
+ *  \retval -1         a failure, including a different nlambda
+ *
+ *  Any existing content of the result is replaced.
+ */
+
+int ffs_result_fread(ffs_result_t * obj, FILE * fp);
+
 /**
  * \}
  */
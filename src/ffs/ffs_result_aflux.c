@@ -316,3 +316,65 @@ int ffs_result_aflux_ntrial_final(ffs_result_aflux_t * obj, int * ntrial) {
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  ffs_result_aflux_fwrite
+ *
+ *  Only the local quantities are written; the totals are formed by
+ *  the reduction at the end.
+ *
+ *****************************************************************************/
+
+int ffs_result_aflux_fwrite(ffs_result_aflux_t * obj, FILE * fp) {
+
+  size_t n;
+  size_t nerr = 0;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(fp == NULL, -1);
+
+  n = obj->ntrial_local;
+
+  nerr += (fwrite(&obj->ntrial_local, sizeof(int), 1, fp) != 1);
+  nerr += (fwrite(&obj->ncross_local, sizeof(int), 1, fp) != 1);
+  nerr += (fwrite(&obj->neq_local, sizeof(int), 1, fp) != 1);
+  nerr += (fwrite(obj->status, sizeof(int), n, fp) != n);
+  nerr += (fwrite(obj->t0, sizeof(double), n, fp) != n);
+
+  return (nerr == 0) ? 0 : -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_result_aflux_fread
+ *
+ *****************************************************************************/
+
+int ffs_result_aflux_fread(ffs_result_aflux_t * obj, FILE * fp) {
+
+  int ntrial;
+  size_t n;
+  size_t nerr = 0;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(fp == NULL, -1);
+
+  dbg_err_if(fread(&ntrial, sizeof(int), 1, fp) != 1);
+  dbg_err_ifm(ntrial != obj->ntrial_local, "ntrial %d (expected %d)", ntrial,
+	      obj->ntrial_local);
+
+  n = obj->ntrial_local;
+
+  nerr += (fread(&obj->ncross_local, sizeof(int), 1, fp) != 1);
+  nerr += (fread(&obj->neq_local, sizeof(int), 1, fp) != 1);
+  nerr += (fread(obj->status, sizeof(int), n, fp) != n);
+  nerr += (fread(obj->t0, sizeof(double), n, fp) != n);
+  dbg_err_if(nerr);
+
+  return 0;
+
+ err:
+
+  return -1;
+}
@@ -11,6 +11,7 @@
 #ifndef FFS_RESULT_AFLUX_H
 #define FFS_RESULT_AFLUX_H
 
+#include <stdio.h>
 #include <mpi.h>
 #include "ffs_util.h"
 
@@ -210,6 +211,30 @@ int ffs_result_aflux_ntrial_final(ffs_result_aflux_t * obj, int * ntrial);
 
 int ffs_result_aflux_reduce(ffs_result_aflux_t * obj, MPI_Comm comm);
 
+/**
+ *  \brief Write the local quantities to a binary file
+ *
+ *  \param  obj      the ffs_result_aflux_t object
+ *  \param  fp       the stream, open for writing
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ */
+
+int ffs_result_aflux_fwrite(ffs_result_aflux_t * obj, FILE * fp);
+
+/**
+ *  \brief Read local quantities written by ffs_result_aflux_fwrite()
+ *
+ *  \param  obj      the ffs_result_aflux_t object, of the same ntrial
+ *  \param  fp       the stream, open for reading
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure, including a different number of trials
+ */
+
+int ffs_result_aflux_fread(ffs_result_aflux_t * obj, FILE * fp);
+
 /**
  * \}
  */
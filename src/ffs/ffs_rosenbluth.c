@@ -10,10 +10,15 @@
 
 #include "ffs_private.h"
 #include "ffs_state.h"
+#include "ffs_checkpoint.h"
+#include "ffs_frontier.h"
 #include "ffs_rosenbluth.h"
 
-static int ffs_rosenbluth_recursive(ffs_trial_arg_t * trial, int interface,
-				    int id, double wt, ranlcg_t * ran);
+static int ffs_rosenbluth_tree(ffs_trial_arg_t * trial,
+			       ffs_frontier_t * frontier, ranlcg_t * ran);
+static int ffs_rosenbluth_trials(ffs_trial_arg_t * trial, int interface,
+				 int id, double wt, ranlcg_t * ran, int * inext,
+				 double * wtnext);
 
 /*****************************************************************************
  *
@@ -25,15 +30,17 @@ int ffs_rosenbluth_run(ffs_trial_arg_t * trial) {
 
   int pid;
   int ntrial;
+  int nlambda;
   int n, nstart;
+  int nfirst = 0;
   int status;
   int itraj;
   long int lseed;
-  double wt;
-  const char * stub = NULL;
+  ffs_handle_t handle;
   ffs_t * ffs = NULL;
   ranlcg_t * ran = NULL;
   ffs_state_t * sinit = NULL;
+  ffs_frontier_t * frontier = NULL;
 
   dbg_return_if(trial == NULL, -1);
 
@@ -46,9 +53,9 @@ int ffs_rosenbluth_run(ffs_trial_arg_t * trial) {
 
   /* Save initial reference state with id = 0 */
 
-  stub = util_filename_stub(trial->inst_id, pid, 0);
-  dbg_err_if( proxy_state(trial->proxy, SIM_STATE_INIT, stub) );
-  dbg_err_if( proxy_state(trial->proxy, SIM_STATE_WRITE, stub) );
+  dbg_err_if( util_handle(pid, 0, &handle) );
+  dbg_err_if( proxy_state(trial->proxy, SIM_STATE_INIT, handle) );
+  dbg_err_if( proxy_state(trial->proxy, SIM_STATE_WRITE, handle) );
   dbg_err_if( ffs_state_create(trial->inst_id, pid, &sinit) );
   dbg_err_if( ffs_state_id_set(sinit, 0) );
 
@@ -57,6 +64,9 @@ int ffs_rosenbluth_run(ffs_trial_arg_t * trial) {
   lseed = trial->inst_seed;
   ranlcg_create(lseed, &ran);
 
+  dbg_err_if( ffs_param_nlambda(trial->param, &nlambda) );
+  dbg_err_if( ffs_frontier_create(nlambda, &frontier) );
+
   /* Distribute the trials evenly among the simulation instances */
   /* We have a local trial index n, and a global seed (1 + n + nstart) */
 
@@ -67,45 +77,76 @@ int ffs_rosenbluth_run(ffs_trial_arg_t * trial) {
   ntrial = ntrial / trial->nproxy;
   nstart = pid*ntrial;
 
+  /* Completed trees are not repeated */
+
+  if (trial->resume) {
+    dbg_err_if( ffs_trial_tree_resume(trial, FFS_CHECKPOINT_ROSENBLUTH,
+				      ntrial, &nfirst) );
+  }
+
+  /* Initial states may be taken from, or kept for, the cache */
+
+  dbg_err_if( ffs_trial_tree_cache_start(trial, ntrial) );
+
   mpilog(trial->log, "\n");
   mpilog(trial->log, "Starting %d trials each on %d proxies\n", ntrial,
 	 trial->nproxy);
 
-  for (n = 0; n < ntrial; n++) {
+  for (n = nfirst; n < ntrial; n++) {
 
     itraj = 1 + n + nstart;                  /* trajectory number (global) */
     lseed = trial->inst_seed + n + nstart;   /* trajectory seed */
     ranlcg_state_set(ran, lseed);
 
-    ffs_trial_init(trial, sinit, ran, n, itraj, &status);
+    dbg_err_if( ffs_trial_tree_init(trial, sinit, ran, n, itraj, &status) );
 
-    if (status != FFS_TRIAL_SUCCEEDED) continue;
+    /* If we reached the first interface, start the trials! */
 
-    /* We reached the first interface; start the trials! */
+    if (status == FFS_TRIAL_SUCCEEDED) {
+      dbg_err_if( util_handle(pid, 1, &handle) );
+      proxy_state(trial->proxy, SIM_STATE_WRITE, handle);
 
-    stub = util_filename_stub(trial->inst_id, pid, 1);
-    proxy_state(trial->proxy, SIM_STATE_WRITE, stub);
+      dbg_err_if( ffs_rosenbluth_tree(trial, frontier, ran) );
 
-    wt = 1.0;
-    ffs_rosenbluth_recursive(trial, 1, 1, wt, ran);
+      dbg_err_if( util_handle(pid, 1, &handle) );
+      proxy_state_retire(trial->proxy, handle);
+    }
 
-    stub = util_filename_stub(trial->inst_id, pid, 1);
-    proxy_state(trial->proxy, SIM_STATE_DELETE, stub);
+    if (trial->checkpoint) {
+      dbg_err_if( ffs_trial_tree_checkpoint(trial, FFS_CHECKPOINT_ROSENBLUTH,
+					    n + 1, ntrial) );
+    }
 
+    if (trial->checkpoint && ffs_checkpoint_stop()) {
+      mpilog(trial->log, "Stopping after checkpoint (as requested)\n");
+      goto err;
+    }
   }
 
-  /* Remove the reference state, and finish */
+  dbg_err_if( ffs_trial_tree_cache_finish(trial, nfirst == 0) );
+
+  if (trial->checkpoint || trial->resume) {
+    dbg_err_if( ffs_trial_tree_finish(trial) );
+  }
+
+  /* Remove the reference state, and any outstanding states, and finish */
+
+  ffs_trial_reaper_report(trial);
 
-  stub = util_filename_stub(trial->inst_id, pid, 0);
-  proxy_state(trial->proxy, SIM_STATE_DELETE, stub);
+  dbg_err_if( util_handle(pid, 0, &handle) );
+  proxy_state(trial->proxy, SIM_STATE_DELETE, handle);
+  proxy_state_reap(trial->proxy, -1);
   proxy_execute(trial->proxy, SIM_EXECUTE_FINISH);
 
+  ffs_frontier_free(frontier);
   ranlcg_free(ran);
 
   return 0;
 
  err:
 
+  ffs_trial_tree_cache_finish(trial, 0);
+  if (frontier) ffs_frontier_free(frontier);
   if (ran) ranlcg_free(ran);
   if (sinit) ffs_state_free(sinit);
 
@@ -114,19 +155,79 @@ int ffs_rosenbluth_run(ffs_trial_arg_t * trial) {
 
 /*****************************************************************************
  *
- *  ffs_rosenbluth_recursive
+ *  ffs_rosenbluth_tree
+ *
+ *  At most one successful trial from each state is followed, so the
+ *  tree is a single chain. The frontier holds the states chosen on
+ *  the way down, which are released on the way back up.
+ *
+ *****************************************************************************/
+
+static int ffs_rosenbluth_tree(ffs_trial_arg_t * trial,
+			       ffs_frontier_t * frontier, ranlcg_t * ran) {
+  int pid;
+  int interface = 1;
+  int id = 1;
+  int inext;
+  double wt = 1.0;
+  double wtnext;
+  ffs_handle_t handle;
+  ffs_frame_t * frame = NULL;
+
+  dbg_return_if(trial == NULL, -1);
+  dbg_return_if(frontier == NULL, -1);
+
+  dbg_err_if(proxy_id(trial->proxy, &pid));
+
+  while (1) {
+    dbg_err_if( ffs_rosenbluth_trials(trial, interface, id, wt, ran, &inext,
+				      &wtnext) );
+    if (inext == 0) break;
+
+    dbg_err_if( ffs_frontier_push(frontier, interface + 1, inext, wtnext,
+				  &frame) );
+    interface += 1;
+    id = inext;
+    wt = wtnext;
+  }
+
+  while (ffs_frontier_top(frontier, &frame) == 0) {
+    dbg_err_if( util_handle(pid, frame->id, &handle) );
+    proxy_state_retire(trial->proxy, handle);
+    dbg_err_if(ffs_frontier_pop(frontier));
+  }
+
+  return 0;
+
+ err:
+
+  while (ffs_frontier_pop(frontier) == 0);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_rosenbluth_trials
  *
  *  We perform k trials for every state, record all the successful ones,
  *  but pick at most one to continue. Note that only state which are
  *  assoicated with trials contribute to the weight w_b,i at a given
  *  interface. 
  *
- *  We need to make all the trials before the recursion.
+ *  We need to make all the trials before moving on. The id of the
+ *  state chosen (which is then the live state) and its weight are
+ *  returned; an id of zero means the chain ends here.
+ *
+ *  If trial->reservoir is set, the choice is made as the trials
+ *  proceed, so that at most one successful state (id + 1) is held
+ *  at any time, rather than one for each success.
  *
  *****************************************************************************/
 
-static int ffs_rosenbluth_recursive(ffs_trial_arg_t * trial, int interface,
-				    int id, double wt, ranlcg_t * ran) {
+static int ffs_rosenbluth_trials(ffs_trial_arg_t * trial, int interface,
+				 int id, double wt, ranlcg_t * ran, int * inext,
+				 double * wtnext) {
   int it;
   int nlambda;
   int ntrial, itrial;
@@ -138,12 +239,15 @@ static int ffs_rosenbluth_recursive(ffs_trial_arg_t * trial, int interface,
   double lambda_min;
   double lambda_max;
   double wtnow;
-  const char * stub = NULL;
+  double reep;
+  ffs_handle_t handle;
+
+  *inext = 0;
 
   ffs_param_nlambda(trial->param, &nlambda);
   ffs_result_weight_accum(trial->result, interface, wt);
 
-  /* If we have reached the final state then end the recursion */
+  /* If we have reached the final state then end the chain */
 
   if (interface == nlambda) return 0;
 
@@ -153,8 +257,13 @@ static int ffs_rosenbluth_recursive(ffs_trial_arg_t * trial, int interface,
 
   dbg_err_if(proxy_id(trial->proxy, &pid));
 
+  /* Successful ids are only listed if the choice is made at the end */
+
   nsuccess = 0;
-  nlist = calloc(ntrial, sizeof(int));
+  if (trial->reservoir == 0) {
+    nlist = calloc(ntrial, sizeof(int));
+    dbg_err_if(nlist == NULL && ntrial > 0);
+  }
 
   for (itrial = 0; itrial < ntrial; itrial++) {
 
@@ -176,10 +285,22 @@ static int ffs_rosenbluth_recursive(ffs_trial_arg_t * trial, int interface,
     if (status != FFS_TRIAL_SUCCEEDED) {
       ffs_result_nback_add(trial->result, interface);
     }
+    else if (trial->reservoir) {
+      /* The k-th success replaces the single candidate (id + 1) with
+       * probability 1/k, which leaves each success equally likely. */
+      nsuccess += 1;
+      reep = 0.0;
+      if (nsuccess > 1) ranlcg_reep(ran, &reep);
+      if (nsuccess*reep < 1.0) {
+	dbg_err_if( util_handle(pid, id + 1, &handle) );
+	proxy_state(trial->proxy, SIM_STATE_WRITE, handle);
+      }
+      ffs_result_trial_success_add(trial->result, interface);
+    }
     else {
       nlist[nsuccess] = id + itrial + 1;
-      stub = util_filename_stub(trial->inst_id, pid, id + itrial + 1);
-      proxy_state(trial->proxy, SIM_STATE_WRITE, stub);
+      dbg_err_if( util_handle(pid, id + itrial + 1, &handle) );
+      proxy_state(trial->proxy, SIM_STATE_WRITE, handle);
       ffs_result_trial_success_add(trial->result, interface);
       nsuccess += 1;
     }
@@ -187,8 +308,8 @@ static int ffs_rosenbluth_recursive(ffs_trial_arg_t * trial, int interface,
     /* Re-read the original state if a further trial is required */
 
     if (itrial < ntrial - 1) {
-      stub = util_filename_stub(trial->inst_id, pid, id);
-      proxy_state(trial->proxy, SIM_STATE_READ, stub);
+      dbg_err_if( util_handle(pid, id, &handle) );
+      proxy_state(trial->proxy, SIM_STATE_READ, handle);
     }
   }
 
@@ -199,35 +320,47 @@ static int ffs_rosenbluth_recursive(ffs_trial_arg_t * trial, int interface,
   ffs_result_success_weight_accum(trial->result, interface, wtnow);
 
   if (nsuccess == 0) {
-    /* Just fall through and exit the recursion */
+    /* Just fall through and end the chain */
+  }
+  else if (trial->reservoir) {
+
+    /* The choice has already been made; only the candidate is left */
+
+    for (it = 1; it < nsuccess; it++) {
+      ffs_result_ndrop_add(trial->result, interface);
+    }
+
+    dbg_err_if( util_handle(pid, id + 1, &handle) );
+    proxy_state(trial->proxy, SIM_STATE_READ, handle);
+
+    *inext = id + 1;
+    *wtnext = wtnow;
   }
   else {
 
     /* If we have any successes at all, choose one at random to
-     * follow it via recursion. Delete all the unwanted states
-     * before going into the recursion to prevent a pile up. */
+     * follow. Delete all the unwanted states before going on to
+     * prevent a pile up. */
 
     ranlcg_reep_int32(ran, &itrial);
     itrial = itrial % nsuccess;
 
     for (it = 0; it < nsuccess; it++) {
       if (it != itrial) {
-	stub = util_filename_stub(trial->inst_id, pid, nlist[it]);
-	proxy_state(trial->proxy, SIM_STATE_DELETE, stub);
+	dbg_err_if( util_handle(pid, nlist[it], &handle) );
+	proxy_state_retire(trial->proxy, handle);
 	ffs_result_ndrop_add(trial->result, interface);
       }
     }
 
-    stub = util_filename_stub(trial->inst_id, pid, nlist[itrial]);
-    proxy_state(trial->proxy, SIM_STATE_READ, stub);
+    dbg_err_if( util_handle(pid, nlist[itrial], &handle) );
+    proxy_state(trial->proxy, SIM_STATE_READ, handle);
 
-    ffs_rosenbluth_recursive(trial, interface + 1, nlist[itrial], wtnow, ran);
-
-    stub = util_filename_stub(trial->inst_id, pid, nlist[itrial]);
-    proxy_state(trial->proxy, SIM_STATE_DELETE, stub);
+    *inext = nlist[itrial];
+    *wtnext = wtnow;
   }
 
-  free(nlist);
+  if (nlist) free(nlist);
 
   return 0;
 
@@ -239,7 +372,6 @@ static int ffs_rosenbluth_recursive(ffs_trial_arg_t * trial, int interface,
   return -1;
 }
 
-
 /*****************************************************************************
  *
  *  ffs_rosenbluth_results
@@ -9,6 +9,7 @@
  *
  *****************************************************************************/
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -18,13 +19,20 @@
 
 struct ffs_state_type {
   int inst_id;        /* Instance id */
-  int ngrp_id;        /* 'Group id' for ensemble, interface or proxy */
-  int id;             /* For file identification */
+  ffs_handle_t handle;/* Group (ensemble, interface or proxy) and id */
   void * memory;      /* For simulation memory block, if required */
+  void * snapshot;    /* Packed state (owned) */
+  size_t nbytes;      /* Size of packed state */
+  int location;       /* ffs_state_loc_enum_t flags */
   u_string_t * stub;  /* Stub file name */
+  int stub_valid;     /* Stub is current (else formed when next asked) */
+  ffs_state_t * base; /* Snapshot is a delta against base (or NULL) */
+  int depth;          /* Length of chain of bases */
+  int nref;           /* Number of states using this one as base */
+  int orphan;         /* Freed by owner while still in use as base */
 };
 
-static int ffs_state_stub_set(ffs_state_t * obj);
+static int ffs_state_stub_format(ffs_state_t * obj);
 
 /*****************************************************************************
  *
@@ -42,9 +50,7 @@ int ffs_state_create(int inst, int ngrp_id, ffs_state_t ** pobj) {
   dbg_err_sif(obj == NULL);
 
   obj->inst_id = inst;
-  obj->ngrp_id = ngrp_id;
-
-  dbg_err_if(ffs_state_stub_set(obj));
+  dbg_err_if(util_handle(ngrp_id, 0, &obj->handle));
 
   *pobj = obj;
 
@@ -66,6 +72,16 @@ void ffs_state_free(ffs_state_t * obj) {
 
   dbg_return_if(obj == NULL, );
 
+  /* A state still in use as a base is released with its last user */
+
+  if (obj->nref > 0) {
+    obj->orphan = 1;
+    return;
+  }
+
+  ffs_state_base_set(obj, NULL);
+
+  if (obj->snapshot) u_free(obj->snapshot);
   if (obj->stub) u_string_free(obj->stub);
   u_free(obj);
 
@@ -80,10 +96,15 @@ void ffs_state_free(ffs_state_t * obj) {
 
 int ffs_state_id(ffs_state_t * obj, int * id) {
 
+  long long int id_state;
+
   dbg_return_if(obj == NULL, -1);
   dbg_return_if(id == NULL, -1);
 
-  *id = obj->id;
+  dbg_return_if(util_handle_ids(obj->handle, NULL, &id_state), -1);
+  dbg_return_if(id_state > INT_MAX, -1);
+
+  *id = (int) id_state;
 
   return 0;
 }
@@ -96,16 +117,48 @@ int ffs_state_id(ffs_state_t * obj, int * id) {
 
 int ffs_state_id_set(ffs_state_t * obj, int id) {
 
+  int id_group;
+
   dbg_return_if(obj == NULL, -1);
 
-  obj->id = id;
-  dbg_err_if(ffs_state_stub_set(obj));
+  dbg_return_if(util_handle_ids(obj->handle, &id_group, NULL), -1);
+  dbg_return_if(util_handle(id_group, id, &obj->handle), -1);
+  obj->stub_valid = 0;
 
   return 0;
+}
 
- err:
+/*****************************************************************************
+ *
+ *  ffs_state_handle
+ *
+ *****************************************************************************/
 
-  return -1;
+int ffs_state_handle(ffs_state_t * obj, ffs_handle_t * handle) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(handle == NULL, -1);
+
+  *handle = obj->handle;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_state_handle_set
+ *
+ *****************************************************************************/
+
+int ffs_state_handle_set(ffs_state_t * obj, ffs_handle_t handle) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(util_handle_ids(handle, NULL, NULL), -1);
+
+  obj->handle = handle;
+  obj->stub_valid = 0;
+
+  return 0;
 }
 
 /*****************************************************************************
@@ -139,6 +192,73 @@ int ffs_state_mem_set(ffs_state_t * obj, void * memblock) {
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  ffs_state_snapshot
+ *
+ *****************************************************************************/
+
+int ffs_state_snapshot(ffs_state_t * obj, void ** buf, size_t * nbytes) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(buf == NULL, -1);
+  dbg_return_if(nbytes == NULL, -1);
+
+  *buf = obj->snapshot;
+  *nbytes = obj->nbytes;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_state_snapshot_set
+ *
+ *****************************************************************************/
+
+int ffs_state_snapshot_set(ffs_state_t * obj, void * buf, size_t nbytes) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  if (obj->snapshot && obj->snapshot != buf) u_free(obj->snapshot);
+
+  obj->snapshot = buf;
+  obj->nbytes = (buf == NULL) ? 0 : nbytes;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_state_location
+ *
+ *****************************************************************************/
+
+int ffs_state_location(ffs_state_t * obj, int * loc) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(loc == NULL, -1);
+
+  *loc = obj->location;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_state_location_set
+ *
+ *****************************************************************************/
+
+int ffs_state_location_set(ffs_state_t * obj, int loc) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  obj->location = loc;
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  ffs_state_stub
@@ -149,6 +269,10 @@ const char * ffs_state_stub(ffs_state_t * obj) {
 
   dbg_return_if(obj == NULL, NULL);
 
+  if (obj->stub_valid == 0) {
+    dbg_return_if(ffs_state_stub_format(obj), NULL);
+  }
+
   return u_string_c(obj->stub);
 }
 
@@ -158,11 +282,14 @@ const char * ffs_state_stub(ffs_state_t * obj) {
  *
  *****************************************************************************/
 
-const char * ffs_state_stub_id(ffs_state_t * obj, int id) {
+int ffs_state_stub_id(ffs_state_t * obj, int id, char * stub) {
 
-  dbg_return_if(obj == NULL, NULL);
+  int id_group;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(util_handle_ids(obj->handle, &id_group, NULL), -1);
 
-  return util_filename_stub(obj->inst_id, obj->ngrp_id, id);
+  return util_filename_stub(obj->inst_id, id_group, id, stub);
 }
 
 /*****************************************************************************
@@ -171,19 +298,43 @@ const char * ffs_state_stub_id(ffs_state_t * obj, int id) {
  *
  *****************************************************************************/
 
-static int ffs_state_stub_set(ffs_state_t * obj) {
+int ffs_state_stub_set(ffs_state_t * obj, const char * stub) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(stub == NULL, -1);
+
+  if (obj->stub == NULL) u_string_create("", strlen(""), &obj->stub);
+  dbg_err_ifm(obj->stub == NULL, "No stub");
+
+  dbg_err_if(u_string_sprintf(obj->stub, "%s", stub));
+  obj->stub_valid = 1;
+
+  return 0;
+
+ err:
 
-  const char * stub = NULL;
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_state_stub_format
+ *
+ *****************************************************************************/
+
+static int ffs_state_stub_format(ffs_state_t * obj) {
+
+  char stub[FILENAME_MAX];
 
   dbg_return_if(obj == NULL, -1);
 
   if (obj->stub == NULL) u_string_create("", strlen(""), &obj->stub);
   dbg_err_ifm(obj->stub == NULL, "No stub");
 
-  stub = util_filename_stub(obj->inst_id, obj->ngrp_id, obj->id);
-  dbg_err_if(stub == NULL);
+  dbg_err_if(util_handle_stub(obj->inst_id, obj->handle, stub));
 
   u_string_sprintf(obj->stub, "%s", stub);
+  obj->stub_valid = 1;
 
   return 0;
 
@@ -191,3 +342,85 @@ static int ffs_state_stub_set(ffs_state_t * obj) {
 
   return -1;
 }
+
+/*****************************************************************************
+ *
+ *  ffs_state_base
+ *
+ *****************************************************************************/
+
+int ffs_state_base(ffs_state_t * obj, ffs_state_t ** base) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(base == NULL, -1);
+
+  *base = obj->base;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_state_base_set
+ *
+ *  The reference to any existing base is dropped first; that base
+ *  goes if it has been freed by its owner and has no other user.
+ *
+ *****************************************************************************/
+
+int ffs_state_base_set(ffs_state_t * obj, ffs_state_t * base) {
+
+  ffs_state_t * old = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(base == obj, -1);
+
+  old = obj->base;
+
+  obj->base = base;
+  obj->depth = 0;
+
+  if (base) {
+    base->nref += 1;
+    obj->depth = base->depth + 1;
+  }
+
+  if (old) {
+    old->nref -= 1;
+    if (old->orphan && old->nref == 0) ffs_state_free(old);
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_state_depth
+ *
+ *****************************************************************************/
+
+int ffs_state_depth(ffs_state_t * obj, int * depth) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(depth == NULL, -1);
+
+  *depth = obj->depth;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_state_nref
+ *
+ *****************************************************************************/
+
+int ffs_state_nref(ffs_state_t * obj, int * nref) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(nref == NULL, -1);
+
+  *nref = obj->nref;
+
+  return 0;
+}
@@ -11,6 +11,10 @@
 #ifndef FFS_STATE_H
 #define FFS_STATE_H
 
+#include <stddef.h>
+
+#include "ffs_util.h"
+
 /**
  *  \defgroup ffs_state FFS state handle
  *  \ingroup ffs_library
@@ -38,6 +42,18 @@
 
 typedef struct ffs_state_type ffs_state_t;
 
+/**
+ *  \brief Where copies of a state are held (may be combined)
+ */
+
+typedef enum {
+  FFS_STATE_MEMORY  = 1,    /**< Packed snapshot in memory */
+  FFS_STATE_SCRATCH = 2,    /**< Files in node-local scratch directory */
+  FFS_STATE_SHARED  = 4,    /**< Files in the shared (working) directory */
+  FFS_STATE_REMOTE  = 8,    /**< Copy received from another proxy */
+  FFS_STATE_RETIRED = 16    /**< No longer required; awaiting deletion */
+} ffs_state_loc_enum_t;
+
 /**
  *  \brief Create a state object
  *
@@ -59,6 +75,8 @@ int ffs_state_create(int inst_id, int ngrp_id, ffs_state_t ** pobj);
  *
  *  \return        void
  *
+ *  A state still in use as the base of another is released later
+ *  (see ffs_state_base_set()).
  */
 
 void ffs_state_free(ffs_state_t * obj);
@@ -89,6 +107,33 @@ int ffs_state_id(ffs_state_t * obj, int * id);
 
 int ffs_state_id_set(ffs_state_t * obj, int id);
 
+/**
+ *  \brief Return the 64-bit handle (group and id) of the state
+ *
+ *  \param  obj        the state object
+ *  \param  handle     pointer to the handle to be returned
+ *
+ *  \retval 0          a success
+ *  \retval -1         a NULL pointer was received
+ *
+ *  The file stub is formed from the handle only when it is first
+ *  asked for (see ffs_state_stub()).
+ */
+
+int ffs_state_handle(ffs_state_t * obj, ffs_handle_t * handle);
+
+/**
+ *  \brief Set the handle (group and id) of the state
+ *
+ *  \param  obj        the state object
+ *  \param  handle     the new handle
+ *
+ *  \retval 0          a success
+ *  \retval -1         the handle is not valid
+ */
+
+int ffs_state_handle_set(ffs_state_t * obj, ffs_handle_t handle);
+
 /**
  *  \brief Recover opaque state memory block
  *
@@ -115,6 +160,63 @@ int ffs_state_mem(ffs_state_t * obj, void ** memblock);
 
 int ffs_state_mem_set(ffs_state_t * obj, void * memblock);
 
+/**
+ *  \brief Return the packed state snapshot, if any
+ *
+ *  \param  obj       the state object
+ *  \param  buf       pointer to the snapshot buffer to be returned
+ *  \param  nbytes    pointer to the snapshot size (bytes) to be returned
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure
+ *
+ *  If no snapshot has been recorded, \c buf will be NULL and \c nbytes
+ *  will be zero.
+ */
+
+int ffs_state_snapshot(ffs_state_t * obj, void ** buf, size_t * nbytes);
+
+/**
+ *  \brief Record a packed state snapshot
+ *
+ *  \param  obj        the state object
+ *  \param  buf        a buffer allocated via u_malloc() or u_calloc()
+ *  \param  nbytes     the size of the buffer
+ *
+ *  \retval 0          a success
+ *  \retval -1         a failure
+ *
+ *  Unlike the memory block above, the snapshot buffer becomes the
+ *  responsibility of the state object, and will be released along
+ *  with it (or when replaced by a subsequent call).
+ */
+
+int ffs_state_snapshot_set(ffs_state_t * obj, void * buf, size_t nbytes);
+
+/**
+ *  \brief Return the locations holding copies of the state
+ *
+ *  \param  obj       the state object
+ *  \param  loc       pointer to bitwise-or of ffs_state_loc_enum_t values
+ *
+ *  \retval 0         a success
+ *  \retval -1        a NULL pointer was received
+ */
+
+int ffs_state_location(ffs_state_t * obj, int * loc);
+
+/**
+ *  \brief Record the locations holding copies of the state
+ *
+ *  \param  obj       the state object
+ *  \param  loc       bitwise-or of ffs_state_loc_enum_t values
+ *
+ *  \retval 0         a success
+ *  \retval -1        a NULL pointer was received
+ */
+
+int ffs_state_location_set(ffs_state_t * obj, int loc);
+
 /**
  *  \brief Return the file stub associated with state
  *
@@ -130,15 +232,85 @@ const char * ffs_state_stub(ffs_state_t * obj);
  *
  *  \param obj       a valid ffs_state_t
  *  \param id        an integer
+ *  \param stub      buffer of at least FILENAME_MAX for the result
  *
- *  This will return the state stub for this state, but with the
+ *  This will format the state stub for this state, but with the
  *  alternative state id.
  *
- *  \retval a string on success
- *  \retval NULL if there is a problem with the requested id
+ *  \retval 0        a success
+ *  \retval -1       if there is a problem with the requested id
+ */
+
+int ffs_state_stub_id(ffs_state_t * obj, int id, char * stub);
+
+/**
+ *  \brief Record an explicit file stub for the state
+ *
+ *  \param obj       a valid ffs_state_t
+ *  \param stub      the new stub
+ *
+ *  This replaces the stub formed from the ids (e.g., where a stub is
+ *  provided by the caller). A subsequent ffs_state_id_set() will
+ *  restore the usual stub.
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ */
+
+int ffs_state_stub_set(ffs_state_t * obj, const char * stub);
+
+/**
+ *  \brief Return the base against which the snapshot is a delta
+ *
+ *  \param  obj       the state object
+ *  \param  base      pointer to the base, or NULL if the snapshot is complete
+ *
+ *  \retval 0         a success
+ *  \retval -1        a NULL pointer was received
+ */
+
+int ffs_state_base(ffs_state_t * obj, ffs_state_t ** base);
+
+/**
+ *  \brief Record the base against which the snapshot is a delta
+ *
+ *  \param  obj       the state object
+ *  \param  base      the base state, or NULL if the snapshot is complete
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure
+ *
+ *  The base is reference counted: if its owner calls ffs_state_free()
+ *  while it is still the base of another state, it is only released
+ *  when that state is freed, or is given a different base. The
+ *  snapshot of a state in use as a base must not be changed.
+ */
+
+int ffs_state_base_set(ffs_state_t * obj, ffs_state_t * base);
+
+/**
+ *  \brief Return the length of the chain of bases
+ *
+ *  \param  obj       the state object
+ *  \param  depth     pointer to the depth (zero if there is no base)
+ *
+ *  \retval 0         a success
+ *  \retval -1        a NULL pointer was received
+ */
+
+int ffs_state_depth(ffs_state_t * obj, int * depth);
+
+/**
+ *  \brief Return the number of states using this one as base
+ *
+ *  \param  obj       the state object
+ *  \param  nref      pointer to the number
+ *
+ *  \retval 0         a success
+ *  \retval -1        a NULL pointer was received
  */
 
-const char * ffs_state_stub_id(ffs_state_t * obj, int id);
+int ffs_state_nref(ffs_state_t * obj, int * nref);
 
 /**
  * \}
@@ -0,0 +1,428 @@
+/*****************************************************************************
+ *
+ *  ffs_store.c
+ *
+ *  A simple hash table of ffs_state_t objects keyed by state handle.
+ *  Chaining is used for collisions, and the table is doubled in
+ *  size if the load becomes too high.
+ *
+ *  States holding a snapshot are also on a list in order of use,
+ *  so that the least recently used may be found.
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2012 The University of Edinburgh
+ *
+ *****************************************************************************/
+
+#include "u/libu.h"
+#include "ffs_store.h"
+
+#define FFS_STORE_NBUCKET_INIT 64
+
+typedef struct ffs_store_node_s ffs_store_node_t;
+
+struct ffs_store_node_s {
+  ffs_handle_t handle;           /* Key */
+  unsigned int hash;             /* Hash of handle */
+  ffs_state_t * state;           /* State (owned) */
+  ffs_store_node_t * next;       /* Next in chain */
+  ffs_store_node_t * older;      /* Next least recently used */
+  ffs_store_node_t * newer;      /* Next most recently used */
+  size_t nbytes;                 /* Snapshot size at last use (0 if none) */
+};
+
+struct ffs_store_s {
+  int nbucket;                   /* Number of buckets */
+  int nstate;                    /* Number of states held */
+  ffs_store_node_t ** bucket;    /* Hash table */
+  ffs_store_node_t * oldest;     /* Least recently used with snapshot */
+  ffs_store_node_t * newest;     /* Most recently used with snapshot */
+  size_t nbytes;                 /* Total size of snapshots on the list */
+};
+
+static unsigned int ffs_store_hash(ffs_handle_t handle);
+static int ffs_store_grow(ffs_store_t * obj);
+static ffs_store_node_t * ffs_store_node(ffs_store_t * obj,
+					 ffs_handle_t handle);
+static int ffs_store_listed(ffs_store_t * obj, ffs_store_node_t * node);
+static void ffs_store_unlink(ffs_store_t * obj, ffs_store_node_t * node);
+
+/*****************************************************************************
+ *
+ *  ffs_store_create
+ *
+ *****************************************************************************/
+
+int ffs_store_create(ffs_store_t ** pobj) {
+
+  ffs_store_t * obj = NULL;
+
+  dbg_return_if(pobj == NULL, -1);
+
+  obj = u_calloc(1, sizeof(ffs_store_t));
+  dbg_err_sif(obj == NULL);
+
+  obj->nbucket = FFS_STORE_NBUCKET_INIT;
+  obj->bucket = u_calloc(obj->nbucket, sizeof(ffs_store_node_t *));
+  dbg_err_sif(obj->bucket == NULL);
+
+  *pobj = obj;
+
+  return 0;
+
+ err:
+
+  if (obj) ffs_store_free(obj);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_store_free
+ *
+ *****************************************************************************/
+
+void ffs_store_free(ffs_store_t * obj) {
+
+  int n;
+  ffs_store_node_t * node = NULL;
+
+  dbg_return_if(obj == NULL, );
+
+  if (obj->bucket) {
+    for (n = 0; n < obj->nbucket; n++) {
+      while ((node = obj->bucket[n])) {
+	obj->bucket[n] = node->next;
+	ffs_state_free(node->state);
+	u_free(node);
+      }
+    }
+    u_free(obj->bucket);
+  }
+
+  u_free(obj);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_store_find
+ *
+ *****************************************************************************/
+
+int ffs_store_find(ffs_store_t * obj, ffs_handle_t handle,
+		   ffs_state_t ** state) {
+
+  ffs_store_node_t * node = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(handle < 0, -1);
+  dbg_return_if(state == NULL, -1);
+
+  node = ffs_store_node(obj, handle);
+  *state = (node == NULL) ? NULL : node->state;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_store_add
+ *
+ *****************************************************************************/
+
+int ffs_store_add(ffs_store_t * obj, ffs_handle_t handle,
+		  ffs_state_t ** state) {
+
+  ffs_state_t * s = NULL;
+  ffs_store_node_t * node = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(state == NULL, -1);
+
+  dbg_err_if(ffs_store_find(obj, handle, &s));
+
+  if (s == NULL) {
+
+    if (obj->nstate >= 2*obj->nbucket) dbg_err_if(ffs_store_grow(obj));
+
+    node = u_calloc(1, sizeof(ffs_store_node_t));
+    dbg_err_sif(node == NULL);
+
+    dbg_err_if(ffs_state_create(0, 0, &s));
+    dbg_err_if(ffs_state_handle_set(s, handle));
+
+    node->handle = handle;
+    node->hash = ffs_store_hash(handle);
+    node->state = s;
+    node->next = obj->bucket[node->hash % obj->nbucket];
+    obj->bucket[node->hash % obj->nbucket] = node;
+    obj->nstate += 1;
+  }
+
+  *state = s;
+
+  return 0;
+
+ err:
+
+  if (node) {
+    if (s) ffs_state_free(s);
+    u_free(node);
+  }
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_store_remove
+ *
+ *****************************************************************************/
+
+int ffs_store_remove(ffs_store_t * obj, ffs_handle_t handle) {
+
+  unsigned int hash;
+  ffs_store_node_t ** pnode = NULL;
+  ffs_store_node_t * node = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(handle < 0, -1);
+
+  hash = ffs_store_hash(handle);
+
+  for (pnode = &obj->bucket[hash % obj->nbucket]; *pnode;
+       pnode = &(*pnode)->next) {
+    node = *pnode;
+    if (node->handle != handle) continue;
+
+    *pnode = node->next;
+    ffs_store_unlink(obj, node);
+    ffs_state_free(node->state);
+    u_free(node);
+    obj->nstate -= 1;
+
+    return 0;
+  }
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_store_nstate
+ *
+ *****************************************************************************/
+
+int ffs_store_nstate(ffs_store_t * obj, int * nstate) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(nstate == NULL, -1);
+
+  *nstate = obj->nstate;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_store_touch
+ *
+ *****************************************************************************/
+
+int ffs_store_touch(ffs_store_t * obj, ffs_handle_t handle) {
+
+  size_t nbytes;
+  void * buf = NULL;
+  ffs_store_node_t * node = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(handle < 0, -1);
+
+  node = ffs_store_node(obj, handle);
+  dbg_return_if(node == NULL, -1);
+
+  ffs_store_unlink(obj, node);
+  dbg_return_if(ffs_state_snapshot(node->state, &buf, &nbytes), -1);
+
+  if (buf) {
+    node->nbytes = nbytes;
+    node->older = obj->newest;
+    node->newer = NULL;
+    if (obj->newest) obj->newest->newer = node;
+    if (obj->oldest == NULL) obj->oldest = node;
+    obj->newest = node;
+    obj->nbytes += nbytes;
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_store_lru
+ *
+ *****************************************************************************/
+
+int ffs_store_lru(ffs_store_t * obj, ffs_state_t * after,
+		  ffs_state_t ** state) {
+
+  ffs_handle_t handle;
+  ffs_store_node_t * node = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(state == NULL, -1);
+
+  *state = NULL;
+
+  if (after == NULL) {
+    node = obj->oldest;
+  }
+  else {
+    dbg_return_if(ffs_state_handle(after, &handle), -1);
+    node = ffs_store_node(obj, handle);
+    dbg_return_if(node == NULL, -1);
+    dbg_return_if(node->state != after, -1);
+    dbg_return_if(ffs_store_listed(obj, node) == 0, -1);
+    node = node->newer;
+  }
+
+  if (node) *state = node->state;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_store_nbytes
+ *
+ *****************************************************************************/
+
+int ffs_store_nbytes(ffs_store_t * obj, size_t * nbytes) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(nbytes == NULL, -1);
+
+  *nbytes = obj->nbytes;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_store_node
+ *
+ *****************************************************************************/
+
+static ffs_store_node_t * ffs_store_node(ffs_store_t * obj,
+					 ffs_handle_t handle) {
+  unsigned int hash;
+  ffs_store_node_t * node = NULL;
+
+  hash = ffs_store_hash(handle);
+
+  for (node = obj->bucket[hash % obj->nbucket]; node; node = node->next) {
+    if (node->handle == handle) break;
+  }
+
+  return node;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_store_listed
+ *
+ *****************************************************************************/
+
+static int ffs_store_listed(ffs_store_t * obj, ffs_store_node_t * node) {
+
+  return (node->older || node->newer || obj->oldest == node);
+}
+
+/*****************************************************************************
+ *
+ *  ffs_store_unlink
+ *
+ *  Remove node from the list in order of use (if it is there).
+ *
+ *****************************************************************************/
+
+static void ffs_store_unlink(ffs_store_t * obj, ffs_store_node_t * node) {
+
+  if (ffs_store_listed(obj, node) == 0) return;
+
+  if (node->older) node->older->newer = node->newer;
+  if (node->newer) node->newer->older = node->older;
+  if (obj->oldest == node) obj->oldest = node->newer;
+  if (obj->newest == node) obj->newest = node->older;
+
+  obj->nbytes -= node->nbytes;
+  node->nbytes = 0;
+  node->older = NULL;
+  node->newer = NULL;
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_store_grow
+ *
+ *  Double the number of buckets and rehash.
+ *
+ *****************************************************************************/
+
+static int ffs_store_grow(ffs_store_t * obj) {
+
+  int n, nbucket;
+  ffs_store_node_t ** bucket = NULL;
+  ffs_store_node_t * node = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  nbucket = 2*obj->nbucket;
+  bucket = u_calloc(nbucket, sizeof(ffs_store_node_t *));
+  dbg_err_sif(bucket == NULL);
+
+  for (n = 0; n < obj->nbucket; n++) {
+    while ((node = obj->bucket[n])) {
+      obj->bucket[n] = node->next;
+      node->next = bucket[node->hash % nbucket];
+      bucket[node->hash % nbucket] = node;
+    }
+  }
+
+  u_free(obj->bucket);
+  obj->bucket = bucket;
+  obj->nbucket = nbucket;
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_store_hash
+ *
+ *  The 64-bit finalizer of MurmurHash3, so that the group bits (at
+ *  the top of the handle) also reach the bucket index.
+ *
+ *****************************************************************************/
+
+static unsigned int ffs_store_hash(ffs_handle_t handle) {
+
+  unsigned long long h = (unsigned long long) handle;
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+
+  return (unsigned int) h;
+}
@@ -0,0 +1,158 @@
+/*****************************************************************************
+ *
+ *  ffs_store.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2012 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef FFS_STORE_H
+#define FFS_STORE_H
+
+#include "ffs_state.h"
+
+/**
+ *  \defgroup ffs_store FFS state store
+ *  \ingroup ffs_library
+ *  \{
+ *
+ *    A collection of ffs_state_t objects, each identified by its
+ *    handle (see util_handle()), which is used by the proxy to hold
+ *    simulation states in memory. Each state in the store owns a
+ *    packed snapshot of the simulation (see ffs_state_snapshot()).
+ *
+ *    The store is local to one rank; no communication is involved.
+ */
+
+/**
+ *  \brief Opaque store type
+ */
+
+typedef struct ffs_store_s ffs_store_t;
+
+/**
+ *  \brief Create a new (empty) store
+ *
+ *  \param  pobj     a pointer to the new object to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ */
+
+int ffs_store_create(ffs_store_t ** pobj);
+
+/**
+ *  \brief Release a store and all the states it holds
+ *
+ *  \param  obj      the store
+ */
+
+void ffs_store_free(ffs_store_t * obj);
+
+/**
+ *  \brief Find the state with the given handle, or add a new (empty) one
+ *
+ *  \param  obj      the store
+ *  \param  handle   the handle identifying the state
+ *  \param  state    a pointer to the state to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  The state remains the property of the store.
+ */
+
+int ffs_store_add(ffs_store_t * obj, ffs_handle_t handle,
+		  ffs_state_t ** state);
+
+/**
+ *  \brief Find the state with the given handle
+ *
+ *  \param  obj      the store
+ *  \param  handle   the handle identifying the state
+ *  \param  state    a pointer to the state to be returned (NULL if absent)
+ *
+ *  \retval 0        a success (even if the state is not present)
+ *  \retval -1       a NULL pointer was received
+ */
+
+int ffs_store_find(ffs_store_t * obj, ffs_handle_t handle,
+		   ffs_state_t ** state);
+
+/**
+ *  \brief Remove and release the state with the given handle
+ *
+ *  \param  obj      the store
+ *  \param  handle   the handle identifying the state
+ *
+ *  \retval 0        a success
+ *  \retval -1       the state was not present
+ */
+
+int ffs_store_remove(ffs_store_t * obj, ffs_handle_t handle);
+
+/**
+ *  \brief Return the number of states held
+ *
+ *  \param  obj      the store
+ *  \param  nstate   a pointer to the number to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
+ */
+
+int ffs_store_nstate(ffs_store_t * obj, int * nstate);
+
+/**
+ *  \brief Record the use of a state, and any change to its snapshot
+ *
+ *  \param  obj      the store
+ *  \param  handle   the handle identifying the state
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure, including the state not being present
+ *
+ *  The state becomes the most recently used, if it holds a snapshot,
+ *  and the size of the snapshot is recorded. A state without a
+ *  snapshot is dropped from the order of use. This should follow
+ *  any ffs_state_snapshot_set() on a state in the store.
+ */
+
+int ffs_store_touch(ffs_store_t * obj, ffs_handle_t handle);
+
+/**
+ *  \brief Return states holding a snapshot, least recently used first
+ *
+ *  \param  obj      the store
+ *  \param  after    the previous state returned, or NULL to start
+ *  \param  state    a pointer to the next state (NULL at the end)
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  The state after must not have been touched, or removed, since it
+ *  was returned.
+ */
+
+int ffs_store_lru(ffs_store_t * obj, ffs_state_t * after,
+		  ffs_state_t ** state);
+
+/**
+ *  \brief Return the total size of the snapshots held
+ *
+ *  \param  obj      the store
+ *  \param  nbytes   a pointer to the size (as at the last touch of each)
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
+ */
+
+int ffs_store_nbytes(ffs_store_t * obj, size_t * nbytes);
+
+/**
+ * \}
+ */
+
+#endif
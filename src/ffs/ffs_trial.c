@@ -5,8 +5,17 @@
  *****************************************************************************/
 
 #include "ffs_private.h"
+#include "ffs_cache.h"
+#include "ffs_checkpoint.h"
 #include "ffs_trial.h"
 
+struct ffs_trial_cache_s {
+  int hit;                /* Records were read from the cache */
+  int ntraj;              /* Number of (local) initial trajectories */
+  int * status;           /* Outcome of each initial trajectory */
+  long int * ranstate;    /* Trajectory RNG state at the first interface */
+};
+
 /*****************************************************************************
  *
  *  ffs_trial_run_to_time
@@ -46,12 +55,19 @@ int ffs_trial_run_to_time(proxy_t * proxy, double teq, int nstepmax,
  *
  *  ffs_trial_run_to_lambda
  *
+ *  Each trial also deletes one retired state, so that deletion keeps
+ *  pace with retirement without holding up the trial loop.
+ *
+ *  A simulation supporting SIM_EXECUTE_TRIAL runs the trial without
+ *  returning at each examination of lambda; the outcome is the same.
+ *
  *****************************************************************************/
 
 int ffs_trial_run_to_lambda(ffs_trial_arg_t * trial, double lambda_min,
 			    double lambda_max, int * status) {
   int n;
   int nstep = 0;
+  int nnative;
   double lambda;
   ffs_t * ffs = NULL;
 
@@ -59,6 +75,7 @@ int ffs_trial_run_to_lambda(ffs_trial_arg_t * trial, double lambda_min,
   dbg_return_if(status == NULL, -1);
 
   proxy_ffs(trial->proxy, &ffs);
+  proxy_state_reap(trial->proxy, 1);
 
   *status = FFS_TRIAL_IN_PROGRESS;
 
@@ -74,12 +91,51 @@ int ffs_trial_run_to_lambda(ffs_trial_arg_t * trial, double lambda_min,
     /* Synchronise on status required */
     if (*status != FFS_TRIAL_IN_PROGRESS) break;
 
+    /* The simulation may run the remainder itself; lambda is then
+     * examined again as above. Otherwise, step by step. */
+
+    dbg_err_if(proxy_execute_trial(trial->proxy, lambda_min, lambda_max,
+				   trial->nstepmax - nstep, trial->nsteplambda,
+				   &nnative));
+    if (nnative > 0) {
+      nstep += nnative;
+      continue;
+    }
+
     for (n = 0; n < trial->nsteplambda; n++) {
       proxy_execute(trial->proxy, SIM_EXECUTE_RUN);
       nstep += 1;
     }
   }
 
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_trial_reaper_report
+ *
+ *  Collective in the cross communicator; the total over all proxies
+ *  is reported.
+ *
+ *****************************************************************************/
+
+int ffs_trial_reaper_report(ffs_trial_arg_t * trial) {
+
+  int nlocal = 0;
+  int ntotal = 0;
+
+  dbg_return_if(trial == NULL, -1);
+
+  proxy_state_nretired(trial->proxy, &nlocal);
+  MPI_Reduce(&nlocal, &ntotal, 1, MPI_INT, MPI_SUM, 0, trial->xcomm);
+
+  mpilog(trial->log, "Retired states awaiting deletion: %d\n", ntotal);
+
   return 0;
 }
 
@@ -153,6 +209,7 @@ int ffs_trial_initial_state(ffs_trial_arg_t * trial, ffs_state_t * state,
 			    ranlcg_t * ran) {
   int errnol = 0;
   int seed;
+  ffs_handle_t handle;
   MPI_Comm comm;
 
   dbg_return_if(trial == NULL, -1);
@@ -161,7 +218,8 @@ int ffs_trial_initial_state(ffs_trial_arg_t * trial, ffs_state_t * state,
 
   proxy_comm(trial->proxy, &comm);
 
-  errnol = proxy_state(trial->proxy, SIM_STATE_READ, ffs_state_stub(state));
+  errnol = ffs_state_handle(state, &handle);
+  if (errnol == 0) errnol = proxy_state(trial->proxy, SIM_STATE_READ, handle);
   mpi_err_if_any(errnol, comm);
 
   ranlcg_reep_int32(ran, &seed);
@@ -316,3 +374,334 @@ int ffs_trial_init(ffs_trial_arg_t * trial, ffs_state_t * sinit,
 
   return -1;
 }
+
+/*****************************************************************************
+ *
+ *  ffs_trial_tree_checkpoint
+ *
+ *****************************************************************************/
+
+int ffs_trial_tree_checkpoint(ffs_trial_arg_t * trial, int kind, int ntraj,
+			      int nlocal) {
+  int pid, rank;
+  int ifail = 0;
+  int init_independent;
+  char filename[FILENAME_MAX];
+  ffs_handle_t handle;
+  MPI_Comm comm;
+
+  dbg_return_if(trial == NULL, -1);
+
+  dbg_err_if( proxy_id(trial->proxy, &pid) );
+  dbg_err_if( proxy_comm(trial->proxy, &comm) );
+  MPI_Comm_rank(trial->inst_comm, &rank);
+
+  ffs_init_independent(trial->init, &init_independent);
+
+  if (init_independent == 0 && ntraj < nlocal) {
+    ifail += ffs_checkpoint_handle(pid, ntraj, &handle);
+    ifail += proxy_state(trial->proxy, SIM_STATE_WRITE, handle);
+    ifail += proxy_state_publish(trial->proxy, handle);
+  }
+
+  ifail += proxy_state_flush(trial->proxy);
+  ifail += ffs_checkpoint_filename(trial->inst_id, rank, filename);
+
+  if (ifail == 0) {
+    ifail = ffs_checkpoint_tree_write(filename, kind, trial->inst_seed,
+				      trial->nproxy, ntraj, trial->result,
+				      trial->flux);
+  }
+
+  mpi_err_if_any(ifail, comm);
+
+  return 0;
+
+ err:
+
+  mpilog_all(trial->log, "Failed to write checkpoint (proxy %d)\n", pid);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_trial_tree_resume
+ *
+ *  Each proxy grows its own trees, so only the ranks of one proxy
+ *  need agree on the position.
+ *
+ *****************************************************************************/
+
+int ffs_trial_tree_resume(ffs_trial_arg_t * trial, int kind, int nlocal,
+			  int * ntraj) {
+  int pid, rank;
+  int present;
+  int ifail = 0;
+  int init_independent;
+  int nread = 0, nmin, nmax;
+  char filename[FILENAME_MAX];
+  ffs_handle_t handle;
+  MPI_Comm comm;
+
+  dbg_return_if(trial == NULL, -1);
+  dbg_return_if(ntraj == NULL, -1);
+
+  *ntraj = 0;
+
+  dbg_err_if( proxy_id(trial->proxy, &pid) );
+  dbg_err_if( proxy_comm(trial->proxy, &comm) );
+  MPI_Comm_rank(trial->inst_comm, &rank);
+
+  dbg_err_if( ffs_checkpoint_filename(trial->inst_id, rank, filename) );
+  dbg_err_if( ffs_checkpoint_present(filename, trial->inst_comm, &present) );
+
+  if (present == 0) {
+    mpilog(trial->log, "No checkpoint to resume from; starting afresh\n");
+    return 0;
+  }
+
+  ifail = ffs_checkpoint_tree_read(filename, kind, trial->inst_seed,
+				   trial->nproxy, &nread, trial->result,
+				   trial->flux);
+  mpi_err_if_any(ifail, comm);
+
+  MPI_Allreduce(&nread, &nmin, 1, MPI_INT, MPI_MIN, comm);
+  MPI_Allreduce(&nread, &nmax, 1, MPI_INT, MPI_MAX, comm);
+  dbg_err_ifm(nmin != nmax, "Checkpoints disagree (%d to %d)", nmin, nmax);
+  dbg_err_if(nread > nlocal);
+
+  /* The next initial trajectory may continue from the last state */
+
+  ffs_init_independent(trial->init, &init_independent);
+
+  if (init_independent == 0 && nread > 0 && nread < nlocal) {
+    ifail += ffs_checkpoint_handle(pid, nread, &handle);
+    ifail += proxy_state_adopt(trial->proxy, handle);
+    ifail += proxy_state(trial->proxy, SIM_STATE_READ, handle);
+  }
+  mpi_err_if_any(ifail, comm);
+
+  mpilog(trial->log, "Resuming from checkpoint after %d of %d trajectories\n",
+	 nread, nlocal);
+
+  *ntraj = nread;
+
+  return 0;
+
+ err:
+
+  mpilog_all(trial->log, "Failed to resume from checkpoint (proxy %d)\n",
+	     pid);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_trial_tree_finish
+ *
+ *****************************************************************************/
+
+int ffs_trial_tree_finish(ffs_trial_arg_t * trial) {
+
+  int n, pid, rank;
+  int init_independent;
+  char filename[FILENAME_MAX];
+  ffs_handle_t handle;
+
+  dbg_return_if(trial == NULL, -1);
+
+  dbg_err_if( proxy_id(trial->proxy, &pid) );
+  MPI_Comm_rank(trial->inst_comm, &rank);
+
+  MPI_Barrier(trial->inst_comm);
+
+  dbg_err_if( ffs_checkpoint_filename(trial->inst_id, rank, filename) );
+  remove(filename);
+
+  ffs_init_independent(trial->init, &init_independent);
+
+  if (init_independent == 0) {
+    for (n = 0; n < 2; n++) {
+      dbg_err_if( ffs_checkpoint_handle(pid, n, &handle) );
+      proxy_state(trial->proxy, SIM_STATE_DELETE, handle);
+    }
+  }
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_trial_tree_cache_start
+ *
+ *****************************************************************************/
+
+int ffs_trial_tree_cache_start(ffs_trial_arg_t * trial, int nlocal) {
+
+  int rank;
+  int valid;
+  int ifail = 0;
+  char filename[FILENAME_MAX];
+  ffs_trial_cache_t * cache = NULL;
+
+  dbg_return_if(trial == NULL, -1);
+  dbg_return_if(nlocal < 0, -1);
+
+  trial->cache = NULL;
+  if (trial->cache_key == NULL) return 0;
+
+  cache = u_calloc(1, sizeof(ffs_trial_cache_t));
+  dbg_err_sif(cache == NULL);
+  cache->status = u_calloc(nlocal + 1, sizeof(int));
+  dbg_err_sif(cache->status == NULL);
+  cache->ranstate = u_calloc(nlocal + 1, sizeof(long int));
+  dbg_err_sif(cache->ranstate == NULL);
+  cache->ntraj = nlocal;
+
+  MPI_Comm_rank(trial->inst_comm, &rank);
+  dbg_err_if( ffs_cache_filename(trial->cache_key, rank, filename) );
+  dbg_err_if( ffs_cache_valid(filename, FFS_CACHE_TREE, trial->cache_key,
+			      trial->inst_comm, &valid) );
+
+  if (valid) {
+    ifail = ffs_cache_tree_read(filename, trial->cache_key, nlocal,
+				cache->status, cache->ranstate, trial->flux);
+    mpi_err_if_any(ifail, trial->inst_comm);
+    cache->hit = 1;
+    mpilog(trial->log, "Initial states taken from cache (%s)\n", filename);
+  }
+  else {
+    mpilog(trial->log, "No initial state cache (%s)\n", filename);
+  }
+
+  trial->cache = cache;
+
+  return 0;
+
+ err:
+
+  mpilog(trial->log, "Failed to read initial state cache\n");
+
+  if (cache) {
+    if (cache->ranstate) u_free(cache->ranstate);
+    if (cache->status) u_free(cache->status);
+    u_free(cache);
+  }
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_trial_tree_init
+ *
+ *  The copy for the cache is released at once, so the proxy does not
+ *  hold on to it.
+ *
+ *****************************************************************************/
+
+int ffs_trial_tree_init(ffs_trial_arg_t * trial, ffs_state_t * sinit,
+			ranlcg_t * ran, int n, int itraj, int * status) {
+  int ifail = 0;
+  ffs_handle_t handle;
+  ffs_trial_cache_t * cache = NULL;
+  MPI_Comm comm;
+
+  dbg_return_if(trial == NULL, -1);
+  dbg_return_if(ran == NULL, -1);
+  dbg_return_if(status == NULL, -1);
+
+  cache = trial->cache;
+
+  if (cache == NULL) {
+    ffs_trial_init(trial, sinit, ran, n, itraj, status);
+    return 0;
+  }
+
+  dbg_return_if(n < 0 || n >= cache->ntraj, -1);
+  dbg_err_if( proxy_comm(trial->proxy, &comm) );
+  dbg_err_if( util_handle(FFS_HANDLE_GROUP_CACHE, itraj, &handle) );
+
+  if (cache->hit) {
+    *status = cache->status[n];
+    if (*status == FFS_TRIAL_SUCCEEDED) {
+      ifail = proxy_state(trial->proxy, SIM_STATE_READ, handle);
+      ranlcg_state_set(ran, cache->ranstate[n]);
+    }
+  }
+  else {
+    ffs_trial_init(trial, sinit, ran, n, itraj, status);
+    cache->status[n] = *status;
+    ranlcg_state(ran, &cache->ranstate[n]);
+    if (*status == FFS_TRIAL_SUCCEEDED) {
+      ifail += proxy_state(trial->proxy, SIM_STATE_WRITE, handle);
+      ifail += proxy_state_publish(trial->proxy, handle);
+      ifail += proxy_state_release(trial->proxy, handle);
+    }
+  }
+
+  mpi_err_if_any(ifail, comm);
+
+  return 0;
+
+ err:
+
+  mpilog_all(trial->log, "Failed to %s cached initial state %d\n",
+	     cache->hit ? "read" : "write", itraj);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_trial_tree_cache_finish
+ *
+ *****************************************************************************/
+
+int ffs_trial_tree_cache_finish(ffs_trial_arg_t * trial, int complete) {
+
+  int rank;
+  int ifail = 0;
+  char filename[FILENAME_MAX];
+  ffs_trial_cache_t * cache = NULL;
+
+  dbg_return_if(trial == NULL, -1);
+
+  cache = trial->cache;
+  if (cache == NULL) return 0;
+
+  if (cache->hit == 0 && complete) {
+    MPI_Comm_rank(trial->inst_comm, &rank);
+    ifail = ffs_cache_filename(trial->cache_key, rank, filename);
+    if (ifail == 0) {
+      ifail = ffs_cache_tree_write(filename, trial->cache_key, cache->ntraj,
+				   cache->status, cache->ranstate, trial->flux);
+    }
+    mpi_err_if_any(ifail, trial->inst_comm);
+    mpilog(trial->log, "Initial states kept in cache (%s)\n", filename);
+  }
+
+  u_free(cache->ranstate);
+  u_free(cache->status);
+  u_free(cache);
+  trial->cache = NULL;
+
+  return 0;
+
+ err:
+
+  mpilog(trial->log, "Failed to write initial state cache\n");
+
+  u_free(cache->ranstate);
+  u_free(cache->status);
+  u_free(cache);
+  trial->cache = NULL;
+
+  return -1;
+}
@@ -32,6 +32,7 @@
 /* This is a convenience aggregate argument list */
 
 typedef struct ffs_trial_arg_s ffs_trial_arg_t;
+typedef struct ffs_trial_cache_s ffs_trial_cache_t;
 
 struct ffs_trial_arg_s {
   int nstepmax;
@@ -49,6 +50,11 @@ struct ffs_trial_arg_s {
   ffs_result_summary_t * summary;
   MPI_Comm xcomm;
   MPI_Comm inst_comm;
+  int checkpoint;
+  int resume;
+  int reservoir;
+  const char * cache_key;
+  ffs_trial_cache_t * cache;
 };
 
 /**
@@ -122,6 +128,125 @@ int ffs_trial_initial_state(ffs_trial_arg_t * trial, ffs_state_t * state,
 int ffs_trial_init(ffs_trial_arg_t * trial, ffs_state_t * sinit,
 		   ranlcg_t * rantraj, int nlocaltraj, int itraj,
 		   int * status);
+
+/**
+ *  \brief Report the number of retired states not yet deleted
+ *
+ *  \param trial      ffs_trial_arg_t structure
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure
+ */
+
+int ffs_trial_reaper_report(ffs_trial_arg_t * trial);
+
+/**
+ *  \brief Checkpoint a proxy between trees (branched, Rosenbluth)
+ *
+ *  \param trial      ffs_trial_arg_t structure
+ *  \param kind       ffs_checkpoint_enum
+ *  \param ntraj      number of local initial trajectories completed
+ *  \param nlocal     total number of local initial trajectories
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure
+ *
+ *  If initial trajectories do not start independently, the next one
+ *  continues from the current simulation state, which is then also
+ *  kept. This is collective in the proxy.
+ *
+ *  Only whole trees are recorded; the tree frontier is not saved, so
+ *  work on a tree in progress at the time of failure is lost.
+ */
+
+int ffs_trial_tree_checkpoint(ffs_trial_arg_t * trial, int kind, int ntraj,
+			      int nlocal);
+
+/**
+ *  \brief Resume a proxy from its checkpoint between trees
+ *
+ *  \param trial      ffs_trial_arg_t structure
+ *  \param kind       ffs_checkpoint_enum
+ *  \param nlocal     total number of local initial trajectories
+ *  \param ntraj      the number of trajectories already completed
+ *
+ *  \retval 0         a success (ntraj is zero if there is no checkpoint)
+ *  \retval -1        a failure
+ *
+ *  The results so far are restored, and the simulation state, if
+ *  required. This is collective in the instance.
+ */
+
+int ffs_trial_tree_resume(ffs_trial_arg_t * trial, int kind, int nlocal,
+			  int * ntraj);
+
+/**
+ *  \brief Remove checkpoint files at the end of a run
+ *
+ *  \param trial      ffs_trial_arg_t structure
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure
+ *
+ *  This is collective in the instance, so that no checkpoint goes
+ *  while another proxy might still fail.
+ */
+
+int ffs_trial_tree_finish(ffs_trial_arg_t * trial);
+
+/**
+ *  \brief Look for cached initial states for the trees
+ *
+ *  \param trial      ffs_trial_arg_t structure
+ *  \param nlocal     total number of local initial trajectories
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure
+ *
+ *  If there is a cache key, a record of the initial trajectories is
+ *  started; it is filled from the cache if there is a match. This is
+ *  collective in the instance.
+ */
+
+int ffs_trial_tree_cache_start(ffs_trial_arg_t * trial, int nlocal);
+
+/**
+ *  \brief Generate, or take from the cache, a state at the first interface
+ *
+ *  \param trial      ffs_trial_arg_t structure
+ *  \param sinit      ffs_state_t identfying the initial (reference) state
+ *  \param ran        ranlcg_t trajectory RNG
+ *  \param n          integer local trajectory id
+ *  \param itraj      integer global trajectory id
+ *  \param status     pointer to integer status to be returned
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure
+ *
+ *  As ffs_trial_init(). A state from the cache becomes the current
+ *  simulation state, and the trajectory RNG is left as it was when
+ *  the state was generated, so that the tree is grown exactly as
+ *  before. A new state is also kept for the cache.
+ */
+
+int ffs_trial_tree_init(ffs_trial_arg_t * trial, ffs_state_t * sinit,
+			ranlcg_t * ran, int n, int itraj, int * status);
+
+/**
+ *  \brief Finish with the record of initial trajectories
+ *
+ *  \param trial      ffs_trial_arg_t structure
+ *  \param complete   non-zero if this run generated every trajectory
+ *
+ *  \retval 0         a success
+ *  \retval -1        a failure
+ *
+ *  New records are written to the cache only if complete. This is
+ *  collective in the instance if complete.
+ */
+
+int ffs_trial_tree_cache_finish(ffs_trial_arg_t * trial, int complete);
+
 /**
  *  \}
  */
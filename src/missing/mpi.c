@@ -17,6 +17,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "u/libu.h"
 #include "./mpi.h"
@@ -508,6 +509,39 @@ int MPI_Probe(int source, int tag, MPI_Comm comm, MPI_Status * status) {
   return rc;
 }
 
+/*****************************************************************************
+ *
+ *  \brief Replacement MPI_Get_count is disallowed
+ *
+ *  \param  status     pointer to MPI_Status object (from MPI_Probe)
+ *  \param  datatype   the MPI_Datatype of the message
+ *  \param  count      pointer to the number of items to be returned
+ *
+ *  \retval  MPI_SUCCESS    a success
+ *  \retval  MPI_ERR...     a failure
+ *
+ *  As no message can ever be received, there is no valid status.
+ *
+ *****************************************************************************/
+
+int MPI_Get_count(MPI_Status * status, MPI_Datatype datatype, int * count) {
+
+  int rc;
+  int comm = MPI_COMM_WORLD;
+
+  err_err_rcif(status == NULL, MPI_ERR_ARG);
+  err_err_rcif(count == NULL, MPI_ERR_ARG);
+  err_err_rcif(1, MPI_ERR_OTHER);
+
+  return MPI_SUCCESS;
+
+ err:
+  err_ifm(1, "Replacement MPI_Get_count() not implemented\n");
+  mpi_errhandler_(&comm, &rc);
+
+  return rc;
+}
+
 /*****************************************************************************
  *
  *  \brief Replacement MPI_Sendrecv is disallowed
@@ -1130,6 +1164,219 @@ int MPI_Comm_compare(MPI_Comm comm1, MPI_Comm comm2, int * result) {
   return MPI_SUCCESS;
 }
 
+/*****************************************************************************
+ *
+ *  \brief Replacement MPI_Exscan is a no-operation
+ *
+ *  The result at rank 0 is undefined by the standard, and there is
+ *  no other rank.
+ *
+ *****************************************************************************/
+
+int MPI_Exscan(void * sendbuf, void * recvbuf, int count, MPI_Datatype type,
+	       MPI_Op op, MPI_Comm comm) {
+  int rc;
+
+  err_err_rcif(sendbuf == NULL, MPI_ERR_BUFFER);
+  err_err_rcif(recvbuf == NULL, MPI_ERR_BUFFER);
+  err_err_rcif(count < 0, MPI_ERR_COUNT);
+
+  return MPI_SUCCESS;
+
+ err:
+  mpi_errhandler_(&comm, &rc);
+
+  return rc;
+}
+
+/*****************************************************************************
+ *
+ *  \brief Replacement MPI_File_open uses fopen(3)
+ *
+ *  \param  comm       the communicator (ignored)
+ *  \param  filename   the file name
+ *  \param  amode      MPI_MODE_RDONLY, or MPI_MODE_WRONLY or MPI_MODE_RDWR
+ *                     with or without MPI_MODE_CREATE
+ *  \param  info       ignored
+ *  \param  fh         pointer to the file handle to be returned
+ *
+ *  \retval MPI_SUCCESS  a success
+ *  \retval MPI_ERR_...  a failure
+ *
+ *****************************************************************************/
+
+int MPI_File_open(MPI_Comm comm, const char * filename, int amode,
+		  MPI_Info info, MPI_File * fh) {
+  int rc;
+  FILE * fp = NULL;
+
+  err_err_rcif(filename == NULL, MPI_ERR_ARG);
+  err_err_rcif(fh == NULL, MPI_ERR_ARG);
+
+  if (amode & MPI_MODE_RDONLY) {
+    fp = fopen(filename, "rb");
+  }
+  else {
+    fp = fopen(filename, "r+b");
+    if (fp == NULL && (amode & MPI_MODE_CREATE)) fp = fopen(filename, "w+b");
+  }
+
+  err_err_rcif(fp == NULL, MPI_ERR_OTHER);
+
+  *fh = (MPI_File) fp;
+
+  return MPI_SUCCESS;
+
+ err:
+  /* As MPI_ERRORS_RETURN, the default for files */
+
+  return rc;
+}
+
+/*****************************************************************************
+ *
+ *  \brief Replacement MPI_File_close
+ *
+ *****************************************************************************/
+
+int MPI_File_close(MPI_File * fh) {
+
+  int rc;
+
+  err_err_rcif(fh == NULL, MPI_ERR_ARG);
+  err_err_rcif(*fh == MPI_FILE_NULL, MPI_ERR_ARG);
+  err_err_rcif(fclose((FILE *) *fh), MPI_ERR_OTHER);
+
+  *fh = MPI_FILE_NULL;
+
+  return MPI_SUCCESS;
+
+ err:
+  /* As MPI_ERRORS_RETURN, the default for files */
+
+  return rc;
+}
+
+/*****************************************************************************
+ *
+ *  \brief Replacement MPI_File_set_size uses ftruncate(2)
+ *
+ *****************************************************************************/
+
+int MPI_File_set_size(MPI_File fh, MPI_Offset size) {
+
+  int rc;
+  FILE * fp = (FILE *) fh;
+
+  err_err_rcif(fp == NULL, MPI_ERR_ARG);
+  err_err_rcif(size < 0, MPI_ERR_ARG);
+  err_err_rcif(fflush(fp), MPI_ERR_OTHER);
+  err_err_rcif(ftruncate(fileno(fp), (off_t) size), MPI_ERR_OTHER);
+
+  return MPI_SUCCESS;
+
+ err:
+  /* As MPI_ERRORS_RETURN, the default for files */
+
+  return rc;
+}
+
+/*****************************************************************************
+ *
+ *  \brief Replacement MPI_File_delete uses remove(3)
+ *
+ *****************************************************************************/
+
+int MPI_File_delete(const char * filename, MPI_Info info) {
+
+  int rc;
+
+  err_err_rcif(filename == NULL, MPI_ERR_ARG);
+  err_err_rcif(remove(filename), MPI_ERR_OTHER);
+
+  return MPI_SUCCESS;
+
+ err:
+  /* As MPI_ERRORS_RETURN, the default for files */
+
+  return rc;
+}
+
+/*****************************************************************************
+ *
+ *  \brief Replacement MPI_File_write_at_all for basic datatypes
+ *
+ *  \param  fh         the file handle
+ *  \param  offset     the offset in bytes
+ *  \param  buf        the data
+ *  \param  count      the number of data items
+ *  \param  datatype   the MPI_Datatype of the data
+ *  \param  status     ignored
+ *
+ *  \retval MPI_SUCCESS  a success
+ *  \retval MPI_ERR_...  a failure
+ *
+ *****************************************************************************/
+
+int MPI_File_write_at_all(MPI_File fh, MPI_Offset offset, void * buf,
+			  int count, MPI_Datatype datatype,
+			  MPI_Status * status) {
+  int rc;
+  size_t sizeof_datatype;
+  FILE * fp = (FILE *) fh;
+
+  err_err_rcif(fp == NULL, MPI_ERR_ARG);
+  err_err_rcif(count < 0, MPI_ERR_COUNT);
+  err_err_rcif(mpi_sizeof(datatype, &sizeof_datatype), MPI_ERR_TYPE);
+
+  if (count == 0) return MPI_SUCCESS;
+
+  err_err_rcif(buf == NULL, MPI_ERR_BUFFER);
+  err_err_rcif(fseek(fp, (long) offset, SEEK_SET), MPI_ERR_OTHER);
+  err_err_rcif(fwrite(buf, sizeof_datatype, count, fp) != (size_t) count,
+	       MPI_ERR_OTHER);
+
+  return MPI_SUCCESS;
+
+ err:
+  /* As MPI_ERRORS_RETURN, the default for files */
+
+  return rc;
+}
+
+/*****************************************************************************
+ *
+ *  \brief Replacement MPI_File_read_at for basic datatypes
+ *
+ *  Any failure to read the full count is an error.
+ *
+ *****************************************************************************/
+
+int MPI_File_read_at(MPI_File fh, MPI_Offset offset, void * buf, int count,
+		     MPI_Datatype datatype, MPI_Status * status) {
+  int rc;
+  size_t sizeof_datatype;
+  FILE * fp = (FILE *) fh;
+
+  err_err_rcif(fp == NULL, MPI_ERR_ARG);
+  err_err_rcif(count < 0, MPI_ERR_COUNT);
+  err_err_rcif(mpi_sizeof(datatype, &sizeof_datatype), MPI_ERR_TYPE);
+
+  if (count == 0) return MPI_SUCCESS;
+
+  err_err_rcif(buf == NULL, MPI_ERR_BUFFER);
+  err_err_rcif(fseek(fp, (long) offset, SEEK_SET), MPI_ERR_OTHER);
+  err_err_rcif(fread(buf, sizeof_datatype, count, fp) != (size_t) count,
+	       MPI_ERR_OTHER);
+
+  return MPI_SUCCESS;
+
+ err:
+  /* As MPI_ERRORS_RETURN, the default for files */
+
+  return rc;
+}
+
 /*****************************************************************************
  *
  *  mpi_copy
@@ -1198,6 +1445,9 @@ static int mpi_sizeof(MPI_Datatype type, size_t * size) {
   case MPI_BYTE:
     *size = sizeof(char);
     break;
+  case MPI_LONG_LONG:
+    *size = sizeof(long long int);
+    break;
   case MPI_PACKED:
     err_err_if(1);
     break;
@@ -34,6 +34,9 @@ typedef MPI_Handle MPI_Datatype;
 typedef MPI_Handle MPI_Request;
 typedef MPI_Handle MPI_Op;
 typedef MPI_Handle MPI_Errhandler;
+typedef MPI_Handle MPI_Info;
+typedef struct mpi_file_s * MPI_File;
+typedef long long MPI_Offset;
 
 typedef struct {
   int MPI_SOURCE;
@@ -94,7 +97,8 @@ enum elementary_datatypes {MPI_CHAR,
 			   MPI_DOUBLE,
 			   MPI_LONG_DOUBLE,
 			   MPI_BYTE,
-			   MPI_PACKED};
+			   MPI_PACKED,
+			   MPI_LONG_LONG};
 
 enum collective_operations {MPI_MAX,
 			    MPI_MIN,
@@ -130,6 +134,15 @@ enum comm_comparisons {MPI_IDENT, MPI_CONGRUENT, MPI_SIMILAR, MPI_UNEQUAL};
 #define MPI_REQUEST_NULL    -4
 #define MPI_OP_NULL         -5
 #define MPI_ERRHANDLER_NULL -6
+#define MPI_INFO_NULL       -7
+#define MPI_FILE_NULL       ((MPI_File) 0)
+
+/* File access modes */
+
+enum file_modes {MPI_MODE_RDONLY = 2,
+		 MPI_MODE_RDWR = 8,
+		 MPI_MODE_WRONLY = 4,
+		 MPI_MODE_CREATE = 1};
 
 /* Interface */
 
@@ -157,6 +170,7 @@ int MPI_Issend(void * buf, int count, MPI_Datatype datatype, int dest,
 
 
 int MPI_Probe(int source, int tag, MPI_Comm comm, MPI_Status * status);
+int MPI_Get_count(MPI_Status * status, MPI_Datatype datatype, int * count);
 int MPI_Sendrecv(void * sendbuf, int sendcount, MPI_Datatype sendtype,
 		 int dest, int sendtag, void  *recvbuf, int recvcount,
 		 MPI_Datatype recvtype, int source, MPI_Datatype recvtag,
@@ -192,11 +206,26 @@ int MPI_Allgatherv(void * sendbuf, int sendcount, MPI_Datatype sendtype,
 
 int MPI_Allreduce(void * send, void * recv, int count, MPI_Datatype type,
 		  MPI_Op op, MPI_Comm comm);
+int MPI_Exscan(void * send, void * recv, int count, MPI_Datatype type,
+	       MPI_Op op, MPI_Comm comm);
 
 int MPI_Comm_split(MPI_Comm comm, int colour, int key, MPI_Comm * newcomm);
 int MPI_Comm_free(MPI_Comm * comm);
 int MPI_Comm_dup(MPI_Comm oldcomm, MPI_Comm * newcomm);
 
+/* Bindings for I/O */
+
+int MPI_File_open(MPI_Comm comm, const char * filename, int amode,
+		  MPI_Info info, MPI_File * fh);
+int MPI_File_close(MPI_File * fh);
+int MPI_File_set_size(MPI_File fh, MPI_Offset size);
+int MPI_File_delete(const char * filename, MPI_Info info);
+int MPI_File_write_at_all(MPI_File fh, MPI_Offset offset, void * buf,
+			  int count, MPI_Datatype datatype,
+			  MPI_Status * status);
+int MPI_File_read_at(MPI_File fh, MPI_Offset offset, void * buf, int count,
+		     MPI_Datatype datatype, MPI_Status * status);
+
 /* Bindings for process topologies */
 
 int MPI_Cart_create(MPI_Comm comm_old, int ndims, int * dims, int * periods,
@@ -106,7 +106,8 @@ typedef struct interface_s interface_t;
 typedef enum  {
   SIM_EXECUTE_INIT,      /**< Initialise simulation enumerator */
   SIM_EXECUTE_RUN,       /**< Run simulation enumerator */
-  SIM_EXECUTE_FINISH     /**< Finalise simulation enumerator */
+  SIM_EXECUTE_FINISH,    /**< Finalise simulation enumerator */
+  SIM_EXECUTE_TRIAL      /**< Run a whole trial (optional) */
 } sim_execute_enum_t;
 
 /**
@@ -116,10 +117,13 @@ typedef enum  {
  */
 
 typedef enum {
-  SIM_STATE_INIT,    /**< Initialise the simulation state */
-  SIM_STATE_READ,    /**< Read the simulation state */
-  SIM_STATE_WRITE,   /**< Write the simulation state */
-  SIM_STATE_DELETE   /**< Remove the simulation state */
+  SIM_STATE_INIT,       /**< Initialise the simulation state */
+  SIM_STATE_READ,       /**< Read the simulation state */
+  SIM_STATE_WRITE,      /**< Write the simulation state */
+  SIM_STATE_DELETE,     /**< Remove the simulation state */
+  SIM_STATE_PACK_SIZE,  /**< Report size of packed state (optional) */
+  SIM_STATE_PACK,       /**< Pack state into FFS buffer (optional) */
+  SIM_STATE_UNPACK      /**< Unpack state from FFS buffer (optional) */
 } sim_state_enum_t;
 
 /**
@@ -254,6 +258,20 @@ struct interface_s {
    *  is responsible for releasing all resources associated with the
    *  simulation (execpt the object itself, which is released via
    *  sim_test_free()). 
+   *
+   *  \code action = SIM_EXECUTE_TRIAL \endcode
+   *
+   *  is optional. It asks the simulation to run the remainder of a
+   *  trial itself, rather than return to FFS after each step (one step
+   *  being that taken by SIM_EXECUTE_RUN). The simulation should obtain
+   *  the bounds via ffs_trial_bounds(), and stop at the first multiple
+   *  of \c nsteplambda steps at which lambda is outside the interval
+   *  [lambda_min, lambda_max), or at which at least \c nstepmax steps
+   *  have been taken. It should then report the number of steps taken
+   *  via ffs_trial_nstep_set(), and the time as for SIM_EXECUTE_RUN.
+   *  FFS then asks for lambda in the usual way. A simulation without
+   *  this feature should return non-zero without further action (on
+   *  all ranks), whereupon FFS will run the trial step by step.
    */
 
   interface_execute_ft execute;
@@ -296,6 +314,27 @@ struct interface_s {
    *
    *  \code action = SIM_STATE_DELETE \endcode
    *  should remove the all the files identified by the \c stub string. 
+   *
+   *  A simulation may additionally support in-memory states, which
+   *  allows FFS to hold snapshots in RAM rather than going via the
+   *  file system. The \c stub argument is then unused. Three further
+   *  cases must be handled:
+   *
+   *  \code action = SIM_STATE_PACK_SIZE \endcode
+   *  should report, via ffs_state_size_set(), the number of bytes
+   *  required to hold the current state on this rank.
+   *
+   *  \code action = SIM_STATE_PACK \endcode
+   *  should copy the current state into the buffer obtained via
+   *  ffs_state_buffer().
+   *
+   *  \code action = SIM_STATE_UNPACK \endcode
+   *  should restore the state from the buffer obtained via
+   *  ffs_state_buffer().
+   *
+   *  A simulation which does not support in-memory states should
+   *  return non-zero for these actions (as for any unrecognised
+   *  action); FFS will then use SIM_STATE_READ and SIM_STATE_WRITE.
    */
 
   interface_state_ft   state;
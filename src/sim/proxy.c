@@ -5,23 +5,93 @@
  *
  *****************************************************************************/
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "u/libu.h"
 #include "ffs_private.h"
+#include "ffs_aggregate.h"
+#include "ffs_archive.h"
+#include "ffs_delta.h"
+#include "ffs_store.h"
+#include "ffs_reaper.h"
 #include "ffs_util.h"
+#include "ffs_writer.h"
 #include "factory.h"
 #include "proxy.h"
 
 struct proxy_s {
   int id;
+  int inst;                   /* Instance id (in state names) */
   abstract_sim_t * delegate;
   interface_t vtable;
   MPI_Comm parent;
   MPI_Comm comm;
   ffs_t * ffs;
+  int pack;                   /* Delegate supports in-memory states */
+  int trial;                  /* Delegate runs whole trials (-1 unknown) */
+  int memory;                 /* In-memory states allowed */
+  int mpi;                    /* Move states between proxies via MPI */
+  ffs_writer_t * writer;      /* Write-behind of packed states (or NULL) */
+  ffs_writer_t * reader;      /* Read-ahead of packed states (or NULL) */
+  ffs_archive_t * archive;    /* Segment files for packed states (or NULL) */
+  ffs_aggregate_t * aggregate;/* MPI-IO files of packed states (or NULL) */
+  u_string_t * scratch;       /* Node-local scratch directory (or NULL) */
+  u_string_t * cache;         /* Name of cache states (or NULL) */
+  ffs_store_t * store;        /* States held by this proxy */
+  ffs_reaper_t * reaper;      /* States awaiting deletion */
+  int delta;                  /* Maximum depth of delta chains (0 for none) */
+  size_t memory_max;          /* Bytes of snapshots in memory (0 no limit) */
+  int nhit;                   /* Reads from memory */
+  int nmiss;                  /* Reads from file */
+  int nspill;                 /* States evicted from memory to file */
+  ffs_handle_t origin;        /* State last read or written (or none) */
+  unsigned int generation;    /* Advanced by every change to the live state */
+  unsigned int origin_gen;    /* Generation when origin was read or written */
+  int nclean;                 /* Reads (or writes) with nothing to do */
+  ffs_handle_t ahead;         /* State being read ahead (or none) */
 };
 
+static int proxy_state_probe(proxy_t * obj);
+static int proxy_state_action(proxy_t * obj, sim_state_enum_t action,
+			      ffs_handle_t handle);
+static void proxy_state_forget(proxy_t * obj, ffs_handle_t handle);
+static int proxy_state_read(proxy_t * obj, ffs_handle_t handle);
+static int proxy_state_write(proxy_t * obj, ffs_handle_t handle);
+static int proxy_state_remove(proxy_t * obj, ffs_handle_t handle);
+static int proxy_state_remove_shared(proxy_t * obj, ffs_handle_t handle);
+static int proxy_state_pack(proxy_t * obj, ffs_handle_t handle);
+static int proxy_state_unpack(proxy_t * obj, void * buf, size_t nbytes);
+static int proxy_state_snapshot(ffs_state_t * s, void ** buf, size_t * nbytes,
+				void ** tmp);
+static int proxy_state_detach(proxy_t * obj, ffs_handle_t handle);
+static int proxy_state_fetch(proxy_t * obj, ffs_state_t * s);
+static int proxy_state_evict(proxy_t * obj);
+static int proxy_state_save(proxy_t * obj, ffs_state_t * s);
+static int proxy_state_write_behind(proxy_t * obj, ffs_state_t * s);
+static int proxy_state_load(proxy_t * obj, ffs_handle_t handle, void ** buf,
+			    size_t * nbytes);
+static int proxy_state_stub(proxy_t * obj, ffs_handle_t handle, char * stub);
+static int proxy_state_delegate(proxy_t * obj, sim_state_enum_t action,
+				ffs_handle_t handle);
+static int proxy_state_filename(proxy_t * obj, ffs_handle_t handle,
+				char * filename);
+static int proxy_state_aggregate_name(proxy_t * obj, const char * prefix,
+				      char * filename);
+static int proxy_state_ahead_drop(proxy_t * obj, ffs_handle_t handle);
+static int proxy_scratch_path(proxy_t * obj, ffs_handle_t handle,
+			      char * path);
+static int proxy_scratch_copy(proxy_t * obj, ffs_handle_t handle);
+static int proxy_file_copy(const char * src, const char * dest);
+
+#define PROXY_STATE_TAG 4001
+
 /*****************************************************************************
  *
  *  proxy_create
@@ -49,8 +119,14 @@ int proxy_create(int id, MPI_Comm parent, proxy_t ** pobj) {
   obj->id = id;
   obj->parent = parent;
   obj->comm = newcomm;
+  obj->memory = 1;
+  obj->trial = -1;
+  obj->origin = FFS_HANDLE_NONE;
+  obj->ahead = FFS_HANDLE_NONE;
 
   err_err_if(ffs_create(obj->comm, &obj->ffs));
+  err_err_if(ffs_store_create(&obj->store));
+  err_err_if(ffs_reaper_create(&obj->reaper));
 
   *pobj = obj;
 
@@ -83,6 +159,14 @@ void proxy_free(proxy_t * obj) {
 
   dbg_return_if(obj == NULL, );
 
+  if (obj->writer) ffs_writer_free(obj->writer);
+  if (obj->reader) ffs_writer_free(obj->reader);
+  if (obj->archive) ffs_archive_free(obj->archive);
+  if (obj->aggregate) ffs_aggregate_free(obj->aggregate);
+  if (obj->scratch) u_string_free(obj->scratch);
+  if (obj->cache) u_string_free(obj->cache);
+  if (obj->reaper) ffs_reaper_free(obj->reaper);
+  if (obj->store) ffs_store_free(obj->store);
   if (obj->ffs) ffs_free(obj->ffs);
   if (obj->comm != MPI_COMM_NULL) MPI_Comm_free(&obj->comm);
   u_free(obj);
@@ -109,6 +193,7 @@ int proxy_delegate_create(proxy_t * obj, const char * name) {
   err_err_if(factory_inquire(name, &present));
   err_err_ifm(present == 0, "No proxy with %s", name);
   err_err_if(factory_make(obj->comm, name, &obj->vtable, &obj->delegate));
+  obj->trial = -1;
 
   return 0;
 
@@ -143,45 +228,1961 @@ int proxy_execute(proxy_t * obj, sim_execute_enum_t action) {
 
   dbg_return_if(obj == NULL, -1);
 
+  obj->generation += 1;
+
   return obj->vtable.execute(obj->delegate, obj->ffs, action);
 }
 
+/*****************************************************************************
+ *
+ *  proxy_execute_trial
+ *
+ *  The first request settles whether the delegate can run a whole
+ *  trial; all ranks in the proxy must agree. A delegate which cannot
+ *  has taken no action, so the caller may go on step by step.
+ *
+ *****************************************************************************/
+
+int proxy_execute_trial(proxy_t * obj, double lambda_min, double lambda_max,
+			int nstepmax, int nsteplambda, int * nstep) {
+
+  int ifail;
+  int native;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(nstep == NULL, -1);
+
+  *nstep = -1;
+  if (obj->trial == 0) return 0;
+
+  ffs_trial_bounds_set(obj->ffs, lambda_min, lambda_max, nstepmax,
+		       nsteplambda);
+  ffs_trial_nstep_set(obj->ffs, 0);
+
+  obj->generation += 1;
+  ifail = obj->vtable.execute(obj->delegate, obj->ffs, SIM_EXECUTE_TRIAL);
+
+  if (obj->trial == -1) {
+    native = (ifail == 0);
+    MPI_Allreduce(&native, &obj->trial, 1, MPI_INT, MPI_LAND, obj->comm);
+    dbg_err_ifm(native != obj->trial, "Inconsistent SIM_EXECUTE_TRIAL");
+    if (obj->trial == 0) return 0;
+  }
+
+  dbg_err_if(ifail);
+  ffs_trial_nstep(obj->ffs, nstep);
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
 /*****************************************************************************
  *
  *  proxy_state
  *
+ *  If the delegate supports in-memory states, reads and writes are
+ *  made from and to the store. If a scratch directory is in use,
+ *  the delegate's files are placed there. Otherwise, the action is
+ *  passed directly to the delegate.
+ *
+ *  If nothing has changed the live state since the same state was
+ *  last read or written, a read (or write) of it is a no-op.
+ *
  *****************************************************************************/
 
-int proxy_state(proxy_t * obj, sim_state_enum_t action, const char * stub) {
+int proxy_state(proxy_t * obj, sim_state_enum_t action, ffs_handle_t handle) {
+
+  int ifail = 0;
 
   dbg_return_if(obj == NULL, -1);
-  dbg_return_if(stub == NULL, -1);
+  dbg_return_if(util_handle_ids(handle, NULL, NULL), -1);
+
+  if (action == SIM_STATE_INIT) {
+    obj->origin = FFS_HANDLE_NONE;
+    obj->generation += 1;
+    ifail = proxy_state_delegate(obj, action, handle);
+    if (ifail == 0) ifail = proxy_state_probe(obj);
+    return ifail;
+  }
 
-  return obj->vtable.state(obj->delegate, obj->ffs, action, stub);
+  if (action == SIM_STATE_READ || action == SIM_STATE_WRITE) {
+    if (obj->origin_gen == obj->generation && handle == obj->origin) {
+      obj->nclean += 1;
+      return 0;
+    }
+  }
+
+  if (action == SIM_STATE_DELETE) proxy_state_forget(obj, handle);
+
+  if (obj->pack == 0 && obj->scratch == NULL) {
+    /* The only record held is of retired states; a new write (or
+     * explicit delete) of the same state supersedes the retirement. */
+    if (action == SIM_STATE_WRITE || action == SIM_STATE_DELETE) {
+      ffs_store_remove(obj->store, handle);
+    }
+    ifail = proxy_state_delegate(obj, action, handle);
+  }
+  else {
+    ifail = proxy_state_action(obj, action, handle);
+  }
+
+  /* The live state is now that just read or written */
+
+  if (ifail == 0 && (action == SIM_STATE_READ || action == SIM_STATE_WRITE)) {
+    obj->origin = handle;
+    obj->origin_gen = obj->generation;
+  }
+
+  return ifail;
 }
 
 /*****************************************************************************
  *
- *  proxy_lambda
+ *  proxy_state_action
  *
  *****************************************************************************/
 
-int proxy_lambda(proxy_t * obj) {
+static int proxy_state_action(proxy_t * obj, sim_state_enum_t action,
+			      ffs_handle_t handle) {
+
+  int ifail = 0;
+
+  switch (action) {
+  case SIM_STATE_READ:
+    ifail = proxy_state_read(obj, handle);
+    break;
+  case SIM_STATE_WRITE:
+    ifail = proxy_state_write(obj, handle);
+    break;
+  case SIM_STATE_DELETE:
+    ifail = proxy_state_remove(obj, handle);
+    break;
+  default:
+    ifail = proxy_state_delegate(obj, action, handle);
+  }
+
+  return ifail;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_forget
+ *
+ *  A state which is going away can no longer stand for the live
+ *  state (nor be the base of a delta).
+ *
+ *****************************************************************************/
+
+static void proxy_state_forget(proxy_t * obj, ffs_handle_t handle) {
+
+  if (handle == obj->origin) obj->origin = FFS_HANDLE_NONE;
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_publish
+ *
+ *  A state held in memory, or in scratch, is copied to the shared
+ *  directory so that it is available to other proxies. The local
+ *  copy is retained. States already shared, or not held by this
+ *  proxy, need no action.
+ *
+ *****************************************************************************/
+
+int proxy_state_publish(proxy_t * obj, ffs_handle_t handle) {
+
+  int loc;
+  ffs_state_t * s = NULL;
 
   dbg_return_if(obj == NULL, -1);
 
-  return obj->vtable.lambda(obj->delegate, obj->ffs);
+  if (obj->pack == 0 && obj->scratch == NULL) return 0;
+
+  dbg_err_if(ffs_store_find(obj->store, handle, &s));
+  if (s == NULL) return 0;
+
+  dbg_err_if(ffs_state_location(s, &loc));
+  if (loc & FFS_STATE_SHARED) return 0;
+
+  if (loc & FFS_STATE_MEMORY) {
+    dbg_err_if(proxy_state_save(obj, s));
+  }
+  else if (loc & FFS_STATE_SCRATCH) {
+    dbg_err_if(proxy_scratch_copy(obj, handle));
+  }
+
+  dbg_err_if(ffs_state_location_set(s, loc | FFS_STATE_SHARED));
+
+  return 0;
+
+ err:
+
+  return -1;
 }
 
 /*****************************************************************************
  *
- *  proxy_info
+ *  proxy_state_adopt
+ *
+ *  Take responsibility for a state found in the shared directory,
+ *  e.g., one left by an earlier run, as if this proxy had written
+ *  and then published it.
  *
  *****************************************************************************/
 
-int proxy_info(proxy_t * obj, ffs_info_enum_t param) {
+int proxy_state_adopt(proxy_t * obj, ffs_handle_t handle) {
+
+  ffs_state_t * s = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(util_handle_ids(handle, NULL, NULL), -1);
+
+  if (obj->pack == 0 && obj->scratch == NULL) return 0;
+
+  dbg_err_if(proxy_state_detach(obj, handle));
+  dbg_err_if(ffs_store_add(obj->store, handle, &s));
+  dbg_err_if(ffs_state_base_set(s, NULL));
+  dbg_err_if(ffs_state_snapshot_set(s, NULL, 0));
+  dbg_err_if(ffs_state_location_set(s, FFS_STATE_SHARED));
+  dbg_err_if(ffs_store_touch(obj->store, handle));
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_release
+ *
+ *  Any background write of the state must be complete before the
+ *  local copy goes, so the writer is flushed.
+ *
+ *****************************************************************************/
+
+int proxy_state_release(proxy_t * obj, ffs_handle_t handle) {
+
+  int ifail = 0;
+  int loc;
+  char path[FILENAME_MAX];
+  ffs_state_t * s = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  proxy_state_forget(obj, handle);
+
+  if (obj->pack == 0 && obj->scratch == NULL) return 0;
+
+  dbg_err_if(ffs_store_find(obj->store, handle, &s));
+  if (s == NULL) return 0;
+
+  dbg_err_if(ffs_state_location(s, &loc));
+  dbg_err_ifm((loc & FFS_STATE_SHARED) == 0, "State %lld is not published",
+	      handle);
+
+  dbg_err_if(proxy_state_flush(obj));
+
+  if (loc & FFS_STATE_SCRATCH) {
+    dbg_err_if(proxy_scratch_path(obj, handle, path));
+    ifail = obj->vtable.state(obj->delegate, obj->ffs, SIM_STATE_DELETE, path);
+  }
+
+  dbg_err_if(ffs_store_remove(obj->store, handle));
+
+  return ifail;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_retire
+ *
+ *  Any copy in memory is released at once, as this costs nothing.
+ *  Copies in files are left for proxy_state_reap(). If the same state
+ *  is written again before then, the retirement is cancelled.
+ *
+ *****************************************************************************/
+
+int proxy_state_retire(proxy_t * obj, ffs_handle_t handle) {
+
+  int loc = FFS_STATE_SHARED;
+  int nref = 0;
+  ffs_state_t * s = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(util_handle_ids(handle, NULL, NULL), -1);
+
+  proxy_state_forget(obj, handle);
+
+  dbg_err_if(ffs_store_find(obj->store, handle, &s));
+  if (s) dbg_err_if(ffs_state_location(s, &loc));
+  if (loc & FFS_STATE_RETIRED) return 0;
+
+  loc &= ~(FFS_STATE_MEMORY | FFS_STATE_REMOTE);
+
+  if ((loc & (FFS_STATE_SCRATCH | FFS_STATE_SHARED)) == 0) {
+    if (s) dbg_err_if(ffs_store_remove(obj->store, handle));
+    return 0;
+  }
+
+  /* A snapshot which is the base of another must be kept */
+
+  dbg_err_if(ffs_store_add(obj->store, handle, &s));
+  dbg_err_if(ffs_state_nref(s, &nref));
+  if (nref == 0) dbg_err_if(ffs_state_snapshot_set(s, NULL, 0));
+  dbg_err_if(ffs_state_location_set(s, loc | FFS_STATE_RETIRED));
+  dbg_err_if(ffs_store_touch(obj->store, handle));
+  dbg_err_if(ffs_reaper_add(obj->reaper, handle));
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_reap
+ *
+ *  Delete up to nmax retired states (all if nmax < 0), oldest first.
+ *  States which have since been rewritten, or deleted, are skipped.
+ *
+ *****************************************************************************/
+
+int proxy_state_reap(proxy_t * obj, int nmax) {
+
+  int n;
+  int loc;
+  int ifail = 0;
+  ffs_handle_t handle;
+  ffs_state_t * s = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  for (n = 0; nmax < 0 || n < nmax; n++) {
+
+    if (ffs_reaper_next(obj->reaper, &handle) != 0) break;
+
+    dbg_err_if(ffs_store_find(obj->store, handle, &s));
+    if (s == NULL) continue;
+    dbg_err_if(ffs_state_location(s, &loc));
+    if ((loc & FFS_STATE_RETIRED) == 0) continue;
+
+    ifail += proxy_state_remove(obj, handle);
+  }
+
+  return ifail;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_nretired
+ *
+ *****************************************************************************/
+
+int proxy_state_nretired(proxy_t * obj, int * nretired) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  return ffs_reaper_nstate(obj->reaper, nretired);
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_inst_set
+ *
+ *****************************************************************************/
+
+int proxy_state_inst_set(proxy_t * obj, int inst) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(inst < 0, -1);
+  dbg_return_if(obj->archive, -1);
+
+  obj->inst = inst;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_cache_set
+ *
+ *****************************************************************************/
+
+int proxy_state_cache_set(proxy_t * obj, const char * prefix) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  if (obj->cache) u_string_free(obj->cache);
+  obj->cache = NULL;
+
+  if (prefix) {
+    dbg_return_if(u_string_create(prefix, strlen(prefix), &obj->cache), -1);
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_memory_set
+ *
+ *****************************************************************************/
+
+int proxy_state_memory_set(proxy_t * obj, int memory) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  obj->memory = memory;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_write_behind_set
+ *
+ *  Any existing writer is flushed and released first.
+ *
+ *****************************************************************************/
+
+int proxy_state_write_behind_set(proxy_t * obj, int nqueue) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(nqueue < 0, -1);
+
+  if (obj->writer) ffs_writer_free(obj->writer);
+  obj->writer = NULL;
+
+  if (nqueue > 0) dbg_return_if(ffs_writer_create(nqueue, &obj->writer), -1);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_archive_set
+ *
+ *****************************************************************************/
+
+int proxy_state_archive_set(proxy_t * obj, int archive) {
+
+  int rank;
+
+  dbg_return_if(obj == NULL, -1);
+
+  if (obj->archive) ffs_archive_free(obj->archive);
+  obj->archive = NULL;
+
+  if (archive) {
+    MPI_Comm_rank(obj->comm, &rank);
+    dbg_return_if(ffs_archive_create(obj->inst, obj->id, rank, &obj->archive),
+		  -1);
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_delta_set
+ *
+ *****************************************************************************/
+
+int proxy_state_delta_set(proxy_t * obj, int maxdepth) {
 
   dbg_return_if(obj == NULL, -1);
+  dbg_return_if(maxdepth < 0, -1);
+
+  obj->delta = maxdepth;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_memory_max_set
+ *
+ *****************************************************************************/
+
+int proxy_state_memory_max_set(proxy_t * obj, size_t nbytes) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  obj->memory_max = nbytes;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_cache_stats
+ *
+ *****************************************************************************/
+
+int proxy_state_cache_stats(proxy_t * obj, int * nhit, int * nmiss,
+			    int * nspill) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(nhit == NULL, -1);
+  dbg_return_if(nmiss == NULL, -1);
+  dbg_return_if(nspill == NULL, -1);
+
+  *nhit = obj->nhit;
+  *nmiss = obj->nmiss;
+  *nspill = obj->nspill;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_nclean
+ *
+ *****************************************************************************/
+
+int proxy_state_nclean(proxy_t * obj, int * nclean) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(nclean == NULL, -1);
+
+  *nclean = obj->nclean;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_prefetch_set
+ *
+ *****************************************************************************/
+
+int proxy_state_prefetch_set(proxy_t * obj, int prefetch) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  if (obj->reader) ffs_writer_free(obj->reader);
+  obj->reader = NULL;
+  obj->ahead = FFS_HANDLE_NONE;
+
+  if (prefetch) dbg_return_if(ffs_writer_create(2, &obj->reader), -1);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_prefetch
+ *
+ *  A state of our own which has been spilled to file may still have
+ *  a write queued, which the reader would not see, so it is left to
+ *  proxy_state_fetch(). A state in an aggregate file is read from a
+ *  file already open, so is also left alone.
+ *
+ *****************************************************************************/
+
+int proxy_state_prefetch(proxy_t * obj, ffs_handle_t handle) {
+
+  int loc;
+  int present;
+  char filename[FILENAME_MAX];
+  ffs_state_t * s = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  if (obj->reader == NULL || obj->pack == 0 || obj->archive) return 0;
+  if (handle == obj->ahead) return 0;
+
+  if (obj->aggregate) {
+    dbg_err_if(ffs_aggregate_present(obj->aggregate, handle, &present));
+    if (present) return 0;
+  }
+
+  dbg_err_if(ffs_store_find(obj->store, handle, &s));
+
+  if (s) {
+    dbg_err_if(ffs_state_location(s, &loc));
+    if (loc & (FFS_STATE_MEMORY | FFS_STATE_SCRATCH)) return 0;
+    if (obj->writer) return 0;
+  }
+
+  /* Discard any earlier read which was not wanted after all */
+
+  dbg_err_if(proxy_state_ahead_drop(obj, obj->ahead));
+  dbg_err_if(proxy_state_filename(obj, handle, filename));
+  dbg_err_if(ffs_writer_read(obj->reader, filename));
+  obj->ahead = handle;
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_flush
+ *
+ *****************************************************************************/
+
+int proxy_state_flush(proxy_t * obj) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  if (obj->writer == NULL) return 0;
+
+  return ffs_writer_flush(obj->writer);
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_mpi_set
+ *
+ *****************************************************************************/
+
+int proxy_state_mpi_set(proxy_t * obj, int mpi) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  obj->mpi = mpi;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_mpi
+ *
+ *  States can only be moved by message if they are held in memory.
+ *
+ *****************************************************************************/
+
+int proxy_state_mpi(proxy_t * obj, int * mpi) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(mpi == NULL, -1);
+
+  *mpi = (obj->mpi && obj->pack);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_mpiio_set
+ *
+ *****************************************************************************/
+
+int proxy_state_mpiio_set(proxy_t * obj, int mpiio) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  if (obj->aggregate) ffs_aggregate_free(obj->aggregate);
+  obj->aggregate = NULL;
+
+  if (mpiio) dbg_return_if(ffs_aggregate_create(&obj->aggregate), -1);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_mpiio
+ *
+ *  As for messages, only packed states can be aggregated.
+ *
+ *****************************************************************************/
+
+int proxy_state_mpiio(proxy_t * obj, int * mpiio) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(mpiio == NULL, -1);
+
+  *mpiio = (obj->aggregate != NULL && obj->pack);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_aggregate
+ *
+ *  The snapshots are written directly from the store. A delta is
+ *  decoded into a temporary copy, and a state which has been evicted
+ *  is read back into memory (it may then be evicted again).
+ *
+ *****************************************************************************/
+
+int proxy_state_aggregate(proxy_t * obj, const char * prefix, int nstate,
+			  ffs_handle_t * handle, MPI_Comm comm) {
+  int n;
+  int loc;
+  int ifail = 0, ifail_any = 0;
+  size_t * nbytes = NULL;
+  void ** buf = NULL;
+  void ** tmp = NULL;
+  char filename[FILENAME_MAX];
+  ffs_state_t * s = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(obj->aggregate == NULL, -1);
+  dbg_return_if(prefix == NULL, -1);
+  dbg_return_if(nstate > 0 && handle == NULL, -1);
+
+  nbytes = u_calloc(nstate + 1, sizeof(size_t));
+  buf = u_calloc(nstate + 1, sizeof(void *));
+  tmp = u_calloc(nstate + 1, sizeof(void *));
+  if (nbytes == NULL || buf == NULL || tmp == NULL) ifail = 1;
+
+  ifail += proxy_state_aggregate_name(obj, prefix, filename);
+
+  for (n = 0; ifail == 0 && n < nstate; n++) {
+    ifail = ffs_store_find(obj->store, handle[n], &s);
+    if (ifail == 0 && s == NULL) {
+      dbg_ifm(1, "State %lld not held by proxy", handle[n]);
+      ifail = 1;
+    }
+    if (ifail == 0) ifail = ffs_state_location(s, &loc);
+    if (ifail == 0 && (loc & FFS_STATE_MEMORY) == 0) {
+      ifail = proxy_state_fetch(obj, s);
+    }
+    if (ifail == 0) ifail = proxy_state_snapshot(s, buf + n, nbytes + n,
+						 tmp + n);
+  }
+
+  MPI_Allreduce(&ifail, &ifail_any, 1, MPI_INT, MPI_LOR, comm);
+  dbg_err_ifm(ifail_any, "Failed to collect states for %s", prefix);
+
+  dbg_err_if(ffs_aggregate_write(obj->aggregate, filename, nstate, handle, buf,
+				 nbytes, comm));
+
+  for (n = 0; n < nstate; n++) {
+    if (tmp[n]) u_free(tmp[n]);
+  }
+  u_free(tmp);
+  u_free(buf);
+  u_free(nbytes);
+
+  dbg_err_if(proxy_state_evict(obj));
+
+  return 0;
+
+ err:
+
+  if (tmp) {
+    for (n = 0; n < nstate; n++) {
+      if (tmp[n]) u_free(tmp[n]);
+    }
+    u_free(tmp);
+  }
+  if (buf) u_free(buf);
+  if (nbytes) u_free(nbytes);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_aggregate_remove
+ *
+ *****************************************************************************/
+
+int proxy_state_aggregate_remove(proxy_t * obj, const char * prefix,
+				 MPI_Comm comm) {
+
+  char filename[FILENAME_MAX];
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(prefix == NULL, -1);
+
+  if (obj->aggregate == NULL) return 0;
+
+  dbg_return_if(proxy_state_aggregate_name(obj, prefix, filename), -1);
+
+  return ffs_aggregate_remove(obj->aggregate, filename, comm);
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_isend
+ *
+ *  The snapshot is sent from the store, so the state must not be
+ *  written or deleted until the request has completed. A delta is
+ *  first replaced by the complete snapshot, as the receiver does not
+ *  hold the base. A state which has been evicted is read back into
+ *  memory (without evicting others, which may be in flight).
+ *
+ *****************************************************************************/
+
+int proxy_state_isend(proxy_t * obj, ffs_handle_t handle, int dest,
+		      MPI_Comm comm, MPI_Request * req) {
+  int loc;
+  size_t nbytes;
+  void * buf = NULL;
+  void * tmp = NULL;
+  ffs_state_t * s = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(req == NULL, -1);
+
+  dbg_err_if(ffs_store_find(obj->store, handle, &s));
+  dbg_err_ifm(s == NULL, "State %lld not held by proxy", handle);
+  dbg_err_if(ffs_state_location(s, &loc));
+  if ((loc & FFS_STATE_MEMORY) == 0 && obj->pack) {
+    dbg_err_if(proxy_state_fetch(obj, s));
+    dbg_err_if(ffs_state_location(s, &loc));
+  }
+  dbg_err_ifm((loc & FFS_STATE_MEMORY) == 0, "State %lld not in memory",
+	      handle);
+
+  dbg_err_if(proxy_state_snapshot(s, &buf, &nbytes, &tmp));
+  if (tmp) {
+    dbg_err_if(ffs_state_snapshot_set(s, tmp, nbytes));
+    tmp = NULL;
+    dbg_err_if(ffs_state_base_set(s, NULL));
+    dbg_err_if(ffs_store_touch(obj->store, handle));
+  }
+  dbg_err_if(nbytes > INT_MAX);
+
+  MPI_Isend(buf, (int) nbytes, MPI_BYTE, dest, PROXY_STATE_TAG, comm, req);
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_recv
+ *
+ *  Receive a snapshot sent by proxy_state_isend() to be held in
+ *  memory as a remote copy. Messages between the same pair of ranks
+ *  arrive in order, so the sequence of sends and receives must agree.
+ *
+ *****************************************************************************/
+
+int proxy_state_recv(proxy_t * obj, ffs_handle_t handle, int source,
+		     MPI_Comm comm) {
+  int count;
+  void * buf = NULL;
+  ffs_state_t * s = NULL;
+  MPI_Status status;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(util_handle_ids(handle, NULL, NULL), -1);
+
+  MPI_Probe(source, PROXY_STATE_TAG, comm, &status);
+  MPI_Get_count(&status, MPI_BYTE, &count);
+
+  buf = u_malloc(count > 0 ? count : 1);
+  dbg_err_sif(buf == NULL);
+
+  MPI_Recv(buf, count, MPI_BYTE, source, PROXY_STATE_TAG, comm, &status);
+
+  dbg_err_if(proxy_state_detach(obj, handle));
+  dbg_err_if(ffs_store_add(obj->store, handle, &s));
+  dbg_err_if(ffs_state_base_set(s, NULL));
+  dbg_err_if(ffs_state_snapshot_set(s, buf, count));
+  buf = NULL;
+  dbg_err_if(ffs_state_location_set(s, FFS_STATE_MEMORY | FFS_STATE_REMOTE));
+  dbg_err_if(ffs_store_touch(obj->store, handle));
+
+  return 0;
+
+ err:
+
+  if (buf) u_free(buf);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_discard
+ *
+ *  Remove a copy of a state received from another proxy (the original
+ *  remains the responsibility of the sender).
+ *
+ *****************************************************************************/
+
+int proxy_state_discard(proxy_t * obj, ffs_handle_t handle) {
+
+  int loc;
+  ffs_state_t * s = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  proxy_state_forget(obj, handle);
+  if (obj->archive) dbg_err_if(ffs_archive_forget(obj->archive, handle));
+
+  dbg_err_if(ffs_store_find(obj->store, handle, &s));
+  if (s == NULL) return 0;
+
+  dbg_err_if(ffs_state_location(s, &loc));
+  if (loc & FFS_STATE_REMOTE) dbg_err_if(ffs_store_remove(obj->store, handle));
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_scratch_set
+ *
+ *  Each proxy has its own directory below the scratch directory,
+ *  named for the MPI_COMM_WORLD rank of its root, so that the same
+ *  path is seen by all ranks in the proxy, and no two proxies share
+ *  a directory.
+ *
+ *****************************************************************************/
+
+int proxy_scratch_set(proxy_t * obj, const char * dir) {
+
+  int rank;
+  int ifail = 0, ifail_local = 0;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(dir == NULL, -1);
+  dbg_return_if(obj->scratch != NULL, -1);
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Bcast(&rank, 1, MPI_INT, 0, obj->comm);
+
+  ifail_local = u_string_create("", 0, &obj->scratch);
+
+  if (ifail_local == 0) {
+    ifail_local = u_string_sprintf(obj->scratch, "%s/ffs-proxy%6.6d", dir,
+				   rank);
+  }
+
+  if (ifail_local == 0 && mkdir(u_string_c(obj->scratch), 0700) != 0) {
+    ifail_local = (errno != EEXIST);
+  }
+
+  MPI_Allreduce(&ifail_local, &ifail, 1, MPI_INT, MPI_LOR, obj->comm);
+  dbg_err_ifm(ifail, "Could not create scratch directory in %s", dir);
+
+  return 0;
+
+ err:
+
+  if (obj->scratch) u_string_free(obj->scratch);
+  obj->scratch = NULL;
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_scratch_remove
+ *
+ *  Remove the contents of the scratch directory, and the directory
+ *  itself. Other ranks may be doing the same, so errors are ignored.
+ *
+ *****************************************************************************/
+
+int proxy_scratch_remove(proxy_t * obj) {
+
+  char path[FILENAME_MAX];
+  DIR * dir = NULL;
+  struct dirent * entry = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  if (obj->scratch == NULL) return 0;
+
+  dir = opendir(u_string_c(obj->scratch));
+
+  if (dir) {
+    while ((entry = readdir(dir))) {
+      if (entry->d_name[0] == '.') continue;
+      snprintf(path, FILENAME_MAX, "%s/%s", u_string_c(obj->scratch),
+	       entry->d_name);
+      remove(path);
+    }
+    closedir(dir);
+  }
+
+  rmdir(u_string_c(obj->scratch));
+  u_string_free(obj->scratch);
+  obj->scratch = NULL;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_probe
+ *
+ *  Ask the delegate for the size of a packed state. All ranks in
+ *  the proxy must agree that the delegate supports in-memory states.
+ *
+ *****************************************************************************/
+
+static int proxy_state_probe(proxy_t * obj) {
+
+  int ifail;
+  int pack = 0;
+
+  dbg_return_if(obj == NULL, -1);
+
+  if (obj->memory) {
+    ffs_state_size_set(obj->ffs, 0);
+    ifail = obj->vtable.state(obj->delegate, obj->ffs, SIM_STATE_PACK_SIZE,
+			      "");
+    pack = (ifail == 0);
+  }
+
+  MPI_Allreduce(&pack, &obj->pack, 1, MPI_INT, MPI_LAND, obj->comm);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_write
+ *
+ *  Any existing shared copy of the same state is now stale.
+ *
+ *****************************************************************************/
+
+static int proxy_state_write(proxy_t * obj, ffs_handle_t handle) {
+
+  int ifail = 0;
+  int loc = 0;
+  char path[FILENAME_MAX];
+  ffs_state_t * s = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  dbg_err_if(ffs_store_find(obj->store, handle, &s));
+  if (s) dbg_err_if(ffs_state_location(s, &loc));
+  if (loc & FFS_STATE_SHARED) proxy_state_remove_shared(obj, handle);
+
+  if (obj->pack) {
+    dbg_err_if(proxy_state_pack(obj, handle));
+    loc = FFS_STATE_MEMORY;
+    if (obj->writer) {
+      dbg_err_if(ffs_store_find(obj->store, handle, &s));
+      dbg_err_if(proxy_state_write_behind(obj, s));
+      loc |= FFS_STATE_SHARED;
+    }
+  }
+  else {
+    dbg_err_if(proxy_scratch_path(obj, handle, path));
+    ifail = obj->vtable.state(obj->delegate, obj->ffs, SIM_STATE_WRITE, path);
+    if (ifail) return ifail;
+    loc = FFS_STATE_SCRATCH;
+  }
+
+  dbg_err_if(ffs_store_add(obj->store, handle, &s));
+  dbg_err_if(ffs_state_location_set(s, loc));
+
+  if (obj->pack) dbg_err_if(proxy_state_evict(obj));
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_read
+ *
+ *  From memory or scratch if held locally, otherwise the state
+ *  should be in the shared directory. A state of our own which has
+ *  been evicted from memory is read back into memory.
+ *
+ *****************************************************************************/
+
+static int proxy_state_read(proxy_t * obj, ffs_handle_t handle) {
+
+  int ifail = 0;
+  int loc = FFS_STATE_SHARED;
+  size_t nbytes = 0;
+  void * buf = NULL;
+  void * tmp = NULL;
+  char path[FILENAME_MAX];
+  ffs_state_t * s = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  dbg_err_if(ffs_store_find(obj->store, handle, &s));
+  if (s) dbg_err_if(ffs_state_location(s, &loc));
+
+  if (loc & FFS_STATE_MEMORY) {
+    obj->nhit += 1;
+    dbg_err_if(proxy_state_snapshot(s, &buf, &nbytes, &tmp));
+    ifail = proxy_state_unpack(obj, buf, nbytes);
+    if (tmp) u_free(tmp);
+    dbg_err_if(ffs_store_touch(obj->store, handle));
+  }
+  else if (loc & FFS_STATE_SCRATCH) {
+    dbg_err_if(proxy_scratch_path(obj, handle, path));
+    ifail = obj->vtable.state(obj->delegate, obj->ffs, SIM_STATE_READ, path);
+  }
+  else if (obj->pack && s && (loc & FFS_STATE_RETIRED) == 0) {
+    obj->nmiss += 1;
+    dbg_err_if(proxy_state_fetch(obj, s));
+    dbg_err_if(ffs_state_snapshot(s, &buf, &nbytes));
+    ifail = proxy_state_unpack(obj, buf, nbytes);
+    dbg_err_if(proxy_state_evict(obj));
+  }
+  else if (obj->pack) {
+    obj->nmiss += 1;
+    dbg_err_if(proxy_state_load(obj, handle, &buf, &nbytes));
+    ifail = proxy_state_unpack(obj, buf, nbytes);
+    u_free(buf);
+  }
+  else {
+    ifail = proxy_state_delegate(obj, SIM_STATE_READ, handle);
+  }
+
+  return ifail;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_remove
+ *
+ *  Remove all copies of the state.
+ *
+ *****************************************************************************/
+
+static int proxy_state_remove(proxy_t * obj, ffs_handle_t handle) {
+
+  int ifail = 0;
+  int loc = FFS_STATE_SHARED;
+  char path[FILENAME_MAX];
+  ffs_state_t * s = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  dbg_err_if(ffs_store_find(obj->store, handle, &s));
+  if (s) dbg_err_if(ffs_state_location(s, &loc));
+
+  if (loc & FFS_STATE_SCRATCH) {
+    dbg_err_if(proxy_scratch_path(obj, handle, path));
+    ifail += obj->vtable.state(obj->delegate, obj->ffs, SIM_STATE_DELETE, path);
+  }
+
+  if (loc & FFS_STATE_SHARED) {
+    ifail += proxy_state_remove_shared(obj, handle);
+  }
+
+  if (s) dbg_err_if(ffs_store_remove(obj->store, handle));
+
+  return ifail;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_remove_shared
+ *
+ *****************************************************************************/
+
+static int proxy_state_remove_shared(proxy_t * obj, ffs_handle_t handle) {
+
+  char filename[FILENAME_MAX];
+
+  dbg_return_if(obj == NULL, -1);
+
+  if (obj->pack == 0) {
+    return proxy_state_delegate(obj, SIM_STATE_DELETE, handle);
+  }
+
+  if (obj->archive) {
+    return ffs_archive_remove(obj->archive, handle, obj->writer);
+  }
+
+  dbg_return_if(proxy_state_filename(obj, handle, filename), -1);
+  dbg_return_if(proxy_state_ahead_drop(obj, handle), -1);
+
+  if (obj->writer) {
+    dbg_return_if(ffs_writer_remove(obj->writer, filename), -1);
+  }
+  else {
+    remove(filename);
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_pack
+ *
+ *  Pack the current simulation state into a new snapshot held in
+ *  the store (replacing any existing snapshot of the same state).
+ *
+ *  If deltas are in use, the new snapshot is encoded against the
+ *  state last read or written (the parent), provided the parent is
+ *  held in memory, the chain of deltas is not too long, and the
+ *  result is smaller. The parent is only a guess at the most similar
+ *  state: a delta against any base of the same size is exact.
+ *
+ *****************************************************************************/
+
+static int proxy_state_pack(proxy_t * obj, ffs_handle_t handle) {
+
+  int depth;
+  size_t nbytes = 0;
+  size_t nbase, ndelta;
+  void * buf = NULL;
+  void * bbuf = NULL;
+  void * btmp = NULL;
+  void * delta = NULL;
+  ffs_state_t * s = NULL;
+  ffs_state_t * base = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  dbg_err_if(obj->vtable.state(obj->delegate, obj->ffs, SIM_STATE_PACK_SIZE,
+			       ""));
+  dbg_err_if(ffs_state_size(obj->ffs, &nbytes));
+
+  buf = u_malloc(nbytes > 0 ? nbytes : 1);
+  dbg_err_sif(buf == NULL);
+
+  dbg_err_if(ffs_state_buffer_set(obj->ffs, buf, nbytes));
+  dbg_err_if(obj->vtable.state(obj->delegate, obj->ffs, SIM_STATE_PACK, ""));
+  dbg_err_if(ffs_state_buffer_set(obj->ffs, NULL, 0));
+
+  if (obj->delta > 0 && obj->origin != FFS_HANDLE_NONE &&
+      obj->origin != handle) {
+    dbg_err_if(ffs_store_find(obj->store, obj->origin, &base));
+    if (base) {
+      dbg_err_if(ffs_state_depth(base, &depth));
+      dbg_err_if(proxy_state_snapshot(base, &bbuf, &nbase, &btmp));
+      if (bbuf == NULL || nbase != nbytes || depth >= obj->delta) base = NULL;
+    }
+    if (base) {
+      dbg_err_if(ffs_delta_encode(bbuf, buf, nbytes, &delta, &ndelta));
+      if (ndelta < nbytes) {
+	u_free(buf);
+	buf = delta;
+	nbytes = ndelta;
+      }
+      else {
+	u_free(delta);
+	base = NULL;
+      }
+      delta = NULL;
+    }
+    if (btmp) u_free(btmp);
+    btmp = NULL;
+  }
+
+  dbg_err_if(proxy_state_detach(obj, handle));
+  dbg_err_if(ffs_store_add(obj->store, handle, &s));
+  dbg_err_if(ffs_state_snapshot_set(s, buf, nbytes));
+  buf = NULL;
+  dbg_err_if(ffs_state_base_set(s, base));
+  dbg_err_if(ffs_store_touch(obj->store, handle));
+
+  return 0;
+
+ err:
+
+  ffs_state_buffer_set(obj->ffs, NULL, 0);
+  if (buf) u_free(buf);
+  if (btmp) u_free(btmp);
+  if (delta) u_free(delta);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_unpack
+ *
+ *****************************************************************************/
+
+static int proxy_state_unpack(proxy_t * obj, void * buf, size_t nbytes) {
+
+  int ifail;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(buf == NULL, -1);
+
+  dbg_return_if(ffs_state_buffer_set(obj->ffs, buf, nbytes), -1);
+  ifail = obj->vtable.state(obj->delegate, obj->ffs, SIM_STATE_UNPACK, "");
+  ffs_state_buffer_set(obj->ffs, NULL, 0);
+
+  return ifail;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_snapshot
+ *
+ *  Return the complete packed snapshot for the state. If this has
+ *  to be decoded, *tmp is a new buffer (which is also *buf) to be
+ *  released by the caller; otherwise *tmp is NULL.
+ *
+ *****************************************************************************/
+
+static int proxy_state_snapshot(ffs_state_t * s, void ** buf, size_t * nbytes,
+				void ** tmp) {
+  size_t ndelta;
+  void * delta = NULL;
+  void * bbuf = NULL;
+  void * btmp = NULL;
+  void * out = NULL;
+  ffs_state_t * base = NULL;
+
+  dbg_return_if(s == NULL, -1);
+  dbg_return_if(buf == NULL, -1);
+  dbg_return_if(nbytes == NULL, -1);
+  dbg_return_if(tmp == NULL, -1);
+
+  *tmp = NULL;
+  dbg_err_if(ffs_state_base(s, &base));
+
+  if (base == NULL) return ffs_state_snapshot(s, buf, nbytes);
+
+  dbg_err_if(ffs_state_snapshot(s, &delta, &ndelta));
+  dbg_err_if(proxy_state_snapshot(base, &bbuf, nbytes, &btmp));
+
+  out = u_malloc(*nbytes > 0 ? *nbytes : 1);
+  dbg_err_sif(out == NULL);
+  dbg_err_if(ffs_delta_decode(bbuf, *nbytes, delta, ndelta, out));
+  if (btmp) u_free(btmp);
+
+  *buf = out;
+  *tmp = out;
+
+  return 0;
+
+ err:
+
+  if (btmp) u_free(btmp);
+  if (out) u_free(out);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_detach
+ *
+ *  A state which is the base of others must keep its snapshot, so
+ *  it is removed from the store before the handle is given a new one.
+ *  It is released when its last user goes.
+ *
+ *****************************************************************************/
+
+static int proxy_state_detach(proxy_t * obj, ffs_handle_t handle) {
+
+  int nref = 0;
+  ffs_state_t * s = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  dbg_err_if(ffs_store_find(obj->store, handle, &s));
+  if (s) dbg_err_if(ffs_state_nref(s, &nref));
+  if (nref > 0) dbg_err_if(ffs_store_remove(obj->store, handle));
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_fetch
+ *
+ *  Read the shared copy of a state held by this proxy back into
+ *  memory. Any write of the copy still queued must complete first.
+ *
+ *****************************************************************************/
+
+static int proxy_state_fetch(proxy_t * obj, ffs_state_t * s) {
+
+  int loc;
+  size_t nbytes;
+  void * buf = NULL;
+  ffs_handle_t handle;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(s == NULL, -1);
+
+  if (obj->writer) dbg_err_if(ffs_writer_flush(obj->writer));
+
+  dbg_err_if(ffs_state_handle(s, &handle));
+  dbg_err_if(ffs_state_location(s, &loc));
+  dbg_err_if(proxy_state_load(obj, handle, &buf, &nbytes));
+  dbg_err_if(ffs_state_snapshot_set(s, buf, nbytes));
+  buf = NULL;
+  dbg_err_if(ffs_state_location_set(s, loc | FFS_STATE_MEMORY));
+  dbg_err_if(ffs_store_touch(obj->store, handle));
+
+  return 0;
+
+ err:
+
+  if (buf) u_free(buf);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_evict
+ *
+ *  While the snapshots in memory exceed the limit, the least recently
+ *  used are written to the shared directory (unless already there)
+ *  and released. Copies received from other proxies, and states which
+ *  are the base of a delta, are not evicted.
+ *
+ *****************************************************************************/
+
+static int proxy_state_evict(proxy_t * obj) {
+
+  int loc, nref;
+  size_t nbytes;
+  ffs_handle_t handle;
+  ffs_state_t * s = NULL;
+  ffs_state_t * next = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+
+  if (obj->memory_max == 0) return 0;
+
+  dbg_err_if(ffs_store_nbytes(obj->store, &nbytes));
+  dbg_err_if(ffs_store_lru(obj->store, NULL, &s));
+
+  while (s && nbytes > obj->memory_max) {
+
+    dbg_err_if(ffs_store_lru(obj->store, s, &next));
+    dbg_err_if(ffs_state_location(s, &loc));
+    dbg_err_if(ffs_state_nref(s, &nref));
+
+    if ((loc & FFS_STATE_MEMORY) && (loc & FFS_STATE_REMOTE) == 0 &&
+	nref == 0) {
+
+      if ((loc & FFS_STATE_SHARED) == 0) {
+	if (obj->writer) {
+	  dbg_err_if(proxy_state_write_behind(obj, s));
+	}
+	else {
+	  dbg_err_if(proxy_state_save(obj, s));
+	}
+      }
+
+      loc = (loc & ~FFS_STATE_MEMORY) | FFS_STATE_SHARED;
+      dbg_err_if(ffs_state_snapshot_set(s, NULL, 0));
+      dbg_err_if(ffs_state_base_set(s, NULL));
+      dbg_err_if(ffs_state_location_set(s, loc));
+      dbg_err_if(ffs_state_handle(s, &handle));
+      dbg_err_if(ffs_store_touch(obj->store, handle));
+      dbg_err_if(ffs_store_nbytes(obj->store, &nbytes));
+      obj->nspill += 1;
+    }
+
+    s = next;
+  }
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_save
+ *
+ *  Write a packed snapshot to the shared directory, either to its
+ *  own file, or to the archive.
+ *
+ *****************************************************************************/
+
+static int proxy_state_save(proxy_t * obj, ffs_state_t * s) {
+
+  int ifail = 0;
+  size_t nbytes;
+  void * buf = NULL;
+  void * tmp = NULL;
+  char filename[FILENAME_MAX];
+  ffs_handle_t handle;
+  FILE * fp = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(s == NULL, -1);
+
+  dbg_err_if(ffs_state_handle(s, &handle));
+  dbg_err_if(proxy_state_snapshot(s, &buf, &nbytes, &tmp));
+
+  if (obj->archive) {
+    ifail = ffs_archive_put(obj->archive, handle, buf, nbytes, NULL);
+    if (tmp) u_free(tmp);
+    return ifail;
+  }
+
+  dbg_err_if(proxy_state_filename(obj, handle, filename));
+  dbg_err_if(proxy_state_ahead_drop(obj, handle));
+
+  fp = fopen(filename, "wb");
+  dbg_err_ifm(fp == NULL, "fopen(%s) failed", filename);
+  dbg_err_sif(fwrite(buf, 1, nbytes, fp) != nbytes);
+  dbg_err_sif(fclose(fp));
+  if (tmp) u_free(tmp);
+
+  return 0;
+
+ err:
+
+  if (fp) fclose(fp);
+  if (tmp) u_free(tmp);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_write_behind
+ *
+ *  As proxy_state_save(), but the file is written by the writer
+ *  thread. The writer requires its own copy of the data, as the
+ *  snapshot may be replaced or released before the write happens.
+ *
+ *****************************************************************************/
+
+static int proxy_state_write_behind(proxy_t * obj, ffs_state_t * s) {
+
+  int ifail = 0;
+  size_t nbytes;
+  void * buf = NULL;
+  void * tmp = NULL;
+  void * copy = NULL;
+  char filename[FILENAME_MAX];
+  ffs_handle_t handle;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(obj->writer == NULL, -1);
+  dbg_return_if(s == NULL, -1);
+
+  dbg_err_if(ffs_state_handle(s, &handle));
+  dbg_err_if(proxy_state_snapshot(s, &buf, &nbytes, &tmp));
+
+  if (obj->archive) {
+    /* The archive makes its own copy of the data */
+    ifail = ffs_archive_put(obj->archive, handle, buf, nbytes, obj->writer);
+    if (tmp) u_free(tmp);
+    return ifail;
+  }
+
+  dbg_err_if(proxy_state_filename(obj, handle, filename));
+  dbg_err_if(proxy_state_ahead_drop(obj, handle));
+
+  /* A decoded snapshot is already a copy */
+
+  copy = tmp;
+  tmp = NULL;
+
+  if (copy == NULL) {
+    copy = u_malloc(nbytes > 0 ? nbytes : 1);
+    dbg_err_sif(copy == NULL);
+    memcpy(copy, buf, nbytes);
+  }
+
+  dbg_err_if(ffs_writer_write(obj->writer, filename, copy, nbytes));
+
+  return 0;
+
+ err:
+
+  if (tmp) u_free(tmp);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_load
+ *
+ *  Read a packed snapshot from an aggregate file, or the shared
+ *  directory (or archive), into a new buffer; the caller is to
+ *  release the buffer.
+ *
+ *****************************************************************************/
+
+static int proxy_state_load(proxy_t * obj, ffs_handle_t handle, void ** pbuf,
+			    size_t * nbytes) {
+  long len;
+  void * buf = NULL;
+  char filename[FILENAME_MAX];
+  FILE * fp = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(pbuf == NULL, -1);
+  dbg_return_if(nbytes == NULL, -1);
+
+  if (obj->aggregate) {
+    dbg_err_if(ffs_aggregate_get(obj->aggregate, handle, pbuf, nbytes));
+    if (*pbuf) return 0;
+  }
+
+  if (obj->archive) {
+    /* Any local record must be on disk before it can be read */
+    if (obj->writer) dbg_err_if(ffs_writer_flush(obj->writer));
+    return ffs_archive_get(obj->archive, handle, pbuf, nbytes);
+  }
+
+  dbg_err_if(proxy_state_filename(obj, handle, filename));
+
+  if (obj->reader && handle == obj->ahead) {
+    /* Read ahead; if that failed, try again here */
+    obj->ahead = FFS_HANDLE_NONE;
+    if (ffs_writer_collect(obj->reader, filename, pbuf, nbytes) == 0) {
+      return 0;
+    }
+  }
+
+  fp = fopen(filename, "rb");
+  dbg_err_ifm(fp == NULL, "fopen(%s) failed", filename);
+  dbg_err_sif(fseek(fp, 0, SEEK_END));
+  dbg_err_sif((len = ftell(fp)) < 0);
+  dbg_err_sif(fseek(fp, 0, SEEK_SET));
+
+  buf = u_malloc(len > 0 ? len : 1);
+  dbg_err_sif(buf == NULL);
+  dbg_err_sif(fread(buf, 1, len, fp) != (size_t) len);
+  fclose(fp);
+
+  *pbuf = buf;
+  *nbytes = len;
+
+  return 0;
+
+ err:
+
+  if (fp) fclose(fp);
+  if (buf) u_free(buf);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_stub
+ *
+ *  The name of a state, for the file system or the delegate. This is
+ *  that of util_handle_stub(), except that states in the cache group
+ *  are named for the cache, as they may be used by other instances
+ *  (or later runs).
+ *
+ *****************************************************************************/
+
+static int proxy_state_stub(proxy_t * obj, ffs_handle_t handle, char * stub) {
+
+  int id_group;
+  long long int id_state;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(stub == NULL, -1);
+  dbg_return_if(util_handle_ids(handle, &id_group, &id_state), -1);
+
+  if (id_group != FFS_HANDLE_GROUP_CACHE) {
+    return util_handle_stub(obj->inst, handle, stub);
+  }
+
+  dbg_return_ifm(obj->cache == NULL, -1, "No cache for state %lld", id_state);
+  dbg_return_if(snprintf(stub, FILENAME_MAX, "%s-%lld", u_string_c(obj->cache),
+			 id_state) >= FILENAME_MAX, -1);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_delegate
+ *
+ *  Pass the action to the delegate, which works by name.
+ *
+ *****************************************************************************/
+
+static int proxy_state_delegate(proxy_t * obj, sim_state_enum_t action,
+				ffs_handle_t handle) {
+  char stub[FILENAME_MAX];
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(proxy_state_stub(obj, handle, stub), -1);
+
+  return obj->vtable.state(obj->delegate, obj->ffs, action, stub);
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_filename
+ *
+ *  Packed states are per rank in the proxy communicator.
+ *
+ *****************************************************************************/
+
+static int proxy_state_filename(proxy_t * obj, ffs_handle_t handle,
+				char * filename) {
+  int rank;
+  char stub[FILENAME_MAX];
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(filename == NULL, -1);
+  dbg_return_if(proxy_state_stub(obj, handle, stub), -1);
+
+  MPI_Comm_rank(obj->comm, &rank);
+  dbg_return_if(snprintf(filename, FILENAME_MAX, "%s.rank%4.4d", stub, rank)
+		>= FILENAME_MAX, -1);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_aggregate_name
+ *
+ *  One aggregate file per rank in the proxy communicator.
+ *
+ *****************************************************************************/
+
+static int proxy_state_aggregate_name(proxy_t * obj, const char * prefix,
+				      char * filename) {
+  int rank;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(prefix == NULL, -1);
+  dbg_return_if(filename == NULL, -1);
+
+  MPI_Comm_rank(obj->comm, &rank);
+  dbg_return_if(snprintf(filename, FILENAME_MAX, "%s.rank%4.4d.aggregate",
+			 prefix, rank) >= FILENAME_MAX, -1);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_state_ahead_drop
+ *
+ *  If the state is being read ahead, the contents are discarded (the
+ *  file is about to change, or they are not wanted).
+ *
+ *****************************************************************************/
+
+static int proxy_state_ahead_drop(proxy_t * obj, ffs_handle_t handle) {
+
+  size_t nbytes;
+  void * buf = NULL;
+  char filename[FILENAME_MAX];
+
+  dbg_return_if(obj == NULL, -1);
+
+  if (obj->reader == NULL || obj->ahead == FFS_HANDLE_NONE) return 0;
+  if (handle != obj->ahead) return 0;
+
+  dbg_return_if(proxy_state_filename(obj, obj->ahead, filename), -1);
+  obj->ahead = FFS_HANDLE_NONE;
+
+  if (ffs_writer_collect(obj->reader, filename, &buf, &nbytes) == 0) {
+    u_free(buf);
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_scratch_path
+ *
+ *  The name of the state in the scratch directory.
+ *
+ *****************************************************************************/
+
+static int proxy_scratch_path(proxy_t * obj, ffs_handle_t handle,
+			      char * path) {
+
+  char stub[FILENAME_MAX];
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(obj->scratch == NULL, -1);
+  dbg_return_if(path == NULL, -1);
+  dbg_return_if(proxy_state_stub(obj, handle, stub), -1);
+
+  dbg_return_if(snprintf(path, FILENAME_MAX, "%s/%s",
+			 u_string_c(obj->scratch), stub) >= FILENAME_MAX, -1);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_scratch_copy
+ *
+ *  The delegate's files for a state are taken to be those in the
+ *  scratch directory named either "stub" or "stub.*". These are
+ *  copied to the shared working directory.
+ *
+ *  More than one rank in the proxy may see the same scratch directory,
+ *  so each copy is made to a temporary file which is then renamed.
+ *
+ *****************************************************************************/
+
+static int proxy_scratch_copy(proxy_t * obj, ffs_handle_t handle) {
+
+  int rank;
+  size_t len;
+  char stub[FILENAME_MAX];
+  char src[FILENAME_MAX];
+  char dest[FILENAME_MAX];
+  char tmp[FILENAME_MAX];
+  DIR * dir = NULL;
+  struct dirent * entry = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(obj->scratch == NULL, -1);
+  dbg_return_if(proxy_state_stub(obj, handle, stub), -1);
+
+  MPI_Comm_rank(obj->comm, &rank);
+  len = strlen(stub);
+
+  dir = opendir(u_string_c(obj->scratch));
+  dbg_err_sif(dir == NULL);
+
+  while ((entry = readdir(dir))) {
+    if (strncmp(entry->d_name, stub, len) != 0) continue;
+    if (entry->d_name[len] != '\0' && entry->d_name[len] != '.') continue;
+
+    snprintf(src, FILENAME_MAX, "%s/%s", u_string_c(obj->scratch),
+	     entry->d_name);
+    snprintf(dest, FILENAME_MAX, "%s", entry->d_name);
+    dbg_err_if(snprintf(tmp, FILENAME_MAX, "%s.tmp%4.4d", dest, rank)
+	       >= FILENAME_MAX);
+
+    dbg_err_if(proxy_file_copy(src, tmp));
+    dbg_err_sif(rename(tmp, dest));
+  }
+
+  closedir(dir);
+
+  return 0;
+
+ err:
+
+  if (dir) closedir(dir);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_file_copy
+ *
+ *****************************************************************************/
+
+static int proxy_file_copy(const char * src, const char * dest) {
+
+  int ifail;
+  size_t nread;
+  char buf[BUFSIZ];
+  FILE * fpin = NULL;
+  FILE * fpout = NULL;
+
+  dbg_return_if(src == NULL, -1);
+  dbg_return_if(dest == NULL, -1);
+
+  fpin = fopen(src, "rb");
+  dbg_err_ifm(fpin == NULL, "fopen(%s) failed", src);
+  fpout = fopen(dest, "wb");
+  dbg_err_ifm(fpout == NULL, "fopen(%s) failed", dest);
+
+  while ((nread = fread(buf, 1, BUFSIZ, fpin)) > 0) {
+    dbg_err_sif(fwrite(buf, 1, nread, fpout) != nread);
+  }
+
+  dbg_err_sif(ferror(fpin));
+  fclose(fpin);
+  fpin = NULL;
+
+  /* The stream is gone whether or not fclose() succeeds */
+
+  ifail = fclose(fpout);
+  fpout = NULL;
+  dbg_err_sif(ifail);
+
+  return 0;
+
+ err:
+
+  if (fpin) fclose(fpin);
+  if (fpout) fclose(fpout);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  proxy_lambda
+ *
+ *****************************************************************************/
+
+int proxy_lambda(proxy_t * obj) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  return obj->vtable.lambda(obj->delegate, obj->ffs);
+}
+
+/*****************************************************************************
+ *
+ *  proxy_info
+ *
+ *****************************************************************************/
+
+int proxy_info(proxy_t * obj, ffs_info_enum_t param) {
+
+  dbg_return_if(obj == NULL, -1);
+
+  /* The simulation takes a new value (e.g., a seed) */
+
+  if (param == FFS_INFO_TIME_FETCH || param == FFS_INFO_RNG_SEED_FETCH ||
+      param == FFS_INFO_LAMBDA_FETCH) {
+    obj->generation += 1;
+  }
 
   return obj->vtable.info(obj->delegate, obj->ffs, param);
 }
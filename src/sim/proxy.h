@@ -10,6 +10,7 @@
 #include <mpi.h>
 
 #include "ffs.h"
+#include "ffs_util.h"
 #include "interface.h"
 
 /**
@@ -92,20 +93,508 @@ int proxy_delegate_free(proxy_t * obj);
 
 int proxy_execute(proxy_t * obj, sim_execute_enum_t action);
 
+/**
+ *  \brief Ask the simulation to run the remainder of a trial
+ *
+ *  \param obj         the proxy object
+ *  \param lambda_min  the trial stops if lambda falls below this value
+ *  \param lambda_max  the trial stops if lambda reaches this value
+ *  \param nstepmax    the trial stops after at least this many steps
+ *  \param nsteplambda the number of steps between examinations of lambda
+ *  \param nstep       a pointer to the number of steps taken
+ *
+ *  \retval 0          a success
+ *  \retval -1         a failure
+ *
+ *  If the simulation does not support SIM_EXECUTE_TRIAL, no steps
+ *  are taken and \c nstep is returned as -1. The answer is sought
+ *  from the simulation only once.
+ */
+
+int proxy_execute_trial(proxy_t * obj, double lambda_min, double lambda_max,
+			int nstepmax, int nsteplambda, int * nstep);
+
 /**
  *  \brief Execute a state action
  *
  *  \param obj      the proxy object
  *  \param action   one of the actions sim_state_enum_t
- *  \param stub     filename stub
+ *  \param handle   the state (see util_handle())
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  This will pass the arguments to the real simulation. However, if
+ *  the simulation supports in-memory states (SIM_STATE_PACK et al.),
+ *  the proxy will hold states written in memory, and subsequent reads
+ *  of the same state will not touch the file system. Otherwise, if a
+ *  scratch directory has been set, the simulation's files are written
+ *  there (see proxy_scratch_set()). A name is formed from the handle
+ *  (see util_handle_stub()) only where the simulation, or a file,
+ *  needs one.
+ *
+ *  The proxy also records which state the live state was last read
+ *  from or written to. Any proxy_execute(), and any proxy_info()
+ *  which passes a value (e.g., a seed) to the simulation, changes
+ *  the live state. Until then, a read or write of that state has
+ *  nothing to do, and returns at once.
+ */
+
+int proxy_state(proxy_t * obj, sim_state_enum_t action, ffs_handle_t handle);
+
+/**
+ *  \brief Make a state available to other proxies
+ *
+ *  \param obj      the proxy object
+ *  \param handle   the state
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  States written via proxy_state() may be held in memory, or in
+ *  a scratch directory, visible to this proxy only. This copies the
+ *  state identified by \c handle to the shared (working) directory, so
+ *  that it may be read by any proxy. The local copy is retained, and
+ *  all copies are removed by a subsequent SIM_STATE_DELETE. There is
+ *  no action if the state is not held locally, or is already shared.
+ */
+
+int proxy_state_publish(proxy_t * obj, ffs_handle_t handle);
+
+/**
+ *  \brief Take on a state already in the shared directory
+ *
+ *  \param obj      the proxy object
+ *  \param handle   the state
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  The state, e.g., one published before a restart, is then treated
+ *  as held by this proxy, and may be sent to other proxies or retired
+ *  in the usual way.
+ */
+
+int proxy_state_adopt(proxy_t * obj, ffs_handle_t handle);
+
+/**
+ *  \brief Give up a published state, leaving the shared copy
+ *
+ *  \param obj      the proxy object
+ *  \param handle   the state
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure, including a state which is not shared
+ *
+ *  Any local copy is released, and the proxy keeps no record of the
+ *  state, so the shared copy outlives the run (cf. adopt).
+ */
+
+int proxy_state_release(proxy_t * obj, ffs_handle_t handle);
+
+/**
+ *  \brief Mark a state as no longer required
+ *
+ *  \param obj      the proxy object
+ *  \param handle   the state
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  An alternative to SIM_STATE_DELETE which releases any memory at
+ *  once, but defers the deletion of any files until a later call to
+ *  proxy_state_reap(). A subsequent SIM_STATE_WRITE of the same state
+ *  cancels the retirement.
+ */
+
+int proxy_state_retire(proxy_t * obj, ffs_handle_t handle);
+
+/**
+ *  \brief Delete retired states
+ *
+ *  \param obj      the proxy object
+ *  \param nmax     the maximum number to delete (all if negative)
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  States are deleted in the order in which they were retired. This
+ *  is local to the calling rank.
+ */
+
+int proxy_state_reap(proxy_t * obj, int nmax);
+
+/**
+ *  \brief Return the number of retired states awaiting deletion
+ *
+ *  \param obj      the proxy object
+ *  \param nretired pointer to the number to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
+ */
+
+int proxy_state_nretired(proxy_t * obj, int * nretired);
+
+/**
+ *  \brief Set the instance whose states the proxy holds
+ *
+ *  \param obj      the proxy object
+ *  \param inst     the instance id (default 0)
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  The instance id forms part of the name of each state (see
+ *  util_handle_stub()), and of each archive segment, so it must be
+ *  set before proxy_state_archive_set().
+ */
+
+int proxy_state_inst_set(proxy_t * obj, int inst);
+
+/**
+ *  \brief Set the name of states in the cache group
+ *
+ *  \param obj      the proxy object
+ *  \param prefix   the name prefix (see ffs_cache_prefix()), or NULL
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  States in group FFS_HANDLE_GROUP_CACHE are named "prefix-id",
+ *  rather than by instance and group, so that they may be found by
+ *  a later run. Until a prefix is set, such states cannot be named.
+ */
+
+int proxy_state_cache_set(proxy_t * obj, const char * prefix);
+
+/**
+ *  \brief Allow or prevent states being held in memory
+ *
+ *  \param obj      the proxy object
+ *  \param memory   non-zero to allow (the default)
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
+ *
+ *  This takes effect at the next SIM_STATE_INIT.
+ */
+
+int proxy_state_memory_set(proxy_t * obj, int memory);
+
+/**
+ *  \brief Write states to file in the background
+ *
+ *  \param obj      the proxy object
+ *  \param nqueue   maximum number of writes outstanding (0 for none)
  *
  *  \retval 0        a success
  *  \retval -1       a failure
  *
- *  This will pass the arguments to the real simulation.
+ *  If states are held in memory, each state written is also queued
+ *  to be written to the shared directory by a separate thread, so
+ *  that the simulation may continue without waiting for the file
+ *  system. The state is available to other proxies only after
+ *  proxy_state_flush(). Otherwise, there is no effect.
+ */
+
+int proxy_state_write_behind_set(proxy_t * obj, int nqueue);
+
+/**
+ *  \brief Keep shared copies of packed states in segment files
+ *
+ *  \param obj      the proxy object
+ *  \param archive  non-zero to use an archive (default is not)
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  Rather than one file per state, packed states in the shared
+ *  directory are appended to one file per proxy rank for each group
+ *  of states (usually each interface); see ffs_archive. This has no
+ *  effect on states written by the delegate itself.
+ */
+
+int proxy_state_archive_set(proxy_t * obj, int archive);
+
+/**
+ *  \brief Hold in-memory states as deltas against their parents
+ *
+ *  \param obj      the proxy object
+ *  \param maxdepth maximum length of a chain of deltas (0 for none)
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  A packed state written is encoded as a delta against the state
+ *  last read or written (usually the one from which the trajectory
+ *  was started), if that is held in memory and the delta is smaller.
+ *  Reads decode the chain of deltas. Copies written to file, or sent
+ *  to other proxies, are always complete. The default is no deltas.
+ */
+
+int proxy_state_delta_set(proxy_t * obj, int maxdepth);
+
+/**
+ *  \brief Limit the memory used by in-memory states
+ *
+ *  \param obj      the proxy object
+ *  \param nbytes   maximum total size of snapshots in memory (0 no limit)
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  When a state is written or read, and the limit is exceeded, the
+ *  least recently used states are spilled to the shared directory
+ *  (or archive), and their memory released. A spilled state is read
+ *  back into memory the next time it is required. The default is
+ *  no limit.
+ */
+
+int proxy_state_memory_max_set(proxy_t * obj, size_t nbytes);
+
+/**
+ *  \brief Return counts of in-memory state use
+ *
+ *  \param obj      the proxy object
+ *  \param nhit     number of reads found in memory
+ *  \param nmiss    number of reads from file
+ *  \param nspill   number of states spilled from memory to file
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
+ */
+
+int proxy_state_cache_stats(proxy_t * obj, int * nhit, int * nmiss,
+			    int * nspill);
+
+/**
+ *  \brief Return the number of state reads and writes elided
+ *
+ *  \param obj      the proxy object
+ *  \param nclean   number of reads (or writes) of the state last read
+ *                  or written, with no change to the live state since
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
+ */
+
+int proxy_state_nclean(proxy_t * obj, int * nclean);
+
+/**
+ *  \brief Allow packed states to be read from file ahead of need
+ *
+ *  \param obj      the proxy object
+ *  \param prefetch non-zero to allow (default is not)
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  A background thread is started to carry out the reads requested
+ *  by proxy_state_prefetch().
+ */
+
+int proxy_state_prefetch_set(proxy_t * obj, int prefetch);
+
+/**
+ *  \brief Start reading a state which will be wanted next
+ *
+ *  \param obj      the proxy object
+ *  \param handle   the state which the next SIM_STATE_READ will request
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  If the state would be read from a packed file in the shared
+ *  directory, the read starts in the background, and the next
+ *  SIM_STATE_READ of the state takes the data from memory. States
+ *  already in memory (or scratch), states in an archive, and states
+ *  the delegate writes itself, need no action. Only one prefetch
+ *  is outstanding at a time; an earlier one not used is discarded.
+ *  This is only ever an optimisation: the result of the read is
+ *  the same either way.
+ */
+
+int proxy_state_prefetch(proxy_t * obj, ffs_handle_t handle);
+
+/**
+ *  \brief Wait for all background writes to complete
+ *
+ *  \param obj      the proxy object
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure, including any failed write
+ */
+
+int proxy_state_flush(proxy_t * obj);
+
+/**
+ *  \brief Allow states to be moved between proxies by message
+ *
+ *  \param obj      the proxy object
+ *  \param mpi      non-zero to allow (default is not)
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
+ */
+
+int proxy_state_mpi_set(proxy_t * obj, int mpi);
+
+/**
+ *  \brief Are states to be moved between proxies by message?
+ *
+ *  \param obj      the proxy object
+ *  \param mpi      pointer to flag to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
+ *
+ *  This requires that states are held in memory; otherwise
+ *  proxy_state_publish() must be used.
+ */
+
+int proxy_state_mpi(proxy_t * obj, int * mpi);
+
+/**
+ *  \brief Allow states to be gathered into files by MPI-IO
+ *
+ *  \param obj      the proxy object
+ *  \param mpiio    non-zero to allow (default is not)
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ */
+
+int proxy_state_mpiio_set(proxy_t * obj, int mpiio);
+
+/**
+ *  \brief Are states to be gathered into files by MPI-IO?
+ *
+ *  \param obj      the proxy object
+ *  \param mpiio    pointer to flag to be returned
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
+ *
+ *  This requires that states are held in memory; otherwise
+ *  proxy_state_publish() must be used.
+ */
+
+int proxy_state_mpiio(proxy_t * obj, int * mpiio);
+
+/**
+ *  \brief Write a group of states from all proxies to one file
+ *
+ *  \param obj      the proxy object
+ *  \param prefix   the file name prefix, the same for all proxies
+ *  \param nstate   the number of states this proxy contributes
+ *  \param handle   the handles of those states, which it must hold
+ *  \param comm     communicator between proxies
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure (on all ranks in \c comm)
+ *
+ *  This is collective in \c comm. Each rank in the proxy writes its
+ *  part of each state to the file "prefix.rankNNNN.aggregate" by
+ *  MPI-IO (see ffs_aggregate), and learns where every state in the
+ *  file is. Any proxy may then read any of the states via proxy_state()
+ *  without the state having been published. The states must not be
+ *  written again until the file is removed.
+ */
+
+int proxy_state_aggregate(proxy_t * obj, const char * prefix, int nstate,
+			  ffs_handle_t * handle, MPI_Comm comm);
+
+/**
+ *  \brief Remove a file written by proxy_state_aggregate()
+ *
+ *  \param obj      the proxy object
+ *  \param prefix   the file name prefix
+ *  \param comm     communicator between proxies
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  This is collective in \c comm. The states themselves are left
+ *  alone. There is no action if no such file was written.
+ */
+
+int proxy_state_aggregate_remove(proxy_t * obj, const char * prefix,
+				 MPI_Comm comm);
+
+/**
+ *  \brief Start sending a state held in memory to another proxy
+ *
+ *  \param obj      the proxy object
+ *  \param handle   the handle identifying the state
+ *  \param dest     rank of the destination in \c comm
+ *  \param comm     communicator between proxies
+ *  \param req      the request to be completed by the caller
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure (the state is not held in memory)
+ */
+
+int proxy_state_isend(proxy_t * obj, ffs_handle_t handle, int dest,
+		      MPI_Comm comm, MPI_Request * req);
+
+/**
+ *  \brief Receive a state from another proxy
+ *
+ *  \param obj      the proxy object
+ *  \param handle   the handle identifying the state
+ *  \param source   rank of the sender in \c comm
+ *  \param comm     communicator between proxies
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  The state is held in memory until removed by proxy_state_discard()
+ *  and may be read via proxy_state() in the usual way.
+ */
+
+int proxy_state_recv(proxy_t * obj, ffs_handle_t handle, int source,
+		     MPI_Comm comm);
+
+/**
+ *  \brief Discard a state received from another proxy
+ *
+ *  \param obj      the proxy object
+ *  \param handle   the handle identifying the state
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  There is no action if no such copy is held.
+ */
+
+int proxy_state_discard(proxy_t * obj, ffs_handle_t handle);
+
+/**
+ *  \brief Use a node-local scratch directory for simulation states
+ *
+ *  \param obj      the proxy object
+ *  \param dir      existing directory, e.g., a tmpfs such as /dev/shm
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  A directory private to the proxy is created below \c dir. This
+ *  is collective in the proxy communicator.
+ */
+
+int proxy_scratch_set(proxy_t * obj, const char * dir);
+
+/**
+ *  \brief Remove the scratch directory and its contents
+ *
+ *  \param obj      the proxy object
+ *
+ *  \retval 0        a success
+ *  \retval -1       a NULL pointer was received
  */
 
-int proxy_state(proxy_t * obj, sim_state_enum_t action, const char * stub);
+int proxy_scratch_remove(proxy_t * obj);
 
 /**
  *  \brief Request for new lambda value
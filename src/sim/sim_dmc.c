@@ -7,6 +7,9 @@
  *
  *  See DT Gillespie, J. Phys. Chem. 81, 2340--2361 (1977).
  *
+ *  The next reaction method may be used instead of the direct method.
+ *  See MA Gibson and J Bruck, J. Phys. Chem. A 104, 1876--1889 (2000).
+ *
  *  Parallel Forward Flux Sampling
  *  (c) 2012 The University of Edinburgh
  *
@@ -14,20 +17,37 @@
 
 #include <assert.h>
 #include <float.h>
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #include "ranlcg.h"
 #include "sim_dmc.h"
 
 #define MAXPROD     10
 
+/* State files are binary (the default) or text (for debugging) */
+
+#define DMC_STATE_MAGIC   "DMCS"
+#define DMC_STATE_VERSION 1
+
+enum dmc_format_enum {DMC_FORMAT_BINARY, DMC_FORMAT_TEXT};
+
+/* The direct method (the default) or the next reaction method */
+
+enum dmc_engine_enum {DMC_ENGINE_DIRECT, DMC_ENGINE_NEXT};
+
 typedef struct state_s state_t;
 typedef struct stoch_s stoch_t;
 typedef struct react_s react_t;
-typedef struct dynam_s dynam_t;
+typedef struct network_s network_t;
+typedef struct dmc_s dynam_t;
 
 struct state_s {
   double t;         /* Current time */
@@ -48,31 +68,73 @@ struct react_s {
   stoch_t prod[MAXPROD];
 };
 
-/* information we need to propagate the dynamical system */
+/* The reaction network is read-only once read, and is shared by all
+ * engines in the process which read the same files. */
 
-struct dynam_s {
+struct network_s {
+  char    file[2][FILENAME_MAX]; /* Component and reaction files */
+  int     nref;           /* Number of engines sharing the network */
   int     ncomponent;     /* Number of components in the system */
   int     nreactions;     /* Number of reactions in the system */
   react_t * R;            /* list of reactions */
   char    **Xname;        /* names of components (strings) */
+  int     * nx0;          /* Initial numbers of molecules */
+  int     * dep_start;    /* Reactions affected by reaction j are ... */
+  int     * dep;          /* ... dep[dep_start[j] .. dep_start[j+1]-1] */
+  network_t * next;
+};
+
+/* information we need to propagate the dynamical system (one engine
+ * per simulation object) */
+
+struct dmc_s {
+  const network_t * net;  /* Shared reaction network */
   double  * a;            /* List of propensities */
   double  sum_a;
   state_t state;
   ranlcg_t * rng;
+  int     format;         /* State file format */
+  int     engine;         /* Direct or next reaction method */
+  int     stale;          /* Putative times must be drawn afresh */
+  double  * tau;          /* Putative time of each reaction (next) */
+  int     * heap;         /* Reactions in order of tau (next) */
+  int     * pos;          /* Position of each reaction in heap (next) */
 };
 
-static int dmc_read_components(dynam_t * dyn, const char * filename);
-static int dmc_read_reactions(dynam_t * dyn, const char * filename);
-static int dmc_print_reactions(dynam_t * dyn);
+static int dmc_network_acquire(const char * cfile, const char * rfile,
+			       const network_t ** pnet);
+static void dmc_network_release(const network_t * net);
+static void dmc_network_free(network_t * net);
+static int dmc_read_components(network_t * net, const char * filename);
+static int dmc_read_reactions(network_t * net, const char * filename);
+static int dmc_print_reactions(const network_t * net);
+static int dmc_dependency_graph(network_t * net);
+static int dmc_int_compare(const void * a, const void * b);
 static int dmc_do_step(dynam_t * dyn);
+static int dmc_do_step_next(dynam_t * dyn);
+static int dmc_next_init(dynam_t * dyn);
+static void dmc_heap_update(dynam_t * dyn, int p);
+static void dmc_heap_sift_down(dynam_t * dyn, int p);
+static double dmc_propensity(const network_t * net, const int * nx, int ir);
+static void dmc_fire(dynam_t * dyn, int ir);
 static int dmc_read_state(dynam_t * dyn, const char * file, state_t * state);
+static int dmc_read_state_text(dynam_t * dyn, FILE * fp, state_t * state);
 static int dmc_write_state(dynam_t * dyn, const char * file, state_t * state);
+static int dmc_write_state_text(dynam_t * dyn, FILE * fp, state_t * state);
+static int dmc_pack(dynam_t * dyn, state_t * state, char * buf);
+static int dmc_unpack(dynam_t * dyn, state_t * state, const char * buf);
+static int dmc_pack_state(dynam_t * dyn, ffs_t * ffs, state_t * state);
+static int dmc_unpack_state(dynam_t * dyn, ffs_t * ffs, state_t * state);
+static size_t dmc_pack_size(dynam_t * dyn);
 static int dmc_init(dynam_t * dyn, int argc, char ** argv);
 static int dmc_finish(dynam_t * dyn);
 static int state_to_lambda(state_t dyn, int * lambda);
 
+static network_t * network_list = NULL;
 
-static dynam_t dyn;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t network_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 /*****************************************************************************
  *
@@ -80,10 +142,6 @@ static dynam_t dyn;
  *
  *****************************************************************************/
 
-struct dmc_s {
-  int nothing;
-};
-
 const interface_t sim_dmc_interface = {
   (interface_table_ft) &sim_dmc_table,
   (interface_create_ft) &sim_dmc_create,
@@ -105,14 +163,19 @@ int sim_dmc_table(interface_t * table) {
  *
  *  sim_dmc_create
  *
- *  A non NULL-pointer must be returned.
+ *  Each object is an independent engine; the reaction network is
+ *  acquired at SIM_EXECUTE_INIT.
  *
  *****************************************************************************/
 
 int sim_dmc_create(sim_dmc_t ** pdmc) {
 
-  /* Note that this is indeed never used. */
-  *pdmc = calloc(1, sizeof(void *));
+  sim_dmc_t * dmc = NULL;
+
+  dmc = calloc(1, sizeof(sim_dmc_t));
+  if (dmc == NULL) return -1;
+
+  *pdmc = dmc;
 
   return 0;
 }
@@ -125,6 +188,7 @@ int sim_dmc_create(sim_dmc_t ** pdmc) {
 
 int sim_dmc_free(sim_dmc_t * dmc) {
 
+  dmc_finish(dmc);
   free(dmc);
 
   return 0;
@@ -156,7 +220,7 @@ int sim_dmc_execute(sim_dmc_t * dmc, ffs_t * ffs, sim_execute_enum_t action) {
     }
 
     ifail += ffs_command_line_create_copy(ffs, &argc, &argv);
-    ifail += dmc_init(&dyn, argc, argv);
+    ifail += dmc_init(dmc, argc, argv);
 
     ifail += ffs_type_set(ffs, FFS_INFO_TIME_PUT, 1, FFS_VAR_DOUBLE);
     ifail += ffs_type_set(ffs, FFS_INFO_LAMBDA_PUT, 1, FFS_VAR_INT);
@@ -169,15 +233,20 @@ int sim_dmc_execute(sim_dmc_t * dmc, ffs_t * ffs, sim_execute_enum_t action) {
 
   case SIM_EXECUTE_RUN:
 
-    ifail += dmc_do_step(&dyn);
-    t = dyn.state.t;
+    if (dmc->engine == DMC_ENGINE_NEXT) {
+      ifail += dmc_do_step_next(dmc);
+    }
+    else {
+      ifail += dmc_do_step(dmc);
+    }
+    t = dmc->state.t;
     ifail += ffs_info_double(ffs, FFS_INFO_TIME_PUT, 1, &t);
 
     break;
 
   case SIM_EXECUTE_FINISH:
 
-    dmc_finish(&dyn);
+    dmc_finish(dmc);
     break;
 
   default:
@@ -199,7 +268,7 @@ int sim_dmc_lambda(sim_dmc_t * dmc, ffs_t * ffs) {
 
   int lambda;
 
-  state_to_lambda(dyn.state, &lambda);
+  state_to_lambda(dmc->state, &lambda);
   ffs_info_int(ffs, FFS_INFO_LAMBDA_PUT, 1, &lambda);
 
   return 0;
@@ -211,6 +280,12 @@ int sim_dmc_lambda(sim_dmc_t * dmc, ffs_t * ffs) {
  *
  *  For the filename, we just use the unique stub without adornment.
  *
+ *  Putative reaction times (next reaction method) are not part of the
+ *  state; they are drawn afresh only when the state or the generator
+ *  is replaced (initialise, read or unpack here, or a new seed). As
+ *  waiting times are memoryless, this is correct. A write or pack
+ *  leaves them alone, so it does not disturb the trajectory.
+ *
  *****************************************************************************/
 
 int sim_dmc_state(sim_dmc_t * dmc, ffs_t * ffs, sim_state_enum_t action,
@@ -221,16 +296,28 @@ int sim_dmc_state(sim_dmc_t * dmc, ffs_t * ffs, sim_state_enum_t action,
   switch (action) {
   case SIM_STATE_INIT:
     /* Not required, or recover initial state */
+    dmc->stale = 1;
     break;
   case SIM_STATE_READ:
-    ifail = dmc_read_state(&dyn, stub, &dyn.state);
+    ifail = dmc_read_state(dmc, stub, &dmc->state);
+    dmc->stale = 1;
     break;
   case SIM_STATE_WRITE:
-    ifail = dmc_write_state(&dyn, stub, &dyn.state);
+    ifail = dmc_write_state(dmc, stub, &dmc->state);
     break;
   case SIM_STATE_DELETE:
     remove(stub);
     break;
+  case SIM_STATE_PACK_SIZE:
+    ifail = ffs_state_size_set(ffs, dmc_pack_size(dmc));
+    break;
+  case SIM_STATE_PACK:
+    ifail = dmc_pack_state(dmc, ffs, &dmc->state);
+    break;
+  case SIM_STATE_UNPACK:
+    ifail = dmc_unpack_state(dmc, ffs, &dmc->state);
+    dmc->stale = 1;
+    break;
   default:
     ifail = -1;
   }
@@ -253,7 +340,7 @@ int sim_dmc_info(sim_dmc_t * dmc, ffs_t * ffs, ffs_info_enum_t param) {
 
   switch (param) {
   case FFS_INFO_TIME_PUT:
-    t = dyn.state.t;
+    t = dmc->state.t;
     ifail += ffs_info_double(ffs, param, 1, &t);
     break;
   case FFS_INFO_LAMBDA_PUT:
@@ -262,7 +349,8 @@ int sim_dmc_info(sim_dmc_t * dmc, ffs_t * ffs, ffs_info_enum_t param) {
   case FFS_INFO_RNG_SEED_FETCH:
     ifail += ffs_info_int(ffs, FFS_INFO_RNG_SEED_FETCH, 1, &seed);
     lseed = seed;
-    ifail += ranlcg_state_set(dyn.rng, lseed);
+    ifail += ranlcg_state_set(dmc->rng, lseed);
+    dmc->stale = 1;
     break;
   default:
     /* FFS has asked for something we don't supply */
@@ -296,9 +384,9 @@ int state_to_lambda(state_t p, int * lambda) {
 
 /*****************************************************************************
  *
- *  gillespie_do_step
+ *  dmc_do_step
  *
- *  Advance state p by one step.
+ *  Advance state p by one step (direct method).
  *
  *****************************************************************************/
 
@@ -314,23 +402,8 @@ int dmc_do_step(dynam_t * dyn) {
 
   dyn->sum_a = 0.0;
 
-  for (i = 0; i < dyn->nreactions; i++) {
-
-    if (dyn->R[i].nreactant == 0) { 
-      dyn->a[i] = dyn->R[i].k;
-    }
-    else if (dyn->R[i].nreactant == 1) { 
-      dyn->a[i] = dyn->R[i].k * dyn->state.nx[dyn->R[i].react[0].index];
-    }
-    else if (dyn->R[i].react[0].index == dyn->R[i].react[1].index) {
-      dyn->a[i] = dyn->R[i].k * dyn->state.nx[dyn->R[i].react[0].index]
-	* (dyn->state.nx[dyn->R[i].react[1].index] - 1);
-    }
-    else {
-      dyn->a[i] = dyn->R[i].k * dyn->state.nx[dyn->R[i].react[0].index]
-	* dyn->state.nx[dyn->R[i].react[1].index];
-    }
-
+  for (i = 0; i < dyn->net->nreactions; i++) {
+    dyn->a[i] = dmc_propensity(dyn->net, dyn->state.nx, i);
     dyn->sum_a += dyn->a[i];
   }
 
@@ -358,128 +431,574 @@ int dmc_do_step(dynam_t * dyn) {
     cumu_a = dyn->a[j];
     while (cumu_a < rs) cumu_a += dyn->a[++j];
 
-    /* update concentrations */
+    dmc_fire(dyn, j);
+  }
 
-    for (i = 0; i < dyn->R[j].nreactant; i++) {
-      dyn->state.nx[dyn->R[j].react[i].index] --;
+  return ifail;
+}
+
+/*****************************************************************************
+ *
+ *  dmc_do_step_next
+ *
+ *  Next reaction method: the reaction with the earliest putative time
+ *  fires, and only the propensities which depend on the species it
+ *  changes are recomputed. The putative times of those reactions are
+ *  rescaled (Gibson and Bruck), except for the reaction which fired,
+ *  or one which was not possible, which take a new random time.
+ *
+ *****************************************************************************/
+
+static int dmc_do_step_next(dynam_t * dyn) {
+
+  int i, j, n;
+  double t;
+  double a_old;
+  double rs;
+  const network_t * net = dyn->net;
+
+  if (dyn->stale) dmc_next_init(dyn);
+
+  j = dyn->heap[0];
+
+  /* No reactions are possible. */
+  if (dyn->tau[j] == DBL_MAX) return 1;
+
+  t = dyn->tau[j];
+  dyn->state.t = t;
+  dmc_fire(dyn, j);
+
+  for (n = net->dep_start[j]; n < net->dep_start[j+1]; n++) {
+
+    i = net->dep[n];
+    a_old = dyn->a[i];
+    dyn->a[i] = dmc_propensity(net, dyn->state.nx, i);
+
+    if (dyn->a[i] == 0.0) {
+      dyn->tau[i] = DBL_MAX;
+    }
+    else if (i == j || a_old == 0.0) {
+      ranlcg_reep(dyn->rng, &rs);
+      dyn->tau[i] = t + log(1./rs)/dyn->a[i];
     }
+    else {
+      dyn->tau[i] = t + (a_old/dyn->a[i])*(dyn->tau[i] - t);
+    }
+
+    dmc_heap_update(dyn, dyn->pos[i]);
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  dmc_next_init
+ *
+ *  All propensities and putative times from the current state.
+ *
+ *****************************************************************************/
 
-    for (i = 0; i < dyn->R[j].nproduct; i++) {
-      dyn->state.nx[dyn->R[j].prod[i].index] += dyn->R[j].prod[i].change;
+static int dmc_next_init(dynam_t * dyn) {
+
+  int i, p;
+  double rs;
+
+  for (i = 0; i < dyn->net->nreactions; i++) {
+    dyn->a[i] = dmc_propensity(dyn->net, dyn->state.nx, i);
+    dyn->tau[i] = DBL_MAX;
+    if (dyn->a[i] > 0.0) {
+      ranlcg_reep(dyn->rng, &rs);
+      dyn->tau[i] = dyn->state.t + log(1./rs)/dyn->a[i];
     }
+    dyn->heap[i] = i;
+    dyn->pos[i] = i;
   }
 
-  return ifail;
+  for (p = dyn->net->nreactions/2 - 1; p >= 0; p--) {
+    dmc_heap_sift_down(dyn, p);
+  }
+
+  dyn->stale = 0;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  dmc_heap_before
+ *
+ *  Does reaction i come before reaction j? (Ties go by index, so the
+ *  order is always the same.)
+ *
+ *****************************************************************************/
+
+static int dmc_heap_before(const dynam_t * dyn, int i, int j) {
+
+  if (dyn->tau[i] == dyn->tau[j]) return (i < j);
+
+  return (dyn->tau[i] < dyn->tau[j]);
+}
+
+/*****************************************************************************
+ *
+ *  dmc_heap_swap
+ *
+ *****************************************************************************/
+
+static void dmc_heap_swap(dynam_t * dyn, int p, int q) {
+
+  int tmp;
+
+  tmp = dyn->heap[p];
+  dyn->heap[p] = dyn->heap[q];
+  dyn->heap[q] = tmp;
+
+  dyn->pos[dyn->heap[p]] = p;
+  dyn->pos[dyn->heap[q]] = q;
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  dmc_heap_sift_down
+ *
+ *****************************************************************************/
+
+static void dmc_heap_sift_down(dynam_t * dyn, int p) {
+
+  int c, m;
+  int n = dyn->net->nreactions;
+
+  while (1) {
+    m = p;
+    c = 2*p + 1;
+    if (c < n && dmc_heap_before(dyn, dyn->heap[c], dyn->heap[m])) m = c;
+    c += 1;
+    if (c < n && dmc_heap_before(dyn, dyn->heap[c], dyn->heap[m])) m = c;
+    if (m == p) break;
+    dmc_heap_swap(dyn, p, m);
+    p = m;
+  }
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  dmc_heap_update
+ *
+ *  Restore the heap after a change to the time at position p.
+ *
+ *****************************************************************************/
+
+static void dmc_heap_update(dynam_t * dyn, int p) {
+
+  int q;
+
+  while (p > 0) {
+    q = (p - 1)/2;
+    if (!dmc_heap_before(dyn, dyn->heap[p], dyn->heap[q])) break;
+    dmc_heap_swap(dyn, p, q);
+    p = q;
+  }
+
+  dmc_heap_sift_down(dyn, p);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  dmc_propensity
+ *
+ *****************************************************************************/
+
+static double dmc_propensity(const network_t * net, const int * nx, int ir) {
+
+  const react_t * r = net->R + ir;
+
+  if (r->nreactant == 0) return r->k;
+  if (r->nreactant == 1) return r->k * nx[r->react[0].index];
+
+  if (r->react[0].index == r->react[1].index) {
+    return r->k * nx[r->react[0].index] * (nx[r->react[1].index] - 1);
+  }
+
+  return r->k * nx[r->react[0].index] * nx[r->react[1].index];
+}
+
+/*****************************************************************************
+ *
+ *  dmc_fire
+ *
+ *  Update the numbers of molecules for reaction ir.
+ *
+ *****************************************************************************/
+
+static void dmc_fire(dynam_t * dyn, int ir) {
+
+  int i;
+  const react_t * r = dyn->net->R + ir;
+
+  for (i = 0; i < r->nreactant; i++) {
+    dyn->state.nx[r->react[i].index] --;
+  }
+
+  for (i = 0; i < r->nproduct; i++) {
+    dyn->state.nx[r->prod[i].index] += r->prod[i].change;
+  }
+
+  return;
 }
 
 /*****************************************************************************
  *
  *  dmc_read_state
  *
+ *  Either format may be read, whatever the format for writing. The
+ *  RNG state is restored if present.
+ *
  *****************************************************************************/
 
 int dmc_read_state(dynam_t * dyn, const char * filename, state_t * p) {
 
-  int  i, ncomp;
   int ifail = 0;
+  int version;
+  size_t nbytes;
+  char magic[sizeof(DMC_STATE_MAGIC)];
+  char * buf = NULL;
 
   FILE * fp = NULL;
 
-  fp = fopen(filename, "r");
+  fp = fopen(filename, "rb");
 
   if (fp == NULL) {
-    ifail = 1;
     printf("read state failed to find %s\n", filename);
+    return 1;
   }
-  else {
 
-    fscanf(fp, "%d\n", &ncomp);
+  nbytes = strlen(DMC_STATE_MAGIC);
+
+  if (fread(magic, 1, nbytes, fp) != nbytes
+      || strncmp(magic, DMC_STATE_MAGIC, nbytes) != 0) {
+    rewind(fp);
+    ifail = dmc_read_state_text(dyn, fp, p);
+  }
+  else {
+    nbytes = dmc_pack_size(dyn);
+    buf = malloc(nbytes);
 
-    if (ncomp != dyn->ncomponent) {
-      printf("The number of components is %d\n", ncomp);
-      printf("The number of components should be %d\n", dyn->ncomponent);
+    if (buf == NULL) {
       ifail = 1;
     }
-    else {
-
-      for (i = 0; i < ncomp; i++) {
-	fscanf(fp, "%d\t\t%s\n", &(p->nx[i]), dyn->Xname[i]);
-      }
-
-      fscanf(fp, "%lf", &p->t);
+    else if (fread(&version, sizeof(int), 1, fp) != 1
+	     || version != DMC_STATE_VERSION) {
+      printf("read state: %s is not version %d\n", filename,
+	     DMC_STATE_VERSION);
+      ifail = 1;
     }
-
-    if (ferror(fp)) {
+    else if (fread(buf, 1, nbytes, fp) != nbytes) {
       ifail = 1;
-      perror("read state perror: ");
+    }
+    else {
+      ifail = dmc_unpack(dyn, p, buf);
     }
 
-    fclose(fp);
+    free(buf);
+  }
+
+  if (ferror(fp)) {
+    ifail = 1;
+    perror("read state perror: ");
   }
 
+  fclose(fp);
+
   return ifail;
 }
 
+/*****************************************************************************
+ *
+ *  dmc_read_state_text
+ *
+ *  Files written before the RNG state was included are accepted.
+ *  The component names are not checked.
+ *
+ *****************************************************************************/
+
+static int dmc_read_state_text(dynam_t * dyn, FILE * fp, state_t * p) {
+
+  int  i, ncomp;
+  char name[BUFSIZ];
+
+  if (fscanf(fp, "%d\n", &ncomp) != 1) return 1;
+
+  if (ncomp != dyn->net->ncomponent) {
+    printf("The number of components is %d\n", ncomp);
+    printf("The number of components should be %d\n", dyn->net->ncomponent);
+    return 1;
+  }
+
+  for (i = 0; i < ncomp; i++) {
+    fscanf(fp, "%d\t\t%s\n", &(p->nx[i]), name);
+  }
+
+  fscanf(fp, "%lf", &p->t);
+
+  if (fscanf(fp, "%ld", &p->seed) == 1) {
+    if (ranlcg_state_set(dyn->rng, p->seed)) return 1;
+  }
+
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  dmc_write_state
  *
+ *  The binary format is a magic string, the version number, and
+ *  then the same content as a packed state.
+ *
  *****************************************************************************/
 
 static int dmc_write_state(dynam_t * dyn, const char * filename, state_t * p) {
 
-  int  i;
   int ifail = 0;
+  int version = DMC_STATE_VERSION;
+  size_t nbytes;
+  char * buf = NULL;
 
   FILE * fp = NULL;
 
-  fp = fopen(filename, "w");
+  fp = fopen(filename, dyn->format == DMC_FORMAT_TEXT ? "w" : "wb");
 
   if (fp == NULL) {
-    ifail = 1;
     printf("write state failed to open %s\n", filename);
+    return 1;
   }
-  else {
 
-    fprintf(fp, "%d\n", dyn->ncomponent);
-
-    for (i = 0; i < dyn->ncomponent; i++) {
-      fprintf(fp, "%d\t\t%s\n", p->nx[i], dyn->Xname[i]);
-    }
-
-    fprintf(fp, "%22.16e", p->t);
+  if (dyn->format == DMC_FORMAT_TEXT) {
+    ifail = dmc_write_state_text(dyn, fp, p);
+  }
+  else {
+    nbytes = dmc_pack_size(dyn);
+    buf = malloc(nbytes);
 
-    if (ferror(fp)) {
+    if (buf == NULL) {
       ifail = 1;
-      perror("write state perror: ");
     }
+    else {
+      dmc_pack(dyn, p, buf);
+      fwrite(DMC_STATE_MAGIC, 1, strlen(DMC_STATE_MAGIC), fp);
+      fwrite(&version, sizeof(int), 1, fp);
+      fwrite(buf, 1, nbytes, fp);
+      free(buf);
+    }
+  }
 
-    fclose(fp);
+  if (ferror(fp)) {
+    ifail = 1;
+    perror("write state perror: ");
   }
 
+  if (fclose(fp) != 0) ifail = 1;
+
   return ifail;
 }
 
+/*****************************************************************************
+ *
+ *  dmc_write_state_text
+ *
+ *****************************************************************************/
+
+static int dmc_write_state_text(dynam_t * dyn, FILE * fp, state_t * p) {
+
+  int  i;
+
+  ranlcg_state(dyn->rng, &p->seed);
+
+  fprintf(fp, "%d\n", dyn->net->ncomponent);
+
+  for (i = 0; i < dyn->net->ncomponent; i++) {
+    fprintf(fp, "%d\t\t%s\n", p->nx[i], dyn->net->Xname[i]);
+  }
+
+  fprintf(fp, "%22.16e\n", p->t);
+  fprintf(fp, "%ld", p->seed);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  dmc_pack_size
+ *
+ *  The packed state is the number of components, the component
+ *  numbers, the time, and the RNG state.
+ *
+ *****************************************************************************/
+
+static size_t dmc_pack_size(dynam_t * dyn) {
+
+  return (1 + dyn->net->ncomponent)*sizeof(int) + sizeof(double)
+    + sizeof(long);
+}
+
+/*****************************************************************************
+ *
+ *  dmc_pack
+ *
+ *  buf must be at least dmc_pack_size() bytes.
+ *
+ *****************************************************************************/
+
+static int dmc_pack(dynam_t * dyn, state_t * p, char * buf) {
+
+  ranlcg_state(dyn->rng, &p->seed);
+
+  memcpy(buf, &dyn->net->ncomponent, sizeof(int));
+  buf += sizeof(int);
+  memcpy(buf, p->nx, dyn->net->ncomponent*sizeof(int));
+  buf += dyn->net->ncomponent*sizeof(int);
+  memcpy(buf, &p->t, sizeof(double));
+  buf += sizeof(double);
+  memcpy(buf, &p->seed, sizeof(long));
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  dmc_unpack
+ *
+ *****************************************************************************/
+
+static int dmc_unpack(dynam_t * dyn, state_t * p, const char * buf) {
+
+  int ncomp;
+
+  memcpy(&ncomp, buf, sizeof(int));
+  buf += sizeof(int);
+
+  if (ncomp != dyn->net->ncomponent) {
+    printf("The number of components is %d\n", ncomp);
+    printf("The number of components should be %d\n", dyn->net->ncomponent);
+    return -1;
+  }
+
+  memcpy(p->nx, buf, dyn->net->ncomponent*sizeof(int));
+  buf += dyn->net->ncomponent*sizeof(int);
+  memcpy(&p->t, buf, sizeof(double));
+  buf += sizeof(double);
+  memcpy(&p->seed, buf, sizeof(long));
+
+  return ranlcg_state_set(dyn->rng, p->seed);
+}
+
+/*****************************************************************************
+ *
+ *  dmc_pack_state
+ *
+ *****************************************************************************/
+
+static int dmc_pack_state(dynam_t * dyn, ffs_t * ffs, state_t * p) {
+
+  size_t nbytes;
+  char * buf = NULL;
+
+  if (ffs_state_buffer(ffs, (void **) &buf, &nbytes)) return -1;
+  if (nbytes < dmc_pack_size(dyn)) return -1;
+
+  return dmc_pack(dyn, p, buf);
+}
+
+/*****************************************************************************
+ *
+ *  dmc_unpack_state
+ *
+ *****************************************************************************/
+
+static int dmc_unpack_state(dynam_t * dyn, ffs_t * ffs, state_t * p) {
+
+  size_t nbytes;
+  char * buf = NULL;
+
+  if (ffs_state_buffer(ffs, (void **) &buf, &nbytes)) return -1;
+  if (nbytes < dmc_pack_size(dyn)) return -1;
+
+  return dmc_unpack(dyn, p, buf);
+}
+
 /*****************************************************************************
  *
  *  dmc_init
  *
  *  A command line is expected in the following form:
  * 
- *  "./a.out <component file> <reaction file>"
+ *  "./a.out <component file> <reaction file> [binary|text] [direct|next]"
+ *
+ *  where the optional arguments are the format of state files, and
+ *  the engine (the direct method, or the next reaction method).
  *
  *****************************************************************************/
 
 int dmc_init(dynam_t * dyn, int argc, char ** argv) {
 
+  int n;
+  int nr;
   int ifail = 0;
   int verbose = 0;
 
   if (argc < 3) return -1;
 
-  ifail += dmc_read_components(dyn, argv[1]);
-  ifail += dmc_read_reactions(dyn, argv[2]);
-  if (verbose) ifail += dmc_print_reactions(dyn);
+  dyn->format = DMC_FORMAT_BINARY;
+  dyn->engine = DMC_ENGINE_DIRECT;
+
+  for (n = 3; n < argc; n++) {
+    if (strcmp(argv[n], "text") == 0) {
+      dyn->format = DMC_FORMAT_TEXT;
+    }
+    else if (strcmp(argv[n], "binary") == 0) {
+      dyn->format = DMC_FORMAT_BINARY;
+    }
+    else if (strcmp(argv[n], "direct") == 0) {
+      dyn->engine = DMC_ENGINE_DIRECT;
+    }
+    else if (strcmp(argv[n], "next") == 0) {
+      dyn->engine = DMC_ENGINE_NEXT;
+    }
+    else {
+      printf("DMC argument must be binary, text, direct or next (not %s)\n",
+	     argv[n]);
+      return -1;
+    }
+  }
+
+  ifail += dmc_network_acquire(argv[1], argv[2], &dyn->net);
+  if (ifail) return ifail;
+  if (verbose) ifail += dmc_print_reactions(dyn->net);
+
+  /* The initial state is a private copy; time is always zero */
+
+  dyn->state.nx = calloc(dyn->net->ncomponent, sizeof(int));
+  dyn->a = calloc(dyn->net->nreactions, sizeof(double));
+  if (dyn->state.nx == NULL || dyn->a == NULL) return -1;
+
+  memcpy(dyn->state.nx, dyn->net->nx0, dyn->net->ncomponent*sizeof(int));
+  dyn->state.t = 0.0;
+
+  if (dyn->engine == DMC_ENGINE_NEXT) {
+    nr = dyn->net->nreactions;
+    dyn->tau = calloc(nr, sizeof(double));
+    dyn->heap = calloc(nr, sizeof(int));
+    dyn->pos = calloc(nr, sizeof(int));
+    if (dyn->tau == NULL || dyn->heap == NULL || dyn->pos == NULL) return -1;
+  }
+  dyn->stale = 1;
+
   ifail += ranlcg_create(23, &dyn->rng);
 
   return ifail;
@@ -493,58 +1012,186 @@ int dmc_init(dynam_t * dyn, int argc, char ** argv) {
 
 int dmc_finish(dynam_t * dyn) {
 
-  int ir;
-
-  for (ir = 0; ir < dyn->ncomponent; ir++) {
-    free(dyn->Xname[ir]);
-  }
   free(dyn->a);
-  free(dyn->Xname);
   free(dyn->state.nx);
-  free(dyn->R);
-  ranlcg_free(dyn->rng);
+  free(dyn->tau);
+  free(dyn->heap);
+  free(dyn->pos);
+  if (dyn->rng) ranlcg_free(dyn->rng);
+  if (dyn->net) dmc_network_release(dyn->net);
+
+  dyn->a = NULL;
+  dyn->state.nx = NULL;
+  dyn->tau = NULL;
+  dyn->heap = NULL;
+  dyn->pos = NULL;
+  dyn->rng = NULL;
+  dyn->net = NULL;
 
   return 0;
 }
 
+/*****************************************************************************
+ *
+ *  dmc_network_acquire
+ *
+ *  Return the network read from the given files, reading them only
+ *  if no other engine holds that network.
+ *
+ *****************************************************************************/
+
+static int dmc_network_acquire(const char * cfile, const char * rfile,
+			       const network_t ** pnet) {
+
+  int ifail = 0;
+  network_t * net = NULL;
+
+  if (strlen(cfile) >= FILENAME_MAX || strlen(rfile) >= FILENAME_MAX) {
+    return -1;
+  }
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&network_lock);
+#endif
+
+  for (net = network_list; net; net = net->next) {
+    if (strcmp(net->file[0], cfile) == 0 && strcmp(net->file[1], rfile) == 0) {
+      break;
+    }
+  }
+
+  if (net == NULL) {
+    net = calloc(1, sizeof(network_t));
+    if (net == NULL) {
+      ifail = -1;
+    }
+    else {
+      strcpy(net->file[0], cfile);
+      strcpy(net->file[1], rfile);
+      ifail += dmc_read_components(net, cfile);
+      ifail += dmc_read_reactions(net, rfile);
+
+      if (ifail) {
+	dmc_network_free(net);
+	net = NULL;
+      }
+      else {
+	net->next = network_list;
+	network_list = net;
+      }
+    }
+  }
+
+  if (net) net->nref += 1;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&network_lock);
+#endif
+
+  *pnet = net;
+
+  return ifail;
+}
+
+/*****************************************************************************
+ *
+ *  dmc_network_release
+ *
+ *  The network is freed when the last engine lets it go.
+ *
+ *****************************************************************************/
+
+static void dmc_network_release(const network_t * net) {
+
+  network_t * tmp = NULL;
+  network_t ** p = NULL;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&network_lock);
+#endif
+
+  for (p = &network_list; *p; p = &(*p)->next) {
+    if (*p == net) {
+      tmp = *p;
+      tmp->nref -= 1;
+      if (tmp->nref == 0) {
+	*p = tmp->next;
+	dmc_network_free(tmp);
+      }
+      break;
+    }
+  }
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&network_lock);
+#endif
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  dmc_network_free
+ *
+ *****************************************************************************/
+
+static void dmc_network_free(network_t * net) {
+
+  int ic;
+
+  if (net->Xname) {
+    for (ic = 0; ic < net->ncomponent; ic++) {
+      free(net->Xname[ic]);
+    }
+  }
+  free(net->Xname);
+  free(net->nx0);
+  free(net->R);
+  free(net->dep_start);
+  free(net->dep);
+  free(net);
+
+  return;
+}
+
 /*****************************************************************************
  *
  *  dmc_print_reactions
  *
  *****************************************************************************/
 
-static int dmc_print_reactions(dynam_t * dyn) {
+static int dmc_print_reactions(const network_t * net) {
 
   int i, j;
   
   printf("\nThe following reactions are simulated:\n\n");
 
-  for (i = 0; i < dyn->nreactions; i++) {
-    if (dyn->R[i].nreactant == 0) { 
+  for (i = 0; i < net->nreactions; i++) {
+    if (net->R[i].nreactant == 0) { 
       printf("0");
     }
     else {
-      printf("%s ", dyn->Xname[dyn->R[i].react[0].index]);
+      printf("%s ", net->Xname[net->R[i].react[0].index]);
     }
 
-    for (j = 1; j < dyn->R[i].nreactant; j++) { 
-      printf("+ %s ", dyn->Xname[dyn->R[i].react[j].index]);
+    for (j = 1; j < net->R[i].nreactant; j++) { 
+      printf("+ %s ", net->Xname[net->R[i].react[j].index]);
     }
     printf(" ->  ");
 
-    if (dyn->R[i].nproduct == 0) { 
+    if (net->R[i].nproduct == 0) { 
       printf("0 ");
     }
     else {
-      printf("%2d %s ", dyn->R[i].prod[0].change,
-	     dyn->Xname[dyn->R[i].prod[0].index]);
+      printf("%2d %s ", net->R[i].prod[0].change,
+	     net->Xname[net->R[i].prod[0].index]);
     }
 
-    for (j = 1; j < dyn->R[i].nproduct; j++) {
-      printf("+ %2d %s ", dyn->R[i].prod[j].change,
-	     dyn->Xname[dyn->R[i].prod[j].index]);
+    for (j = 1; j < net->R[i].nproduct; j++) {
+      printf("+ %2d %s ", net->R[i].prod[j].change,
+	     net->Xname[net->R[i].prod[j].index]);
     }
-    printf("k = %4.3f\n", dyn->R[i].k);
+    printf("k = %4.3f\n", net->R[i].k);
   }
 
   return 0;
@@ -565,7 +1212,7 @@ static int dmc_print_reactions(dynam_t * dyn) {
  *
  *****************************************************************************/
 
-static int dmc_read_components(dynam_t * dyn, const char * filename) {
+static int dmc_read_components(network_t * net, const char * filename) {
 
   int ic;
   int ncomp = 0;
@@ -587,18 +1234,15 @@ static int dmc_read_components(dynam_t * dyn, const char * filename) {
   /* Allocate ncomp integers for the state values, a string for each
    * component name max length BUFSIZ */
 
-  dyn->ncomponent = ncomp;
-  dyn->state.nx = calloc(ncomp, sizeof(int));
-  dyn->Xname = calloc(ncomp, sizeof(char *));
+  net->ncomponent = ncomp;
+  net->nx0 = calloc(ncomp, sizeof(int));
+  net->Xname = calloc(ncomp, sizeof(char *));
 
   for (ic = 0; ic < ncomp; ic++) {
-    dyn->Xname[ic] = calloc(BUFSIZ, sizeof(char));
-    fscanf(fp, "%d\t\t%s\n", &dyn->state.nx[ic], dyn->Xname[ic]);
+    net->Xname[ic] = calloc(BUFSIZ, sizeof(char));
+    fscanf(fp, "%d\t\t%s\n", &net->nx0[ic], net->Xname[ic]);
   }
 
-  /* We don't read the time, but just set it to zero (always ok here). */
-  dyn->state.t = 0.0;
-
   fclose(fp);
 
   return 0;
@@ -612,7 +1256,7 @@ static int dmc_read_components(dynam_t * dyn, const char * filename) {
  *
  *****************************************************************************/
 
-static int dmc_read_reactions(dynam_t * dyn, const char * filename) {
+static int dmc_read_reactions(network_t * net, const char * filename) {
 
   int  ir;            /* Reaction */
   int  jr, jp;        /* Reactant, product */
@@ -632,11 +1276,10 @@ static int dmc_read_reactions(dynam_t * dyn, const char * filename) {
     return -1;
   }
 
-  /* Allocate nreact reactions, and propensities */
+  /* Allocate nreact reactions */
 
-  dyn->nreactions = nreact;
-  dyn->R = calloc(nreact, sizeof(react_t));
-  dyn->a = calloc(nreact, sizeof(double));
+  net->nreactions = nreact;
+  net->R = calloc(nreact, sizeof(react_t));
 
   /* For each reaction ... */
 
@@ -644,42 +1287,199 @@ static int dmc_read_reactions(dynam_t * dyn, const char * filename) {
 
     /* Read rate constant, number of reactants, number of products, (dummy) */
 
-    fscanf(fp, "%lf %d %d %s\n", &dyn->R[ir].k, &dyn->R[ir].nreactant,
-	   &dyn->R[ir].nproduct, dummy);
+    fscanf(fp, "%lf %d %d %s\n", &net->R[ir].k, &net->R[ir].nreactant,
+	   &net->R[ir].nproduct, dummy);
 
     /* Index of first reactant */
-    if (dyn->R[ir].nreactant == 0) {
+    if (net->R[ir].nreactant == 0) {
       fscanf(fp,"%s", dummy);
     }
     else {
-      fscanf(fp,"%s %d", dummy, &dyn->R[ir].react[0].index);
+      fscanf(fp,"%s %d", dummy, &net->R[ir].react[0].index);
     }
 
     /* Indices of remaining reactants */
-    for (jr = 1; jr < dyn->R[ir].nreactant; jr++) { 
-      fscanf(fp,"%s %s %d", dummy, dummy, &dyn->R[ir].react[jr].index);
+    for (jr = 1; jr < net->R[ir].nreactant; jr++) { 
+      fscanf(fp,"%s %s %d", dummy, dummy, &net->R[ir].react[jr].index);
     }
 
     /* "->" */
     fscanf(fp,"%s",dummy);
 
     /* Change and index of first product */
-    if (dyn->R[ir].nproduct == 0) {
+    if (net->R[ir].nproduct == 0) {
       fscanf(fp,"%s", dummy);
     }
     else {
-      fscanf(fp,"%d %s %d\n", &dyn->R[ir].prod[0].change,
-	     dummy, &dyn->R[ir].prod[0].index);
+      fscanf(fp,"%d %s %d\n", &net->R[ir].prod[0].change,
+	     dummy, &net->R[ir].prod[0].index);
     }
 
     /* Change and index of remaing products */
-    for (jp = 1; jp < dyn->R[ir].nproduct; jp++) { 
-      fscanf(fp,"%s %d %s %d\n", dummy, &dyn->R[ir].prod[jp].change,
-	     dummy, &dyn->R[ir].prod[jp].index);
+    for (jp = 1; jp < net->R[ir].nproduct; jp++) { 
+      fscanf(fp,"%s %d %s %d\n", dummy, &net->R[ir].prod[jp].change,
+	     dummy, &net->R[ir].prod[jp].index);
     }
   }
 
   fclose(fp);
 
+  return dmc_dependency_graph(net);
+}
+
+/*****************************************************************************
+ *
+ *  dmc_dependency_graph
+ *
+ *  For each reaction j, the reactions whose propensity depends on a
+ *  species changed by j (which always include j itself). A species
+ *  which j both consumes and produces, with no net change, does not
+ *  count.
+ *
+ *  The reactions which consume each species are listed first, so the
+ *  dependents of j are found from the species j changes; time and
+ *  storage go as the number of dependencies, not nreactions^2. The
+ *  first pass counts them, and the second fills the list. Each list
+ *  is in order of reaction index (the order in which random times
+ *  are drawn in dmc_do_step_next() depends on it).
+ *
+ *****************************************************************************/
+
+static int dmc_dependency_graph(network_t * net) {
+
+  int i, j, m, n, p, pass;
+  int s, nspecies;
+  int species[2 + MAXPROD];
+  int * change = NULL;
+  int * mark = NULL;
+  int * by_start = NULL;
+  int * by = NULL;
+  size_t ndep;
+  const react_t * r = NULL;
+
+  change = calloc(net->ncomponent, sizeof(int));
+  by_start = calloc(net->ncomponent + 1, sizeof(int));
+  mark = malloc(net->nreactions*sizeof(int));
+  net->dep_start = calloc(net->nreactions + 1, sizeof(int));
+
+  if (change == NULL || by_start == NULL || mark == NULL
+      || net->dep_start == NULL) goto err;
+
+  /* Reactions consuming each species: by[by_start[s] .. by_start[s+1]-1]
+   * (a species consumed twice by one reaction is listed once) */
+
+  for (i = 0; i < net->nreactions; i++) {
+    r = net->R + i;
+    for (n = 0; n < r->nreactant; n++) {
+      if (n == 1 && r->react[1].index == r->react[0].index) continue;
+      by_start[r->react[n].index + 1] += 1;
+    }
+  }
+
+  for (s = 0; s < net->ncomponent; s++) {
+    by_start[s+1] += by_start[s];
+  }
+
+  by = malloc((by_start[net->ncomponent] + 1)*sizeof(int));
+  if (by == NULL) goto err;
+
+  for (s = 0; s < net->ncomponent; s++) {
+    change[s] = by_start[s];
+  }
+
+  for (i = 0; i < net->nreactions; i++) {
+    r = net->R + i;
+    for (n = 0; n < r->nreactant; n++) {
+      if (n == 1 && r->react[1].index == r->react[0].index) continue;
+      by[change[r->react[n].index]++] = i;
+    }
+  }
+
+  for (s = 0; s < net->ncomponent; s++) {
+    change[s] = 0;
+  }
+
+  for (pass = 0; pass < 2; pass++) {
+
+    ndep = 0;
+    for (i = 0; i < net->nreactions; i++) mark[i] = -1;
+
+    for (j = 0; j < net->nreactions; j++) {
+
+      r = net->R + j;
+      nspecies = 0;
+      for (n = 0; n < r->nreactant; n++) {
+	change[r->react[n].index] -= 1;
+	species[nspecies++] = r->react[n].index;
+      }
+      for (n = 0; n < r->nproduct; n++) {
+	change[r->prod[n].index] += r->prod[n].change;
+	species[nspecies++] = r->prod[n].index;
+      }
+
+      if (pass == 1) net->dep_start[j] = ndep;
+
+      mark[j] = j;
+      if (pass == 1) net->dep[ndep] = j;
+      ndep += 1;
+
+      for (m = 0; m < nspecies; m++) {
+	s = species[m];
+	if (change[s] == 0) continue;
+	for (p = by_start[s]; p < by_start[s+1]; p++) {
+	  i = by[p];
+	  if (mark[i] == j) continue;
+	  mark[i] = j;
+	  if (pass == 1) net->dep[ndep] = i;
+	  ndep += 1;
+	}
+      }
+
+      if (pass == 1) {
+	qsort(net->dep + net->dep_start[j], ndep - net->dep_start[j],
+	      sizeof(int), dmc_int_compare);
+      }
+
+      for (m = 0; m < nspecies; m++) change[species[m]] = 0;
+    }
+
+    if (pass == 0) {
+      /* dep_start[] holds int offsets */
+      if (ndep > INT_MAX) goto err;
+      net->dep = malloc(ndep*sizeof(int));
+      if (net->dep == NULL) goto err;
+    }
+  }
+
+  net->dep_start[net->nreactions] = ndep;
+
+  free(by);
+  free(by_start);
+  free(mark);
+  free(change);
+
   return 0;
+
+ err:
+
+  free(by);
+  free(by_start);
+  free(mark);
+  free(change);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  dmc_int_compare
+ *
+ *****************************************************************************/
+
+static int dmc_int_compare(const void * a, const void * b) {
+
+  int ia = *((const int *) a);
+  int ib = *((const int *) b);
+
+  return (ia > ib) - (ia < ib);
 }
@@ -19,6 +19,16 @@
  *  which provides a simulation using the Gillespie algorithm, a
  *  type of dynamic Monte Carlo method (hence the "dmc"). The actual
  *  implementation is described in sim_dmc.c
+ *
+ *  Each simulation object is an independent engine, so a process may
+ *  hold any number (e.g., several proxies per rank). The reaction
+ *  network, which is read-only, is shared by engines which read the
+ *  same input files.
+ *
+ *  The arguments (\c sim_argv) are the component file, the reaction
+ *  file, and optionally the state file format (\c binary or \c text)
+ *  and the engine: \c direct (Gillespie's direct method, the default)
+ *  or \c next (the next reaction method of Gibson and Bruck).
  */
 
 /**
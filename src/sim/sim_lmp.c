@@ -5,6 +5,7 @@
  *****************************************************************************/
 
 #include <inttypes.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -26,9 +27,43 @@ struct sim_lmp_s {
   double time;
   int argc;
   char ** argv;
+  char * script;          /* Input script (read once) */
+  int nline;              /* Number of lines in script */
+  char ** line;           /* Lines of the script */
+  double * lambda_buf;    /* Scratch for lambda records (gathered at rank 0) */
+  int lambda_style;       /* lmp_lambda_enum_t */
+  int lambda_index;       /* Element of global compute vector (or -1) */
+  char lambda_id[BUFSIZ]; /* Compute or variable name */
+  int native;             /* fix ffs runs whole trials */
+  int native_thermostat;  /* fix ffs holds the langevin thermostat */
+  int run_nstep;          /* LAMMPS time steps per FFS step */
+  char native_id[BUFSIZ]; /* fix ffs ID */
   /* and anything else relating to lammps */
 };
 
+/* sim_lambda may name a global scalar compute "c_ID", an element of a
+ * global vector compute "c_ID[I]", or an equal-style variable "v_name",
+ * as in LAMMPS thermo output. Anything else means the dimer separation. */
+
+typedef enum lmp_lambda_enum {LMP_LAMBDA_DIMER,
+			      LMP_LAMBDA_COMPUTE,
+			      LMP_LAMBDA_VARIABLE} lmp_lambda_enum_t;
+
+/* An in-memory snapshot (SIM_STATE_PACK) is this header followed by
+ * x[3*natoms], v[3*natoms] (double) and image[natoms] (int), all in
+ * order of atom id as provided by lammps_gather_atoms(). */
+
+typedef struct lmp_snapshot_s {
+  int64_t ntimestep;
+  int natoms;
+  int seed;
+  double boxlo[3];
+  double boxhi[3];
+  double xy;
+  double yz;
+  double xz;
+} lmp_snapshot_t;
+
 static int lmp_parse_input(sim_lmp_t * obj, ffs_t * ffs);
 static int lmp_execute_input(sim_lmp_t * obj, ffs_t * ffs);
 static int lmp_parse_input_line(sim_lmp_t * obj, char * ffs_line, char * lmp_line);
@@ -37,11 +72,24 @@ static int lmp_read_restart(sim_lmp_t * obj, ffs_t * ffs, const char * stub);
 static int lmp_execute(sim_lmp_t * obj);
 static int lmp_unfix(sim_lmp_t * obj);
 static int lmp_state_delete(sim_lmp_t * obj, ffs_t * ffs, const char * stub);
+static size_t lmp_pack_size(sim_lmp_t * obj);
+static int lmp_read_input(sim_lmp_t * obj, MPI_Comm comm);
+static void lmp_free_input(sim_lmp_t * obj);
+static int lmp_bcast_file(MPI_Comm comm, const char * filename, char ** pbuf);
+static int lmp_split_lines(char * buf, int * nline, char *** plines);
+static int lmp_lambda_bind(sim_lmp_t * obj, ffs_t * ffs);
+static int lmp_lambda_evaluate(sim_lmp_t * obj, double * lambda);
+static int lmp_pack_state(sim_lmp_t * obj, ffs_t * ffs);
+static int lmp_unpack_state(sim_lmp_t * obj, ffs_t * ffs);
 static int lmp_arrange_input_argv(sim_lmp_t * obj);
+static int lmp_reseed(sim_lmp_t * obj);
+#ifdef HAVE_LAMMPS_FIX_FFS
+static int lmp_native_bind(sim_lmp_t * obj, const char * name);
+static int lmp_execute_trial(sim_lmp_t * obj, ffs_t * ffs);
+#endif
 
 /*dimer problem specific*/
 static int dimer_evaluate_lambda(sim_lmp_t * obj, ffs_t * ffs, double * lambda);
-static int get_coord_with_type(double * coords, int * types, int natoms, int desired_type, double * dc, int * nc);
 static int lammps_get_3Dboxsize(void *lmp, double * BL);
 static int calculate_pair_separation(double * coord , double * BoxLength, double * separation);
 
@@ -60,6 +108,24 @@ const interface_t sim_lmp_interface = {
 
 #define LAMMPS_MAX_SEED 900000000
 
+/* lammps_scatter_atoms() requires an atom map, which is not present
+ * by default for atomic styles. This is issued before the input
+ * script, so the script may still choose a hash instead. */
+
+#define LAMMPS_ATOM_MAP_COMMAND "atom_modify map array"
+
+/* Dimer order parameter: a record per rank holds the number of dimer
+ * atoms found locally, followed by their positions. */
+
+#define DIMER_TYPE    2
+#define DIMER_NATOM   2
+#define DIMER_NRECORD (1 + 3*DIMER_NATOM)
+
+/* With fix ffs (USER-FFS), a trial in which the thermostat is not
+ * itself langevin has a separate fix of this ID. */
+
+#define LAMMPS_FIX_FFS_ID "ffs_trial"
+
 /*****************************************************************************
  *
  *  sim_lmp_table
@@ -101,6 +167,8 @@ int sim_lmp_create(sim_lmp_t ** pobj) {
 
 void sim_lmp_free(sim_lmp_t * obj) {
 
+  lmp_free_input(obj);
+  free(obj->lambda_buf);
   free(obj);
 
 
@@ -117,6 +185,7 @@ int sim_lmp_execute(sim_lmp_t * obj, ffs_t * ffs,
 		     sim_execute_enum_t action) {
 
   int ifail = 0;
+  int nproc;
   double time;
   MPI_Comm comm = MPI_COMM_NULL;
   
@@ -130,6 +199,12 @@ int sim_lmp_execute(sim_lmp_t * obj, ffs_t * ffs,
 
     lammps_open(obj->argc - 2, obj->argv, comm, &obj->lmp);
     ifail += (obj->lmp == NULL);
+
+    if (obj->lambda_buf == NULL) {
+      MPI_Comm_size(comm, &nproc);
+      obj->lambda_buf = calloc(nproc*DIMER_NRECORD, sizeof(double));
+      ifail += (obj->lambda_buf == NULL);
+    }
     
     ifail += ffs_type_set(ffs, FFS_INFO_TIME_PUT, 1, FFS_VAR_DOUBLE);
     ifail += ffs_type_set(ffs, FFS_INFO_LAMBDA_PUT, 1, FFS_VAR_DOUBLE);
@@ -152,6 +227,16 @@ int sim_lmp_execute(sim_lmp_t * obj, ffs_t * ffs,
     lammps_close(obj->lmp);
     break;
 
+  case SIM_EXECUTE_TRIAL:
+    /* the whole trial is run by fix ffs (if present) */
+#ifdef HAVE_LAMMPS_FIX_FFS
+    if (obj->native == 0) return -1;
+    ifail += lmp_execute_trial(obj, ffs);
+#else
+    ifail = -1;
+#endif
+    break;
+
   default:
     /* Something went wrong? */
     ifail = -1;
@@ -179,6 +264,7 @@ int sim_lmp_state(sim_lmp_t * obj, ffs_t * ffs, sim_state_enum_t action,
     
     obj->seed=242334; /*set the seed here for now*/
     ifail += lmp_execute_input(obj, ffs);
+    if (ifail == 0) ifail += lmp_lambda_bind(obj, ffs);
     
     break;
     
@@ -193,6 +279,7 @@ int sim_lmp_state(sim_lmp_t * obj, ffs_t * ffs, sim_state_enum_t action,
 
     ifail += lmp_read_restart(obj, ffs, stub);
     ifail += lmp_execute_input(obj, ffs);
+    if (ifail == 0) ifail += lmp_lambda_bind(obj, ffs);
         
     break;
   case SIM_STATE_WRITE:
@@ -204,6 +291,17 @@ int sim_lmp_state(sim_lmp_t * obj, ffs_t * ffs, sim_state_enum_t action,
     /* create the file name form the stub, and delete the file */
     ifail += lmp_state_delete(obj, ffs, stub);
 
+    break;
+  case SIM_STATE_PACK_SIZE:
+    /* snapshots are held in memory on the live LAMMPS instance */
+    if (obj->lmp == NULL) return -1;
+    ifail += ffs_state_size_set(ffs, lmp_pack_size(obj));
+    break;
+  case SIM_STATE_PACK:
+    ifail += lmp_pack_state(obj, ffs);
+    break;
+  case SIM_STATE_UNPACK:
+    ifail += lmp_unpack_state(obj, ffs);
     break;
   default:
     /* something went wrong? */
@@ -224,7 +322,12 @@ int sim_lmp_lambda(sim_lmp_t * obj, ffs_t * ffs) {
   double lambda;
   int ifail = 0;
   
-  ifail += dimer_evaluate_lambda(obj, ffs, &lambda);
+  if (obj->lambda_style == LMP_LAMBDA_DIMER) {
+    ifail += dimer_evaluate_lambda(obj, ffs, &lambda);
+  }
+  else {
+    ifail += lmp_lambda_evaluate(obj, &lambda);
+  }
   ifail += ffs_info_double(ffs, FFS_INFO_LAMBDA_PUT, 1, &lambda);
   return ifail;
 }
@@ -239,7 +342,6 @@ int sim_lmp_info (sim_lmp_t * obj, ffs_t * ffs, ffs_info_enum_t param) {
   int ifail = 0;
   double time;
   int seed;
-  char command[BUFSIZ];
   
   /* Examine param, and put or get the appropriate information. */
   switch(param) {
@@ -260,9 +362,7 @@ int sim_lmp_info (sim_lmp_t * obj, ffs_t * ffs, ffs_info_enum_t param) {
     if (seed == 0) seed = 1;
     
     obj->seed = seed;
-    ifail += lmp_unfix(obj);
-    sprintf(command, obj->fix_command, obj->seed);
-    lammps_command(obj->lmp, command);
+    ifail += lmp_reseed(obj);
     
     break;
   case FFS_INFO_LAMBDA_PUT:
@@ -278,45 +378,34 @@ int sim_lmp_info (sim_lmp_t * obj, ffs_t * ffs, ffs_info_enum_t param) {
   return ifail;
 }
 
+/*****************************************************************************
+ *
+ *  lmp_parse_input
+ *
+ *  The input script is read once here, and is held for replay by
+ *  lmp_execute_input().
+ *
+ *****************************************************************************/
+
 int lmp_parse_input(sim_lmp_t * obj, ffs_t * ffs){
 
-  int n, me;
+  int n;
   int ifail = 0;
   char line[BUFSIZ];
   char ffs_line[1024];
   int ffs_command_found = 0;
 
   MPI_Comm comm = MPI_COMM_NULL;
-  FILE *fp = NULL;
 
   ffs_comm(ffs, &comm);
-  MPI_Comm_rank(comm, &me);
-  
-  if (me == 0){
-    fp = fopen(obj->input_file, "r");
-    
-    if (fp == NULL) {
-      ifail = 1;
-      printf("error opening file: %s\n", obj->input_file);
-      return ifail;
-    }
-  }
 
-  while(1){
-    if(me == 0) {
-      if(fgets(line, BUFSIZ, fp) == NULL){
-	n = 0;
-      }
-      else {
-	n = strlen(line) + 1;
-      }
-      if (n == 0) fclose(fp);
-    }
-    
-    MPI_Bcast(&n,1,MPI_INT,0,comm);
-    if (n == 0) break;
-    MPI_Bcast(line,n,MPI_CHAR,0,comm);
-    if(line[n-2] == '\n')line[n-2] = '\0';
+  ifail = lmp_read_input(obj, comm);
+  if (ifail) return ifail;
+
+  for (n = 0; n < obj->nline; n++) {
+
+    /* lmp_parse_input_line() tokenises the line, so use a copy */
+    snprintf(line, BUFSIZ, "%s", obj->line[n]);
 
     if (ffs_command_found == 1) {
       ifail += lmp_parse_input_line(obj,ffs_line, line);
@@ -325,7 +414,7 @@ int lmp_parse_input(sim_lmp_t * obj, ffs_t * ffs){
     
     if(strncmp(line, "#$FFS", 5) == 0){
       ffs_command_found = 1;
-      sprintf(ffs_line, "%s", line);
+      snprintf(ffs_line, 1024, "%s", line);
     }
   }
   
@@ -387,62 +476,53 @@ static int lmp_arrange_input_argv(sim_lmp_t * obj) {
 }
 
 
+/*****************************************************************************
+ *
+ *  lmp_execute_input
+ *
+ *  Replay the input script held in memory. The line following an FFS
+ *  directive is replaced by the command for that directive.
+ *
+ *****************************************************************************/
+
 int lmp_execute_input(sim_lmp_t * obj, ffs_t * ffs) {
   
-  int me, n;
-  char line[BUFSIZ];
+  int n;
   char command[BUFSIZ];
-  MPI_Comm comm = MPI_COMM_NULL;
-  FILE * fp = NULL;
   int ffs_command_found = 0;
-  
-  
-  ffs_comm(ffs, &comm);
 
-  MPI_Comm_rank(comm, &me);
-  
-  if(me == 0){
-    fp = fopen(obj->input_file, "r");
-    if (fp == NULL){
-      printf("error opening file %s\n",obj->input_file);
-      return 1;
-    }
+  if (obj->line == NULL) {
+    printf("error input file %s has not been read\n", obj->input_file);
+    return 1;
   }
 
-  while (1) {
-    if(me == 0) {
-      if (fgets(line,BUFSIZ,fp) == NULL) n = 0;
-      else n = strlen(line) + 1;
-    }
-    
-    MPI_Bcast(&n,1,MPI_INT,0,comm);
-    if (n == 0) break;
-    
-    MPI_Bcast(line,n,MPI_CHAR,0,comm);
+  lammps_command(obj->lmp, LAMMPS_ATOM_MAP_COMMAND);
+
+  for (n = 0; n < obj->nline; n++) {
 
-    if (strncmp(line, "#$FFS_READ_RESTART", 18) == 0) {
+    if (strncmp(obj->line[n], "#$FFS_READ_RESTART", 18) == 0) {
       sprintf(command, "read_restart %s", obj->restart_file);
       ffs_command_found = 1;
     }
-    else if(strncmp(line, "#$FFS_FIX", 9) == 0) {
+    else if(strncmp(obj->line[n], "#$FFS_FIX", 9) == 0) {
       sprintf(command, obj->fix_command,obj->seed);
       ffs_command_found = 1;
     }
-    else if(strncmp(line, "#$FFS_RUN", 9) == 0) {
+    else if(strncmp(obj->line[n], "#$FFS_RUN", 9) == 0) {
       sprintf(command, " "); /*We don't want to execute the run command here */
       ffs_command_found = 1;
     }
     else {
-      if(ffs_command_found == 0)strcpy(command, line);
+      if(ffs_command_found == 0) snprintf(command, BUFSIZ, "%s", obj->line[n]);
       lammps_command(obj->lmp, command);
       ffs_command_found = 0;
     }
   }
 
-  if(me == 0)fclose(fp);
   return 0;
 }
 
+
 int lmp_parse_input_line(sim_lmp_t * obj, char * ffs_line, char * lmp_line){
   int ifail = 0;
   char *tokens_ffs = NULL;
@@ -529,10 +609,19 @@ int lmp_parse_input_line(sim_lmp_t * obj, char * ffs_line, char * lmp_line){
 }
 
 
+/*****************************************************************************
+ *
+ *  lmp_write_restart
+ *
+ *  The metadata (input file, restart file, fix and run commands, and
+ *  the seed) are written as one record to the ".in" file, an item
+ *  per line, alongside the LAMMPS restart file.
+ *
+ *****************************************************************************/
+
 int lmp_write_restart(sim_lmp_t * obj, ffs_t * ffs, const char * stub) {
   
   char filename[BUFSIZ];
-  char line[BUFSIZ];
   char command[BUFSIZ];
   FILE * fp = NULL;
   int ifail = 0;
@@ -558,19 +647,9 @@ int lmp_write_restart(sim_lmp_t * obj, ffs_t * ffs, const char * stub) {
       printf("error could not open file %s\n",filename);
       return 1;
     }
-  
-    sprintf(line, "%s\n", obj->input_file);
-    fputs(line, fp);
-    sprintf(line, "%s\n", obj->restart_file);
-    fputs(line, fp);
-    sprintf(line, "%s\n", obj->fix_command);
-    fputs(line, fp);
-    sprintf(line, "%s\n", obj->run_command);
-    fputs(line, fp);
-    sprintf(line, "%d\n", obj->seed);
-    fputs(line, fp);
-    
-    fclose(fp);
+    fprintf(fp, "%s\n%s\n%s\n%s\n%d\n", obj->input_file, obj->restart_file,
+	    obj->fix_command, obj->run_command, obj->seed);
+    if (fclose(fp) != 0) ifail += 1;
   }
 
   /* Now write lammps restart file */
@@ -583,98 +662,311 @@ int lmp_write_restart(sim_lmp_t * obj, ffs_t * ffs, const char * stub) {
   return ifail;
 }
 
+/*****************************************************************************
+ *
+ *  lmp_read_restart
+ *
+ *  The ".in" record is broadcast in one message.
+ *
+ *****************************************************************************/
+
 int lmp_read_restart(sim_lmp_t * obj, ffs_t * ffs, const char * stub) {
   
   char filename[BUFSIZ];
-  char line[BUFSIZ];
-  FILE * fp = NULL;
+  char * record = NULL;
+  char ** item = NULL;
+  int nitem = 0;
   int ifail = 0;
-  int me;
-  int n;
-  int seed;
   
   MPI_Comm comm = MPI_COMM_NULL;
     
   ffs_comm(ffs, &comm);
 
-  MPI_Comm_rank(comm, &me);
-  
   if(obj->lmp == NULL) {
     printf("error no lammps\n");
     return 1;
   }
-  
-  if (me == 0 ) {
-    sprintf(filename, "%s.in",stub);
-    fp = fopen(filename, "r");
-    if ( fp == NULL){
-      printf("error could not open file %s\n",filename);
-      return 1;
-    }
+
+  sprintf(filename, "%s.in", stub);
+  if (lmp_bcast_file(comm, filename, &record)) return 1;
+
+  ifail = lmp_split_lines(record, &nitem, &item);
+
+  if (ifail == 0 && nitem < 5) {
+    printf("error incomplete state file %s\n", filename);
+    ifail = 1;
   }
 
-  n = 0;
-  if(me == 0){
-    if(fgets(line, BUFSIZ, fp ) == NULL)ifail += 1;
-    else n = strlen(line) + 1;
+  if (ifail == 0) {
+    snprintf(obj->input_file, BUFSIZ, "%s", item[0]);
+    snprintf(obj->restart_file, BUFSIZ, "%s", item[1]);
+    snprintf(obj->fix_command, BUFSIZ, "%s", item[2]);
+    snprintf(obj->run_command, BUFSIZ, "%s", item[3]);
+    obj->seed = atoi(item[4]);
   }
-  MPI_Bcast(&n,1,MPI_INT,0,comm);
-  if (n != 0){ 
-    MPI_Bcast(line, n, MPI_CHAR, 0, comm);
-    if(line[n-2] == '\n')line[n-2] = '\0';
-    strncpy(obj->input_file, line, n - 1);
+
+  free(item);
+  free(record);
+    
+  return ifail;
+}
+
+/*****************************************************************************
+ *
+ *  lmp_read_input
+ *
+ *  The input script is read by rank 0 and broadcast to all ranks,
+ *  where it is held as a list of lines (without newlines).
+ *
+ *****************************************************************************/
+
+static int lmp_read_input(sim_lmp_t * obj, MPI_Comm comm) {
+
+  lmp_free_input(obj);
+
+  if (lmp_bcast_file(comm, obj->input_file, &obj->script)) return 1;
+
+  return lmp_split_lines(obj->script, &obj->nline, &obj->line);
+}
+
+/*****************************************************************************
+ *
+ *  lmp_free_input
+ *
+ *****************************************************************************/
+
+static void lmp_free_input(sim_lmp_t * obj) {
+
+  free(obj->line);
+  free(obj->script);
+  obj->line = NULL;
+  obj->script = NULL;
+  obj->nline = 0;
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  lmp_bcast_file
+ *
+ *  Rank 0 reads the whole file, which is broadcast in one message to
+ *  a new buffer (with a terminating '\0') on every rank. A failure to
+ *  read the file, or to allocate the buffer on any rank, is reported
+ *  on all ranks.
+ *
+ *****************************************************************************/
+
+static int lmp_bcast_file(MPI_Comm comm, const char * filename,
+			  char ** pbuf) {
+
+  int me;
+  int ok, okall;
+  int n = -1;
+  long int nbytes;
+  char * buf = NULL;
+  FILE * fp = NULL;
+
+  MPI_Comm_rank(comm, &me);
+
+  if (me == 0) {
+    fp = fopen(filename, "r");
+    if (fp == NULL) {
+      printf("error opening file %s\n", filename);
+    }
+    else {
+      if (fseek(fp, 0, SEEK_END) == 0) {
+	nbytes = ftell(fp);
+	rewind(fp);
+	if (nbytes >= 0 && nbytes < INT_MAX) buf = malloc(nbytes + 1);
+	if (buf && fread(buf, 1, nbytes, fp) == (size_t) nbytes) n = nbytes;
+      }
+      fclose(fp);
+    }
   }
-  
-  n = 0;
-  if(me == 0){
-    if(fgets(line, BUFSIZ, fp) == NULL)ifail += 1;
-    else n = strlen(line) + 1;
+
+  MPI_Bcast(&n, 1, MPI_INT, 0, comm);
+
+  if (n < 0) {
+    free(buf);
+    return 1;
   }
-  MPI_Bcast(&n,1,MPI_INT,0,comm);
-  if (n != 0){ 
-    MPI_Bcast(line, n, MPI_CHAR, 0, comm);
-    if(line[n-2] == '\n')line[n-2] = '\0';
-    strncpy(obj->restart_file, line, n - 1);
+
+  /* Every rank must have its buffer before the contents are sent */
+
+  if (me != 0) buf = malloc(n + 1);
+  ok = (buf != NULL);
+  MPI_Allreduce(&ok, &okall, 1, MPI_INT, MPI_LAND, comm);
+
+  if (okall == 0) {
+    if (me == 0) printf("failed to allocate %d bytes for %s\n", n, filename);
+    free(buf);
+    return 1;
   }
-  
-  n = 0;
-  if(me == 0){
-    if(fgets(line, BUFSIZ, fp) == NULL)ifail += 1;
-    else n = strlen(line) + 1;
+
+  MPI_Bcast(buf, n, MPI_CHAR, 0, comm);
+  buf[n] = '\0';
+
+  *pbuf = buf;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lmp_split_lines
+ *
+ *  The buffer is split in place at each newline. The new list of
+ *  pointers to the lines should be released by the caller.
+ *
+ *****************************************************************************/
+
+static int lmp_split_lines(char * buf, int * nline, char *** plines) {
+
+  int n = 0;
+  int nmax = 1;
+  char * p = NULL;
+  char ** lines = NULL;
+
+  for (p = buf; *p; p++) {
+    if (*p == '\n') nmax += 1;
   }
-  MPI_Bcast(&n,1,MPI_INT,0,comm);
-  if (n != 0){ 
-    MPI_Bcast(line, n, MPI_CHAR, 0, comm);
-    if(line[n-2] == '\n')line[n-2] = '\0';
-    strncpy(obj->fix_command, line, n - 1);
+
+  lines = calloc(nmax, sizeof(char *));
+  if (lines == NULL) return 1;
+
+  p = buf;
+  while (*p) {
+    lines[n++] = p;
+    p = strchr(p, '\n');
+    if (p == NULL) break;
+    *p++ = '\0';
   }
-  
-  n = 0;
-  if(me == 0){
-    if(fgets(line, BUFSIZ, fp) == NULL)ifail += 1;
-    else n = strlen(line) + 1;
-  }
-  MPI_Bcast(&n,1,MPI_INT,0,comm);
-  if (n != 0){ 
-    MPI_Bcast(line, n, MPI_CHAR, 0, comm);
-    if(line[n-2] == '\n')line[n-2] = '\0';
-    strncpy(obj->run_command, line, n - 1);
-  }
-
-  n = 0;
-  if(me == 0){
-    if(fgets(line, BUFSIZ, fp) == NULL)ifail += 1;
-    else n = strlen(line) + 1;
-  }
-  MPI_Bcast(&n,1,MPI_INT,0,comm);
-  if (n != 0){ 
-    MPI_Bcast(line, n, MPI_CHAR, 0, comm);
-    seed = atoi(line);
-    obj->seed = seed;
+
+  *nline = n;
+  *plines = lines;
+
+  return 0;
+}
+
+
+/*****************************************************************************
+ *
+ *  lmp_pack_size
+ *
+ *  Every rank holds a copy of the whole snapshot, as that is what
+ *  lammps_gather_atoms() provides and lammps_scatter_atoms() expects.
+ *
+ *****************************************************************************/
+
+static size_t lmp_pack_size(sim_lmp_t * obj) {
+
+  size_t natoms;
+
+  natoms = (size_t) lammps_get_natoms(obj->lmp);
+
+  return sizeof(lmp_snapshot_t) + natoms*(6*sizeof(double) + sizeof(int));
+}
+
+/*****************************************************************************
+ *
+ *  lmp_pack_state
+ *
+ *  Positions, velocities and image flags are gathered directly into
+ *  the FFS buffer, along with the box and the time step, so that the
+ *  state can be restored without a restart file.
+ *
+ *****************************************************************************/
+
+static int lmp_pack_state(sim_lmp_t * obj, ffs_t * ffs) {
+
+  size_t nbytes;
+  char * buf = NULL;
+  double * x = NULL;
+  double * v = NULL;
+  int * image = NULL;
+  int periodicity[3];
+  int box_change;
+  lmp_snapshot_t * snap = NULL;
+
+  if (obj->lmp == NULL) return -1;
+  if (ffs_state_buffer(ffs, (void **) &buf, &nbytes)) return -1;
+  if (nbytes < lmp_pack_size(obj)) return -1;
+
+  snap = (lmp_snapshot_t *) buf;
+  snap->natoms = lammps_get_natoms(obj->lmp);
+  snap->ntimestep = *((int64_t *) lammps_extract_global(obj->lmp, "ntimestep"));
+  snap->seed = obj->seed;
+
+  lammps_extract_box(obj->lmp, snap->boxlo, snap->boxhi, &snap->xy,
+		     &snap->yz, &snap->xz, periodicity, &box_change);
+
+  x = (double *) (buf + sizeof(lmp_snapshot_t));
+  v = x + 3*snap->natoms;
+  image = (int *) (v + 3*snap->natoms);
+
+  lammps_gather_atoms(obj->lmp, (char *) "x", 1, 3, x);
+  lammps_gather_atoms(obj->lmp, (char *) "v", 1, 3, v);
+  lammps_gather_atoms(obj->lmp, (char *) "image", 0, 1, image);
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  lmp_unpack_state
+ *
+ *  The snapshot is scattered back onto the live instance. Atoms
+ *  which are now outside their sub-domain are migrated at the
+ *  set up of the next run. The thermostat takes the seed of the
+ *  snapshot, as it would on reading a restart file.
+ *
+ *****************************************************************************/
+
+static int lmp_unpack_state(sim_lmp_t * obj, ffs_t * ffs) {
+
+  int ifail = 0;
+  size_t nbytes;
+  char * buf = NULL;
+  double * x = NULL;
+  double * v = NULL;
+  int * image = NULL;
+  double dt;
+  char command[BUFSIZ];
+  lmp_snapshot_t * snap = NULL;
+
+  if (obj->lmp == NULL) return -1;
+  if (ffs_state_buffer(ffs, (void **) &buf, &nbytes)) return -1;
+  if (nbytes < sizeof(lmp_snapshot_t)) return -1;
+
+  snap = (lmp_snapshot_t *) buf;
+
+  if (snap->natoms != lammps_get_natoms(obj->lmp)) {
+    printf("Snapshot has %d atoms (expected %d)\n", snap->natoms,
+	   (int) lammps_get_natoms(obj->lmp));
+    return -1;
   }
-  
-  if(me == 0)fclose(fp);
-    
+  if (nbytes < lmp_pack_size(obj)) return -1;
+
+  x = (double *) (buf + sizeof(lmp_snapshot_t));
+  v = x + 3*snap->natoms;
+  image = (int *) (v + 3*snap->natoms);
+
+  lammps_reset_box(obj->lmp, snap->boxlo, snap->boxhi, snap->xy, snap->yz,
+		   snap->xz);
+
+  lammps_scatter_atoms(obj->lmp, (char *) "x", 1, 3, x);
+  lammps_scatter_atoms(obj->lmp, (char *) "v", 1, 3, v);
+  lammps_scatter_atoms(obj->lmp, (char *) "image", 0, 1, image);
+
+  sprintf(command, "reset_timestep %" PRId64, snap->ntimestep);
+  lammps_command(obj->lmp, command);
+
+  dt = *((double *) lammps_extract_global(obj->lmp, "dt"));
+  obj->time = dt*snap->ntimestep;
+  obj->seed = snap->seed;
+  ifail += lmp_reseed(obj);
+
   return ifail;
 }
 
@@ -721,6 +1013,33 @@ int lmp_unfix(sim_lmp_t * obj){
   
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  lmp_reseed
+ *
+ *  Give the thermostat the current seed. A thermostat held by fix ffs
+ *  is reseeded in place; otherwise the fix is re-issued.
+ *
+ *****************************************************************************/
+
+static int lmp_reseed(sim_lmp_t * obj) {
+
+  int ifail = 0;
+  char command[BUFSIZ];
+
+  if (obj->native_thermostat) {
+    sprintf(command, "fix_modify %s seed %d", obj->native_id, obj->seed);
+    lammps_command(obj->lmp, command);
+  }
+  else if (obj->fix_command[0] != '\0') {
+    ifail += lmp_unfix(obj);
+    sprintf(command, obj->fix_command, obj->seed);
+    lammps_command(obj->lmp, command);
+  }
+
+  return ifail;
+}
   
   
 
@@ -746,127 +1065,295 @@ int lmp_state_delete(sim_lmp_t * obj, ffs_t * ffs, const char * stub) {
   return ifail;
 }
 
-/*dimer stuff follows*/
-/*should be in its own file*/
-int dimer_evaluate_lambda(sim_lmp_t * obj, ffs_t * ffs, double * lambda){
-  /* int t can be used to distinguish between int, double etc lambda
-   * not operational at the moment
-   */
+/*****************************************************************************
+ *
+ *  lmp_lambda_bind
+ *
+ *  Resolve sim_lambda once the input script has been executed. A
+ *  compute or variable is checked by evaluating it after a "run 0",
+ *  which ensures any compute has been initialised.
+ *
+ *****************************************************************************/
 
-  double BoxLength[3];
-  double dimer_coords[6];
-  double rsep;
-  int nc;
-  
-  int natoms = lammps_get_natoms(obj->lmp);
-  double *coords = (double *) malloc(3*natoms*sizeof(double));
-  int *id = (int *) malloc(natoms*sizeof(int));
-  int *type = (int *) malloc(natoms*sizeof(int));
-
-  lammps_gather_atoms(obj->lmp, "x", 1, 3, coords);
-  lammps_gather_atoms(obj->lmp, "id", 0, 1, id);
-  lammps_gather_atoms(obj->lmp, "type", 0, 1, type);
-
-  if(get_coord_with_type(coords, type, natoms, 2, dimer_coords, &nc) != 0){
-    free(coords);
-    free(id);
-    free(type);
-    return 1;
+static int lmp_lambda_bind(sim_lmp_t * obj, ffs_t * ffs) {
+
+  char name[BUFSIZ];
+  char * p = NULL;
+  double lambda;
+
+  obj->lambda_style = LMP_LAMBDA_DIMER;
+  obj->lambda_index = -1;
+  obj->lambda_id[0] = '\0';
+  obj->native = 0;
+  obj->native_thermostat = 0;
+
+  if (ffs_lambda_name(ffs, name, BUFSIZ) != 0) return 0;
+
+  if (strncmp(name, "c_", 2) == 0) {
+    obj->lambda_style = LMP_LAMBDA_COMPUTE;
+    snprintf(obj->lambda_id, BUFSIZ, "%s", name + 2);
+    p = strchr(obj->lambda_id, '[');
+    if (p) {
+      *p = '\0';
+      obj->lambda_index = atoi(p + 1) - 1; /* LAMMPS counts from 1 */
+      if (obj->lambda_index < 0) {
+	printf("Illegal sim_lambda %s\n", name);
+	return 1;
+      }
+    }
   }
-  
-  if(lammps_get_3Dboxsize(obj->lmp, BoxLength) != 0){
-    free(coords);
-    free(id);
-    free(type);
-    return 1;
+  else if (strncmp(name, "v_", 2) == 0) {
+    obj->lambda_style = LMP_LAMBDA_VARIABLE;
+    snprintf(obj->lambda_id, BUFSIZ, "%s", name + 2);
   }
 
-  if(calculate_pair_separation(dimer_coords, BoxLength, &rsep) != 0){
-    free(coords);
-    free(id);
-    free(type);
+  if (obj->lambda_style == LMP_LAMBDA_DIMER) return 0;
+
+  lammps_command(obj->lmp, (char *) "run 0");
+
+  if (lmp_lambda_evaluate(obj, &lambda) != 0) {
+    printf("sim_lambda %s is not a global compute or equal-style variable\n",
+	   name);
     return 1;
   }
-  free(coords);
-  free(id);
-  free(type);
 
-  /* Want an increasing lambda */
-  *lambda = rsep;
+#ifdef HAVE_LAMMPS_FIX_FFS
+  return lmp_native_bind(obj, name);
+#else
+  return 0;
+#endif
+}
+
+#ifdef HAVE_LAMMPS_FIX_FFS
+
+/*****************************************************************************
+ *
+ *  lmp_native_bind
+ *
+ *  Add fix ffs for sim_lambda, so that a trial may be run by a single
+ *  "run" command which fix ffs halts at the interface. A langevin
+ *  thermostat (with no optional keywords) is replaced by fix ffs of
+ *  the same ID, which is then reseeded without being re-issued.
+ *
+ *  Each FFS step must be a plain "run N".
+ *
+ *****************************************************************************/
+
+static int lmp_native_bind(sim_lmp_t * obj, const char * name) {
+
+  int ntok;
+  char tok[8][BUFSIZ];
+  char command[BUFSIZ];
+
+  if (sscanf(obj->run_command, "%s %d %s", tok[0], &obj->run_nstep, tok[1])
+      != 2 || strcmp(tok[0], "run") != 0 || obj->run_nstep < 1) {
+    return 0;
+  }
+
+  ntok = sscanf(obj->fix_command, "%s %s %s %s %s %s %s %s %s", tok[0],
+		tok[1], tok[2], tok[3], tok[4], tok[5], tok[6], tok[7],
+		command);
+
+  if (ntok == 8 && strcmp(tok[3], "langevin") == 0
+      && strcmp(tok[7], "%d") == 0) {
+    lmp_unfix(obj);
+    snprintf(obj->native_id, BUFSIZ, "%s", tok[1]);
+    snprintf(command, BUFSIZ, "fix %s %s ffs %s langevin %s %s %s %d",
+	     tok[1], tok[2], name, tok[4], tok[5], tok[6], obj->seed);
+    obj->native_thermostat = 1;
+  }
+  else {
+    snprintf(obj->native_id, BUFSIZ, "%s", LAMMPS_FIX_FFS_ID);
+    snprintf(command, BUFSIZ, "fix %s all ffs %s", LAMMPS_FIX_FFS_ID, name);
+  }
+
+  lammps_command(obj->lmp, command);
+  obj->native = 1;
 
   return 0;
 }
 
-int dimer_evaluate_lambda2(sim_lmp_t * obj, ffs_t * ffs, double * lambda){
+/*****************************************************************************
+ *
+ *  lmp_execute_trial
+ *
+ *  The run is long enough to reach nstepmax at the first examination
+ *  of lambda at or beyond it (as it would step by step); fix ffs
+ *  halts it sooner if lambda leaves [lambda_min, lambda_max).
+ *
+ *****************************************************************************/
+
+static int lmp_execute_trial(sim_lmp_t * obj, ffs_t * ffs) {
+
+  int ifail = 0;
+  int nstepmax, nsteplambda;
+  int nrun;
+  double lambda_min, lambda_max;
+  double dt;
+  int64_t step0, step1;
+  char command[BUFSIZ];
+
+  ifail = ffs_trial_bounds(ffs, &lambda_min, &lambda_max, &nstepmax,
+			   &nsteplambda);
+  if (ifail) return ifail;
+
+  nrun = nsteplambda*((nstepmax + nsteplambda - 1)/nsteplambda);
+
+  sprintf(command, "fix_modify %s ffs_bounds %.17g %.17g %d", obj->native_id,
+	  lambda_min, lambda_max, nsteplambda*obj->run_nstep);
+  lammps_command(obj->lmp, command);
+
+  step0 = *((int64_t *) lammps_extract_global(obj->lmp, "ntimestep"));
 
-  /* Code not active
-  double coords_dimer_local[6];
-  double coords_dimer[6];
-  int ndimer_local;
-  int ndimer;
+  sprintf(command, "run %d", nrun*obj->run_nstep);
+  lammps_command(obj->lmp, command);
 
-  int nlocal;
-  double **coords_local;
+  step1 = *((int64_t *) lammps_extract_global(obj->lmp, "ntimestep"));
+  dt = *((double *) lammps_extract_global(obj->lmp, "dt"));
+
+  obj->time = dt*step1;
+
+  ifail += ffs_trial_nstep_set(ffs, (int) ((step1 - step0)/obj->run_nstep));
+  ifail += ffs_info_double(ffs, FFS_INFO_TIME_PUT, 1, &obj->time);
+
+  return ifail;
+}
+
+#endif
+
+/*****************************************************************************
+ *
+ *  lmp_lambda_evaluate
+ *
+ *  A global compute or variable has the same value on all ranks, so
+ *  no communication is required beyond that made by LAMMPS itself
+ *  (which is why this must be called on all ranks).
+ *
+ *  No bounds check is possible for an element of a vector compute.
+ *
+ *****************************************************************************/
+
+static int lmp_lambda_evaluate(sim_lmp_t * obj, double * lambda) {
+
+  double * value = NULL;
+
+  switch (obj->lambda_style) {
+  case LMP_LAMBDA_COMPUTE:
+    if (obj->lambda_index < 0) {
+      value = (double *) lammps_extract_compute(obj->lmp, obj->lambda_id, 0, 0);
+    }
+    else {
+      value = (double *) lammps_extract_compute(obj->lmp, obj->lambda_id, 0, 1);
+      if (value) value += obj->lambda_index;
+    }
+    if (value == NULL) return 1;
+    *lambda = *value;
+    break;
+  case LMP_LAMBDA_VARIABLE:
+    /* The value of an equal-style variable is allocated by LAMMPS */
+    value = (double *) lammps_extract_variable(obj->lmp, obj->lambda_id, NULL);
+    if (value == NULL) return 1;
+    *lambda = *value;
+    free(value);
+    break;
+  default:
+    return 1;
+  }
 
-  nlocal = *((int *)) lammps_extract_global(obj, "nlocal");
-  coords_local = **((double *)) lammps_extract_atom(obj, "x");
-  */
   return 0;
 }
 
-int dimer_evaluate_lambda3(sim_lmp_t * obj, ffs_t * ffs, double * lambda) {
+/*dimer stuff follows*/
+/*should be in its own file*/
+
+/*****************************************************************************
+ *
+ *  dimer_evaluate_lambda
+ *
+ *  The separation of the two dimer atoms (of type DIMER_TYPE). Each
+ *  rank looks only at its own atoms, and sends a short fixed-size
+ *  record (the number of dimer atoms found, and their positions) to
+ *  rank 0 of the simulation communicator, which computes lambda. The
+ *  communication does not depend on the number of atoms.
+ *
+ *  Only rank 0 has lambda on exit; other ranks return zero.
+ *
+ *****************************************************************************/
+
+int dimer_evaluate_lambda(sim_lmp_t * obj, ffs_t * ffs, double * lambda){
 
-  double * dist = NULL;
+  int ifail = 0;
+  int n, k, me, nproc;
+  int nlocal, nfound;
+  int * type = NULL;
+  double ** x = NULL;
+  double * record = NULL;
+  double send[DIMER_NRECORD];
+  double dimer_coords[3*DIMER_NATOM];
+  double BoxLength[3];
+  double rsep;
   MPI_Comm comm = MPI_COMM_NULL;
-  int me,step;
-  
+
+  *lambda = 0.0;
+
   ffs_comm(ffs, &comm);
   MPI_Comm_rank(comm, &me);
-  printf ("hep me[%d]\n",me);
-  
-  //printf("%lf\n", (double *)lammps_extract_compute(obj->lmp,"1", 2, 1)));
-  //dist = *((double *) lammps_extract_compute(obj,(char *) "thermo_pe", 0, 0));
-  /* this relies on line
-   * compute 1 all bond/local dist
-   * in the input script
-   */
-  
-  //dist = ((double *) lammps_extract_compute(obj->lmp, "1", 2, 1));
-  
-  step = *((int *) lammps_extract_global(obj->lmp, "ntimestep"));
-  dist = ((double *) lammps_extract_compute(obj->lmp, "1", 2, 1));
-  if ( dist != NULL){
-    
-    printf ("me[%d] step %d dist = %lf\n", me,step,*dist);
-  
-    *lambda = *dist;
+  MPI_Comm_size(comm, &nproc);
+
+  if (obj->lambda_buf == NULL) {
+    printf("error no lambda buffer\n");
+    return 1;
   }
-  
-  return 0;
-}
 
-int get_coord_with_type(double * coords, int * types, int natoms, int desired_type, double * dc, int * nc)
-{
+  nlocal = *((int *) lammps_extract_global(obj->lmp, "nlocal"));
+  x = (double **) lammps_extract_atom(obj->lmp, "x");
+  type = (int *) lammps_extract_atom(obj->lmp, "type");
 
-  int i,k;
-  int offset;
-  
-  nc = 0;
-  offset=0;
-  
-  for (i = 0; i < natoms ; i++){
-    if(types[i] == desired_type){
-      nc += 1;
-      for (k=0; k < 3; k++){
-	dc[offset] = coords[i*3+k];
-	offset += 1;
+  for (k = 0; k < DIMER_NRECORD; k++) send[k] = 0.0;
+
+  nfound = 0;
+  for (n = 0; n < nlocal; n++) {
+    if (type[n] != DIMER_TYPE) continue;
+    if (nfound < DIMER_NATOM) {
+      for (k = 0; k < 3; k++) send[1 + 3*nfound + k] = x[n][k];
+    }
+    nfound += 1;
+  }
+  send[0] = nfound;
+
+  MPI_Gather(send, DIMER_NRECORD, MPI_DOUBLE, obj->lambda_buf, DIMER_NRECORD,
+	     MPI_DOUBLE, 0, comm);
+
+  if (me == 0) {
+
+    nfound = 0;
+    for (n = 0; n < nproc; n++) {
+      record = obj->lambda_buf + n*DIMER_NRECORD;
+      for (k = 0; k < (int) record[0]; k++) {
+	if (nfound < DIMER_NATOM && k < DIMER_NATOM) {
+	  memcpy(dimer_coords + 3*nfound, record + 1 + 3*k, 3*sizeof(double));
+	}
+	nfound += 1;
       }
     }
+
+    if (nfound != DIMER_NATOM) {
+      printf("error found %d atoms of type %d (expected %d)\n", nfound,
+	     DIMER_TYPE, DIMER_NATOM);
+      return 1;
+    }
+
+    ifail += lammps_get_3Dboxsize(obj->lmp, BoxLength);
+    ifail += calculate_pair_separation(dimer_coords, BoxLength, &rsep);
+
+    /* Want an increasing lambda */
+    *lambda = rsep;
   }
 
-  return 0;
+  return ifail;
 }
 
+
 int lammps_get_3Dboxsize(void *lmp, double * BL)
 {
   double xlo,xhi;
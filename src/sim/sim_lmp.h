@@ -17,6 +17,18 @@
  *
  *  \{
  *    Uses molecular dynamics via the LAMMPS C library interface
+ *
+ *    The order parameter is identified by \c sim_lambda in the FFS
+ *    input. This may name a global scalar compute \c c_ID, an element
+ *    of a global vector compute \c c_ID[I], or an equal-style variable
+ *    \c v_name, which must be defined in the LAMMPS input script. Any
+ *    other value means the separation of the two atoms of type 2 (the
+ *    dimer problem).
+ *
+ *    If built with HAVE_LAMMPS_FIX_FFS, and LAMMPS has fix ffs (see
+ *    USER-FFS in the LAMMPS example), a compute or variable order
+ *    parameter allows each trial to be run by a single LAMMPS "run"
+ *    (SIM_EXECUTE_TRIAL), which fix ffs halts at the interface.
  */
 
 /**
@@ -28,12 +28,15 @@ int ffs_ensemble_create(int nmax, ffs_ensemble_t ** pobj) {
   obj->nmax = nmax;
   obj->nsuccess = 0;
 
-  obj->traj = u_calloc(nmax, sizeof(int));
+  obj->traj = u_calloc(nmax, sizeof(long long int));
   dbg_err_sif(obj->traj == NULL);
 
   obj->wt = u_calloc(nmax, sizeof(double));
   dbg_err_sif(obj->wt == NULL);
 
+  obj->owner = u_calloc(nmax, sizeof(int));
+  dbg_err_sif(obj->owner == NULL);
+
   *pobj = obj;
 
   return 0;
@@ -55,6 +58,7 @@ void ffs_ensemble_free(ffs_ensemble_t * obj) {
 
   dbg_return_if(obj == NULL, );
 
+  if (obj->owner) u_free(obj->owner);
   if (obj->wt) u_free(obj->wt);
   if (obj->traj) u_free(obj->traj);
   u_free(obj);
@@ -112,3 +116,187 @@ int ffs_ensemble_samplewt(ffs_ensemble_t * obj, ranlcg_t * ran, int * irun) {
 
   return 0;
 }
+
+/*****************************************************************************
+ *
+ *  ffs_ensemble_compact
+ *
+ *****************************************************************************/
+
+int ffs_ensemble_compact(ffs_ensemble_t * src, ffs_ensemble_t * dst) {
+
+  int n;
+
+  dbg_return_if(src == NULL, -1);
+  dbg_return_if(dst == NULL, -1);
+
+  dst->nsuccess = 0;
+  for (n = 0; n < src->nsuccess; n++) {
+    if (src->traj[n] == -1) continue;
+    dbg_return_if(dst->nsuccess >= dst->nmax, -1);
+    dst->traj[dst->nsuccess] = src->traj[n];
+    dst->wt[dst->nsuccess] = src->wt[n];
+    dst->owner[dst->nsuccess] = src->owner[n];
+    dst->nsuccess += 1;
+  }
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_ensemble_subsample
+ *
+ *****************************************************************************/
+
+int ffs_ensemble_subsample(ffs_ensemble_t * obj, int nkeep, ranlcg_t * ran,
+			   int * ndrop) {
+  int n, m;
+  int nnew, npick;
+  int * count = NULL;
+  long long int * traj = NULL;
+  double * wt = NULL;
+  int * owner = NULL;
+  double sumwt, step, x, cum;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(ran == NULL, -1);
+  dbg_return_if(ndrop == NULL, -1);
+  dbg_return_if(nkeep < 1, -1);
+
+  *ndrop = 0;
+  if (obj->nsuccess <= nkeep) return 0;
+
+  ffs_ensemble_sumwt(obj, &sumwt);
+  dbg_return_if(sumwt <= 0.0, -1);
+
+  count = u_calloc(obj->nsuccess, sizeof(int));
+  traj = u_calloc(obj->nsuccess, sizeof(long long int));
+  wt = u_calloc(obj->nsuccess, sizeof(double));
+  owner = u_calloc(obj->nsuccess, sizeof(int));
+  dbg_err_sif(count == NULL || traj == NULL || wt == NULL || owner == NULL);
+
+  step = sumwt/nkeep;
+  ranlcg_reep(ran, &x);
+  x *= step;
+
+  cum = 0.0;
+  npick = 0;
+  for (n = 0; n < obj->nsuccess; n++) {
+    cum += obj->wt[n];
+    while (npick < nkeep && x < cum) {
+      count[n] += 1;
+      npick += 1;
+      x += step;
+    }
+  }
+
+  /* Kept, then dropped */
+
+  nnew = 0;
+  for (n = 0; n < obj->nsuccess; n++) {
+    if (count[n] == 0) continue;
+    traj[nnew] = obj->traj[n];
+    wt[nnew] = count[n]*step;
+    owner[nnew] = obj->owner[n];
+    nnew += 1;
+  }
+
+  for (n = 0, m = nnew; n < obj->nsuccess; n++) {
+    if (count[n] > 0) continue;
+    traj[m] = obj->traj[n];
+    wt[m] = obj->wt[n];
+    owner[m] = obj->owner[n];
+    m += 1;
+  }
+
+  for (n = 0; n < obj->nsuccess; n++) {
+    obj->traj[n] = traj[n];
+    obj->wt[n] = wt[n];
+    obj->owner[n] = owner[n];
+  }
+
+  *ndrop = obj->nsuccess - nnew;
+  obj->nsuccess = nnew;
+
+  u_free(owner);
+  u_free(wt);
+  u_free(traj);
+  u_free(count);
+
+  return 0;
+
+ err:
+
+  if (owner) u_free(owner);
+  if (wt) u_free(wt);
+  if (traj) u_free(traj);
+  if (count) u_free(count);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_ensemble_fwrite
+ *
+ *****************************************************************************/
+
+int ffs_ensemble_fwrite(ffs_ensemble_t * obj, FILE * fp) {
+
+  size_t n;
+  size_t nerr = 0;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(fp == NULL, -1);
+
+  n = obj->nsuccess;
+
+  nerr += (fwrite(&obj->nmax, sizeof(int), 1, fp) != 1);
+  nerr += (fwrite(&obj->nsuccess, sizeof(int), 1, fp) != 1);
+  nerr += (fwrite(obj->traj, sizeof(long long int), n, fp) != n);
+  nerr += (fwrite(obj->wt, sizeof(double), n, fp) != n);
+  nerr += (fwrite(obj->owner, sizeof(int), n, fp) != n);
+
+  return (nerr == 0) ? 0 : -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_ensemble_fread
+ *
+ *****************************************************************************/
+
+int ffs_ensemble_fread(ffs_ensemble_t ** pobj, FILE * fp) {
+
+  int nmax, nsuccess;
+  size_t n;
+  size_t nerr = 0;
+  ffs_ensemble_t * obj = NULL;
+
+  dbg_return_if(pobj == NULL, -1);
+  dbg_return_if(fp == NULL, -1);
+
+  dbg_err_if(fread(&nmax, sizeof(int), 1, fp) != 1);
+  dbg_err_if(fread(&nsuccess, sizeof(int), 1, fp) != 1);
+  dbg_err_if(nsuccess < 0 || nsuccess > nmax);
+
+  dbg_err_if(ffs_ensemble_create(nmax, &obj));
+  obj->nsuccess = nsuccess;
+  n = nsuccess;
+
+  nerr += (fread(obj->traj, sizeof(long long int), n, fp) != n);
+  nerr += (fread(obj->wt, sizeof(double), n, fp) != n);
+  nerr += (fread(obj->owner, sizeof(int), n, fp) != n);
+  dbg_err_if(nerr);
+
+  *pobj = obj;
+
+  return 0;
+
+ err:
+
+  if (obj) ffs_ensemble_free(obj);
+
+  return -1;
+}
@@ -20,6 +20,8 @@
  *
  */
 
+#include <stdio.h>
+
 #include "ranlcg.h"
 
 /**
@@ -35,8 +37,9 @@ typedef struct ffs_ensemble_s ffs_ensemble_t;
 struct ffs_ensemble_s {
   int nmax;             /**< Maximum number in the ensemble */
   int nsuccess;         /**< Number of successful trajectories (<= nmax) */ 
-  int * traj;           /**< Integer trajectory ids */
+  long long int * traj; /**< 64-bit trajectory ids */
   double * wt;          /**< Integer trajectory weight */ 
+  int * owner;          /**< Proxy id holding the state */
 };
 
 /**
@@ -90,6 +93,75 @@ int ffs_ensemble_sumwt(ffs_ensemble_t * obj, double * sum);
 
 int ffs_ensemble_samplewt(ffs_ensemble_t * obj, ranlcg_t * ran, int * irun);
 
+/**
+ *  \brief Copy the live members of one ensemble to another
+ *
+ *  Members of src with a trajectory id of -1 are skipped; the rest
+ *  are copied, with their weights and owners, in order to dst,
+ *  replacing its contents.
+ *
+ *  \param src      the source ensemble
+ *  \param dst      the destination ensemble
+ *
+ *  \retval 0       a success
+ *  \retval -1      a NULL pointer, or too many members for dst
+ */
+
+int ffs_ensemble_compact(ffs_ensemble_t * src, ffs_ensemble_t * dst);
+
+/**
+ *  \brief Reduce the ensemble to at most nkeep members by weight
+ *
+ *  Systematic resampling: nkeep points, evenly spaced with a random
+ *  offset, are laid over the cumulative weight, and each member is
+ *  kept if any point falls within it. A kept member's weight becomes
+ *  the number of its points times the spacing, so that the total
+ *  weight, and the probability of any member being drawn by
+ *  ffs_ensemble_samplewt(), are unchanged on average.
+ *
+ *  The kept members retain their order; the dropped members follow
+ *  them, at nsuccess to nsuccess + ndrop - 1, so that the caller may
+ *  release their states. There is no action if there are no more
+ *  than nkeep members.
+ *
+ *  \param obj      the ensemble
+ *  \param nkeep    the maximum number of members to keep (> 0)
+ *  \param ran      a ranlcg_t random number generator object
+ *  \param ndrop    a pointer to the number dropped to be returned
+ *
+ *  \retval 0       a success
+ *  \retval -1      a failure (the ensemble is unchanged)
+ */
+
+int ffs_ensemble_subsample(ffs_ensemble_t * obj, int nkeep, ranlcg_t * ran,
+			   int * ndrop);
+
+/**
+ *  \brief Write the ensemble to a binary stream
+ *
+ *  Only the successful trajectories are written.
+ *
+ *  \param obj      the ensemble
+ *  \param fp       the stream, open for writing
+ *
+ *  \retval 0       a success
+ *  \retval -1      a failure
+ */
+
+int ffs_ensemble_fwrite(ffs_ensemble_t * obj, FILE * fp);
+
+/**
+ *  \brief Read an ensemble written by ffs_ensemble_fwrite()
+ *
+ *  \param pobj     a pointer to the new ensemble to be returned
+ *  \param fp       the stream, open for reading
+ *
+ *  \retval 0       a success
+ *  \retval -1      a failure
+ */
+
+int ffs_ensemble_fread(ffs_ensemble_t ** pobj, FILE * fp);
+
 /**
  * \}
  */
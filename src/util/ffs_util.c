@@ -18,13 +18,6 @@
 
 int facility = LOG_LOCAL0;
 
-struct util_s {
-  u_string_t * stub;
-};
-
-static int util_inst(void);
-static struct util_s * inst = NULL;
-
 /*****************************************************************************
  *
  *  util_ulog
@@ -94,56 +87,75 @@ int util_mpi_any(int expr, MPI_Comm comm) {
 
 /*****************************************************************************
  *
- *  util_filename_stub
+ *  util_handle
  *
- ****************************************************************************/
+ *****************************************************************************/
 
-const char * util_filename_stub(int id_inst, int id_group, int id_state) {
+int util_handle(int id_group, long long int id_state, ffs_handle_t * handle) {
 
-  const int ifmt4 = 9999;         /* Maximum instance, group number */
-  const int ifmt9 = 999999999;    /* Maximum state id */
-  const char * fmt = "inst%4.4d-grp%4.4d-state%9.9d";
+  dbg_return_if(handle == NULL, -1);
+  dbg_return_ifm(id_group < 0 || id_group > FFS_HANDLE_GROUP_MAX, -1,
+		 "Handle group out of range %d", id_group);
+  dbg_return_ifm(id_state < 0 || id_state > FFS_HANDLE_ID_MAX, -1,
+		 "Handle state id out of range %lld", id_state);
 
-  dbg_return_if(id_inst < 0, NULL);
-  dbg_return_if(id_group < 0, NULL);
-  dbg_return_if(id_state < 0, NULL);
-  dbg_return_if(util_inst(), NULL);
+  *handle = ((ffs_handle_t) id_group << FFS_HANDLE_ID_BITS) | id_state;
 
-  dbg_err_ifm(id_inst  > ifmt4, "Format botch inst. = %d", id_inst);
-  dbg_err_ifm(id_group > ifmt4, "Format botch group = %d", id_group);
-  dbg_err_ifm(id_state > ifmt9, "Format botch state = %d", id_state);
+  return 0;
+}
 
-  u_string_sprintf(inst->stub, fmt, id_inst, id_group, id_state);
+/*****************************************************************************
+ *
+ *  util_handle_ids
+ *
+ *****************************************************************************/
 
-  return u_string_c(inst->stub);
+int util_handle_ids(ffs_handle_t handle, int * id_group,
+		    long long int * id_state) {
 
- err:
+  dbg_return_if(handle < 0, -1);
 
-  return NULL;
+  if (id_group) *id_group = (int) (handle >> FFS_HANDLE_ID_BITS);
+  if (id_state) *id_state = handle & FFS_HANDLE_ID_MAX;
+
+  return 0;
 }
 
 /*****************************************************************************
  *
- *  util_inst
- *
- *  Singleton object
+ *  util_handle_stub
  *
  *****************************************************************************/
 
-static int util_inst(void) {
+int util_handle_stub(int id_inst, ffs_handle_t handle, char * stub) {
 
-  if (inst == NULL) {
-    inst = u_calloc(1, sizeof(struct util_s));
-    dbg_err_if(inst == NULL);
-  }
+  int id_group;
+  long long int id_state;
 
-  if (inst->stub == NULL) {
-    dbg_err_if(u_string_create("", strlen(""), &inst->stub));
-  }
+  dbg_return_if(id_inst < 0, -1);
+  dbg_return_if(stub == NULL, -1);
+  dbg_return_if(util_handle_ids(handle, &id_group, &id_state), -1);
+
+  dbg_return_if(snprintf(stub, FILENAME_MAX, "inst%4.4d-grp%4.4d-state%9.9lld",
+			 id_inst, id_group, id_state) >= FILENAME_MAX, -1);
 
   return 0;
+}
 
- err:
+/*****************************************************************************
+ *
+ *  util_filename_stub
+ *
+ ****************************************************************************/
 
-  return -1;
+int util_filename_stub(int id_inst, int id_group, long long int id_state,
+		       char * stub) {
+
+  ffs_handle_t handle;
+
+  dbg_return_if(stub == NULL, -1);
+  dbg_return_if(util_handle(id_group, id_state, &handle), -1);
+
+  return util_handle_stub(id_inst, handle, stub);
 }
+
@@ -172,20 +172,90 @@ int util_config_get_subkey_value_d(u_config_t * c, const char * subkey,
 int util_compare_double(double a, double b, double tol);
 
 /**
- *  \brief Return a file name stub, e.g.,  "inst0000-grp0000-state00000000"
+ *  \brief A 64-bit state handle: group (e.g., interface) and state id
+ *
+ *  The group occupies the bits above FFS_HANDLE_ID_BITS, and the
+ *  state id those below. A handle is a plain value, so may be copied,
+ *  compared and sent by message (MPI_LONG_LONG) as it stands.
+ *  No valid handle is negative, so FFS_HANDLE_NONE may stand for none.
+ */
+
+typedef long long int ffs_handle_t;
+
+#define FFS_HANDLE_ID_BITS 47
+#define FFS_HANDLE_GROUP_MAX 65535
+#define FFS_HANDLE_ID_MAX ((1LL << FFS_HANDLE_ID_BITS) - 1)
+#define FFS_HANDLE_NONE (-1LL)
+
+/**
+ *  \brief Groups reserved for states kept beyond the end of a run
+ *
+ *  States of the initial ensemble kept in a cache (see ffs_cache.h),
+ *  and those kept with a checkpoint (see ffs_checkpoint.h).
+ */
+
+#define FFS_HANDLE_GROUP_CACHE (FFS_HANDLE_GROUP_MAX - 1)
+#define FFS_HANDLE_GROUP_CHECKPOINT FFS_HANDLE_GROUP_MAX
+
+/**
+ *  \brief Form a state handle
+ *
+ *  \param  id_group     group number (0 to FFS_HANDLE_GROUP_MAX)
+ *  \param  id_state     state id (0 to FFS_HANDLE_ID_MAX)
+ *  \param  handle       pointer to the handle to be returned
+ *
+ *  \retval 0     a success
+ *  \retval -1    an id was out of range, or a NULL pointer was received
+ */
+
+int util_handle(int id_group, long long int id_state, ffs_handle_t * handle);
+
+/**
+ *  \brief Return the group and state id of a handle
+ *
+ *  \param  handle       the handle
+ *  \param  id_group     pointer to the group (may be NULL)
+ *  \param  id_state     pointer to the state id (may be NULL)
+ *
+ *  \retval 0     a success
+ *  \retval -1    the handle is not valid
+ */
+
+int util_handle_ids(ffs_handle_t handle, int * id_group,
+		    long long int * id_state);
+
+/**
+ *  \brief Format the file name stub for a state handle
+ *
+ *  \param  id_inst      the instance number
+ *  \param  handle       the state handle
+ *  \param  stub         buffer of at least FILENAME_MAX for the result
+ *
+ *  \retval 0     a success
+ *  \retval -1    a failure
+ *
+ *  The stub is as for util_filename_stub().
+ */
+
+int util_handle_stub(int id_inst, ffs_handle_t handle, char * stub);
+
+/**
+ *  \brief Format a file name stub, e.g.,  "inst0000-grp0000-state00000000"
  *
  *  \param  id_inst      intended for the instance number
  *  \param  id_group     intended for group or ensemble number
  *  \param  id_state     state id
+ *  \param  stub         buffer of at least FILENAME_MAX for the result
  *
- *   The format used to construct the stub is "inst%4.4d-ngrp%4.4d-state%9.9d"
- *
- *  \retval stub  the file stub on success
- *  \retval NULL if there was a problem formating the string
+ *   The format used to construct the stub is "inst%4.4d-grp%4.4d-state%9.9lld"
+ *   (the fields widen for larger values).
  *
+ *  \retval 0     a success
+ *  \retval -1    the ids are not valid, or the stub is too long
  */
 
-const char * util_filename_stub(int id_inst, int id_group, int id_state);
+int util_filename_stub(int id_inst, int id_group, long long int id_state,
+		       char * stub);
 
 /**
  * \}
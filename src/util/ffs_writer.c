@@ -0,0 +1,519 @@
+/*****************************************************************************
+ *
+ *  ffs_writer.c
+ *
+ *  The queue is a ring buffer. Only the caller advances the tail,
+ *  and only the writer thread advances the head, so no lock is
+ *  required. Two counting semaphores hold the number of free slots
+ *  and the number of requests, so that the caller blocks when the
+ *  queue is full, and the thread blocks (rather than spins) when
+ *  it is empty. A flush is just a marker request which the thread
+ *  acknowledges.
+ *
+ *  The results of reads are kept in a short list until collected.
+ *  Both the caller and the thread use the list, so it has a lock.
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC EP/I030298/1
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+
+#include "u/libu.h"
+#include "ffs_writer.h"
+
+typedef enum {FFS_WRITER_WRITE,
+	      FFS_WRITER_APPEND,
+	      FFS_WRITER_REMOVE,
+	      FFS_WRITER_READ,
+	      FFS_WRITER_FLUSH,
+	      FFS_WRITER_STOP} ffs_writer_enum_t;
+
+typedef struct ffs_writer_job_s ffs_writer_job_t;
+typedef struct ffs_writer_read_s ffs_writer_read_t;
+
+struct ffs_writer_job_s {
+  ffs_writer_enum_t action;   /* Request */
+  char * filename;            /* File name (owned) */
+  void * buf;                 /* Data (owned) */
+  size_t nbytes;              /* Size of data */
+};
+
+struct ffs_writer_read_s {
+  char * filename;            /* File name (owned) */
+  void * buf;                 /* Contents (NULL if the read failed) */
+  size_t nbytes;              /* Size of contents */
+  ffs_writer_read_t * next;   /* Next result */
+};
+
+struct ffs_writer_s {
+  int nqueue;                 /* Number of slots in ring */
+  unsigned int head;          /* Next request (advanced by thread only) */
+  unsigned int tail;          /* Next free slot (advanced by caller only) */
+  int nfail;                  /* Failures since last flush */
+  int nread;                  /* Reads not yet collected */
+  ffs_writer_job_t * ring;    /* Requests */
+  ffs_writer_read_t * done;   /* Results of reads */
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;       /* Protects the results of reads */
+  int started;                /* Thread is running */
+  pthread_t thread;           /* Writer thread */
+  sem_t nfree;                /* Number of free slots */
+  sem_t nused;                /* Number of requests */
+  sem_t flushed;              /* Flush acknowledged */
+#endif
+};
+
+static int ffs_writer_submit(ffs_writer_t * obj, ffs_writer_enum_t action,
+			     const char * filename, void * buf, size_t nbytes);
+static int ffs_writer_job_exec(ffs_writer_t * obj, ffs_writer_job_t * job);
+static int ffs_writer_job_read(ffs_writer_t * obj, ffs_writer_job_t * job);
+static ffs_writer_read_t * ffs_writer_done(ffs_writer_t * obj,
+					   const char * filename);
+
+#ifdef HAVE_PTHREAD
+static void * ffs_writer_thread(void * arg);
+#endif
+
+/*****************************************************************************
+ *
+ *  ffs_writer_create
+ *
+ *****************************************************************************/
+
+int ffs_writer_create(int nqueue, ffs_writer_t ** pobj) {
+
+  ffs_writer_t * obj = NULL;
+
+  dbg_return_if(nqueue < 1, -1);
+  dbg_return_if(pobj == NULL, -1);
+
+  obj = u_calloc(1, sizeof(ffs_writer_t));
+  dbg_err_sif(obj == NULL);
+
+  obj->nqueue = nqueue;
+  obj->ring = u_calloc(nqueue, sizeof(ffs_writer_job_t));
+  dbg_err_sif(obj->ring == NULL);
+
+#ifdef HAVE_PTHREAD
+  dbg_err_sif(sem_init(&obj->nfree, 0, nqueue));
+  dbg_err_sif(sem_init(&obj->nused, 0, 0));
+  dbg_err_sif(sem_init(&obj->flushed, 0, 0));
+  dbg_err_if(pthread_mutex_init(&obj->lock, NULL));
+  dbg_err_if(pthread_create(&obj->thread, NULL, ffs_writer_thread, obj));
+  obj->started = 1;
+#endif
+
+  *pobj = obj;
+
+  return 0;
+
+ err:
+
+  if (obj) ffs_writer_free(obj);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_writer_free
+ *
+ *****************************************************************************/
+
+void ffs_writer_free(ffs_writer_t * obj) {
+
+  ffs_writer_read_t * r = NULL;
+
+  dbg_return_if(obj == NULL, );
+
+#ifdef HAVE_PTHREAD
+  if (obj->started) {
+    ffs_writer_submit(obj, FFS_WRITER_STOP, NULL, NULL, 0);
+    pthread_join(obj->thread, NULL);
+  }
+  sem_destroy(&obj->flushed);
+  sem_destroy(&obj->nused);
+  sem_destroy(&obj->nfree);
+  pthread_mutex_destroy(&obj->lock);
+#endif
+
+  /* Results never collected */
+
+  while ((r = obj->done)) {
+    obj->done = r->next;
+    if (r->buf) u_free(r->buf);
+    u_free(r->filename);
+    u_free(r);
+  }
+
+  if (obj->ring) u_free(obj->ring);
+  u_free(obj);
+
+  return;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_writer_write
+ *
+ *****************************************************************************/
+
+int ffs_writer_write(ffs_writer_t * obj, const char * filename, void * buf,
+		     size_t nbytes) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(filename == NULL, -1);
+  dbg_return_if(buf == NULL, -1);
+
+  return ffs_writer_submit(obj, FFS_WRITER_WRITE, filename, buf, nbytes);
+}
+
+/*****************************************************************************
+ *
+ *  ffs_writer_append
+ *
+ *****************************************************************************/
+
+int ffs_writer_append(ffs_writer_t * obj, const char * filename, void * buf,
+		      size_t nbytes) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(filename == NULL, -1);
+  dbg_return_if(buf == NULL, -1);
+
+  return ffs_writer_submit(obj, FFS_WRITER_APPEND, filename, buf, nbytes);
+}
+
+/*****************************************************************************
+ *
+ *  ffs_writer_remove
+ *
+ *****************************************************************************/
+
+int ffs_writer_remove(ffs_writer_t * obj, const char * filename) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(filename == NULL, -1);
+
+  return ffs_writer_submit(obj, FFS_WRITER_REMOVE, filename, NULL, 0);
+}
+
+/*****************************************************************************
+ *
+ *  ffs_writer_read
+ *
+ *****************************************************************************/
+
+int ffs_writer_read(ffs_writer_t * obj, const char * filename) {
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(filename == NULL, -1);
+
+  dbg_return_if(ffs_writer_submit(obj, FFS_WRITER_READ, filename, NULL, 0),
+		-1);
+  obj->nread += 1;
+
+  return 0;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_writer_collect
+ *
+ *  If the read is still outstanding, a flush waits for it (and for
+ *  anything queued before it).
+ *
+ *****************************************************************************/
+
+int ffs_writer_collect(ffs_writer_t * obj, const char * filename, void ** buf,
+		       size_t * nbytes) {
+
+  int ifail = 0;
+  ffs_writer_read_t * r = NULL;
+
+  dbg_return_if(obj == NULL, -1);
+  dbg_return_if(filename == NULL, -1);
+  dbg_return_if(buf == NULL, -1);
+  dbg_return_if(nbytes == NULL, -1);
+
+  if (obj->nread == 0) return -1;
+
+  r = ffs_writer_done(obj, filename);
+
+  if (r == NULL) {
+    /* Any failed write is left for ffs_writer_flush() to report */
+    dbg_return_if(ffs_writer_submit(obj, FFS_WRITER_FLUSH, NULL, NULL, 0),
+		  -1);
+#ifdef HAVE_PTHREAD
+    while (sem_wait(&obj->flushed) != 0);
+#endif
+    r = ffs_writer_done(obj, filename);
+  }
+
+  if (r == NULL) return -1;
+
+  obj->nread -= 1;
+  ifail = (r->buf == NULL);
+  *buf = r->buf;
+  *nbytes = r->nbytes;
+  u_free(r->filename);
+  u_free(r);
+
+  return -ifail;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_writer_done
+ *
+ *  Remove, and return, the result of a read of filename from the
+ *  list (or NULL if there is none yet).
+ *
+ *****************************************************************************/
+
+static ffs_writer_read_t * ffs_writer_done(ffs_writer_t * obj,
+					   const char * filename) {
+
+  ffs_writer_read_t * r = NULL;
+  ffs_writer_read_t ** pr = NULL;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&obj->lock);
+#endif
+
+  for (pr = &obj->done; *pr; pr = &(*pr)->next) {
+    if (strcmp((*pr)->filename, filename) == 0) {
+      r = *pr;
+      *pr = r->next;
+      break;
+    }
+  }
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&obj->lock);
+#endif
+
+  return r;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_writer_flush
+ *
+ *****************************************************************************/
+
+int ffs_writer_flush(ffs_writer_t * obj) {
+
+  int nfail;
+
+  dbg_return_if(obj == NULL, -1);
+
+  dbg_err_if(ffs_writer_submit(obj, FFS_WRITER_FLUSH, NULL, NULL, 0));
+
+#ifdef HAVE_PTHREAD
+  while (sem_wait(&obj->flushed) != 0);
+#endif
+
+  /* The thread is now idle until the next request */
+
+  nfail = obj->nfail;
+  obj->nfail = 0;
+  dbg_err_ifm(nfail, "%d deferred write%s failed", nfail, nfail > 1 ? "s" : "");
+
+  return 0;
+
+ err:
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_writer_submit
+ *
+ *  Copy the file name before waiting, as it may be a (caller's)
+ *  temporary.
+ *
+ *****************************************************************************/
+
+static int ffs_writer_submit(ffs_writer_t * obj, ffs_writer_enum_t action,
+			     const char * filename, void * buf, size_t nbytes) {
+
+  ffs_writer_job_t job;
+
+  dbg_return_if(obj == NULL, -1);
+
+  job.action = action;
+  job.filename = NULL;
+  job.buf = buf;
+  job.nbytes = nbytes;
+
+  if (filename) {
+    job.filename = u_strdup(filename);
+    dbg_err_sif(job.filename == NULL);
+  }
+
+#ifdef HAVE_PTHREAD
+  while (sem_wait(&obj->nfree) != 0);
+
+  obj->ring[obj->tail % obj->nqueue] = job;
+  obj->tail += 1;
+
+  sem_post(&obj->nused);
+#else
+  if (action != FFS_WRITER_FLUSH && action != FFS_WRITER_STOP) {
+    obj->nfail += ffs_writer_job_exec(obj, &job);
+  }
+#endif
+
+  return 0;
+
+ err:
+
+  if (buf) u_free(buf);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_writer_job_exec
+ *
+ *  Carry out, and release, a write, append, remove, or read request.
+ *
+ *****************************************************************************/
+
+static int ffs_writer_job_exec(ffs_writer_t * obj, ffs_writer_job_t * job) {
+
+  int ifail = 0;
+  FILE * fp = NULL;
+
+  dbg_return_if(job == NULL, -1);
+
+  if (job->action == FFS_WRITER_READ) return ffs_writer_job_read(obj, job);
+
+  if (job->action == FFS_WRITER_WRITE || job->action == FFS_WRITER_APPEND) {
+    fp = fopen(job->filename, job->action == FFS_WRITER_WRITE ? "wb" : "ab");
+    if (fp == NULL) {
+      ifail = 1;
+    }
+    else {
+      if (fwrite(job->buf, 1, job->nbytes, fp) != job->nbytes) ifail = 1;
+      if (fclose(fp) != 0) ifail = 1;
+    }
+    dbg_ifm(ifail, "Deferred write of %s failed", job->filename);
+  }
+  else if (job->action == FFS_WRITER_REMOVE) {
+    remove(job->filename);
+  }
+
+  if (job->filename) u_free(job->filename);
+  if (job->buf) u_free(job->buf);
+  job->filename = NULL;
+  job->buf = NULL;
+
+  return ifail;
+}
+
+/*****************************************************************************
+ *
+ *  ffs_writer_job_read
+ *
+ *  Read the whole file into a new buffer, and add the result to the
+ *  list. A failed read is recorded with no buffer, so that the
+ *  caller finds out; it does not count as a failed write.
+ *
+ *****************************************************************************/
+
+static int ffs_writer_job_read(ffs_writer_t * obj, ffs_writer_job_t * job) {
+
+  long len = -1;
+  FILE * fp = NULL;
+  ffs_writer_read_t * r = NULL;
+
+  r = u_calloc(1, sizeof(ffs_writer_read_t));
+  dbg_err_sif(r == NULL);
+
+  r->filename = job->filename;
+  job->filename = NULL;
+
+  fp = fopen(r->filename, "rb");
+
+  if (fp && fseek(fp, 0, SEEK_END) == 0) len = ftell(fp);
+  if (len >= 0 && fseek(fp, 0, SEEK_SET) == 0) {
+    r->buf = u_malloc(len > 0 ? len : 1);
+    if (r->buf && fread(r->buf, 1, len, fp) != (size_t) len) {
+      u_free(r->buf);
+      r->buf = NULL;
+    }
+    r->nbytes = len;
+  }
+  if (fp) fclose(fp);
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&obj->lock);
+#endif
+  r->next = obj->done;
+  obj->done = r;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&obj->lock);
+#endif
+
+  return 0;
+
+ err:
+
+  if (job->filename) u_free(job->filename);
+  job->filename = NULL;
+
+  return 0;
+}
+
+#ifdef HAVE_PTHREAD
+
+/*****************************************************************************
+ *
+ *  ffs_writer_thread
+ *
+ *****************************************************************************/
+
+static void * ffs_writer_thread(void * arg) {
+
+  int stop = 0;
+  ffs_writer_t * obj = arg;
+  ffs_writer_job_t * job = NULL;
+
+  while (stop == 0) {
+
+    while (sem_wait(&obj->nused) != 0);
+
+    job = obj->ring + (obj->head % obj->nqueue);
+
+    switch (job->action) {
+    case FFS_WRITER_FLUSH:
+      sem_post(&obj->flushed);
+      break;
+    case FFS_WRITER_STOP:
+      stop = 1;
+      break;
+    default:
+      obj->nfail += ffs_writer_job_exec(obj, job);
+    }
+
+    obj->head += 1;
+    sem_post(&obj->nfree);
+  }
+
+  return NULL;
+}
+
+#endif
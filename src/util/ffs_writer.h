@@ -0,0 +1,156 @@
+/*****************************************************************************
+ *
+ *  ffs_writer.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef FFS_WRITER_H
+#define FFS_WRITER_H
+
+#include <stddef.h>
+
+/**
+ *
+ *  \defgroup ffs_writer Write-behind utility
+ *  \ingroup utilities
+ *  \{
+ *     A background thread to write (and remove) files, so that the
+ *     caller need not wait for the I/O. Files may also be read ahead
+ *     of need, and the contents collected later.
+ *
+ *     Requests are placed in a bounded queue with a single producer
+ *     (the caller) and a single consumer (the writer thread), and are
+ *     carried out strictly in order. If the queue is full, the caller
+ *     waits for a free slot.
+ *
+ *     If the library is built without threads (no HAVE_PTHREAD), each
+ *     request is carried out immediately by the caller.
+ */
+
+/**
+ *  \brief Opaque writer type
+ */
+
+typedef struct ffs_writer_s ffs_writer_t;
+
+/**
+ *  \brief Create a writer and start the writer thread
+ *
+ *  \param nqueue   maximum number of requests outstanding (> 0)
+ *  \param pobj     a pointer to the new object to be returned
+ *
+ *  \retval 0       a success
+ *  \retval -1      a failure
+ */
+
+int ffs_writer_create(int nqueue, ffs_writer_t ** pobj);
+
+/**
+ *  \brief Complete all outstanding requests, stop the thread, and release
+ *
+ *  \param obj      the writer
+ */
+
+void ffs_writer_free(ffs_writer_t * obj);
+
+/**
+ *  \brief Queue a request to write a buffer to file
+ *
+ *  \param obj       the writer
+ *  \param filename  the file name (which is copied)
+ *  \param buf       the data, which become the property of the writer
+ *  \param nbytes    size of the data
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure (buf is still released)
+ *
+ *  Any existing file of the same name is overwritten.
+ */
+
+int ffs_writer_write(ffs_writer_t * obj, const char * filename, void * buf,
+		     size_t nbytes);
+
+/**
+ *  \brief Queue a request to append a buffer to a file
+ *
+ *  \param obj       the writer
+ *  \param filename  the file name (which is copied)
+ *  \param buf       the data, which become the property of the writer
+ *  \param nbytes    size of the data
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure (buf is still released)
+ *
+ *  The file is created if it does not exist.
+ */
+
+int ffs_writer_append(ffs_writer_t * obj, const char * filename, void * buf,
+		      size_t nbytes);
+
+/**
+ *  \brief Queue a request to remove a file
+ *
+ *  \param obj       the writer
+ *  \param filename  the file name (which is copied)
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  It is not an error if the file does not exist.
+ */
+
+int ffs_writer_remove(ffs_writer_t * obj, const char * filename);
+
+/**
+ *  \brief Queue a request to read the whole of a file
+ *
+ *  \param obj       the writer
+ *  \param filename  the file name (which is copied)
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure
+ *
+ *  The contents are held by the writer until ffs_writer_collect()
+ *  is called with the same file name. Any earlier requests to write
+ *  the file are carried out first.
+ */
+
+int ffs_writer_read(ffs_writer_t * obj, const char * filename);
+
+/**
+ *  \brief Collect the contents of a file read by the writer
+ *
+ *  \param obj       the writer
+ *  \param filename  the file name given to ffs_writer_read()
+ *  \param buf       a pointer to the contents (to be released by the caller)
+ *  \param nbytes    a pointer to the size of the contents
+ *
+ *  \retval 0        a success
+ *  \retval -1       no such read was requested, or the read failed
+ *
+ *  If the read is not yet complete, the caller waits for it.
+ */
+
+int ffs_writer_collect(ffs_writer_t * obj, const char * filename, void ** buf,
+		       size_t * nbytes);
+
+/**
+ *  \brief Wait until all outstanding requests have been carried out
+ *
+ *  \param obj       the writer
+ *
+ *  \retval 0        a success
+ *  \retval -1       a failure, or any write failed since the last flush
+ */
+
+int ffs_writer_flush(ffs_writer_t * obj);
+
+/**
+ * \}
+ */
+
+#endif
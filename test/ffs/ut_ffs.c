@@ -179,6 +179,9 @@ int ut_ffs_lambda_name(u_test_case_t * tc) {
   u_dbg("Start");
   dbg_err_if(ffs_create(MPI_COMM_WORLD, &ffs));
 
+  /* No name has been set */
+  dbg_err_if(ffs_lambda_name(ffs, name, BUFSIZ) == 0);
+
   dbg_err_if(ffs_lambda_name_set(ffs, name_orig));
   dbg_err_if(ffs_lambda_name(ffs, name, BUFSIZ));
   dbg_err_if(strcmp(name_orig, name) != 0);
@@ -195,3 +198,45 @@ int ut_ffs_lambda_name(u_test_case_t * tc) {
   return U_TEST_FAILURE;
 
 }
+
+/*****************************************************************************
+ *
+ *  ut_ffs_trial
+ *
+ *****************************************************************************/
+
+int ut_ffs_trial(u_test_case_t * tc) {
+
+  int nstepmax, nsteplambda, nstep;
+  double lambda_min, lambda_max;
+  ffs_t * ffs = NULL;
+
+  u_dbg("Start");
+  dbg_err_if(ffs_create(MPI_COMM_WORLD, &ffs));
+
+  dbg_err_if(ffs_trial_bounds_set(ffs, -1.5, 2.5, 100, 10));
+  dbg_err_if(ffs_trial_bounds(ffs, &lambda_min, &lambda_max, &nstepmax,
+			      &nsteplambda));
+  dbg_err_if(lambda_min != -1.5);
+  dbg_err_if(lambda_max != 2.5);
+  dbg_err_if(nstepmax != 100);
+  dbg_err_if(nsteplambda != 10);
+
+  dbg_err_if(ffs_trial_nstep_set(ffs, 30));
+  dbg_err_if(ffs_trial_nstep(ffs, &nstep));
+  dbg_err_if(nstep != 30);
+
+  dbg_err_if(ffs_trial_bounds(ffs, &lambda_min, &lambda_max, NULL,
+			      &nsteplambda) == 0);
+
+  ffs_free(ffs);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+  if (ffs) ffs_free(ffs);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
@@ -20,6 +20,7 @@
 #define UT_FFS_COMMAND_BUILD_NAME "FFS command build arguments"
 #define UT_FFS_EXCH_INT_NAME      "FFS exchange integer data"
 #define UT_FFS_LAMBDA_NAME        "FFS lambda function name"
+#define UT_FFS_TRIAL_NAME         "FFS trial bounds and steps"
 
 int ut_ffs_create(u_test_case_t * tc);
 
@@ -31,6 +32,8 @@ int ut_ffs_command_build(u_test_case_t * tc);
 
 int ut_ffs_lambda_name(u_test_case_t * tc);
 
+int ut_ffs_trial(u_test_case_t * tc);
+
 /**
  *  \}
  */
@@ -0,0 +1,142 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_aggregate.c
+ *
+ *  Unit test for ../../src/ffs/ffs_aggregate.c
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "ffs_aggregate.h"
+#include "ut_ffs_aggregate.h"
+
+#define UT_NDATA 4
+
+/*****************************************************************************
+ *
+ *  ut_aggregate
+ *
+ *  Each rank contributes (rank + 1) states of different sizes, and
+ *  every rank must then be able to read every state.
+ *
+ *****************************************************************************/
+
+int ut_aggregate(u_test_case_t * tc) {
+
+  int n, m, nstate;
+  int rank, size;
+  int present, nfile;
+  int data[UT_NDATA];
+  int * buf = NULL;
+  size_t nbytes;
+  const char * filename = "logs/ut-grp0000.rank0000.aggregate";
+  ffs_handle_t handle;
+  ffs_handle_t handles[UT_NDATA];
+  void * bufs[UT_NDATA];
+  size_t sizes[UT_NDATA];
+  int local[UT_NDATA][UT_NDATA];
+  FILE * fp = NULL;
+  ffs_aggregate_t * obj = NULL;
+
+  u_dbg("Start");
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  dbg_err_if(ffs_aggregate_create(&obj));
+
+  nstate = (rank + 1) % UT_NDATA;
+
+  for (n = 0; n < nstate; n++) {
+    dbg_err_if(util_handle(0, 100*rank + n, handles + n));
+    for (m = 0; m <= n; m++) {
+      local[n][m] = 100*rank + 10*n + m;
+    }
+    bufs[n] = local[n];
+    sizes[n] = (n + 1)*sizeof(int);
+  }
+
+  dbg_err_if(ffs_aggregate_write(obj, filename, nstate, handles, bufs,
+				 sizes, MPI_COMM_WORLD));
+  dbg_err_if(ffs_aggregate_nfile(obj, &nfile));
+  dbg_err_if(nfile != 1);
+
+  /* Every state, from every rank */
+
+  for (m = 0; m < size; m++) {
+    for (n = 0; n < (m + 1) % UT_NDATA; n++) {
+      dbg_err_if(util_handle(0, 100*m + n, &handle));
+      dbg_err_if(ffs_aggregate_present(obj, handle, &present));
+      dbg_err_if(present == 0);
+      dbg_err_if(ffs_aggregate_get(obj, handle, (void **) &buf, &nbytes));
+      dbg_err_if(buf == NULL);
+      dbg_err_if(nbytes != (n + 1)*sizeof(int));
+      dbg_err_if(buf[0] != 100*m + 10*n);
+      dbg_err_if(buf[n] != 100*m + 10*n + n);
+      u_free(buf);
+      buf = NULL;
+    }
+  }
+
+  dbg_err_if(util_handle(0, 100*size, &handle));
+  dbg_err_if(ffs_aggregate_present(obj, handle, &present));
+  dbg_err_if(present);
+  dbg_err_if(ffs_aggregate_get(obj, handle, (void **) &buf, &nbytes));
+  dbg_err_if(buf != NULL);
+
+  /* A second write of the same file replaces the first */
+
+  data[0] = rank;
+  bufs[0] = data;
+  sizes[0] = sizeof(int);
+  dbg_err_if(util_handle(1, rank, handles));
+
+  dbg_err_if(ffs_aggregate_write(obj, filename, 1, handles, bufs, sizes,
+				 MPI_COMM_WORLD));
+  dbg_err_if(ffs_aggregate_nfile(obj, &nfile));
+  dbg_err_if(nfile != 1);
+
+  dbg_err_if(util_handle(0, 0, &handle));
+  dbg_err_if(ffs_aggregate_present(obj, handle, &present));
+  dbg_err_if(present);
+
+  dbg_err_if(util_handle(1, size - 1, &handle));
+  dbg_err_if(ffs_aggregate_get(obj, handle, (void **) &buf, &nbytes));
+  dbg_err_if(buf == NULL);
+  dbg_err_if(nbytes != sizeof(int));
+  dbg_err_if(buf[0] != size - 1);
+  u_free(buf);
+  buf = NULL;
+
+  /* Removal */
+
+  dbg_err_if(ffs_aggregate_remove(obj, filename, MPI_COMM_WORLD));
+  dbg_err_if(ffs_aggregate_nfile(obj, &nfile));
+  dbg_err_if(nfile != 0);
+  dbg_err_if(ffs_aggregate_present(obj, handle, &present));
+  dbg_err_if(present);
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  dbg_err_if((fp = fopen(filename, "rb")) != NULL);
+
+  /* An unknown file is no error */
+
+  dbg_err_if(ffs_aggregate_remove(obj, filename, MPI_COMM_WORLD));
+
+  ffs_aggregate_free(obj);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+
+  if (fp) fclose(fp);
+  if (buf) u_free(buf);
+  if (obj) ffs_aggregate_free(obj);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
@@ -0,0 +1,20 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_aggregate.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef UT_FFS_AGGREGATE_H
+#define UT_FFS_AGGREGATE_H
+
+#include "u/libu.h"
+
+#define UT_AGGREGATE_NAME "State aggregate file"
+
+int ut_aggregate(u_test_case_t * tc);
+
+#endif
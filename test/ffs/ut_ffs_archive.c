@@ -0,0 +1,148 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_archive.c
+ *
+ *  Unit test for ../../src/ffs/ffs_archive.c
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "ffs_archive.h"
+#include "ut_ffs_archive.h"
+
+#define UT_NSTATE 100
+
+/*****************************************************************************
+ *
+ *  ut_archive
+ *
+ *  Two archives stand for two proxies (the same rank). States are
+ *  written to two segments by the first, and read back by both.
+ *
+ *****************************************************************************/
+
+int ut_archive(u_test_case_t * tc) {
+
+  int n, nseg;
+  int rank;
+  int data[2];
+  int * buf = NULL;
+  size_t nbytes;
+  ffs_handle_t handle;
+  char seg0[FILENAME_MAX];
+  char seg1[FILENAME_MAX];
+  FILE * fp = NULL;
+  ffs_archive_t * a0 = NULL;
+  ffs_archive_t * a1 = NULL;
+
+  u_dbg("Start");
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  /* The test rank stands for the instance, so that ranks neither
+   * share segment files nor find each other's when scanning */
+
+  dbg_err_if(ffs_archive_create(rank, 0, 0, &a0));
+  dbg_err_if(ffs_archive_create(rank, 1, 0, &a1));
+
+  for (n = 0; n < UT_NSTATE; n++) {
+    data[0] = n;
+    data[1] = 2*n;
+    dbg_err_if(util_handle(n % 2, n, &handle));
+    dbg_err_if(ffs_archive_put(a0, handle, data, sizeof(data), NULL));
+  }
+
+  dbg_err_if(ffs_archive_nsegment(a0, &nseg));
+  dbg_err_if(nseg != 2);
+
+  sprintf(seg0, "inst%4.4d-grp0000.proxy0000.rank0000.archive", rank);
+  sprintf(seg1, "inst%4.4d-grp0001.proxy0000.rank0000.archive", rank);
+  dbg_err_if((fp = fopen(seg0, "rb")) == NULL);
+  fclose(fp);
+  fp = NULL;
+
+  /* A rewrite supersedes the original */
+
+  data[0] = -1;
+  data[1] = 0;
+  dbg_err_if(util_handle(0, 0, &handle));
+  dbg_err_if(ffs_archive_put(a0, handle, data, sizeof(data), NULL));
+
+  for (n = 0; n < UT_NSTATE; n++) {
+    dbg_err_if(util_handle(n % 2, n, &handle));
+
+    dbg_err_if(ffs_archive_get(a0, handle, (void **) &buf, &nbytes));
+    dbg_err_if(nbytes != sizeof(data));
+    dbg_err_if(buf[0] != (n == 0 ? -1 : n));
+    dbg_err_if(buf[1] != 2*n);
+    u_free(buf);
+    buf = NULL;
+
+    dbg_err_if(ffs_archive_get(a1, handle, (void **) &buf, &nbytes));
+    dbg_err_if(nbytes != sizeof(data));
+    dbg_err_if(buf[0] != (n == 0 ? -1 : n));
+    u_free(buf);
+    buf = NULL;
+  }
+
+  /* The second archive must not remove the first's states */
+
+  dbg_err_if(util_handle(0, 2, &handle));
+  dbg_err_if(ffs_archive_remove(a1, handle, NULL));
+  dbg_err_if(ffs_archive_get(a0, handle, (void **) &buf, &nbytes));
+  u_free(buf);
+  buf = NULL;
+
+  /* The segment goes when its last state goes */
+
+  for (n = 0; n < UT_NSTATE; n += 2) {
+    dbg_err_if(util_handle(0, n, &handle));
+    dbg_err_if(ffs_archive_remove(a0, handle, NULL));
+  }
+
+  dbg_err_if(ffs_archive_nsegment(a0, &nseg));
+  dbg_err_if(nseg != 1);
+  dbg_err_if((fp = fopen(seg0, "rb")) != NULL);
+  dbg_err_if(ffs_archive_get(a0, handle, (void **) &buf, &nbytes) == 0);
+
+  /* A new segment of the same name is found again by the reader */
+
+  data[0] = 7;
+  dbg_err_if(util_handle(0, 1000, &handle));
+  dbg_err_if(ffs_archive_put(a0, handle, data, sizeof(data), NULL));
+  dbg_err_if(ffs_archive_get(a1, handle, (void **) &buf, &nbytes));
+  dbg_err_if(buf[0] != 7);
+  u_free(buf);
+  buf = NULL;
+
+  dbg_err_if(ffs_archive_forget(a1, handle));
+  dbg_err_if(ffs_archive_remove(a0, handle, NULL));
+
+  for (n = 1; n < UT_NSTATE; n += 2) {
+    dbg_err_if(util_handle(1, n, &handle));
+    dbg_err_if(ffs_archive_remove(a0, handle, NULL));
+  }
+
+  dbg_err_if(ffs_archive_nsegment(a0, &nseg));
+  dbg_err_if(nseg != 0);
+  dbg_err_if((fp = fopen(seg1, "rb")) != NULL);
+
+  ffs_archive_free(a1);
+  ffs_archive_free(a0);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+
+  if (fp) fclose(fp);
+  if (buf) u_free(buf);
+  if (a1) ffs_archive_free(a1);
+  if (a0) ffs_archive_free(a0);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
@@ -0,0 +1,20 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_archive.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef UT_FFS_ARCHIVE_H
+#define UT_FFS_ARCHIVE_H
+
+#include "u/libu.h"
+
+#define UT_ARCHIVE_NAME "State archive"
+
+int ut_archive(u_test_case_t * tc);
+
+#endif
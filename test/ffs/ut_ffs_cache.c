@@ -0,0 +1,137 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_cache.c
+ *
+ *  Unit test for ../../src/ffs/ffs_cache.c
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "ffs_cache.h"
+#include "ut_ffs_cache.h"
+
+/*****************************************************************************
+ *
+ *  ut_cache
+ *
+ *  Both kinds of index are written and read back. An index is valid
+ *  only for the same kind and key; a missing index is not an error.
+ *
+ *****************************************************************************/
+
+int ut_cache(u_test_case_t * tc) {
+
+  int n, rank;
+  int valid;
+  int ival;
+  int nsuccess = 0;
+  int status[3] = {1, 2, 1};
+  int sread[3];
+  long int ranstate[3] = {7, 0, 11};
+  long int rread[3];
+  const char * key = "direct dmc [-n 4] lambda 1 2 17 0.5";
+  const char * other = "direct dmc [-n 4] lambda 1 2 18 0.5";
+  char filename[FILENAME_MAX];
+  char prefix[FILENAME_MAX];
+
+  ffs_ensemble_t * states = NULL;
+  ffs_ensemble_t * copy = NULL;
+  ffs_result_aflux_t * flux = NULL;
+  ffs_result_aflux_t * fcopy = NULL;
+
+  u_dbg("Start");
+
+  dbg_err_if(ffs_cache_filename(key, 2, filename));
+  dbg_err_if(strncmp(filename, "cache", 5) != 0);
+  dbg_err_if(strcmp(filename + strlen(filename) - 9, ".rank0002") != 0);
+
+  dbg_err_if(ffs_cache_prefix(key, prefix));
+  dbg_err_if(strncmp(prefix, filename, strlen(prefix)) != 0);
+  dbg_err_if(strcmp(filename + strlen(prefix), ".rank0002") != 0);
+
+  /* Ranks must not share a file */
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  sprintf(filename, "logs/ut-cache.rank%4.4d", rank);
+  remove(filename);
+
+  dbg_err_if(ffs_cache_valid(filename, FFS_CACHE_DIRECT, key, MPI_COMM_SELF,
+			     &valid));
+  dbg_err_if(valid != 0);
+
+  dbg_err_if(ffs_ensemble_create(4, &states));
+  for (n = 0; n < 3; n++) {
+    states->traj[n] = 10 + n;
+    states->wt[n] = 1.0;
+    states->owner[n] = n % 2;
+  }
+  states->nsuccess = 3;
+
+  dbg_err_if(ffs_result_aflux_create(3, &flux));
+  dbg_err_if(ffs_result_aflux_ncross_add(flux));
+  dbg_err_if(ffs_result_aflux_time_set(flux, 1, 2.5));
+
+  dbg_err_if(ffs_cache_direct_write(filename, key, states, 2, flux));
+
+  dbg_err_if(ffs_cache_valid(filename, FFS_CACHE_DIRECT, key, MPI_COMM_SELF,
+			     &valid));
+  dbg_err_if(valid != 1);
+  dbg_err_if(ffs_cache_valid(filename, FFS_CACHE_TREE, key, MPI_COMM_SELF,
+			     &valid));
+  dbg_err_if(valid != 0);
+  dbg_err_if(ffs_cache_valid(filename, FFS_CACHE_DIRECT, other, MPI_COMM_SELF,
+			     &valid));
+  dbg_err_if(valid != 0);
+
+  dbg_err_if(ffs_result_aflux_create(3, &fcopy));
+  dbg_err_if(ffs_cache_direct_read(filename, other, &copy, &nsuccess,
+				   fcopy) == 0);
+  dbg_err_if(copy != NULL);
+
+  dbg_err_if(ffs_cache_direct_read(filename, key, &copy, &nsuccess, fcopy));
+  dbg_err_if(nsuccess != 2);
+  dbg_err_if(copy->nsuccess != 3);
+  for (n = 0; n < 3; n++) {
+    dbg_err_if(copy->traj[n] != states->traj[n]);
+    dbg_err_if(copy->owner[n] != states->owner[n]);
+  }
+  dbg_err_if(ffs_result_aflux_ncross_local(fcopy, &ival));
+  dbg_err_if(ival != 1);
+
+  /* Trees */
+
+  dbg_err_if(ffs_cache_tree_write(filename, key, 3, status, ranstate, flux));
+  dbg_err_if(ffs_cache_valid(filename, FFS_CACHE_DIRECT, key, MPI_COMM_SELF,
+			     &valid));
+  dbg_err_if(valid != 0);
+  dbg_err_if(ffs_cache_tree_read(filename, key, 2, sread, rread, fcopy) == 0);
+  dbg_err_if(ffs_cache_tree_read(filename, key, 3, sread, rread, fcopy));
+
+  for (n = 0; n < 3; n++) {
+    dbg_err_if(sread[n] != status[n]);
+    dbg_err_if(rread[n] != ranstate[n]);
+  }
+
+  remove(filename);
+
+  ffs_result_aflux_free(fcopy);
+  ffs_result_aflux_free(flux);
+  ffs_ensemble_free(copy);
+  ffs_ensemble_free(states);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+
+  if (fcopy) ffs_result_aflux_free(fcopy);
+  if (flux) ffs_result_aflux_free(flux);
+  if (copy) ffs_ensemble_free(copy);
+  if (states) ffs_ensemble_free(states);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
@@ -0,0 +1,20 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_cache.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef UT_FFS_CACHE_H
+#define UT_FFS_CACHE_H
+
+#include "u/libu.h"
+
+#define UT_CACHE_NAME "First interface cache"
+
+int ut_cache(u_test_case_t * tc);
+
+#endif
@@ -0,0 +1,157 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_checkpoint.c
+ *
+ *  Unit test for ../../src/ffs/ffs_checkpoint.c
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "ffs_checkpoint.h"
+#include "ut_ffs_checkpoint.h"
+
+/*****************************************************************************
+ *
+ *  ut_checkpoint
+ *
+ *  A checkpoint is written and read back into fresh objects. A
+ *  checkpoint of another run (a different seed), or one which does
+ *  not match the interfaces, or of another kind, must be refused.
+ *
+ *****************************************************************************/
+
+int ut_checkpoint(u_test_case_t * tc) {
+
+  int n, rank;
+  int ival;
+  int interface;
+  long long int ncum_trial;
+  int ntraj;
+  const int nlambda = 3;
+  const int seed = 17;
+  double wt;
+  char filename[FILENAME_MAX];
+
+  ffs_ensemble_t * states = NULL;
+  ffs_ensemble_t * copy = NULL;
+  ffs_result_t * result = NULL;
+  ffs_result_t * rcopy = NULL;
+  ffs_result_aflux_t * flux = NULL;
+  ffs_result_aflux_t * fcopy = NULL;
+
+  u_dbg("Start");
+
+  dbg_err_if(ffs_checkpoint_filename(1, 2, filename));
+  dbg_err_if(strcmp(filename, "inst0001-checkpoint.rank0002") != 0);
+
+  /* Ranks must not share a file */
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  sprintf(filename, "logs/ut-checkpoint.rank%4.4d", rank);
+
+  dbg_err_if(ffs_ensemble_create(4, &states));
+  for (n = 0; n < 3; n++) {
+    states->traj[n] = 10 + n;
+    states->wt[n] = 0.5*n;
+    states->owner[n] = n % 2;
+  }
+  states->nsuccess = 3;
+
+  dbg_err_if(ffs_result_create(nlambda, &result));
+  dbg_err_if(ffs_result_trial_success_add(result, 2));
+  dbg_err_if(ffs_result_weight_accum(result, 2, 0.25));
+  dbg_err_if(ffs_result_nkeep_set(result, 1, 3));
+
+  dbg_err_if(ffs_result_aflux_create(2, &flux));
+  dbg_err_if(ffs_result_aflux_ncross_add(flux));
+  dbg_err_if(ffs_result_aflux_ncross_add(flux));
+
+  dbg_err_if(ffs_checkpoint_write(filename, seed, 2, 2, 40, states, result,
+				  flux));
+
+  /* Read back */
+
+  dbg_err_if(ffs_result_create(nlambda, &rcopy));
+  dbg_err_if(ffs_result_aflux_create(2, &fcopy));
+
+  dbg_err_if(ffs_checkpoint_read(filename, seed, 2, &interface, &ncum_trial,
+				 &copy, rcopy, fcopy));
+  dbg_err_if(interface != 2);
+  dbg_err_if(ncum_trial != 40);
+
+  dbg_err_if(copy->nmax != 4);
+  dbg_err_if(copy->nsuccess != 3);
+  for (n = 0; n < 3; n++) {
+    dbg_err_if(copy->traj[n] != states->traj[n]);
+    dbg_err_if(copy->wt[n] != states->wt[n]);
+    dbg_err_if(copy->owner[n] != states->owner[n]);
+  }
+
+  dbg_err_if(ffs_result_trial_success(rcopy, 2, &ival));
+  dbg_err_if(ival != 1);
+  dbg_err_if(ffs_result_weight(rcopy, 2, &wt));
+  dbg_err_if(wt != 0.25);
+  dbg_err_if(ffs_result_nkeep(rcopy, 1, &ival));
+  dbg_err_if(ival != 3);
+  dbg_err_if(ffs_result_aflux_ncross_local(fcopy, &ival));
+  dbg_err_if(ival != 2);
+
+  ffs_ensemble_free(copy);
+  copy = NULL;
+
+  /* Mismatches */
+
+  dbg_err_if(ffs_checkpoint_read(filename, seed + 1, 2, &interface,
+				 &ncum_trial, &copy, rcopy, fcopy) == 0);
+  dbg_err_if(copy != NULL);
+
+  ffs_result_free(rcopy);
+  dbg_err_if(ffs_result_create(nlambda + 1, &rcopy));
+  dbg_err_if(ffs_checkpoint_read(filename, seed, 2, &interface,
+				 &ncum_trial, &copy, rcopy, fcopy) == 0);
+  dbg_err_if(copy != NULL);
+
+  /* Between trees, there is no ensemble */
+
+  dbg_err_if(ffs_checkpoint_tree_write(filename, FFS_CHECKPOINT_BRANCHED,
+				       seed, 2, 5, result, flux));
+  dbg_err_if(ffs_checkpoint_tree_read(filename, FFS_CHECKPOINT_ROSENBLUTH,
+				      seed, 2, &ntraj, result, flux) == 0);
+  dbg_err_if(ffs_checkpoint_read(filename, seed, 2, &interface,
+				 &ncum_trial, &copy, result, fcopy) == 0);
+  dbg_err_if(copy != NULL);
+
+  ffs_result_aflux_free(fcopy);
+  dbg_err_if(ffs_result_aflux_create(2, &fcopy));
+  dbg_err_if(ffs_checkpoint_tree_read(filename, FFS_CHECKPOINT_BRANCHED,
+				      seed, 2, &ntraj, result, fcopy));
+  dbg_err_if(ntraj != 5);
+  dbg_err_if(ffs_result_aflux_ncross_local(fcopy, &ival));
+  dbg_err_if(ival != 2);
+
+  remove(filename);
+
+  ffs_result_aflux_free(fcopy);
+  ffs_result_aflux_free(flux);
+  ffs_result_free(rcopy);
+  ffs_result_free(result);
+  ffs_ensemble_free(states);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+
+  if (copy) ffs_ensemble_free(copy);
+  if (fcopy) ffs_result_aflux_free(fcopy);
+  if (flux) ffs_result_aflux_free(flux);
+  if (rcopy) ffs_result_free(rcopy);
+  if (result) ffs_result_free(result);
+  if (states) ffs_ensemble_free(states);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
@@ -0,0 +1,20 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_checkpoint.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef UT_FFS_CHECKPOINT_H
+#define UT_FFS_CHECKPOINT_H
+
+#include "u/libu.h"
+
+#define UT_CHECKPOINT_NAME "Instance checkpoint"
+
+int ut_checkpoint(u_test_case_t * tc);
+
+#endif
@@ -0,0 +1,130 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_delta.c
+ *
+ *  Unit test for ../../src/ffs/ffs_delta.c (and the base of
+ *  a state in ../../src/ffs/ffs_state.c)
+ *
+ *****************************************************************************/
+
+#include <string.h>
+
+#include "ffs_delta.h"
+#include "ffs_state.h"
+#include "ut_ffs_delta.h"
+
+#define UT_NBYTES 1000
+
+/*****************************************************************************
+ *
+ *  ut_delta
+ *
+ *****************************************************************************/
+
+int ut_delta(u_test_case_t * tc) {
+
+  int n;
+  int depth, nref;
+  size_t ndelta;
+  unsigned char base[UT_NBYTES];
+  unsigned char buf[UT_NBYTES];
+  unsigned char out[UT_NBYTES];
+  void * delta = NULL;
+  ffs_state_t * s0 = NULL;
+  ffs_state_t * s1 = NULL;
+  ffs_state_t * s2 = NULL;
+  ffs_state_t * sbase = NULL;
+
+  u_dbg("Start");
+
+  for (n = 0; n < UT_NBYTES; n++) {
+    base[n] = (unsigned char) (n % 251);
+  }
+
+  /* An identical state has an empty delta */
+
+  memcpy(buf, base, UT_NBYTES);
+  dbg_err_if(ffs_delta_encode(base, buf, UT_NBYTES, &delta, &ndelta));
+  dbg_err_if(ndelta != 0);
+  dbg_err_if(ffs_delta_decode(base, UT_NBYTES, delta, ndelta, out));
+  dbg_err_if(memcmp(out, base, UT_NBYTES));
+  u_free(delta);
+  delta = NULL;
+
+  /* A few changes, including the first and last bytes, and two
+   * changes close enough together to share a run */
+
+  buf[0] += 1;
+  buf[500] += 1;
+  buf[503] += 1;
+  buf[UT_NBYTES - 1] += 1;
+
+  dbg_err_if(ffs_delta_encode(base, buf, UT_NBYTES, &delta, &ndelta));
+  dbg_err_if(ndelta >= 64);
+  dbg_err_if(ffs_delta_decode(base, UT_NBYTES, delta, ndelta, out));
+  dbg_err_if(memcmp(out, buf, UT_NBYTES));
+
+  /* A truncated delta, or the wrong size, is detected */
+
+  dbg_err_if(ffs_delta_decode(base, UT_NBYTES, delta, ndelta - 1, out) == 0);
+  dbg_err_if(ffs_delta_decode(base, 100, delta, ndelta, out) == 0);
+  u_free(delta);
+  delta = NULL;
+
+  /* Nothing in common: the delta is larger, but still correct */
+
+  for (n = 0; n < UT_NBYTES; n++) {
+    buf[n] = base[n] + 1;
+  }
+
+  dbg_err_if(ffs_delta_encode(base, buf, UT_NBYTES, &delta, &ndelta));
+  dbg_err_if(ndelta <= UT_NBYTES);
+  dbg_err_if(ffs_delta_decode(base, UT_NBYTES, delta, ndelta, out));
+  dbg_err_if(memcmp(out, buf, UT_NBYTES));
+  u_free(delta);
+  delta = NULL;
+
+  /* A chain s0 <- s1 <- s2. s0 and s1 are freed by their owner
+   * first, but remain while s2 depends on them. */
+
+  dbg_err_if(ffs_state_create(0, 0, &s0));
+  dbg_err_if(ffs_state_create(0, 0, &s1));
+  dbg_err_if(ffs_state_create(0, 0, &s2));
+
+  dbg_err_if(ffs_state_base_set(s0, s0) == 0);
+  dbg_err_if(ffs_state_base_set(s1, s0));
+  dbg_err_if(ffs_state_base_set(s2, s1));
+
+  dbg_err_if(ffs_state_depth(s2, &depth));
+  dbg_err_if(depth != 2);
+  dbg_err_if(ffs_state_nref(s0, &nref));
+  dbg_err_if(nref != 1);
+
+  ffs_state_free(s0);
+  ffs_state_free(s1);
+
+  dbg_err_if(ffs_state_base(s2, &sbase));
+  dbg_err_if(sbase != s1);
+  dbg_err_if(ffs_state_base(sbase, &sbase));
+  dbg_err_if(sbase != s0);
+  dbg_err_if(ffs_state_depth(s1, &depth));
+  dbg_err_if(depth != 1);
+
+  /* Dropping the base releases the chain */
+
+  dbg_err_if(ffs_state_base_set(s2, NULL));
+  dbg_err_if(ffs_state_depth(s2, &depth));
+  dbg_err_if(depth != 0);
+
+  ffs_state_free(s2);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+
+  if (delta) u_free(delta);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
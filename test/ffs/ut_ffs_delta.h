@@ -0,0 +1,20 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_delta.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef UT_FFS_DELTA_H
+#define UT_FFS_DELTA_H
+
+#include "u/libu.h"
+
+#define UT_DELTA_NAME "State delta encoding"
+
+int ut_delta(u_test_case_t * tc);
+
+#endif
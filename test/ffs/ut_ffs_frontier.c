@@ -0,0 +1,69 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_frontier.c
+ *
+ *  Unit test for ../../src/ffs/ffs_frontier.c
+ *
+ *****************************************************************************/
+
+#include "ffs_frontier.h"
+#include "ut_ffs_frontier.h"
+
+/*****************************************************************************
+ *
+ *  ut_frontier
+ *
+ *  Frames are pushed to the capacity, which must then be refused,
+ *  and popped in reverse order.
+ *
+ *****************************************************************************/
+
+int ut_frontier(u_test_case_t * tc) {
+
+  int n, depth;
+  const int nmax = 4;
+
+  ffs_frame_t * frame = NULL;
+  ffs_frontier_t * frontier = NULL;
+
+  u_dbg("Start");
+
+  dbg_err_if(ffs_frontier_create(nmax, &frontier));
+  dbg_err_if(ffs_frontier_top(frontier, &frame) == 0);
+  dbg_err_if(ffs_frontier_pop(frontier) == 0);
+
+  for (n = 1; n <= nmax; n++) {
+    dbg_err_if(ffs_frontier_push(frontier, n, 10*n, 0.5*n, &frame));
+    dbg_err_if(frame->idnext != 10*n);
+    dbg_err_if(frame->itrial != 0);
+    frame->ntrial = n;
+  }
+
+  dbg_err_if(ffs_frontier_push(frontier, 0, 0, 0.0, &frame) == 0);
+  dbg_err_if(ffs_frontier_depth(frontier, &depth));
+  dbg_err_if(depth != nmax);
+
+  for (n = nmax; n >= 1; n--) {
+    dbg_err_if(ffs_frontier_top(frontier, &frame));
+    dbg_err_if(frame->interface != n);
+    dbg_err_if(frame->id != 10*n);
+    dbg_err_if(frame->wt != 0.5*n);
+    dbg_err_if(frame->ntrial != n);
+    dbg_err_if(ffs_frontier_pop(frontier));
+  }
+
+  dbg_err_if(ffs_frontier_depth(frontier, &depth));
+  dbg_err_if(depth != 0);
+
+  ffs_frontier_free(frontier);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+
+  if (frontier) ffs_frontier_free(frontier);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
@@ -0,0 +1,20 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_frontier.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2013 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef UT_FFS_FRONTIER_H
+#define UT_FFS_FRONTIER_H
+
+#include "u/libu.h"
+
+#define UT_FRONTIER_NAME "Tree frontier"
+
+int ut_frontier(u_test_case_t * tc);
+
+#endif
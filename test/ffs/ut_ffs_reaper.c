@@ -0,0 +1,72 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_reaper.c
+ *
+ *  Unit test for ../../src/ffs/ffs_reaper.c
+ *
+ *****************************************************************************/
+
+#include "ffs_reaper.h"
+#include "ut_ffs_reaper.h"
+
+/*****************************************************************************
+ *
+ *  ut_reaper
+ *
+ *  Handles are added and removed in interleaved fashion, so that the
+ *  list wraps around, and enough are added to force it to grow.
+ *
+ *****************************************************************************/
+
+int ut_reaper(u_test_case_t * tc) {
+
+  int n, nstate;
+  int nnext = 0;
+  const int ntest = 1000;
+  ffs_handle_t handle;
+  ffs_handle_t expect;
+
+  ffs_reaper_t * reaper = NULL;
+
+  u_dbg("Start");
+
+  dbg_err_if(ffs_reaper_create(&reaper));
+  dbg_err_if(ffs_reaper_next(reaper, &handle) == 0);
+  dbg_err_if(ffs_reaper_add(reaper, FFS_HANDLE_NONE) == 0);
+
+  for (n = 0; n < ntest; n++) {
+    dbg_err_if(util_handle(1, n, &handle));
+    dbg_err_if(ffs_reaper_add(reaper, handle));
+
+    /* Remove one for every two added */
+    if (n % 2) {
+      dbg_err_if(ffs_reaper_next(reaper, &handle));
+      dbg_err_if(util_handle(1, nnext++, &expect));
+      dbg_err_if(handle != expect);
+    }
+  }
+
+  dbg_err_if(ffs_reaper_nstate(reaper, &nstate));
+  dbg_err_if(nstate != ntest - nnext);
+
+  while (ffs_reaper_next(reaper, &handle) == 0) {
+    dbg_err_if(util_handle(1, nnext++, &expect));
+    dbg_err_if(handle != expect);
+  }
+
+  dbg_err_if(nnext != ntest);
+  dbg_err_if(ffs_reaper_nstate(reaper, &nstate));
+  dbg_err_if(nstate != 0);
+
+  ffs_reaper_free(reaper);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+
+  if (reaper) ffs_reaper_free(reaper);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
@@ -0,0 +1,20 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_reaper.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2012 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef UT_FFS_REAPER_H
+#define UT_FFS_REAPER_H
+
+#include "u/libu.h"
+
+#define UT_REAPER_NAME "State reaper"
+
+int ut_reaper(u_test_case_t * tc);
+
+#endif
@@ -6,6 +6,8 @@
  *
  *****************************************************************************/
 
+#include <string.h>
+
 #include "u/libu.h"
 #include "ffs_state.h"
 
@@ -13,6 +15,7 @@ int u_test_ffs_state_create(u_test_case_t * tc) {
 
   ffs_state_t * state = NULL;
   int id = 0;
+  ffs_handle_t handle, href;
   int * pidref = NULL;
   int * pid = NULL;
 
@@ -29,6 +32,11 @@ int u_test_ffs_state_create(u_test_case_t * tc) {
   dbg_err_if(ffs_state_mem(state, (void *) &pid));
   dbg_err_if(*pid != 11);
   dbg_err_if(ffs_state_stub(state) == NULL);
+  dbg_err_if(strcmp(ffs_state_stub(state), "inst0000-grp0000-state000000010"));
+
+  dbg_err_if(ffs_state_handle(state, &handle));
+  dbg_err_if(util_handle(0, 10, &href));
+  dbg_err_if(handle != href);
 
   u_free(pidref);
   ffs_state_free(state);
@@ -0,0 +1,158 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_store.c
+ *
+ *  Unit test for ../../src/ffs/ffs_store.c
+ *
+ *****************************************************************************/
+
+#include "ffs_util.h"
+#include "ffs_store.h"
+#include "ut_ffs_store.h"
+
+static int ut_store_value(ffs_state_t * s);
+static ffs_handle_t ut_store_handle(int id_group, int id);
+
+/*****************************************************************************
+ *
+ *  ut_store
+ *
+ *  Enough states are added to force the table to grow.
+ *
+ *****************************************************************************/
+
+int ut_store(u_test_case_t * tc) {
+
+  int n, nstate;
+  int * data = NULL;
+  size_t nbytes;
+  const int ntest = 1000;
+
+  ffs_store_t * store = NULL;
+  ffs_state_t * state = NULL;
+  ffs_state_t * s = NULL;
+
+  u_dbg("Start");
+
+  dbg_err_if(ffs_store_create(&store));
+
+  for (n = 0; n < ntest; n++) {
+    dbg_err_if(ffs_store_add(store, ut_store_handle(1, n), &state));
+    dbg_err_if(state == NULL);
+    dbg_err_if((data = u_calloc(1, sizeof(int))) == NULL);
+    *data = n;
+    dbg_err_if(ffs_state_snapshot_set(state, data, sizeof(int)));
+  }
+
+  dbg_err_if(ffs_store_nstate(store, &nstate));
+  dbg_err_if(nstate != ntest);
+
+  /* Adding an existing handle returns the existing state */
+
+  dbg_err_if(ffs_store_add(store, ut_store_handle(1, 10), &state));
+  dbg_err_if(ffs_store_nstate(store, &nstate));
+  dbg_err_if(nstate != ntest);
+
+  for (n = 0; n < ntest; n++) {
+    dbg_err_if(ffs_store_find(store, ut_store_handle(1, n), &s));
+    dbg_err_if(s == NULL);
+    dbg_err_if(ffs_state_snapshot(s, (void **) &data, &nbytes));
+    dbg_err_if(nbytes != sizeof(int));
+    dbg_err_if(*data != n);
+  }
+
+  dbg_err_if(ffs_store_find(store, ut_store_handle(2, 0), &s));
+  dbg_err_if(s != NULL);
+
+  /* Removal */
+
+  dbg_err_if(ffs_store_remove(store, ut_store_handle(1, 0)));
+  dbg_err_if(ffs_store_remove(store, ut_store_handle(1, 0)) == 0);
+  dbg_err_if(ffs_store_find(store, ut_store_handle(1, 0), &s));
+  dbg_err_if(s != NULL);
+  dbg_err_if(ffs_store_nstate(store, &nstate));
+  dbg_err_if(nstate != ntest - 1);
+
+  /* Order of use: only states touched with a snapshot appear */
+
+  dbg_err_if(ffs_store_lru(store, NULL, &s));
+  dbg_err_if(s != NULL);
+
+  for (n = 1; n <= 3; n++) {
+    dbg_err_if(ffs_store_touch(store, ut_store_handle(1, n)));
+  }
+  dbg_err_if(ffs_store_touch(store, ut_store_handle(1, 1)));
+  dbg_err_if(ffs_store_nbytes(store, &nbytes));
+  dbg_err_if(nbytes != 3*sizeof(int));
+
+  dbg_err_if(ffs_store_lru(store, NULL, &s));
+  dbg_err_if(s == NULL || ut_store_value(s) != 2);
+  dbg_err_if(ffs_store_lru(store, s, &s));
+  dbg_err_if(s == NULL || ut_store_value(s) != 3);
+  dbg_err_if(ffs_store_lru(store, s, &s));
+  dbg_err_if(s == NULL || ut_store_value(s) != 1);
+  dbg_err_if(ffs_store_lru(store, s, &s));
+  dbg_err_if(s != NULL);
+
+  /* Release of a snapshot, and removal, take a state off the list */
+
+  dbg_err_if(ffs_store_find(store, ut_store_handle(1, 2), &s));
+  dbg_err_if(ffs_state_snapshot_set(s, NULL, 0));
+  dbg_err_if(ffs_store_touch(store, ut_store_handle(1, 2)));
+  dbg_err_if(ffs_store_remove(store, ut_store_handle(1, 3)));
+  dbg_err_if(ffs_store_nbytes(store, &nbytes));
+  dbg_err_if(nbytes != sizeof(int));
+
+  dbg_err_if(ffs_store_lru(store, NULL, &s));
+  dbg_err_if(s == NULL || ut_store_value(s) != 1);
+  dbg_err_if(ffs_store_lru(store, s, &s));
+  dbg_err_if(s != NULL);
+
+  ffs_store_free(store);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+
+  if (store) ffs_store_free(store);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
+
+/*****************************************************************************
+ *
+ *  ut_store_value
+ *
+ *  The integer held as snapshot (-1 if none).
+ *
+ *****************************************************************************/
+
+static int ut_store_value(ffs_state_t * s) {
+
+  int * data = NULL;
+  size_t nbytes;
+
+  if (ffs_state_snapshot(s, (void **) &data, &nbytes)) return -1;
+  if (data == NULL) return -1;
+
+  return *data;
+}
+
+/*****************************************************************************
+ *
+ *  ut_store_handle
+ *
+ *  FFS_HANDLE_NONE on failure, which the store functions reject.
+ *
+ *****************************************************************************/
+
+static ffs_handle_t ut_store_handle(int id_group, int id) {
+
+  ffs_handle_t handle;
+
+  if (util_handle(id_group, id, &handle)) return FFS_HANDLE_NONE;
+
+  return handle;
+}
@@ -0,0 +1,20 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_store.h
+ *
+ *  Parallel Forward Flux Sampling
+ *  (c) 2012 The University of Edinburgh
+ *  Funded by United Kingdom EPSRC Grant EP/I030298/1
+ *
+ *****************************************************************************/
+
+#ifndef UT_FFS_STORE_H
+#define UT_FFS_STORE_H
+
+#include "u/libu.h"
+
+#define UT_STORE_NAME "State store"
+
+int ut_store(u_test_case_t * tc);
+
+#endif
@@ -18,6 +18,14 @@
 #include "ut_ffs_result.h"
 #include "ut_ffs_result_aflux.h"
 #include "ut_ffs_result_summary.h"
+#include "ut_ffs_store.h"
+#include "ut_ffs_reaper.h"
+#include "ut_ffs_archive.h"
+#include "ut_ffs_aggregate.h"
+#include "ut_ffs_delta.h"
+#include "ut_ffs_checkpoint.h"
+#include "ut_ffs_frontier.h"
+#include "ut_ffs_cache.h"
 
 /*
  * Register the tests for ffs objects
@@ -39,6 +47,7 @@ int u_test_suite_ffs_register(u_test_t * t) {
   u_test_case_register(UT_FFS_COMMAND_BUILD_NAME, ut_ffs_command_build, ts);
   u_test_case_register(UT_FFS_EXCH_INT_NAME, ut_ffs_exch_int, ts);
   u_test_case_register(UT_FFS_LAMBDA_NAME, ut_ffs_lambda_name, ts);
+  u_test_case_register(UT_FFS_TRIAL_NAME, ut_ffs_trial, ts);
 
   u_test_case_register(UT_INST_NAME, ut_inst, ts);
   u_test_case_register(UT_INST_INPUT_NAME, ut_inst_input, ts);
@@ -51,5 +60,14 @@ int u_test_suite_ffs_register(u_test_t * t) {
   u_test_case_register(UT_RESULT_AFLUX_NAME, ut_ffs_result_aflux, ts);
   u_test_case_register(UT_RESULT_SUMMARY_NAME, ut_ffs_result_summary, ts);
 
+  u_test_case_register(UT_STORE_NAME, ut_store, ts);
+  u_test_case_register(UT_REAPER_NAME, ut_reaper, ts);
+  u_test_case_register(UT_ARCHIVE_NAME, ut_archive, ts);
+  u_test_case_register(UT_AGGREGATE_NAME, ut_aggregate, ts);
+  u_test_case_register(UT_DELTA_NAME, ut_delta, ts);
+  u_test_case_register(UT_CHECKPOINT_NAME, ut_checkpoint, ts);
+  u_test_case_register(UT_FRONTIER_NAME, ut_frontier, ts);
+  u_test_case_register(UT_CACHE_NAME, ut_cache, ts);
+
   return u_test_suite_add(ts, t);
 }
@@ -21,6 +21,7 @@ int ut_proxy(u_test_case_t * tc) {
   ffs_t * ffs = NULL;
 
   int id = -1;
+  int nstep;
   int result;
   MPI_Comm testcomm;
 
@@ -33,10 +34,16 @@ int ut_proxy(u_test_case_t * tc) {
   dbg_err_if(proxy_delegate_create(proxy, "test"));
 
   dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_INIT));
-  dbg_err_if(proxy_state(proxy, SIM_STATE_INIT, "no stub"));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_INIT, 0));
   dbg_err_if(proxy_lambda(proxy));
   dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
 
+  /* The test simulation does not run whole trials (asked once) */
+  dbg_err_if(proxy_execute_trial(proxy, 0.0, 1.0, 10, 1, &nstep));
+  dbg_err_if(nstep != -1);
+  dbg_err_if(proxy_execute_trial(proxy, 0.0, 1.0, 10, 1, &nstep));
+  dbg_err_if(nstep != -1);
+
   dbg_err_if(proxy_delegate_free(proxy));
 
   dbg_err_if(proxy_ffs(proxy, &ffs));
@@ -5,6 +5,8 @@
  *****************************************************************************/
 
 #include <float.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "ffs_private.h"
 #include "ffs_util.h"
@@ -14,7 +16,9 @@
 
 static char * input = 
   "inputs/dmc_switch1_comp.dat inputs/dmc_switch1_react.dat";
-static char * stub = "logs/dmc_state.dat";
+
+static int ut_sim_dmc_handle(int rank, int id, ffs_handle_t * handle,
+			     char * filename);
 
 /*****************************************************************************
  *
@@ -62,14 +66,15 @@ int ut_sim_dmc_proxy(u_test_case_t * tc) {
   proxy_t * proxy = NULL;
 
   int rank = 0;
-  char filename[BUFSIZ];
+  ffs_handle_t handle;
+  char filename[FILENAME_MAX];
   MPI_Comm comm = MPI_COMM_NULL;
 
   u_dbg("Start");
 
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   MPI_Comm_split(MPI_COMM_WORLD, rank, 0, &comm);
-  sprintf(filename, "%s-%d", stub, rank);
+  dbg_err_if(ut_sim_dmc_handle(rank, 0, &handle, filename));
 
   dbg_err_if(proxy_create(rank, comm, &proxy));
   dbg_err_if(proxy_delegate_create(proxy, "dmc"));
@@ -78,10 +83,10 @@ int ut_sim_dmc_proxy(u_test_case_t * tc) {
   dbg_err_if(ffs_command_line_set(ffs, input));
   dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_INIT));
 
-  dbg_err_if(proxy_state(proxy, SIM_STATE_INIT, filename));
-  dbg_err_if(proxy_state(proxy, SIM_STATE_WRITE, filename));
-  dbg_err_if(proxy_state(proxy, SIM_STATE_READ, filename));
-  dbg_err_if(proxy_state(proxy, SIM_STATE_DELETE, filename));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_INIT, handle));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_WRITE, handle));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_READ, handle));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_DELETE, handle));
 
   dbg_err_if(proxy_lambda(proxy));
 
@@ -173,3 +178,589 @@ int ut_sim_dmc_info(u_test_case_t * tc) {
   u_dbg("Failure\n");
   return U_TEST_FAILURE;
 }
+
+/*****************************************************************************
+ *
+ *  ut_sim_dmc_memory
+ *
+ *  A state written via the proxy should be held in memory and be
+ *  recovered exactly (without any work if nothing has changed since);
+ *  a published state should also appear in file.
+ *  Under a memory limit, states are spilled to file and read back,
+ *  including ahead of need.
+ *
+ *****************************************************************************/
+
+int ut_sim_dmc_memory(u_test_case_t * tc) {
+
+  ffs_t * ffs = NULL;
+  proxy_t * proxy = NULL;
+
+  int n;
+  int rank = 0;
+  int lref, lambda;
+  int nhit, nmiss, nspill;
+  int nclean;
+  double tref, tref2, t;
+  ffs_handle_t handle;
+  ffs_handle_t handle2;
+  char filename[FILENAME_MAX];
+  char filename2[FILENAME_MAX];
+  char packed[BUFSIZ];
+  char packed2[BUFSIZ];
+  FILE * fp = NULL;
+  MPI_Comm comm = MPI_COMM_NULL;
+
+  u_dbg("Start");
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_split(MPI_COMM_WORLD, rank, 0, &comm);
+  dbg_err_if(ut_sim_dmc_handle(rank, 0, &handle, filename));
+  dbg_err_if(snprintf(packed, BUFSIZ, "%s.rank0000", filename) >= BUFSIZ);
+  dbg_err_if(ut_sim_dmc_handle(rank, 1, &handle2, filename2));
+  dbg_err_if(snprintf(packed2, BUFSIZ, "%s.rank0000", filename2) >= BUFSIZ);
+
+  dbg_err_if(proxy_create(rank, comm, &proxy));
+  dbg_err_if(proxy_delegate_create(proxy, "dmc"));
+
+  dbg_err_if(proxy_ffs(proxy, &ffs));
+  dbg_err_if(ffs_command_line_set(ffs, input));
+  dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_INIT));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_INIT, handle));
+
+  dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_RUN));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_WRITE, handle));
+
+  /* No file should have been written */
+
+  dbg_err_if((fp = fopen(filename, "r")) != NULL);
+  dbg_err_if((fp = fopen(packed, "r")) != NULL);
+
+  /* Nothing has changed, so reading the state back is a no-op */
+
+  dbg_err_if(proxy_state(proxy, SIM_STATE_READ, handle));
+  dbg_err_if(proxy_state_nclean(proxy, &nclean));
+  dbg_err_if(nclean != 1);
+
+  dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
+  dbg_err_if(proxy_info(proxy, FFS_INFO_LAMBDA_PUT));
+  dbg_err_if(ffs_time(ffs, &tref));
+  dbg_err_if(ffs_info_int(ffs, FFS_INFO_LAMBDA_FETCH, 1, &lref));
+
+  for (n = 0; n < 100; n++) {
+    dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_RUN));
+  }
+
+  dbg_err_if(proxy_state(proxy, SIM_STATE_READ, handle));
+  dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
+  dbg_err_if(proxy_info(proxy, FFS_INFO_LAMBDA_PUT));
+  dbg_err_if(ffs_time(ffs, &t));
+  dbg_err_if(ffs_info_int(ffs, FFS_INFO_LAMBDA_FETCH, 1, &lambda));
+  dbg_err_if(t != tref);
+  dbg_err_if(lambda != lref);
+  dbg_err_if(proxy_state_nclean(proxy, &nclean));
+  dbg_err_if(nclean != 1);
+
+  /* Publish (the copy in memory is retained) */
+
+  dbg_err_if(proxy_state_publish(proxy, handle));
+  dbg_err_if((fp = fopen(packed, "r")) == NULL);
+  fclose(fp);
+  fp = NULL;
+
+  for (n = 0; n < 100; n++) {
+    dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_RUN));
+  }
+
+  dbg_err_if(proxy_state(proxy, SIM_STATE_READ, handle));
+  dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
+  dbg_err_if(ffs_time(ffs, &t));
+  dbg_err_if(t != tref);
+
+  /* With a (very small) memory limit, both states are spilled to
+   * file, and the first is read back from there. */
+
+  dbg_err_if(proxy_state_memory_max_set(proxy, 1));
+  dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_RUN));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_WRITE, handle2));
+  dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
+  dbg_err_if(ffs_time(ffs, &tref2));
+  dbg_err_if(proxy_state_cache_stats(proxy, &nhit, &nmiss, &nspill));
+  dbg_err_if(nhit != 2);
+  dbg_err_if(nmiss != 0);
+  dbg_err_if(nspill != 2);
+  dbg_err_if((fp = fopen(packed2, "r")) == NULL);
+  fclose(fp);
+  fp = NULL;
+
+  dbg_err_if(proxy_state(proxy, SIM_STATE_READ, handle));
+  dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
+  dbg_err_if(ffs_time(ffs, &t));
+  dbg_err_if(t != tref);
+  dbg_err_if(proxy_state_cache_stats(proxy, &nhit, &nmiss, &nspill));
+  dbg_err_if(nmiss != 1);
+  dbg_err_if(nspill != 3);
+
+  /* A spilled state read ahead is the same state. A read ahead
+   * which is never used is discarded. */
+
+  dbg_err_if(proxy_state_prefetch_set(proxy, 1));
+  dbg_err_if(proxy_state_prefetch(proxy, handle2));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_READ, handle2));
+  dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
+  dbg_err_if(ffs_time(ffs, &t));
+  dbg_err_if(t != tref2);
+  dbg_err_if(proxy_state_cache_stats(proxy, &nhit, &nmiss, &nspill));
+  dbg_err_if(nmiss != 2);
+
+  dbg_err_if(proxy_state_prefetch(proxy, handle));
+  dbg_err_if(proxy_state_prefetch_set(proxy, 0));
+
+  dbg_err_if(proxy_state_memory_max_set(proxy, 0));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_DELETE, handle2));
+  dbg_err_if((fp = fopen(packed2, "r")) != NULL);
+
+  dbg_err_if(proxy_state(proxy, SIM_STATE_DELETE, handle));
+  dbg_err_if((fp = fopen(packed, "r")) != NULL);
+
+  dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_FINISH));
+  dbg_err_if(proxy_delegate_free(proxy));
+  proxy_free(proxy);
+  MPI_Comm_free(&comm);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+  if (fp) fclose(fp);
+  if (proxy) proxy_free(proxy);
+  MPI_Comm_free(&comm);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
+
+/*****************************************************************************
+ *
+ *  ut_sim_dmc_scratch
+ *
+ *  With in-memory states switched off, a state written via the proxy
+ *  should go to the scratch directory, and only reach the working
+ *  directory when published. All copies go on deletion, or when
+ *  reaped following retirement.
+ *
+ *****************************************************************************/
+
+int ut_sim_dmc_scratch(u_test_case_t * tc) {
+
+  ffs_t * ffs = NULL;
+  proxy_t * proxy = NULL;
+
+  int n;
+  int rank = 0;
+  double tref, t;
+  ffs_handle_t handle;
+  char filename[FILENAME_MAX];
+  char scratch[BUFSIZ];
+  FILE * fp = NULL;
+  MPI_Comm comm = MPI_COMM_NULL;
+
+  u_dbg("Start");
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_split(MPI_COMM_WORLD, rank, 0, &comm);
+  dbg_err_if(ut_sim_dmc_handle(rank, 0, &handle, filename));
+  sprintf(scratch, "logs/ffs-proxy%6.6d/%s", rank, filename);
+
+  dbg_err_if(proxy_create(rank, comm, &proxy));
+  dbg_err_if(proxy_delegate_create(proxy, "dmc"));
+  dbg_err_if(proxy_state_memory_set(proxy, 0));
+  dbg_err_if(proxy_scratch_set(proxy, "logs"));
+
+  dbg_err_if(proxy_ffs(proxy, &ffs));
+  dbg_err_if(ffs_command_line_set(ffs, input));
+  dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_INIT));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_INIT, handle));
+
+  dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_RUN));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_WRITE, handle));
+
+  dbg_err_if((fp = fopen(filename, "r")) != NULL);
+  dbg_err_if((fp = fopen(scratch, "r")) == NULL);
+  fclose(fp);
+  fp = NULL;
+
+  dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
+  dbg_err_if(ffs_time(ffs, &tref));
+
+  for (n = 0; n < 100; n++) {
+    dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_RUN));
+  }
+
+  dbg_err_if(proxy_state(proxy, SIM_STATE_READ, handle));
+  dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
+  dbg_err_if(ffs_time(ffs, &t));
+  dbg_err_if(t != tref);
+
+  /* Publish */
+
+  dbg_err_if(proxy_state_publish(proxy, handle));
+  dbg_err_if((fp = fopen(filename, "r")) == NULL);
+  fclose(fp);
+  fp = NULL;
+
+  dbg_err_if(proxy_state(proxy, SIM_STATE_DELETE, handle));
+  dbg_err_if((fp = fopen(filename, "r")) != NULL);
+  dbg_err_if((fp = fopen(scratch, "r")) != NULL);
+
+  /* Retirement defers deletion until reaped; a rewrite cancels it */
+
+  dbg_err_if(proxy_state(proxy, SIM_STATE_WRITE, handle));
+  dbg_err_if(proxy_state_retire(proxy, handle));
+  dbg_err_if((fp = fopen(scratch, "r")) == NULL);
+  fclose(fp);
+  fp = NULL;
+
+  dbg_err_if(proxy_state(proxy, SIM_STATE_WRITE, handle));
+  dbg_err_if(proxy_state_reap(proxy, -1));
+  dbg_err_if((fp = fopen(scratch, "r")) == NULL);
+  fclose(fp);
+  fp = NULL;
+
+  dbg_err_if(proxy_state_retire(proxy, handle));
+  dbg_err_if(proxy_state_nretired(proxy, &n));
+  dbg_err_if(n != 1);
+  dbg_err_if(proxy_state_reap(proxy, -1));
+  dbg_err_if((fp = fopen(scratch, "r")) != NULL);
+
+  dbg_err_if(proxy_scratch_remove(proxy));
+  dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_FINISH));
+  dbg_err_if(proxy_delegate_free(proxy));
+  proxy_free(proxy);
+  MPI_Comm_free(&comm);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+  if (fp) fclose(fp);
+  if (proxy) proxy_free(proxy);
+  MPI_Comm_free(&comm);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
+
+/*****************************************************************************
+ *
+ *  ut_sim_dmc_format
+ *
+ *  States are written to file in text format and then in binary
+ *  format. As the RNG state is included, the trajectory following
+ *  a read must be the same as that following the write. A text file
+ *  must also be readable when the format is binary.
+ *
+ *****************************************************************************/
+
+int ut_sim_dmc_format(u_test_case_t * tc) {
+
+  ffs_t * ffs = NULL;
+  proxy_t * proxy = NULL;
+
+  int n, nf;
+  int rank = 0;
+  double tref, tnext, t;
+  ffs_handle_t handle;
+  ffs_handle_t text;
+  char filename[FILENAME_MAX];
+  char argv[BUFSIZ];
+  char magic[4];
+  FILE * fp = NULL;
+  MPI_Comm comm = MPI_COMM_NULL;
+
+  u_dbg("Start");
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_split(MPI_COMM_WORLD, rank, 0, &comm);
+  dbg_err_if(ut_sim_dmc_handle(rank, 0, &text, filename));
+
+  dbg_err_if(proxy_create(rank, comm, &proxy));
+  dbg_err_if(proxy_delegate_create(proxy, "dmc"));
+  dbg_err_if(proxy_state_memory_set(proxy, 0));
+  dbg_err_if(proxy_ffs(proxy, &ffs));
+
+  for (nf = 0; nf < 2; nf++) {
+
+    sprintf(argv, "%s %s", input, nf == 0 ? "text" : "binary");
+    dbg_err_if(ut_sim_dmc_handle(rank, nf, &handle, filename));
+
+    dbg_err_if(ffs_command_line_reset(ffs, argv));
+    dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_INIT));
+    dbg_err_if(proxy_state(proxy, SIM_STATE_INIT, handle));
+
+    for (n = 0; n < 10; n++) {
+      dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_RUN));
+    }
+
+    dbg_err_if(proxy_state(proxy, SIM_STATE_WRITE, handle));
+    dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
+    dbg_err_if(ffs_time(ffs, &tref));
+
+    for (n = 0; n < 100; n++) {
+      dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_RUN));
+    }
+    dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
+    dbg_err_if(ffs_time(ffs, &tnext));
+
+    dbg_err_if(proxy_state(proxy, SIM_STATE_READ, handle));
+    dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
+    dbg_err_if(ffs_time(ffs, &t));
+    dbg_err_if(t != tref);
+
+    for (n = 0; n < 100; n++) {
+      dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_RUN));
+    }
+    dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
+    dbg_err_if(ffs_time(ffs, &t));
+    dbg_err_if(t != tnext);
+
+    dbg_err_if((fp = fopen(filename, "rb")) == NULL);
+    dbg_err_if(fread(magic, 1, 4, fp) != 4);
+    fclose(fp);
+    fp = NULL;
+    dbg_err_if((strncmp(magic, "DMCS", 4) == 0) != (nf == 1));
+
+    if (nf == 1) {
+      dbg_err_if(proxy_state(proxy, SIM_STATE_READ, text));
+      dbg_err_if(proxy_state(proxy, SIM_STATE_DELETE, text));
+      dbg_err_if(proxy_state(proxy, SIM_STATE_DELETE, handle));
+    }
+
+    dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_FINISH));
+  }
+
+  dbg_err_if(proxy_delegate_free(proxy));
+  proxy_free(proxy);
+  MPI_Comm_free(&comm);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+  if (fp) fclose(fp);
+  if (proxy) proxy_free(proxy);
+  MPI_Comm_free(&comm);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
+
+/*****************************************************************************
+ *
+ *  ut_sim_dmc_engines
+ *
+ *  Two simulations in the same process are independent: each starts
+ *  from the initial state, and (with the same seed) follows the same
+ *  trajectory whatever the other does. Either may finish first.
+ *
+ *****************************************************************************/
+
+int ut_sim_dmc_engines(u_test_case_t * tc) {
+
+  ffs_t * ffs[2] = {NULL, NULL};
+  proxy_t * proxy[2] = {NULL, NULL};
+
+  int n, np;
+  int rank = 0;
+  int lambda[2];
+  double t[2];
+  MPI_Comm comm = MPI_COMM_NULL;
+
+  u_dbg("Start");
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_split(MPI_COMM_WORLD, rank, 0, &comm);
+
+  for (np = 0; np < 2; np++) {
+    dbg_err_if(proxy_create(rank, comm, &proxy[np]));
+    dbg_err_if(proxy_delegate_create(proxy[np], "dmc"));
+    dbg_err_if(proxy_ffs(proxy[np], &ffs[np]));
+    dbg_err_if(ffs_command_line_set(ffs[np], input));
+    dbg_err_if(proxy_execute(proxy[np], SIM_EXECUTE_INIT));
+    dbg_err_if(proxy_state(proxy[np], SIM_STATE_INIT, 0));
+  }
+
+  for (n = 0; n < 100; n++) {
+    dbg_err_if(proxy_execute(proxy[0], SIM_EXECUTE_RUN));
+  }
+
+  dbg_err_if(proxy_info(proxy[1], FFS_INFO_TIME_PUT));
+  dbg_err_if(ffs_time(ffs[1], &t[1]));
+  dbg_err_if(t[1] != 0.0);
+
+  for (n = 0; n < 100; n++) {
+    dbg_err_if(proxy_execute(proxy[1], SIM_EXECUTE_RUN));
+  }
+
+  for (np = 0; np < 2; np++) {
+    dbg_err_if(proxy_info(proxy[np], FFS_INFO_TIME_PUT));
+    dbg_err_if(proxy_info(proxy[np], FFS_INFO_LAMBDA_PUT));
+    dbg_err_if(ffs_time(ffs[np], &t[np]));
+    dbg_err_if(ffs_info_int(ffs[np], FFS_INFO_LAMBDA_FETCH, 1, &lambda[np]));
+  }
+
+  dbg_err_if(t[0] <= 0.0);
+  dbg_err_if(t[0] != t[1]);
+  dbg_err_if(lambda[0] != lambda[1]);
+
+  /* The second carries on after the first has gone */
+
+  dbg_err_if(proxy_execute(proxy[0], SIM_EXECUTE_FINISH));
+  dbg_err_if(proxy_delegate_free(proxy[0]));
+  proxy_free(proxy[0]);
+  proxy[0] = NULL;
+
+  dbg_err_if(proxy_execute(proxy[1], SIM_EXECUTE_RUN));
+  dbg_err_if(proxy_execute(proxy[1], SIM_EXECUTE_FINISH));
+  dbg_err_if(proxy_delegate_free(proxy[1]));
+  proxy_free(proxy[1]);
+  MPI_Comm_free(&comm);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+  if (proxy[0]) proxy_free(proxy[0]);
+  if (proxy[1]) proxy_free(proxy[1]);
+  MPI_Comm_free(&comm);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
+
+/*****************************************************************************
+ *
+ *  ut_sim_dmc_next
+ *
+ *  With the next reaction method, a state read back with the same
+ *  seed must continue in the same way each time, and a write part
+ *  way through must not change the trajectory, whether the state is
+ *  held in file or in memory. An unknown engine is an error.
+ *
+ *****************************************************************************/
+
+int ut_sim_dmc_next(u_test_case_t * tc) {
+
+  ffs_t * ffs = NULL;
+  proxy_t * proxy = NULL;
+
+  int n, nm, nw;
+  int rank = 0;
+  int seed = 37;
+  double tref, t;
+  double tnext[2];
+  ffs_handle_t handle;
+  ffs_handle_t handle2;
+  char argv[BUFSIZ];
+  MPI_Comm comm = MPI_COMM_NULL;
+
+  u_dbg("Start");
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_split(MPI_COMM_WORLD, rank, 0, &comm);
+  dbg_err_if(ut_sim_dmc_handle(rank, 0, &handle, NULL));
+  dbg_err_if(ut_sim_dmc_handle(rank, 1, &handle2, NULL));
+  sprintf(argv, "%s next", input);
+
+  for (nm = 0; nm < 2; nm++) {
+
+    dbg_err_if(proxy_create(rank, comm, &proxy));
+    dbg_err_if(proxy_delegate_create(proxy, "dmc"));
+    dbg_err_if(proxy_state_memory_set(proxy, nm));
+    dbg_err_if(proxy_ffs(proxy, &ffs));
+    dbg_err_if(ffs_command_line_set(ffs, argv));
+    dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_INIT));
+    dbg_err_if(proxy_state(proxy, SIM_STATE_INIT, handle));
+
+    for (n = 0; n < 10; n++) {
+      dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_RUN));
+    }
+
+    dbg_err_if(proxy_state(proxy, SIM_STATE_WRITE, handle));
+    dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
+    dbg_err_if(ffs_time(ffs, &tref));
+    dbg_err_if(tref <= 0.0);
+
+    for (nw = 0; nw < 2; nw++) {
+
+      dbg_err_if(proxy_state(proxy, SIM_STATE_READ, handle));
+      dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
+      dbg_err_if(ffs_time(ffs, &t));
+      dbg_err_if(t != tref);
+
+      dbg_err_if(proxy_cache_info_int(proxy, FFS_INFO_RNG_SEED_PUT, 1, &seed));
+      dbg_err_if(proxy_info(proxy, FFS_INFO_RNG_SEED_FETCH));
+
+      for (n = 0; n < 100; n++) {
+	if (nw == 1 && n == 50) {
+	  dbg_err_if(proxy_state(proxy, SIM_STATE_WRITE, handle2));
+	}
+	dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_RUN));
+      }
+      dbg_err_if(proxy_info(proxy, FFS_INFO_TIME_PUT));
+      dbg_err_if(ffs_time(ffs, &tnext[nw]));
+    }
+
+    dbg_err_if(tnext[0] <= tref);
+    dbg_err_if(tnext[1] != tnext[0]);
+
+    dbg_err_if(proxy_state(proxy, SIM_STATE_DELETE, handle));
+    dbg_err_if(proxy_state(proxy, SIM_STATE_DELETE, handle2));
+    dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_FINISH));
+    dbg_err_if(proxy_delegate_free(proxy));
+    proxy_free(proxy);
+    proxy = NULL;
+  }
+
+  /* Unknown engine */
+
+  sprintf(argv, "%s nextreaction", input);
+
+  dbg_err_if(proxy_create(rank, comm, &proxy));
+  dbg_err_if(proxy_delegate_create(proxy, "dmc"));
+  dbg_err_if(proxy_ffs(proxy, &ffs));
+  dbg_err_if(ffs_command_line_set(ffs, argv));
+  dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_INIT) == 0);
+  dbg_err_if(proxy_delegate_free(proxy));
+  proxy_free(proxy);
+  MPI_Comm_free(&comm);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+  if (proxy) proxy_free(proxy);
+  MPI_Comm_free(&comm);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
+
+/*****************************************************************************
+ *
+ *  ut_sim_dmc_handle
+ *
+ *  The states of each test rank are in a group of their own, so the
+ *  ranks do not share files. The file name (if wanted) is that of the
+ *  state for instance 0.
+ *
+ *****************************************************************************/
+
+static int ut_sim_dmc_handle(int rank, int id, ffs_handle_t * handle,
+			     char * filename) {
+
+  dbg_return_if(util_handle(rank, id, handle), -1);
+  if (filename) dbg_return_if(util_handle_stub(0, *handle, filename), -1);
+
+  return 0;
+}
@@ -12,9 +12,19 @@
 #define UT_SIM_DMC_TEST_NAME "Dynamic Monte Carlo (Gillespie) simulation test"
 #define UT_SIM_DMC_PROXY_TEST_NAME "DMC proxy commands"
 #define UT_SIM_DMC_INFO_TEST_NAME "DMC proxy data exchange"
+#define UT_SIM_DMC_MEMORY_TEST_NAME "DMC in-memory states"
+#define UT_SIM_DMC_SCRATCH_TEST_NAME "DMC scratch states"
+#define UT_SIM_DMC_FORMAT_TEST_NAME "DMC state file formats"
+#define UT_SIM_DMC_ENGINES_TEST_NAME "DMC independent engines"
+#define UT_SIM_DMC_NEXT_TEST_NAME "DMC next reaction method"
 
 int ut_sim_dmc(u_test_case_t * tc);
 int ut_sim_dmc_proxy(u_test_case_t * tc);
 int ut_sim_dmc_info(u_test_case_t * tc);
+int ut_sim_dmc_memory(u_test_case_t * tc);
+int ut_sim_dmc_scratch(u_test_case_t * tc);
+int ut_sim_dmc_format(u_test_case_t * tc);
+int ut_sim_dmc_engines(u_test_case_t * tc);
+int ut_sim_dmc_next(u_test_case_t * tc);
 
 #endif
@@ -6,6 +6,8 @@
  *
  *****************************************************************************/
 
+#include <string.h>
+
 #include "ffs_private.h"
 #include "ffs_util.h"
 #include "proxy.h"
@@ -137,3 +139,128 @@ int ut_sim_lmp_io(u_test_case_t * tc) {
   u_dbg("Failure\n");
   return U_TEST_FAILURE;
 }
+
+/*****************************************************************************
+ *
+ *  ut_sim_lmp_pack
+ *
+ *  An in-memory snapshot, once unpacked after a run, should pack to
+ *  exactly the same bytes.
+ *
+ *****************************************************************************/
+
+int ut_sim_lmp_pack(u_test_case_t * tc) {
+
+  sim_lmp_t * lammps = NULL;
+  ffs_t * ffs = NULL;
+  size_t nbytes = 0;
+  void * buf0 = NULL;
+  void * buf1 = NULL;
+  const char * argv =
+    "-in inputs/lmp_lj_test1.in -sc none -log logs/lmp_lj_test1.log";
+  const char * stub = "logs/lmp_lj_test1_pack";
+
+  u_dbg("Start");
+
+  dbg_err_if(ffs_create(MPI_COMM_WORLD, &ffs));
+  dbg_err_if(ffs_command_line_set(ffs, argv));
+
+  dbg_err_if(sim_lmp_create(&lammps));
+  dbg_err_if(sim_lmp_execute(lammps, ffs, SIM_EXECUTE_INIT));
+  dbg_err_if(sim_lmp_state(lammps, ffs, SIM_STATE_INIT, stub));
+
+  dbg_err_if(sim_lmp_state(lammps, ffs, SIM_STATE_PACK_SIZE, stub));
+  dbg_err_if(ffs_state_size(ffs, &nbytes));
+  dbg_err_if(nbytes == 0);
+
+  buf0 = u_calloc(1, nbytes);
+  buf1 = u_calloc(1, nbytes);
+  dbg_err_if(buf0 == NULL);
+  dbg_err_if(buf1 == NULL);
+
+  dbg_err_if(ffs_state_buffer_set(ffs, buf0, nbytes));
+  dbg_err_if(sim_lmp_state(lammps, ffs, SIM_STATE_PACK, stub));
+
+  dbg_err_if(sim_lmp_execute(lammps, ffs, SIM_EXECUTE_RUN));
+
+  dbg_err_if(sim_lmp_state(lammps, ffs, SIM_STATE_UNPACK, stub));
+  dbg_err_if(ffs_state_buffer_set(ffs, buf1, nbytes));
+  dbg_err_if(sim_lmp_state(lammps, ffs, SIM_STATE_PACK, stub));
+  dbg_err_if(memcmp(buf0, buf1, nbytes) != 0);
+
+  dbg_err_if(ffs_state_buffer_set(ffs, NULL, 0));
+  dbg_err_if(sim_lmp_execute(lammps, ffs, SIM_EXECUTE_FINISH));
+
+  u_free(buf1);
+  u_free(buf0);
+  sim_lmp_free(lammps);
+  ffs_free(ffs);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+  if (buf1) u_free(buf1);
+  if (buf0) u_free(buf0);
+  if (lammps) sim_lmp_free(lammps);
+  if (ffs) ffs_free(ffs);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
+
+/*****************************************************************************
+ *
+ *  ut_sim_lmp_lambda
+ *
+ *  Lambda bound to a compute (thermo_temp is always present), and a
+ *  variable which does not exist (an error).
+ *
+ *****************************************************************************/
+
+int ut_sim_lmp_lambda(u_test_case_t * tc) {
+
+  sim_lmp_t * lammps = NULL;
+  ffs_t * ffs = NULL;
+  double lambda = 0.0;
+  const char * argv =
+    "-in inputs/lmp_lj_test1.in -sc none -log logs/lmp_lj_test1.log";
+  const char * stub = "logs/lmp_lj_test1_lambda";
+
+  u_dbg("Start");
+
+  dbg_err_if(ffs_create(MPI_COMM_WORLD, &ffs));
+  dbg_err_if(ffs_command_line_set(ffs, argv));
+  dbg_err_if(ffs_lambda_name_set(ffs, "c_thermo_temp"));
+
+  dbg_err_if(sim_lmp_create(&lammps));
+  dbg_err_if(sim_lmp_execute(lammps, ffs, SIM_EXECUTE_INIT));
+  dbg_err_if(sim_lmp_state(lammps, ffs, SIM_STATE_INIT, stub));
+
+  dbg_err_if(sim_lmp_lambda(lammps, ffs));
+  dbg_err_if(ffs_lambda(ffs, &lambda));
+  dbg_err_if(lambda <= 0.0);
+
+  /* A new LAMMPS instance is required to execute the input again */
+
+  dbg_err_if(sim_lmp_execute(lammps, ffs, SIM_EXECUTE_FINISH));
+  dbg_err_if(sim_lmp_execute(lammps, ffs, SIM_EXECUTE_INIT));
+
+  dbg_err_if(ffs_lambda_name_set(ffs, "v_nonexistent"));
+  dbg_err_if(sim_lmp_state(lammps, ffs, SIM_STATE_INIT, stub) == 0);
+
+  dbg_err_if(sim_lmp_execute(lammps, ffs, SIM_EXECUTE_FINISH));
+
+  sim_lmp_free(lammps);
+  ffs_free(ffs);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+  if (lammps) sim_lmp_free(lammps);
+  if (ffs) ffs_free(ffs);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
@@ -12,9 +12,13 @@
 #define UT_SIM_LMP_NAME       "LAMMPS coupler"
 #define UT_SIM_LMP_INIT_NAME  "LAMMPS initialisation"
 #define UT_SIM_LMP_IO_NAME    "LAMMPS i/o test"
+#define UT_SIM_LMP_PACK_NAME  "LAMMPS in-memory state"
+#define UT_SIM_LMP_LAMBDA_NAME "LAMMPS lambda compute"
 
 int ut_sim_lmp(u_test_case_t * tc);
 int ut_sim_lmp_init(u_test_case_t * tc);
 int ut_sim_lmp_io(u_test_case_t * tc);
+int ut_sim_lmp_pack(u_test_case_t * tc);
+int ut_sim_lmp_lambda(u_test_case_t * tc);
 
 #endif
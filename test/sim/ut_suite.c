@@ -39,11 +39,18 @@ int uts_sim_register(u_test_t * t) {
   u_test_case_register(UT_SIM_DMC_TEST_NAME, ut_sim_dmc, ts);
   u_test_case_register(UT_SIM_DMC_PROXY_TEST_NAME, ut_sim_dmc_proxy, ts);
   u_test_case_register(UT_SIM_DMC_INFO_TEST_NAME, ut_sim_dmc_info, ts);
+  u_test_case_register(UT_SIM_DMC_MEMORY_TEST_NAME, ut_sim_dmc_memory, ts);
+  u_test_case_register(UT_SIM_DMC_SCRATCH_TEST_NAME, ut_sim_dmc_scratch, ts);
+  u_test_case_register(UT_SIM_DMC_FORMAT_TEST_NAME, ut_sim_dmc_format, ts);
+  u_test_case_register(UT_SIM_DMC_ENGINES_TEST_NAME, ut_sim_dmc_engines, ts);
+  u_test_case_register(UT_SIM_DMC_NEXT_TEST_NAME, ut_sim_dmc_next, ts);
 
 #ifdef HAVE_LAMMPS
   u_test_case_register(UT_SIM_LMP_NAME, ut_sim_lmp, ts);
   u_test_case_register(UT_SIM_LMP_INIT_NAME, ut_sim_lmp_init, ts);
   u_test_case_register(UT_SIM_LMP_IO_NAME, ut_sim_lmp_io, ts);
+  u_test_case_register(UT_SIM_LMP_PACK_NAME, ut_sim_lmp_pack, ts);
+  u_test_case_register(UT_SIM_LMP_LAMBDA_NAME, ut_sim_lmp_lambda, ts);
 
   u_test_case_depends_on(UT_SIM_LMP_INIT_NAME, UT_SIM_LMP_NAME, ts);
   u_test_case_depends_on(UT_SIM_LMP_IO_NAME, UT_SIM_LMP_INIT_NAME, ts);
@@ -6,11 +6,30 @@
  *
  *****************************************************************************/
 
+#include <dirent.h>
 #include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include "u/libu.h"
+#include "ffs_checkpoint.h"
 #include "ffs_control.h"
+#include "ffs_private.h"
 #include "ffs_util.h"
+#include "proxy.h"
+
+static int st_dmc_resume_run(const char * input1, const char * input2,
+			     const char * log, int nstop,
+			     ffs_result_summary_t * result);
+static int st_dmc_run(const char * input, const char * log,
+		      ffs_result_summary_t * result);
+static int st_dmc_cache_index(int * nindex, ino_t * ino);
+static int st_dmc_cache_clean(void);
+static int st_dmc_format_io(const char * format, double * tio,
+			    long int * nbytes);
+static int st_dmc_engine_run(const char * argv, int nstep, double * tsim,
+			     double * lmean, double * twall);
 
 /*****************************************************************************
  *
@@ -84,7 +103,11 @@ int st_dmc_branched(u_test_case_t * tc) {
 int st_dmc_direct(u_test_case_t * tc) {
 
   const char * input1 = "inputs/dmc_smoke3.inp";
+  const char * input2 = "inputs/dmc_smoke4.inp";
   const char * log1   = "logs/dmc-smoke3";
+  const char * log2   = "logs/dmc-smoke4";
+  const char * input3 = "inputs/dmc_smoke7.inp";
+  const char * log3   = "logs/dmc-smoke7";
 
   double f1, pab;
   ffs_result_summary_t * result = NULL;
@@ -103,7 +126,35 @@ int st_dmc_direct(u_test_case_t * tc) {
 
   dbg_err_if( ffs_result_summary_stat(result, &f1, &pab) );
   dbg_err_if( util_compare_double(f1,  2.3113490e-02, FLT_EPSILON) );
-  dbg_err_if( util_compare_double(pab, 1.0939857e-03, FLT_EPSILON) );
+  dbg_err_if( util_compare_double(pab, 7.7429880e-04, FLT_EPSILON) );
+
+  /* The same, with states moved by message */
+
+  dbg_err_if( ffs_control_create(MPI_COMM_WORLD, &ffs) );
+  dbg_err_if( ffs_control_start(ffs, log2) );
+  dbg_err_if( ffs_control_execute(ffs, input2) );
+  dbg_err_if( ffs_control_stop(ffs, result) );
+
+  ffs_control_free(ffs);
+  ffs = NULL;
+
+  dbg_err_if( ffs_result_summary_stat(result, &f1, &pab) );
+  dbg_err_if( util_compare_double(f1,  2.3113490e-02, FLT_EPSILON) );
+  dbg_err_if( util_compare_double(pab, 7.7429880e-04, FLT_EPSILON) );
+
+  /* The same, with states moved via aggregate MPI-IO files */
+
+  dbg_err_if( ffs_control_create(MPI_COMM_WORLD, &ffs) );
+  dbg_err_if( ffs_control_start(ffs, log3) );
+  dbg_err_if( ffs_control_execute(ffs, input3) );
+  dbg_err_if( ffs_control_stop(ffs, result) );
+
+  ffs_control_free(ffs);
+  ffs = NULL;
+
+  dbg_err_if( ffs_result_summary_stat(result, &f1, &pab) );
+  dbg_err_if( util_compare_double(f1,  2.3113490e-02, FLT_EPSILON) );
+  dbg_err_if( util_compare_double(pab, 7.7429880e-04, FLT_EPSILON) );
 
   ffs_result_summary_free(result);
   u_dbg("Success\n");
@@ -131,6 +182,8 @@ int st_dmc_rosenbluth(u_test_case_t * tc) {
   const char * input2 = "inputs/dmc_smoke6.inp";
   const char * log1   = "logs/dmc-smoke5";
   const char * log2   = "logs/dmc-smoke6";
+  const char * input3 = "inputs/dmc_smoke8.inp";
+  const char * log3   = "logs/dmc-smoke8";
 
   double f1, pab;
   ffs_result_summary_t * result = NULL;
@@ -163,6 +216,20 @@ int st_dmc_rosenbluth(u_test_case_t * tc) {
   dbg_err_if( util_compare_double(f1,  1.2106479e-02, FLT_EPSILON) );
   dbg_err_if( util_compare_double(pab, 1.7781842e-04, FLT_EPSILON) );
 
+  /* The same, with the successor chosen by reservoir sampling */
+
+  dbg_err_if( ffs_control_create(MPI_COMM_WORLD, &ffs) );
+  dbg_err_if( ffs_control_start(ffs, log3) );
+  dbg_err_if( ffs_control_execute(ffs, input3) );
+  dbg_err_if( ffs_control_stop(ffs, result) );
+
+  ffs_control_free(ffs);
+  ffs = NULL;
+
+  dbg_err_if( ffs_result_summary_stat(result, &f1, &pab) );
+  dbg_err_if( util_compare_double(f1,  1.2106479e-02, FLT_EPSILON) );
+  dbg_err_if( util_compare_double(pab, 4.1152263e-03, FLT_EPSILON) );
+
   ffs_result_summary_free(result);
   u_dbg("Success\n");
 
@@ -176,3 +243,641 @@ int st_dmc_rosenbluth(u_test_case_t * tc) {
 
   return U_TEST_FAILURE;
 }
+
+/*****************************************************************************
+ *
+ *  st_dmc_resume
+ *
+ *  Runs are stopped after a number of checkpoints, and then resumed.
+ *  The result must be the reference wherever the run was stopped.
+ *
+ *  Direct FFS (dmc_smoke3.inp) is stopped between interfaces, and
+ *  the branched (dmc_smoke1.inp) and Rosenbluth (dmc_smoke6.inp)
+ *  methods between trees. The tree references hold on one rank;
+ *  on more, the result depends on the decomposition, so is compared
+ *  with that of an uninterrupted run.
+ *
+ *****************************************************************************/
+
+int st_dmc_resume(u_test_case_t * tc) {
+
+  const char * input1 = "inputs/dmc_resume1.inp";
+  const char * input2 = "inputs/dmc_resume2.inp";
+  const char * input3 = "inputs/dmc_resume3.inp";
+  const char * input4 = "inputs/dmc_resume4.inp";
+  const char * input5 = "inputs/dmc_resume5.inp";
+  const char * input6 = "inputs/dmc_resume6.inp";
+  const char * log    = "logs/dmc-resume";
+
+  int n;
+  int nproc;
+  int nstop[3] = {2, 7, 12};
+  int ntree[2] = {2, 8};
+  double f1, pab;
+  double f1ref, pabref;
+  ffs_result_summary_t * result = NULL;
+
+  u_dbg("Start");
+  dbg_err_if( ffs_result_summary_create(&result) );
+  MPI_Comm_size(MPI_COMM_WORLD, &nproc);
+
+  for (n = 0; n < 3; n++) {
+    dbg_err_if( st_dmc_resume_run(input1, input2, log, nstop[n], result) );
+    dbg_err_if( ffs_result_summary_stat(result, &f1, &pab) );
+    dbg_err_if( util_compare_double(f1,  2.3113490e-02, FLT_EPSILON) );
+    dbg_err_if( util_compare_double(pab, 7.7429880e-04, FLT_EPSILON) );
+  }
+
+  /* Branched */
+
+  f1ref = 9.0845812e-03;
+  pabref = 1.1940658e-02;
+
+  if (nproc > 1) {
+    dbg_err_if( st_dmc_run("inputs/dmc_smoke1.inp", log, result) );
+    dbg_err_if( ffs_result_summary_stat(result, &f1ref, &pabref) );
+  }
+
+  for (n = 0; n < 2; n++) {
+    dbg_err_if( st_dmc_resume_run(input3, input4, log, ntree[n], result) );
+    dbg_err_if( ffs_result_summary_stat(result, &f1, &pab) );
+    dbg_err_if( util_compare_double(f1,  f1ref,  FLT_EPSILON) );
+    dbg_err_if( util_compare_double(pab, pabref, FLT_EPSILON) );
+  }
+
+  /* Rosenbluth */
+
+  f1ref = 1.2106479e-02;
+  pabref = 1.7781842e-04;
+
+  if (nproc > 1) {
+    dbg_err_if( st_dmc_run("inputs/dmc_smoke6.inp", log, result) );
+    dbg_err_if( ffs_result_summary_stat(result, &f1ref, &pabref) );
+  }
+
+  for (n = 0; n < 2; n++) {
+    dbg_err_if( st_dmc_resume_run(input5, input6, log, ntree[n], result) );
+    dbg_err_if( ffs_result_summary_stat(result, &f1, &pab) );
+    dbg_err_if( util_compare_double(f1,  f1ref,  FLT_EPSILON) );
+    dbg_err_if( util_compare_double(pab, pabref, FLT_EPSILON) );
+  }
+
+  ffs_result_summary_free(result);
+  u_dbg("Success\n");
+
+  return U_TEST_SUCCESS;
+
+ err:
+
+  if (result) ffs_result_summary_free(result);
+  u_dbg("Failure\n");
+
+  return U_TEST_FAILURE;
+}
+
+/*****************************************************************************
+ *
+ *  st_dmc_run
+ *
+ *  A single run of the given input.
+ *
+ *****************************************************************************/
+
+static int st_dmc_run(const char * input, const char * log,
+		      ffs_result_summary_t * result) {
+
+  ffs_control_t * ffs = NULL;
+
+  dbg_err_if( ffs_control_create(MPI_COMM_WORLD, &ffs) );
+  dbg_err_if( ffs_control_start(ffs, log) );
+  dbg_err_if( ffs_control_execute(ffs, input) );
+  dbg_err_if( ffs_control_stop(ffs, result) );
+  ffs_control_free(ffs);
+
+  return 0;
+
+ err:
+
+  if (ffs) ffs_control_free(ffs);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  st_dmc_resume_run
+ *
+ *  Run input1 (with checkpoints) until nstop checkpoints have been
+ *  written, as if killed there, and then input2 (with resume) to the
+ *  end. The checkpoint must be present between the two, and gone
+ *  at the end. The result is that of the second run.
+ *
+ *****************************************************************************/
+
+static int st_dmc_resume_run(const char * input1, const char * input2,
+			     const char * log, int nstop,
+			     ffs_result_summary_t * result) {
+  int rank;
+  int present;
+  char filename[FILENAME_MAX];
+  ffs_control_t * ffs = NULL;
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  dbg_err_if( ffs_checkpoint_filename(0, rank, filename) );
+
+  /* The stopped run may, or may not, report a failure */
+
+  dbg_err_if( ffs_checkpoint_stop_set(nstop) );
+  dbg_err_if( ffs_control_create(MPI_COMM_WORLD, &ffs) );
+  dbg_err_if( ffs_control_start(ffs, log) );
+  ffs_control_execute(ffs, input1);
+  ffs_control_free(ffs);
+  ffs = NULL;
+  dbg_err_if( ffs_checkpoint_stop_set(0) );
+
+  dbg_err_if( ffs_checkpoint_present(filename, MPI_COMM_WORLD, &present) );
+  dbg_err_if( present == 0 );
+
+  dbg_err_if( ffs_control_create(MPI_COMM_WORLD, &ffs) );
+  dbg_err_if( ffs_control_start(ffs, log) );
+  dbg_err_if( ffs_control_execute(ffs, input2) );
+  dbg_err_if( ffs_control_stop(ffs, result) );
+  ffs_control_free(ffs);
+  ffs = NULL;
+
+  dbg_err_if( ffs_checkpoint_present(filename, MPI_COMM_WORLD, &present) );
+  dbg_err_if( present != 0 );
+
+  return 0;
+
+ err:
+
+  ffs_checkpoint_stop_set(0);
+  if (ffs) ffs_control_free(ffs);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  st_dmc_cache
+ *
+ *  dmc_smoke3.inp with a cache of the states at the first interface.
+ *  The first run fills the cache, and the second takes the states
+ *  from it; both must give the dmc_smoke3.inp reference. A hit does
+ *  not write the index file again (a new index replaces the old by
+ *  rename, so would have a new inode). A different init_teq, and a
+ *  different seed, must each miss, so start a new index.
+ *
+ *  The cache files are removed at the start and at the end.
+ *
+ *****************************************************************************/
+
+int st_dmc_cache(u_test_case_t * tc) {
+
+  const char * input1 = "inputs/dmc_cache1.inp";
+  const char * input2 = "inputs/dmc_cache2.inp";
+  const char * input3 = "inputs/dmc_cache3.inp";
+  const char * log    = "logs/dmc-cache";
+
+  int nindex;
+  ino_t ino[2];
+  double f1, pab;
+  ffs_result_summary_t * result = NULL;
+
+  u_dbg("Start");
+  dbg_err_if( ffs_result_summary_create(&result) );
+  dbg_err_if( st_dmc_cache_clean() );
+
+  /* Fill the cache */
+
+  dbg_err_if( st_dmc_run(input1, log, result) );
+  dbg_err_if( ffs_result_summary_stat(result, &f1, &pab) );
+  dbg_err_if( util_compare_double(f1,  2.3113490e-02, FLT_EPSILON) );
+  dbg_err_if( util_compare_double(pab, 7.7429880e-04, FLT_EPSILON) );
+
+  dbg_err_if( st_dmc_cache_index(&nindex, ino) );
+  dbg_err_if( nindex != 1 );
+
+  /* Hit */
+
+  dbg_err_if( st_dmc_run(input1, log, result) );
+  dbg_err_if( ffs_result_summary_stat(result, &f1, &pab) );
+  dbg_err_if( util_compare_double(f1,  2.3113490e-02, FLT_EPSILON) );
+  dbg_err_if( util_compare_double(pab, 7.7429880e-04, FLT_EPSILON) );
+
+  dbg_err_if( st_dmc_cache_index(&nindex, ino + 1) );
+  dbg_err_if( nindex != 1 );
+  dbg_err_if( ino[1] != ino[0] );
+
+  /* Misses */
+
+  dbg_err_if( st_dmc_run(input2, log, result) );
+  dbg_err_if( st_dmc_cache_index(&nindex, ino) );
+  dbg_err_if( nindex != 2 );
+
+  dbg_err_if( st_dmc_run(input3, log, result) );
+  dbg_err_if( st_dmc_cache_index(&nindex, ino) );
+  dbg_err_if( nindex != 3 );
+
+  dbg_err_if( st_dmc_cache_clean() );
+  ffs_result_summary_free(result);
+  u_dbg("Success\n");
+
+  return U_TEST_SUCCESS;
+
+ err:
+
+  st_dmc_cache_clean();
+  if (result) ffs_result_summary_free(result);
+  u_dbg("Failure\n");
+
+  return U_TEST_FAILURE;
+}
+
+/*****************************************************************************
+ *
+ *  st_dmc_cache_index
+ *
+ *  Count this rank's cache index files ("cacheXXXXXXXX.rankNNNN"; the
+ *  state files have "-n" after the hash) in the working directory.
+ *  The inode returned is that of the last one found.
+ *
+ *****************************************************************************/
+
+static int st_dmc_cache_index(int * nindex, ino_t * ino) {
+
+  int rank;
+  size_t len;
+  char tail[FILENAME_MAX];
+  struct stat sb;
+  DIR * dir = NULL;
+  struct dirent * entry = NULL;
+
+  dbg_return_if(nindex == NULL, -1);
+  dbg_return_if(ino == NULL, -1);
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  dbg_err_if(snprintf(tail, FILENAME_MAX, ".rank%4.4d", rank) >= FILENAME_MAX);
+  len = strlen("cache") + 8 + strlen(tail);
+
+  *nindex = 0;
+  *ino = 0;
+
+  dir = opendir(".");
+  dbg_err_sif(dir == NULL);
+
+  while ((entry = readdir(dir))) {
+    if (strlen(entry->d_name) != len) continue;
+    if (strncmp(entry->d_name, "cache", strlen("cache")) != 0) continue;
+    if (strcmp(entry->d_name + len - strlen(tail), tail) != 0) continue;
+    dbg_err_sif(stat(entry->d_name, &sb) != 0);
+    *nindex += 1;
+    *ino = sb.st_ino;
+  }
+
+  closedir(dir);
+
+  return 0;
+
+ err:
+
+  if (dir) closedir(dir);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  st_dmc_cache_clean
+ *
+ *  Remove all the cache files ("cache*.rankNNNN") in the working
+ *  directory. The state files are named for the rank in the proxy,
+ *  not in the instance, so one rank removes the lot.
+ *
+ *****************************************************************************/
+
+static int st_dmc_cache_clean(void) {
+
+  int rank;
+  int ifail = 0;
+  DIR * dir = NULL;
+  struct dirent * entry = NULL;
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Barrier(MPI_COMM_WORLD);
+
+  if (rank == 0) {
+    dir = opendir(".");
+    ifail = (dir == NULL);
+    while (dir && (entry = readdir(dir))) {
+      if (strncmp(entry->d_name, "cache", strlen("cache")) != 0) continue;
+      if (strstr(entry->d_name, ".rank") == NULL) continue;
+      ifail += remove(entry->d_name);
+    }
+    if (dir) closedir(dir);
+  }
+
+  MPI_Bcast(&ifail, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+  return (ifail == 0) ? 0 : -1;
+}
+
+/*****************************************************************************
+ *
+ *  st_dmc_format
+ *
+ *  dmc_smoke1.inp with states in files, first in text and then in
+ *  binary format. The result must be the same in either format (on
+ *  one rank it must also be the dmc_smoke1.inp reference; on more,
+ *  the branched result depends on the decomposition).
+ *
+ *  The binary state file must be smaller than the text one. The run
+ *  times, and the cost of a state write and read alone, are reported
+ *  for information only: for a network this small, opening and
+ *  closing the file costs more than either format, and the Gillespie
+ *  steps dominate the run, so no speedup is asserted.
+ *
+ *****************************************************************************/
+
+int st_dmc_format(u_test_case_t * tc) {
+
+  const char * input[2] = {"inputs/dmc_format1.inp", "inputs/dmc_format2.inp"};
+  const char * log[2]   = {"logs/dmc-format1", "logs/dmc-format2"};
+  const char * format[2] = {"text", "binary"};
+
+  int n;
+  int rank, nproc;
+  long int nbytes[2];
+  double f1[2], pab[2];
+  double t[2];
+  double tio[2];
+  ffs_result_summary_t * result = NULL;
+  ffs_control_t * ffs = NULL;
+
+  u_dbg("Start");
+  dbg_err_if( ffs_result_summary_create(&result) );
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nproc);
+
+  for (n = 0; n < 2; n++) {
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    t[n] = MPI_Wtime();
+
+    dbg_err_if( ffs_control_create(MPI_COMM_WORLD, &ffs) );
+    dbg_err_if( ffs_control_start(ffs, log[n]) );
+    dbg_err_if( ffs_control_execute(ffs, input[n]) );
+    dbg_err_if( ffs_control_stop(ffs, result) );
+
+    ffs_control_free(ffs);
+    ffs = NULL;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    t[n] = MPI_Wtime() - t[n];
+
+    dbg_err_if( ffs_result_summary_stat(result, &f1[n], &pab[n]) );
+    dbg_err_if( st_dmc_format_io(format[n], &tio[n], &nbytes[n]) );
+  }
+
+  dbg_err_if( util_compare_double(f1[1],  f1[0],  FLT_EPSILON) );
+  dbg_err_if( util_compare_double(pab[1], pab[0], FLT_EPSILON) );
+
+  if (nproc == 1) {
+    dbg_err_if( util_compare_double(f1[0],  9.0845812e-03, FLT_EPSILON) );
+    dbg_err_if( util_compare_double(pab[0], 1.1940658e-02, FLT_EPSILON) );
+  }
+
+  dbg_err_if( nbytes[1] >= nbytes[0] );
+
+  if (rank == 0) {
+    printf("DMC state files: size       text %8ld B binary %8ld B\n",
+	   nbytes[0], nbytes[1]);
+    printf("DMC state files: run time   text %8.3f s binary %8.3f s\n",
+	   t[0], t[1]);
+    printf("DMC state files: write+read text %8.2e s binary %8.2e s\n",
+	   tio[0], tio[1]);
+  }
+
+  ffs_result_summary_free(result);
+  u_dbg("Success\n");
+
+  return U_TEST_SUCCESS;
+
+ err:
+
+  if (result) ffs_result_summary_free(result);
+  if (ffs) ffs_control_free(ffs);
+  u_dbg("Failure\n");
+
+  return U_TEST_FAILURE;
+}
+
+/*****************************************************************************
+ *
+ *  st_dmc_format_io
+ *
+ *  Mean time for one write and read of a state file via the proxy
+ *  for the dmc_smoke1.inp network, and the size of the file.
+ *
+ *  Two states are used in turn, so that the proxy can never skip the
+ *  read or write as a repeat of the last; every operation is real.
+ *
+ *****************************************************************************/
+
+static int st_dmc_format_io(const char * format, double * tio,
+			    long int * nbytes) {
+
+  const int nrep = 1000;
+  const char * network =
+    "inputs/dmc_switch1_comp.dat inputs/dmc_switch1_react.dat";
+
+  int n;
+  int rank;
+  int nclean0, nclean;
+  double t;
+  char argv[BUFSIZ];
+  char stub[FILENAME_MAX];
+  ffs_handle_t handle[2];
+  ffs_t * ffs = NULL;
+  FILE * fp = NULL;
+  proxy_t * proxy = NULL;
+  MPI_Comm comm = MPI_COMM_NULL;
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_split(MPI_COMM_WORLD, rank, 0, &comm);
+
+  sprintf(argv, "%s %s", network, format);
+  dbg_err_if(util_handle(rank, 0, &handle[0]));
+  dbg_err_if(util_handle(rank, 1, &handle[1]));
+  dbg_err_if(util_handle_stub(0, handle[0], stub));
+
+  dbg_err_if(proxy_create(rank, comm, &proxy));
+  dbg_err_if(proxy_delegate_create(proxy, "dmc"));
+  dbg_err_if(proxy_state_memory_set(proxy, 0));
+  dbg_err_if(proxy_ffs(proxy, &ffs));
+  dbg_err_if(ffs_command_line_set(ffs, argv));
+  dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_INIT));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_INIT, handle[0]));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_WRITE, handle[1]));
+  dbg_err_if(proxy_state_nclean(proxy, &nclean0));
+
+  t = MPI_Wtime();
+
+  for (n = 0; n < nrep; n++) {
+    dbg_err_if(proxy_state(proxy, SIM_STATE_WRITE, handle[0]));
+    dbg_err_if(proxy_state(proxy, SIM_STATE_READ, handle[1]));
+  }
+
+  *tio = (MPI_Wtime() - t) / nrep;
+
+  dbg_err_if(proxy_state_nclean(proxy, &nclean));
+  dbg_err_if(nclean != nclean0);
+
+  fp = fopen(stub, "rb");
+  dbg_err_if(fp == NULL);
+  dbg_err_sif(fseek(fp, 0, SEEK_END));
+  dbg_err_sif((*nbytes = ftell(fp)) < 0);
+  fclose(fp);
+  fp = NULL;
+
+  dbg_err_if(proxy_state(proxy, SIM_STATE_DELETE, handle[0]));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_DELETE, handle[1]));
+  dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_FINISH));
+  dbg_err_if(proxy_delegate_free(proxy));
+  proxy_free(proxy);
+  MPI_Comm_free(&comm);
+
+  return 0;
+
+ err:
+
+  if (fp) fclose(fp);
+  if (proxy) proxy_free(proxy);
+  MPI_Comm_free(&comm);
+
+  return -1;
+}
+
+/*****************************************************************************
+ *
+ *  st_dmc_engine
+ *
+ *  The direct method and the next reaction method for the same number
+ *  of steps on each of the dmc_switch networks. The trajectories are
+ *  different, but the mean simulated time per step, and the mean order
+ *  parameter, must agree to within the statistical error (which is
+ *  generous here). The elapsed times are reported.
+ *
+ *  The networks are bistable, so a fair comparison needs long runs;
+ *  this is only registered if FFS_TEST_BENCHMARK is set.
+ *
+ *****************************************************************************/
+
+int st_dmc_engine(u_test_case_t * tc) {
+
+  const int nstep = 1000000;
+  const char * network[2] = {
+    "inputs/dmc_switch1_comp.dat inputs/dmc_switch1_react.dat",
+    "inputs/dmc_switch2_comp.dat inputs/dmc_switch2_react.dat"};
+  const char * engine[2] = {"direct", "next"};
+
+  int n, m;
+  int rank;
+  char argv[BUFSIZ];
+  double tsim[2], lmean[2], twall[2];
+
+  u_dbg("Start");
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  for (n = 0; n < 2; n++) {
+
+    for (m = 0; m < 2; m++) {
+      sprintf(argv, "%s %s", network[n], engine[m]);
+      dbg_err_if( st_dmc_engine_run(argv, nstep, &tsim[m], &lmean[m],
+				    &twall[m]) );
+    }
+
+    dbg_err_if( util_compare_double(tsim[1]/tsim[0], 1.0, 0.1) );
+    dbg_err_if( util_compare_double(lmean[1]/lmean[0], 1.0, 0.1) );
+
+    if (rank == 0) {
+      printf("DMC engine switch%d: direct %8.3f s next %8.3f s "
+	     "(speedup %5.2f)\n", n + 1, twall[0], twall[1],
+	     twall[0]/twall[1]);
+      printf("DMC engine switch%d: time/step %10.4e %10.4e "
+	     "mean lambda %8.3f %8.3f\n", n + 1, tsim[0]/nstep,
+	     tsim[1]/nstep, lmean[0], lmean[1]);
+    }
+  }
+
+  u_dbg("Success\n");
+
+  return U_TEST_SUCCESS;
+
+ err:
+
+  u_dbg("Failure\n");
+
+  return U_TEST_FAILURE;
+}
+
+/*****************************************************************************
+ *
+ *  st_dmc_engine_run
+ *
+ *  Run nstep steps from the initial state (each rank independently).
+ *  The order parameter is sampled every step.
+ *
+ *****************************************************************************/
+
+static int st_dmc_engine_run(const char * argv, int nstep, double * tsim,
+			     double * lmean, double * twall) {
+
+  int n;
+  int rank;
+  int lambda;
+  double lsum = 0.0;
+  ffs_t * ffs = NULL;
+  proxy_t * proxy = NULL;
+  MPI_Comm comm = MPI_COMM_NULL;
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_split(MPI_COMM_WORLD, rank, 0, &comm);
+
+  dbg_err_if(proxy_create(rank, comm, &proxy));
+  dbg_err_if(proxy_delegate_create(proxy, "dmc"));
+  dbg_err_if(proxy_ffs(proxy, &ffs));
+  dbg_err_if(ffs_command_line_set(ffs, argv));
+  dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_INIT));
+  dbg_err_if(proxy_state(proxy, SIM_STATE_INIT, 0));
+
+  *twall = MPI_Wtime();
+
+  for (n = 0; n < nstep; n++) {
+    dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_RUN));
+    dbg_err_if(proxy_lambda(proxy));
+    dbg_err_if(ffs_info_int(ffs, FFS_INFO_LAMBDA_FETCH, 1, &lambda));
+    lsum += lambda;
+  }
+
+  *twall = MPI_Wtime() - *twall;
+  *lmean = lsum/nstep;
+  dbg_err_if(ffs_time(ffs, tsim));
+
+  dbg_err_if(proxy_execute(proxy, SIM_EXECUTE_FINISH));
+  dbg_err_if(proxy_delegate_free(proxy));
+  proxy_free(proxy);
+  MPI_Comm_free(&comm);
+
+  return 0;
+
+ err:
+
+  if (proxy) proxy_free(proxy);
+  MPI_Comm_free(&comm);
+
+  return -1;
+}
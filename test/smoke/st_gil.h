@@ -12,5 +12,9 @@
 int st_dmc_branched(u_test_case_t * tc);
 int st_dmc_direct(u_test_case_t * tc);
 int st_dmc_rosenbluth(u_test_case_t * tc);
+int st_dmc_resume(u_test_case_t * tc);
+int st_dmc_cache(u_test_case_t * tc);
+int st_dmc_format(u_test_case_t * tc);
+int st_dmc_engine(u_test_case_t * tc);
 
 #endif
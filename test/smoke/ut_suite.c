@@ -8,6 +8,8 @@
  *
  *****************************************************************************/
 
+#include <stdlib.h>
+
 #include "u/libu.h"
 
 #include "st_gil.h"
@@ -29,6 +31,16 @@ int u_test_suite_smoke_register(u_test_t * t) {
   u_test_case_register("DMC smoke test branched", st_dmc_branched, ts);
   u_test_case_register("DMC smoke test direct", st_dmc_direct, ts);
   u_test_case_register("DMC smoke test Rosenbluth", st_dmc_rosenbluth, ts);
+  u_test_case_register("DMC smoke test resume", st_dmc_resume, ts);
+  u_test_case_register("DMC smoke test cache", st_dmc_cache, ts);
+  u_test_case_register("DMC state format benchmark", st_dmc_format, ts);
+
+  /* The engine benchmark takes long runs to compare the engines
+   * fairly, so is only run on request */
+
+  if (getenv("FFS_TEST_BENCHMARK")) {
+    u_test_case_register("DMC engine benchmark", st_dmc_engine, ts);
+  }
 
   return u_test_suite_add(ts, t);
 }
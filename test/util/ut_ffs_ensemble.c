@@ -0,0 +1,196 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_ensemble.c
+ *
+ *  Unit tests
+ *
+ *****************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+
+#include "u/libu.h"
+#include "ffs_ensemble.h"
+#include "ut_ffs_ensemble.h"
+
+#define UT_NMEMBER 10
+#define UT_NKEEP    4
+#define UT_NREPEAT  10000
+
+/*****************************************************************************
+ *
+ *  ut_ffs_ensemble
+ *
+ *  Members have weights 1, ..., 10 (total 55). Keeping 4 gives a
+ *  spacing of 13.75, larger than any weight, so member i must be
+ *  kept with probability i/13.75.
+ *
+ *****************************************************************************/
+
+int ut_ffs_ensemble(u_test_case_t * tc) {
+
+  int n, nrep;
+  int ndrop;
+  int seen[UT_NMEMBER + 1];
+  int nkept[UT_NMEMBER + 1];
+  double sumwt;
+  ranlcg_t * ran = NULL;
+  ffs_ensemble_t * ens = NULL;
+
+  u_dbg("Start");
+
+  dbg_err_if(ranlcg_create(17, &ran));
+
+  for (n = 0; n <= UT_NMEMBER; n++) {
+    nkept[n] = 0;
+  }
+
+  for (nrep = 0; nrep < UT_NREPEAT; nrep++) {
+
+    dbg_err_if(ffs_ensemble_create(UT_NMEMBER, &ens));
+    for (n = 0; n < UT_NMEMBER; n++) {
+      ens->traj[n] = n + 1;
+      ens->wt[n] = n + 1;
+      ens->owner[n] = n % 2;
+    }
+    ens->nsuccess = UT_NMEMBER;
+
+    dbg_err_if(ffs_ensemble_subsample(ens, UT_NKEEP, ran, &ndrop));
+    dbg_err_if(ens->nsuccess > UT_NKEEP);
+    dbg_err_if(ens->nsuccess + ndrop != UT_NMEMBER);
+
+    /* The total weight is kept, and every member appears once, with
+     * the kept ones in their original order */
+
+    dbg_err_if(ffs_ensemble_sumwt(ens, &sumwt));
+    dbg_err_if(fabs(sumwt - 55.0) > 1.0e-10);
+
+    for (n = 0; n <= UT_NMEMBER; n++) {
+      seen[n] = 0;
+    }
+    for (n = 0; n < UT_NMEMBER; n++) {
+      dbg_err_if(ens->traj[n] < 1 || ens->traj[n] > UT_NMEMBER);
+      dbg_err_if(ens->owner[n] != (ens->traj[n] - 1) % 2);
+      seen[ens->traj[n]] += 1;
+    }
+    for (n = 1; n <= UT_NMEMBER; n++) {
+      dbg_err_if(seen[n] != 1);
+    }
+    for (n = 1; n < ens->nsuccess; n++) {
+      dbg_err_if(ens->traj[n] <= ens->traj[n-1]);
+    }
+    for (n = 0; n < ens->nsuccess; n++) {
+      nkept[ens->traj[n]] += 1;
+    }
+
+    ffs_ensemble_free(ens);
+    ens = NULL;
+  }
+
+  for (n = 1; n <= UT_NMEMBER; n++) {
+    dbg_err_if(fabs(1.0*nkept[n]/UT_NREPEAT - n/13.75) > 0.02);
+  }
+
+  /* No more members than required is no action */
+
+  dbg_err_if(ffs_ensemble_create(UT_NKEEP, &ens));
+  for (n = 0; n < UT_NKEEP; n++) {
+    ens->traj[n] = n;
+    ens->wt[n] = 2.0;
+  }
+  ens->nsuccess = UT_NKEEP;
+
+  dbg_err_if(ffs_ensemble_subsample(ens, UT_NKEEP, ran, &ndrop));
+  dbg_err_if(ndrop != 0);
+  dbg_err_if(ens->nsuccess != UT_NKEEP);
+  dbg_err_if(ens->wt[0] != 2.0);
+
+  ffs_ensemble_free(ens);
+  ranlcg_free(ran);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+
+  if (ens) ffs_ensemble_free(ens);
+  if (ran) ranlcg_free(ran);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
+
+/*****************************************************************************
+ *
+ *  ut_ffs_ensemble_compact
+ *
+ *  As at a direct FFS close-up beyond the first interface: members
+ *  carry non-unit weights, the excess is marked by a trajectory id
+ *  of -1, and the rest are compacted and subsampled. The weights,
+ *  and not the ids, must follow each member, and the kept weights
+ *  must sum to the total of the compacted ensemble.
+ *
+ *****************************************************************************/
+
+int ut_ffs_ensemble_compact(u_test_case_t * tc) {
+
+  int n;
+  int ndrop;
+  double sumwt, sumwt0;
+  ranlcg_t * ran = NULL;
+  ffs_ensemble_t * list = NULL;
+  ffs_ensemble_t * ens = NULL;
+
+  u_dbg("Start");
+
+  dbg_err_if(ranlcg_create(23, &ran));
+  dbg_err_if(ffs_ensemble_create(UT_NMEMBER, &list));
+  dbg_err_if(ffs_ensemble_create(UT_NMEMBER - 2, &ens));
+
+  for (n = 0; n < UT_NMEMBER; n++) {
+    list->traj[n] = 100 + n;
+    list->wt[n] = 0.25*(n + 1);
+    list->owner[n] = n % 3;
+  }
+  list->nsuccess = UT_NMEMBER;
+  list->traj[0] = -1;
+  list->traj[5] = -1;
+
+  dbg_err_if(ffs_ensemble_compact(list, ens));
+  dbg_err_if(ens->nsuccess != UT_NMEMBER - 2);
+
+  sumwt0 = 0.0;
+  for (n = 0; n < ens->nsuccess; n++) {
+    dbg_err_if(ens->traj[n] == -1);
+    dbg_err_if(ens->wt[n] != 0.25*(ens->traj[n] - 100 + 1));
+    dbg_err_if(ens->owner[n] != (ens->traj[n] - 100) % 3);
+    sumwt0 += ens->wt[n];
+  }
+  dbg_err_if(fabs(sumwt0 - 0.25*(55 - 1 - 6)) > 1.0e-10);
+
+  dbg_err_if(ffs_ensemble_subsample(ens, UT_NKEEP, ran, &ndrop));
+  dbg_err_if(ens->nsuccess > UT_NKEEP);
+  dbg_err_if(ffs_ensemble_sumwt(ens, &sumwt));
+  dbg_err_if(fabs(sumwt - sumwt0) > 1.0e-10);
+
+  /* Too many live members for the destination is an error */
+
+  ens->nmax = 2;
+  dbg_err_if(ffs_ensemble_compact(list, ens) == 0);
+
+  ffs_ensemble_free(ens);
+  ffs_ensemble_free(list);
+  ranlcg_free(ran);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+
+  if (ens) ffs_ensemble_free(ens);
+  if (list) ffs_ensemble_free(list);
+  if (ran) ranlcg_free(ran);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
@@ -0,0 +1,27 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_ensemble.h
+ *
+ *****************************************************************************/
+
+#ifndef UT_FFS_ENSEMBLE_H
+#define UT_FFS_ENSEMBLE_H
+
+/**
+ *  \ingroup unit
+ * \{
+ *
+ */
+
+#define UT_FFS_ENSEMBLE_NAME "Ensemble subsampling tests"
+
+#define UT_FFS_ENSEMBLE_COMPACT_NAME "Ensemble compact and weight tests"
+
+int ut_ffs_ensemble(u_test_case_t * tc);
+int ut_ffs_ensemble_compact(u_test_case_t * tc);
+
+/**
+ * \}
+ */
+
+#endif
@@ -0,0 +1,139 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_writer.c
+ *
+ *  Unit tests
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "u/libu.h"
+#include "ffs_writer.h"
+#include "ut_ffs_writer.h"
+
+#define UT_NFILE 20
+
+/*****************************************************************************
+ *
+ *  ut_ffs_writer
+ *
+ *  The queue is shorter than the number of requests, so the caller
+ *  must wait for the writer at some point.
+ *
+ *****************************************************************************/
+
+int ut_ffs_writer(u_test_case_t * tc) {
+
+  int n, m;
+  int rank;
+  int * buf = NULL;
+  void * vbuf = NULL;
+  size_t nbytes;
+  int data[UT_NFILE];
+  char filename[BUFSIZ];
+  FILE * fp = NULL;
+  ffs_writer_t * writer = NULL;
+
+  u_dbg("Start");
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  dbg_err_if(ffs_writer_create(0, &writer) == 0);
+  dbg_err_if(ffs_writer_create(2, &writer));
+
+  for (n = 0; n < UT_NFILE; n++) {
+    buf = u_calloc(UT_NFILE, sizeof(int));
+    dbg_err_if(buf == NULL);
+    for (m = 0; m < UT_NFILE; m++) buf[m] = n*m;
+    sprintf(filename, "logs/ut_writer-%d-%d", rank, n);
+    dbg_err_if(ffs_writer_write(writer, filename, buf, UT_NFILE*sizeof(int)));
+  }
+
+  dbg_err_if(ffs_writer_flush(writer));
+
+  for (n = 0; n < UT_NFILE; n++) {
+    sprintf(filename, "logs/ut_writer-%d-%d", rank, n);
+    dbg_err_if((fp = fopen(filename, "rb")) == NULL);
+    dbg_err_if(fread(data, sizeof(int), UT_NFILE, fp) != UT_NFILE);
+    fclose(fp);
+    fp = NULL;
+    for (m = 0; m < UT_NFILE; m++) dbg_err_if(data[m] != n*m);
+  }
+
+  /* Reads ahead: collected in any order, and only once. A read
+   * queued after a write sees the new contents. */
+
+  for (n = 0; n < UT_NFILE; n += 2) {
+    sprintf(filename, "logs/ut_writer-%d-%d", rank, n);
+    dbg_err_if(ffs_writer_read(writer, filename));
+  }
+
+  for (n = UT_NFILE - 2; n >= 0; n -= 2) {
+    sprintf(filename, "logs/ut_writer-%d-%d", rank, n);
+    dbg_err_if(ffs_writer_collect(writer, filename, &vbuf, &nbytes));
+    dbg_err_if(nbytes != UT_NFILE*sizeof(int));
+    buf = vbuf;
+    for (m = 0; m < UT_NFILE; m++) dbg_err_if(buf[m] != n*m);
+    u_free(buf);
+    buf = NULL;
+    dbg_err_if(ffs_writer_collect(writer, filename, &vbuf, &nbytes) == 0);
+  }
+
+  buf = u_calloc(UT_NFILE, sizeof(int));
+  dbg_err_if(buf == NULL);
+  sprintf(filename, "logs/ut_writer-%d-%d", rank, 1);
+  dbg_err_if(ffs_writer_write(writer, filename, buf, UT_NFILE*sizeof(int)));
+  buf = NULL;
+  dbg_err_if(ffs_writer_read(writer, filename));
+  dbg_err_if(ffs_writer_collect(writer, filename, &vbuf, &nbytes));
+  buf = vbuf;
+  for (m = 0; m < UT_NFILE; m++) dbg_err_if(buf[m] != 0);
+  u_free(buf);
+  buf = NULL;
+
+  /* A failed read is reported by the collection; one never
+   * collected is released with the writer */
+
+  dbg_err_if(ffs_writer_read(writer, "logs/no/such/file"));
+  dbg_err_if(ffs_writer_collect(writer, "logs/no/such/file", &vbuf, &nbytes)
+	     == 0);
+  dbg_err_if(ffs_writer_read(writer, filename));
+
+  /* Removal happens in order after any write */
+
+  for (n = 0; n < UT_NFILE; n++) {
+    sprintf(filename, "logs/ut_writer-%d-%d", rank, n);
+    dbg_err_if(ffs_writer_remove(writer, filename));
+  }
+
+  dbg_err_if(ffs_writer_flush(writer));
+
+  for (n = 0; n < UT_NFILE; n++) {
+    sprintf(filename, "logs/ut_writer-%d-%d", rank, n);
+    dbg_err_if((fp = fopen(filename, "rb")) != NULL);
+  }
+
+  /* A failed write is reported at the next flush, and only then */
+
+  buf = u_calloc(1, sizeof(int));
+  dbg_err_if(buf == NULL);
+  dbg_err_if(ffs_writer_write(writer, "logs/no/such/dir", buf, sizeof(int)));
+  dbg_err_if(ffs_writer_flush(writer) == 0);
+  dbg_err_if(ffs_writer_flush(writer));
+
+  ffs_writer_free(writer);
+
+  u_dbg("Success\n");
+  return U_TEST_SUCCESS;
+
+ err:
+
+  if (fp) fclose(fp);
+  if (writer) ffs_writer_free(writer);
+
+  u_dbg("Failure\n");
+  return U_TEST_FAILURE;
+}
@@ -0,0 +1,24 @@
+/*****************************************************************************
+ *
+ *  ut_ffs_writer.h
+ *
+ *****************************************************************************/
+
+#ifndef UT_FFS_WRITER_H
+#define UT_FFS_WRITER_H
+
+/**
+ *  \ingroup unit
+ * \{
+ *
+ */
+
+#define UT_FFS_WRITER_NAME "Write-behind queue tests"
+
+int ut_ffs_writer(u_test_case_t * tc);
+
+/**
+ * \}
+ */
+
+#endif
@@ -12,6 +12,8 @@
 #include "u/libu.h"
 #include "ut_ranlcg.h"
 #include "ut_util.h"
+#include "ut_ffs_writer.h"
+#include "ut_ffs_ensemble.h"
 
 /*****************************************************************************
  *
@@ -32,5 +34,10 @@ int u_test_suite_util_register (u_test_t * t) {
   u_test_case_register(UT_UTIL_CONFIG_NAME, ut_util_config, ts);
   u_test_case_depends_on(UT_UTIL_CONFIG_NAME, UT_UTIL_MISC_NAME, ts);
 
+  u_test_case_register(UT_FFS_WRITER_NAME, ut_ffs_writer, ts);
+  u_test_case_register(UT_FFS_ENSEMBLE_NAME, ut_ffs_ensemble, ts);
+  u_test_case_register(UT_FFS_ENSEMBLE_COMPACT_NAME, ut_ffs_ensemble_compact,
+		       ts);
+
   return u_test_suite_add(ts, t);
 }
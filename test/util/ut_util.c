@@ -7,6 +7,7 @@
  *****************************************************************************/
 
 #include <float.h>
+#include <string.h>
 
 #include "u/libu.h"
 #include "ffs_util.h"
@@ -19,6 +20,12 @@
 
 int ut_util_misc(u_test_case_t * tc) {
 
+  int group;
+  long long int id;
+  ffs_handle_t handle;
+  char stub[FILENAME_MAX];
+  char stub2[FILENAME_MAX];
+
   u_dbg("Start");
   dbg_err_if(util_compare_double(1.234, 1.234, DBL_EPSILON) != 0);
   dbg_err_if(util_compare_double(1.234, 1.235, DBL_EPSILON) == 0);
@@ -27,7 +34,28 @@ int ut_util_misc(u_test_case_t * tc) {
   dbg_err_if(util_compare_double(DBL_EPSILON, 0.0, DBL_EPSILON) == 0);
   dbg_err_if(util_compare_double(DBL_EPSILON, 0.0, 2*DBL_EPSILON) != 0);
 
-  dbg_err_if(util_filename_stub(1, 1, 1) == NULL);
+  dbg_err_if(util_filename_stub(1, 1, 1, stub));
+  dbg_err_if(strcmp(stub, "inst0001-grp0001-state000000001") != 0);
+  dbg_err_if(util_filename_stub(1, -1, 1, stub) == 0);
+
+  /* Handles round trip, and give the same stub beyond the old limits */
+
+  dbg_err_if(util_handle(2, 3, &handle));
+  dbg_err_if(util_handle_ids(handle, &group, &id));
+  dbg_err_if(group != 2 || id != 3);
+  dbg_err_if(util_handle_stub(1, handle, stub));
+  dbg_err_if(strcmp(stub, "inst0001-grp0002-state000000003") != 0);
+  dbg_err_if(util_filename_stub(1, 2, 3, stub2));
+  dbg_err_if(strcmp(stub, stub2) != 0);
+
+  dbg_err_if(util_handle(FFS_HANDLE_GROUP_MAX, FFS_HANDLE_ID_MAX, &handle));
+  dbg_err_if(util_handle_ids(handle, &group, &id));
+  dbg_err_if(group != FFS_HANDLE_GROUP_MAX || id != FFS_HANDLE_ID_MAX);
+  dbg_err_if(util_handle_stub(10000, handle, stub));
+  dbg_err_if(strcmp(stub, "inst10000-grp65535-state140737488355327") != 0);
+
+  dbg_err_if(util_handle(-1, 0, &handle) == 0);
+  dbg_err_if(util_handle(0, FFS_HANDLE_ID_MAX + 1, &handle) == 0);
 
   u_dbg("Success\n");
   return U_TEST_SUCCESS;
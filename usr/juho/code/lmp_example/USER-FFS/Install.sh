@@ -0,0 +1,13 @@
+# Install/unInstall package files in LAMMPS
+
+if (test $1 = 1) then
+
+   cp -p fix_ffs.cpp ..
+   cp -p fix_ffs.h ..
+
+elif (test $1 = 0) then
+
+   rm -f ../fix_ffs.cpp
+   rm -f ../fix_ffs.h
+
+fi
@@ -0,0 +1,277 @@
+/* ----------------------------------------------------------------------
+   fix ID group ffs c_ID|c_ID[I]|v_name [langevin Tstart Tstop damp seed]
+
+   After "fix_modify ID ffs_bounds lmin lmax N", the order parameter
+   is evaluated every N steps of the next run (counted from its first
+   step), and the run is halted at the first evaluation outside
+   [lmin, lmax). This allows a forward flux sampling trial to be run
+   by one "run" command. The optional langevin thermostat is that of
+   fix langevin (without keywords), and may be reseeded in place by
+   "fix_modify ID seed N".
+
+   Requires timer->force_timeout() (as used by fix halt).
+   ------------------------------------------------------------------------- */
+
+#include "math.h"
+#include "stdlib.h"
+#include "string.h"
+#include "fix_ffs.h"
+#include "atom.h"
+#include "update.h"
+#include "modify.h"
+#include "compute.h"
+#include "input.h"
+#include "variable.h"
+#include "force.h"
+#include "comm.h"
+#include "timer.h"
+#include "random_mars.h"
+#include "error.h"
+
+using namespace LAMMPS_NS;
+using namespace FixConst;
+
+enum{COMPUTE,VARIABLE};
+
+#define INVOKED_SCALAR 1
+#define INVOKED_VECTOR 2
+
+/* ---------------------------------------------------------------------- */
+
+FixFFS::FixFFS(LAMMPS *lmp, int narg, char **arg) :
+  Fix(lmp, narg, arg)
+{
+  if (narg != 4 && narg != 9) error->all(FLERR,"Illegal fix ffs command");
+
+  scalar_flag = 1;
+  global_freq = 1;
+  extscalar = 0;
+
+  // order parameter, as named in thermo output
+
+  if (strncmp(arg[3],"c_",2) == 0) style = COMPUTE;
+  else if (strncmp(arg[3],"v_",2) == 0) style = VARIABLE;
+  else error->all(FLERR,"Illegal fix ffs command");
+
+  int n = strlen(&arg[3][2]) + 1;
+  id_lambda = new char[n];
+  strcpy(id_lambda,&arg[3][2]);
+
+  index = 0;
+  char *ptr = strchr(id_lambda,'[');
+  if (ptr) {
+    if (style != COMPUTE || id_lambda[strlen(id_lambda)-1] != ']')
+      error->all(FLERR,"Illegal fix ffs command");
+    index = atoi(ptr+1);
+    *ptr = '\0';
+    if (index < 1) error->all(FLERR,"Illegal fix ffs command");
+  }
+
+  ilambda = -1;
+  lambda = 0.0;
+  armed = 0;
+  lambda_min = lambda_max = 0.0;
+  nevery = 1;
+
+  // optional langevin thermostat
+
+  thermostat = 0;
+  random = NULL;
+
+  if (narg == 9) {
+    if (strcmp(arg[4],"langevin") != 0)
+      error->all(FLERR,"Illegal fix ffs command");
+    thermostat = 1;
+    t_start = force->numeric(FLERR,arg[5]);
+    t_stop = force->numeric(FLERR,arg[6]);
+    t_period = force->numeric(FLERR,arg[7]);
+    if (t_period <= 0.0) error->all(FLERR,"Fix ffs period must be > 0.0");
+    reseed(force->inumeric(FLERR,arg[8]));
+  }
+}
+
+/* ---------------------------------------------------------------------- */
+
+FixFFS::~FixFFS()
+{
+  delete [] id_lambda;
+  delete random;
+}
+
+/* ---------------------------------------------------------------------- */
+
+int FixFFS::setmask()
+{
+  int mask = 0;
+  mask |= END_OF_STEP;
+  mask |= POST_RUN;
+  if (thermostat) mask |= POST_FORCE;
+  return mask;
+}
+
+/* ---------------------------------------------------------------------- */
+
+void FixFFS::init()
+{
+  if (style == COMPUTE) {
+    ilambda = modify->find_compute(id_lambda);
+    if (ilambda < 0)
+      error->all(FLERR,"Compute ID for fix ffs does not exist");
+    Compute *compute = modify->compute[ilambda];
+    if (index == 0 && compute->scalar_flag == 0)
+      error->all(FLERR,"Fix ffs compute does not calculate a scalar");
+    if (index > 0 && compute->vector_flag == 0)
+      error->all(FLERR,"Fix ffs compute does not calculate a vector");
+    if (index > 0 && index > compute->size_vector)
+      error->all(FLERR,"Fix ffs compute vector is accessed out-of-range");
+  } else {
+    ilambda = input->variable->find(id_lambda);
+    if (ilambda < 0)
+      error->all(FLERR,"Variable name for fix ffs does not exist");
+    if (input->variable->equalstyle(ilambda) == 0)
+      error->all(FLERR,"Fix ffs variable is not equal-style variable");
+  }
+}
+
+/* ---------------------------------------------------------------------- */
+
+void FixFFS::setup(int vflag)
+{
+  if (thermostat) post_force(vflag);
+  if (armed) modify->addstep_compute(update->ntimestep + nevery);
+}
+
+/* ----------------------------------------------------------------------
+   as fix langevin with no keywords
+------------------------------------------------------------------------- */
+
+void FixFFS::post_force(int vflag)
+{
+  double **v = atom->v;
+  double **f = atom->f;
+  double *rmass = atom->rmass;
+  double *mass = atom->mass;
+  int *type = atom->type;
+  int *mask = atom->mask;
+  int nlocal = atom->nlocal;
+
+  double delta = update->ntimestep - update->beginstep;
+  if (delta != 0.0) delta /= update->endstep - update->beginstep;
+  double t_target = t_start + delta * (t_stop-t_start);
+  double tsqrt = sqrt(t_target);
+
+  double boltz = force->boltz;
+  double dt = update->dt;
+  double mvv2e = force->mvv2e;
+  double ftm2v = force->ftm2v;
+
+  double m,gamma1,gamma2;
+
+  for (int i = 0; i < nlocal; i++) {
+    if (!(mask[i] & groupbit)) continue;
+    m = rmass ? rmass[i] : mass[type[i]];
+    gamma1 = -m / t_period / ftm2v;
+    gamma2 = sqrt(m) * sqrt(24.0*boltz/t_period/dt/mvv2e) / ftm2v;
+    gamma2 *= tsqrt;
+    f[i][0] += gamma1*v[i][0] + gamma2*(random->uniform()-0.5);
+    f[i][1] += gamma1*v[i][1] + gamma2*(random->uniform()-0.5);
+    f[i][2] += gamma1*v[i][2] + gamma2*(random->uniform()-0.5);
+  }
+}
+
+/* ---------------------------------------------------------------------- */
+
+void FixFFS::end_of_step()
+{
+  if (!armed) return;
+  if ((update->ntimestep - update->beginstep) % nevery) return;
+
+  lambda = evaluate();
+  if (lambda < lambda_min || lambda >= lambda_max) timer->force_timeout();
+}
+
+/* ----------------------------------------------------------------------
+   bounds apply to one run only; allow subsequent runs
+------------------------------------------------------------------------- */
+
+void FixFFS::post_run()
+{
+  if (armed) timer->reset_timeout();
+  armed = 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+int FixFFS::modify_param(int narg, char **arg)
+{
+  if (strcmp(arg[0],"ffs_bounds") == 0) {
+    if (narg < 4) error->all(FLERR,"Illegal fix_modify command");
+    lambda_min = force->numeric(FLERR,arg[1]);
+    lambda_max = force->numeric(FLERR,arg[2]);
+    nevery = force->inumeric(FLERR,arg[3]);
+    if (nevery <= 0) error->all(FLERR,"Illegal fix_modify command");
+    armed = 1;
+    return 4;
+  }
+
+  if (strcmp(arg[0],"seed") == 0) {
+    if (narg < 2) error->all(FLERR,"Illegal fix_modify command");
+    if (!thermostat) error->all(FLERR,"Fix ffs has no thermostat to reseed");
+    reseed(force->inumeric(FLERR,arg[1]));
+    return 2;
+  }
+
+  return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+double FixFFS::compute_scalar()
+{
+  return lambda;
+}
+
+/* ----------------------------------------------------------------------
+   evaluate the order parameter (on all procs)
+------------------------------------------------------------------------- */
+
+double FixFFS::evaluate()
+{
+  double value;
+
+  modify->clearstep_compute();
+
+  if (style == COMPUTE) {
+    Compute *compute = modify->compute[ilambda];
+    if (index == 0) {
+      if (!(compute->invoked_flag & INVOKED_SCALAR)) {
+        compute->compute_scalar();
+        compute->invoked_flag |= INVOKED_SCALAR;
+      }
+      value = compute->scalar;
+    } else {
+      if (!(compute->invoked_flag & INVOKED_VECTOR)) {
+        compute->compute_vector();
+        compute->invoked_flag |= INVOKED_VECTOR;
+      }
+      value = compute->vector[index-1];
+    }
+  } else {
+    value = input->variable->compute_equal(ilambda);
+  }
+
+  modify->addstep_compute(update->ntimestep + nevery);
+
+  return value;
+}
+
+/* ----------------------------------------------------------------------
+   a new generator, each proc with a different seed (as fix langevin)
+------------------------------------------------------------------------- */
+
+void FixFFS::reseed(int seed)
+{
+  if (seed <= 0) error->all(FLERR,"Illegal fix ffs seed");
+  delete random;
+  random = new RanMars(lmp,seed + comm->me);
+}
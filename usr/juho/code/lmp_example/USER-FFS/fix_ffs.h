@@ -0,0 +1,53 @@
+/* ----------------------------------------------------------------------
+   fix ffs: halt a run when an order parameter leaves [lmin, lmax)
+   ------------------------------------------------------------------------- */
+
+#ifdef FIX_CLASS
+
+FixStyle(ffs,FixFFS)
+
+#else
+
+#ifndef LMP_FIX_FFS_H
+#define LMP_FIX_FFS_H
+
+#include "fix.h"
+
+namespace LAMMPS_NS {
+
+class FixFFS : public Fix {
+ public:
+  FixFFS(class LAMMPS *, int, char **);
+  virtual ~FixFFS();
+  int setmask();
+  void init();
+  void setup(int);
+  void post_force(int);
+  void end_of_step();
+  void post_run();
+  int modify_param(int, char **);
+  double compute_scalar();
+
+ protected:
+  int style;                  // COMPUTE or VARIABLE
+  char *id_lambda;            // compute ID or variable name
+  int index;                  // element of a vector compute (0 for scalar)
+  int ilambda;                // index of the compute or variable
+  double lambda;              // last value of the order parameter
+
+  int armed;                  // halt the current run (set by ffs_bounds)
+  double lambda_min,lambda_max;
+  int nevery;                 // time steps between evaluations
+
+  int thermostat;             // langevin thermostat is present
+  double t_start,t_stop,t_period;
+  class RanMars *random;
+
+  double evaluate();
+  void reseed(int);
+};
+
+}
+
+#endif
+#endif